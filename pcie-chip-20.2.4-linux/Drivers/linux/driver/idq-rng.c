@@ -29,12 +29,19 @@
 #include "idq-rng.h"
 #include "quantis_ioctl.h"
 
+/*
+ * Q400RegInit() - Reset the FPGA and start the sensors in the given mode
+ *
+ * Takes about half a second, all of it sleeping: only to be called from
+ * process context, probe() leaves it to card_init_work().
+ */
 int Q400RegInit(struct xilinx_fpga_regs __iomem *regs, uint qrng_mode,
 		uint qrng_num)
 {
-	u32 user_data, ud2, u32data;
+	u32 user_data, u32data;
 	char serial[256];
-	mdelay(10);
+	int rc;
+	msleep(10);
 
 	// reset FPGA
 	iowrite32(FPGA_SOFT_RST_DEACTIVE, &regs->sw_rst);
@@ -60,44 +67,17 @@ int Q400RegInit(struct xilinx_fpga_regs __iomem *regs, uint qrng_mode,
 	else
 		iowrite32(FPGA_Q400_NUM_AUTO, &regs->q400_num);
 
-	if (qrng_mode == QUANTIS_QRNG_MODE_SAMPLE) {
-		// Do not use post-processing feature of the chip
-		pr_info(DRV_NAME ": SAMPLE MODE (qrng_mode:%d)\n", qrng_mode);
-		u32data = REG_CLEAR;
-		u32data |= (FPGA_REMOVE_TAIL_16BIT | FPGA_REMOVE_PKT_TAIL);
-		iowrite32(u32data, &regs->testmode_hwreject);
-		iowrite32(FPGA_SAMPLE_MODE, &regs->mode_sel);
-		msleep(100);
-
-		user_data = ioread32(&regs->testmode_hwreject);
-		ud2 = ioread32(&regs->mode_sel);
-		if (user_data != u32data || ud2 != FPGA_SAMPLE_MODE) {
-			pr_err(DRV_NAME ": ERROR, sample mode setting ! (REG_0x14:0x%x, REG_0x5A8:0x%x) \n",
-			       user_data, ud2);
-		}
-
-	} else { // HRNG: Hardware RNG
-		// Use post-processing feature of the chip
-
-		pr_info(DRV_NAME ": RNG MODE (qrng_mode:%d)\n", qrng_mode);
-		u32data = REG_CLEAR;
-		u32data |= (FPGA_REMOVE_HEAD_16BIT | FPGA_REMOVE_PKT_TAIL);
-		iowrite32(u32data, &regs->testmode_hwreject);
-		iowrite32(FPGA_RNG_MDOE, &regs->mode_sel);
-		msleep(100);
-
-		user_data = ioread32(&regs->testmode_hwreject);
-		ud2 = ioread32(&regs->mode_sel);
-		if (user_data != u32data || ud2 != FPGA_RNG_MDOE) {
-			pr_err(DRV_NAME ": ERROR, rng mode setting !  (REG_0x14:0x%x,REG_0x5A8:0x%x)\n",
-			       user_data, ud2);
-		}
-	}
+	pr_info(DRV_NAME ": %s MODE (qrng_mode:%d)\n",
+		qrng_mode == QUANTIS_QRNG_MODE_SAMPLE ? "SAMPLE" : "RNG",
+		qrng_mode);
+	Q400SetMode(regs, qrng_mode);
+	msleep(100);
+	rc = Q400CheckMode(regs, qrng_mode);
 
 	u32data = 0x0;
 	u32data |= FPGA_SPI_STATUS_RESET;
 	iowrite32(u32data, &regs->spi_module_ctrl);
-	mdelay(300);
+	msleep(300);
 
 	u32data = REG_CLEAR;
 	u32data |= (FPGA_SPI_ENABLE | 0x1);
@@ -111,7 +91,61 @@ int Q400RegInit(struct xilinx_fpga_regs __iomem *regs, uint qrng_mode,
 	pr_debug(DRV_NAME ": mode : %s (0x05A8:0x%x)\n",
 	       (user_data == FPGA_RNG_MDOE) ? "RNG" : "SAMPLE", user_data);
 
-	return 1;
+	return rc < 0 ? rc : 1;
+}
+
+/* Q400ModeRegs() - values of testmode_hwreject and mode_sel for a mode */
+static void Q400ModeRegs(uint qrng_mode, u32 *hwreject, u32 *mode)
+{
+	*hwreject = REG_CLEAR;
+	if (qrng_mode == QUANTIS_QRNG_MODE_SAMPLE) {
+		// Do not use post-processing feature of the chip
+		*hwreject |= (FPGA_REMOVE_TAIL_16BIT | FPGA_REMOVE_PKT_TAIL);
+		*mode = FPGA_SAMPLE_MODE;
+	} else { // HRNG: Hardware RNG
+		// Use post-processing feature of the chip
+		*hwreject |= (FPGA_REMOVE_HEAD_16BIT | FPGA_REMOVE_PKT_TAIL);
+		*mode = FPGA_RNG_MDOE;
+	}
+}
+
+/*
+ * Q400SetMode() - Select the post-processing of the FPGA
+ *
+ * SAMPLE hands out the raw samples of the sensors, RNG their post-processed
+ * output. Only testmode_hwreject and mode_sel are written, the sensors keep
+ * running, and nothing waits: callable with a spinlock held. The registers
+ * are only checked once the mode settled, with Q400CheckMode().
+ */
+void Q400SetMode(struct xilinx_fpga_regs __iomem *regs, uint qrng_mode)
+{
+	u32 u32data, mode;
+
+	Q400ModeRegs(qrng_mode, &u32data, &mode);
+	iowrite32(u32data, &regs->testmode_hwreject);
+	iowrite32(mode, &regs->mode_sel);
+}
+
+/*
+ * Q400CheckMode() - Check that the FPGA took the mode of Q400SetMode()
+ *
+ * Returns 0, or -EIO if the registers do not hold the values.
+ */
+int Q400CheckMode(struct xilinx_fpga_regs __iomem *regs, uint qrng_mode)
+{
+	u32 user_data, ud2, u32data, mode;
+
+	Q400ModeRegs(qrng_mode, &u32data, &mode);
+	user_data = ioread32(&regs->testmode_hwreject);
+	ud2 = ioread32(&regs->mode_sel);
+	if (user_data != u32data || ud2 != mode) {
+		pr_err(DRV_NAME ": ERROR, %s mode setting ! (REG_0x14:0x%x, REG_0x5A8:0x%x)\n",
+		       mode == FPGA_SAMPLE_MODE ? "sample" : "rng", user_data,
+		       ud2);
+		return -EIO;
+	}
+
+	return 0;
 }
 
 int Q400RegExit(struct xilinx_fpga_regs __iomem *regs)
@@ -121,20 +155,20 @@ int Q400RegExit(struct xilinx_fpga_regs __iomem *regs)
 	iowrite32(0xA1, &regs->spi_module_ctrl);
 	user_data = ioread32(&regs->spi_module_ctrl);
 	pr_debug(DRV_NAME ": xdma_user 0x08: 0x%x (expected:0xA1)\n", user_data);
-	mdelay(1000);
+	msleep(1000);
 
 	u32data = REG_CLEAR;
 	u32data |= FPGA_SPI_STATUS_RESET;
 	iowrite32(u32data, &regs->spi_module_ctrl);
 	user_data = ioread32(&regs->spi_module_ctrl);
 	pr_debug(DRV_NAME ": xdma_user 0x08: 0x%x (expected:0x40)\n", user_data);
-	mdelay(1);
+	usleep_range(1000, 2000);
 
 	u32data = REG_CLEAR;
 	iowrite32(u32data, &regs->spi_module_ctrl);
 	user_data = ioread32(&regs->spi_module_ctrl);
 	pr_debug(DRV_NAME ": xdma_user 0x08: 0x%x (expected:0x00)\n", user_data);
-	mdelay(100);
+	msleep(100);
 
 	return 1;
 }
@@ -199,6 +233,32 @@ unsigned int Q400RegGetStatus(struct xilinx_fpga_regs __iomem *regs)
 	return status_result;
 }
 
+/*
+ * Q400CheckStatus() - Check the sensors without waiting for them
+ *
+ * Meant for the read path: a single register read and no busy-wait. While
+ * the sensors are not ready the status is unknown and reported as fine, the
+ * read then simply waits for data.
+ *
+ * Returns 0 if at least one sensor delivers valid data, -EIO otherwise.
+ */
+int Q400CheckStatus(struct xilinx_fpga_regs __iomem *regs)
+{
+	u32 status_result;
+	u32 modules_error;
+
+	status_result = ioread32(&regs->reg_init_status_chk);
+	if (!(status_result & Q400_SENSOR_READY))
+		return 0;
+
+	modules_error = (status_result & Q400_SENSOR_PKT_ERR) >>
+			Q400_SENSOR_PKT_ERR_SHIFT;
+	if ((status_result & Q400_SENSOR_BEING & ~modules_error) == 0)
+		return -EIO;
+
+	return 0;
+}
+
 unsigned int QrngPciGetBoardVersion(struct xilinx_fpga_regs __iomem *regs)
 {
 	unsigned int recvverinfo;
@@ -15,15 +15,20 @@
 #include <linux/types.h>
 #include <linux/delay.h>
 #include <linux/time.h>
+#include <linux/random.h>
 /* include early, to verify it depends only on the headers above */
 #include "xdma-core.h"
 #include "xdma-sgm.h"
 #include "xbar_sys_parameters.h"
+#include "perfmon_parameters.h"
 #include "version.h"
 
 #include "idq-rng.h"
 #include "quantis_ioctl.h"
 
+#define CREATE_TRACE_POINTS
+#include "xdma-trace.h"
+
 #define U_MAX_RD_SIZE (4096) //user area max size to read
 
 /* SECTION: Module licensing */
@@ -50,6 +55,18 @@ MODULE_PARM_DESC(
 	enable_credit_mp,
 	"Set 1 to enable creidt feature, default is 0 (no credit control)");
 
+static unsigned int credit_policy = CREDIT_POLICY_FILL;
+module_param(credit_policy, uint, S_IRUGO);
+MODULE_PARM_DESC(
+	credit_policy,
+	"Set 1 to keep the RX ring filled up to credit_fill as blocks complete, 0 to give credits back only as blocks are read (low power), default is 1");
+
+static unsigned int credit_fill = 75;
+module_param(credit_fill, uint, S_IRUGO);
+MODULE_PARM_DESC(
+	credit_fill,
+	"percent of the RX ring kept filled ahead of the readers with credit_policy=1, 1 to 100, default is 75");
+
 static unsigned int default_qrng_mode;
 module_param(default_qrng_mode, uint, 0644);
 MODULE_PARM_DESC(
@@ -79,6 +96,77 @@ MODULE_PARM_DESC(
 	garbage_to_read_rng,
 	"the number of bytes read after device initialization mode RNG to make sure there is no garbage left in the fifo, use 0 to disable this feature");
 
+static unsigned int garbage_to_switch = 65536;
+module_param(garbage_to_switch, uint, S_IRUGO);
+MODULE_PARM_DESC(
+	garbage_to_switch,
+	"the number of bytes read after a mode switch, besides the bytes the ring holds and the block being written, to make sure there is no byte of the previous mode left in the fifo");
+
+static unsigned int soft_source;
+module_param(soft_source, uint, S_IRUGO);
+MODULE_PARM_DESC(
+	soft_source,
+	"number of /dev files fed by a software data source instead of a card, to test applications without hardware");
+
+static unsigned int soft_source_rate;
+module_param(soft_source_rate, uint, 0644);
+MODULE_PARM_DESC(soft_source_rate,
+		 "rate of each software data source in KiB/s, 0 for unlimited");
+
+static unsigned int status_interval = 1000;
+module_param(status_interval, uint, 0644);
+MODULE_PARM_DESC(
+	status_interval,
+	"milliseconds between two reads of the modules status by the driver, default is 1000");
+
+static int ring_idle_timeout = 10000;
+module_param(ring_idle_timeout, int, 0644);
+MODULE_PARM_DESC(
+	ring_idle_timeout,
+	"milliseconds the RX ring keeps running after the last close, 0 to stop it at once, -1 to never stop it");
+
+static unsigned int rx_block_size = RX_BUF_BLOCK;
+module_param(rx_block_size, uint, S_IRUGO);
+MODULE_PARM_DESC(
+	rx_block_size,
+	"bytes per block of the RX ring, each filled through one DMA descriptor, a power of two from 4096 to 131072, default is 4096");
+
+static unsigned int rx_block_count = RX_BUF_PAGES;
+module_param(rx_block_count, uint, S_IRUGO);
+MODULE_PARM_DESC(
+	rx_block_count,
+	"number of blocks of the RX ring, a power of two from 8 to 2048, default is 256");
+
+static unsigned int rx_ring_contiguous = 1;
+module_param(rx_ring_contiguous, uint, 0644);
+MODULE_PARM_DESC(
+	rx_ring_contiguous,
+	"Set 1 to allocate the RX ring in physically contiguous chunks of up to 2 MiB when memory allows, 0 for chunks of one block");
+
+static unsigned int irq_poll_interval;
+module_param(irq_poll_interval, uint, 0644);
+MODULE_PARM_DESC(
+	irq_poll_interval,
+	"microseconds between two polls of the RX ring while blocks keep arriving, the interrupts being off, 0 to service each interrupt, default is 0");
+
+static unsigned int irq_poll_idle = 2;
+module_param(irq_poll_idle, uint, 0644);
+MODULE_PARM_DESC(
+	irq_poll_idle,
+	"polls in a row finding no new block before the interrupts of the RX ring are enabled again, default is 2");
+
+static unsigned int hwrng_quality = 1000;
+module_param(hwrng_quality, uint, S_IRUGO);
+MODULE_PARM_DESC(
+	hwrng_quality,
+	"entropy in bits per 1024 bits read from /dev/hwrng, up to 1024, 0 to not register the cards with hw_random");
+
+static unsigned int perfmon_offset;
+module_param(perfmon_offset, uint, S_IRUGO);
+MODULE_PARM_DESC(
+	perfmon_offset,
+	"offset in the user BAR of an AXI performance monitor to report in the link statistics, e.g. 0x100000, 0 for none, default is 0");
+
 /* SECTION: Module global variables */
 
 static struct class *g_xdma_class; /* sys filesystem */
@@ -141,6 +229,11 @@ static void engine_service_perf(struct xdma_engine *engine, u32 desc_completed);
 static void engine_service_resume(struct xdma_engine *engine);
 static int engine_service(struct xdma_engine *engine, int desc_writeback);
 static void engine_service_work(struct work_struct *work);
+static void engine_interrupts_resume(struct xdma_engine *engine);
+static void engine_service_rates(struct xdma_engine *engine);
+static bool engine_service_poll_next(struct xdma_engine *engine, bool found);
+static enum hrtimer_restart engine_poll_timer(struct hrtimer *timer);
+static int engine_service_cpu(struct xdma_engine *engine);
 static int engine_service_poll(struct xdma_engine *engine,
 			       u32 expected_desc_count);
 static void user_irq_service(struct xdma_irq *user_irq);
@@ -153,6 +246,7 @@ static int is_config_bar(struct xdma_dev *lro, int idx);
 static void identify_bars(struct xdma_dev *lro, int *bar_id_list, int num_bars,
 			  int config_bar_pos);
 static int map_bars(struct xdma_dev *lro, struct pci_dev *dev);
+static void perfmon_map(struct xdma_dev *lro, struct pci_dev *dev);
 static void dump_desc(struct xdma_desc *desc_virt);
 static void transfer_dump(struct xdma_transfer *transfer);
 static struct xdma_desc *xdma_desc_alloc(struct pci_dev *dev, int number,
@@ -212,13 +306,30 @@ static ssize_t char_sgdma_read_write(struct file *file, char __user *buf,
 				     size_t count, loff_t *pos, int dir_to_dev);
 static int transfer_monitor_cyclic(struct xdma_engine *engine,
 				   struct xdma_transfer *transfer);
-static int copy_cyclic_to_user(struct xdma_dev *lro, struct xdma_engine *engine,
-			       size_t pkt_length, int head, char __user *buf,
-			       size_t size);
-static int complete_cyclic(struct xdma_dev *lro, struct xdma_engine *engine,
-			   char __user *buf, size_t size);
-static ssize_t char_sgdma_read_cyclic(struct file *file, char __user *buf,
-				      size_t size);
+static void ring_wait_account(struct xdma_engine *engine, s64 us);
+static int cyclic_received(struct xdma_engine *engine);
+static void cyclic_claim(struct xdma_engine *engine, size_t size,
+			 struct xdma_cyclic_claim *claim);
+static void cyclic_free_blocks(struct xdma_engine *engine);
+static void cyclic_unclaim(struct xdma_engine *engine,
+			   const struct xdma_cyclic_claim *claim);
+static int copy_cyclic_span(void *buf, size_t offset, const char *src,
+			    size_t size, enum cyclic_dest dest);
+static int copy_cyclic(struct xdma_engine *engine,
+		       const struct xdma_cyclic_claim *claim, void *buf,
+		       enum cyclic_dest dest);
+static int complete_cyclic(struct xdma_engine *engine, void *buf, size_t size,
+			   enum cyclic_dest dest);
+static bool cyclic_data_ready(struct xdma_engine *engine);
+static void cyclic_flush_garbage(struct xdma_engine *engine);
+static void status_monitor_work(struct work_struct *work);
+static void card_init_work(struct work_struct *work);
+static int modules_status_get(struct xdma_dev *lro, u32 *status, u32 *age);
+static u64 ring_stat_sum(struct xdma_engine *engine, size_t offset);
+static ssize_t char_sgdma_read_cyclic(struct file *file, void *buf,
+				      size_t size, enum cyclic_dest dest,
+				      bool nonblock);
+static unsigned int char_sgdma_poll(struct file *file, poll_table *wait);
 static long char_sgdma_ioctl(struct file *file, unsigned int cmd,
 			     unsigned long arg);
 static ssize_t char_sgdma_write(struct file *file, const char __user *buf,
@@ -227,12 +338,41 @@ static ssize_t char_sgdma_read(struct file *file, char __user *buf,
 			       size_t count, loff_t *pos);
 static ssize_t char_xdma_read(struct file *file, char __user *buf, size_t count,
 			      loff_t *pos);
+static ssize_t char_sgdma_read_iter(struct kiocb *iocb, struct iov_iter *to);
 static int cyclic_transfer_setup(struct xdma_engine *engine);
 static int char_sgdma_open(struct inode *inode, struct file *file);
 static int cyclic_shutdown_polled(struct xdma_engine *engine);
 static int cyclic_shutdown_interrupt(struct xdma_engine *engine);
 static int cyclic_transfer_teardown(struct xdma_engine *engine);
 static int char_sgdma_close(struct inode *inode, struct file *file);
+static int ring_get(struct xdma_char *lro_char);
+static int ring_put(struct xdma_char *lro_char);
+static int ring_teardown(struct xdma_char *lro_char);
+static void ring_idle_work(struct work_struct *work);
+static int card_hwrng_register(struct xdma_dev *lro);
+static void card_hwrng_unregister(struct xdma_dev *lro);
+static unsigned int garbage_to_read(struct xdma_dev *lro);
+static void garbage_flushed(struct xdma_engine *engine);
+static void engine_return_credits(struct xdma_engine *engine, int num_credit);
+static int ring_fill_blocks(struct xdma_engine *engine);
+static int ring_initial_credits(struct xdma_engine *engine);
+static void ring_refill(struct xdma_engine *engine);
+static struct quantis_ring_ctrl *ring_ctrl_alloc(struct xdma_engine *engine);
+static void ring_reset(struct xdma_engine *engine);
+static void ring_chunks_free(struct xdma_engine *engine);
+static int ring_chunks_alloc(struct xdma_engine *engine, int order, gfp_t gfp);
+static int ring_buffer_alloc(struct xdma_engine *engine);
+static void ring_buffer_free(struct xdma_engine *engine, void *buffer);
+static struct xdma_transfer *ring_transfer_create(struct xdma_engine *engine);
+static bool ring_geometry_valid(unsigned int block, unsigned int blocks);
+static void ring_ctrl_free(struct quantis_ring_ctrl *ctrl);
+static void ring_return_credits(struct xdma_engine *engine);
+static void ring_publish(struct xdma_engine *engine);
+static long ring_wait_ioctl(struct file *file, struct xdma_engine *engine,
+			    bool wait);
+static void ring_vm_open(struct vm_area_struct *vma);
+static void ring_vm_close(struct vm_area_struct *vma);
+static int char_sgdma_mmap(struct file *file, struct vm_area_struct *vma);
 static int msi_msix_capable(struct pci_dev *dev, int type);
 static struct xdma_dev *alloc_dev_instance(struct pci_dev *pdev);
 static int probe_scan_for_msi(struct xdma_dev *lro, struct pci_dev *pdev);
@@ -265,11 +405,20 @@ static int create_dev(struct xdma_char *lro_char, enum chardev_type type);
 static struct xdma_char *create_sg_char(struct xdma_dev *lro, int bar,
 					struct xdma_engine *engine,
 					enum chardev_type type);
+static void soft_source_work(struct work_struct *work);
+static int soft_transfer_setup(struct xdma_engine *engine);
+static int soft_transfer_teardown(struct xdma_engine *engine);
+static bool soft_source_ioctl(struct xdma_dev *lro, unsigned int cmd,
+			      unsigned long arg, int *rc);
+static struct xdma_dev *soft_source_create(void);
+static void soft_source_destroy(struct xdma_dev *lro);
 static int __init xdma_init(void);
 static void __exit xdma_exit(void);
 
 #define MAX_XDMA_DEVICES 64
 static char dev_present[MAX_XDMA_DEVICES];
+static struct xdma_dev *soft_devs[MAX_XDMA_DEVICES];
+static struct dentry *xdma_debugfs; /* debugfs directory of the driver */
 
 /* SECTION: Callback tables */
 
@@ -281,9 +430,24 @@ static const struct file_operations sg_fops = {
 	.open = char_sgdma_open,
 	.release = char_sgdma_close,
 	.read = char_sgdma_read,
+	.read_iter = char_sgdma_read_iter,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 9, 0)
+	/* goes through read_iter from 4.9 on */
+	.splice_read = generic_file_splice_read,
+#endif
 	.write = char_sgdma_write,
 	.unlocked_ioctl = char_sgdma_ioctl,
 	.llseek = char_sgdma_llseek,
+	.mmap = char_sgdma_mmap,
+	.poll = char_sgdma_poll,
+};
+
+/*
+ * VMA operations for the RX ring mapped in user space
+ */
+static const struct vm_operations_struct ring_vm_ops = {
+	.open = ring_vm_open,
+	.close = ring_vm_close,
 };
 
 static struct pci_driver pci_driver = {
@@ -798,16 +962,25 @@ static int engine_ring_process(struct xdma_engine *engine)
 
 		/* increment tail pointer */
 
-		engine->rx_tail = (engine->rx_tail + 1) % RX_BUF_PAGES;
+		engine->rx_tail = (engine->rx_tail + 1) % engine->rx_blocks;
+		this_cpu_inc(engine->stats->blocks);
+		if (engine->rx_credits_out > 0)
+			engine->rx_credits_out--;
 
 		/* overrun? */
 		if (engine->rx_tail == engine->rx_head) {
 			dbg_tfr("engine_service_cyclic(): overrun\n");
 			/* flag to user space that overrun has occurred */
 			engine->rx_overrun = 1;
+			this_cpu_inc(engine->stats->overruns);
+			trace_xdma_overrun(engine);
 		}
 	}
 
+	/* the credits the card used up come back here, not in read() */
+	if (engine->rx_tail != start || engine->rx_overrun)
+		ring_refill(engine);
+
 	return eop_count;
 }
 
@@ -839,6 +1012,11 @@ static int engine_service_cyclic_polled(struct xdma_engine *engine)
 		eop_count = engine_ring_process(engine);
 	}
 
+	if (engine->rx_mapped)
+		ring_publish(engine);
+	else
+		cyclic_flush_garbage(engine);
+
 	if (eop_count == 0) {
 		engine_status_read(engine, 1);
 		if ((engine->running) && !(engine->status & XDMA_STAT_BUSY)) {
@@ -863,6 +1041,10 @@ static int engine_service_cyclic_interrupt(struct xdma_engine *engine)
 	engine_status_read(engine, 1);
 
 	eop_count = engine_ring_process(engine);
+	if (engine->rx_mapped)
+		ring_publish(engine);
+	else
+		cyclic_flush_garbage(engine);
 	/*
 	 * wake any reader on EOP, as one or more packets are now in
 	 * the RX buffer
@@ -1222,9 +1404,126 @@ static int engine_service(struct xdma_engine *engine, int desc_writeback)
 }
 
 /* engine_service_work */
+/*
+ * engine_service_cpu() - CPU to queue the work of the engine on
+ *
+ * The CPU taking the interrupt when it is one of service_cpus, else the
+ * first online one of them. WORK_CPU_UNBOUND if service_cpus is empty or
+ * offline, the work then runs where it is queued from, as with
+ * schedule_work().
+ */
+static int engine_service_cpu(struct xdma_engine *engine)
+{
+	unsigned int cpu;
+
+	if (cpumask_empty(engine->service_cpus))
+		return WORK_CPU_UNBOUND;
+
+	cpu = raw_smp_processor_id();
+	if (cpumask_test_cpu(cpu, engine->service_cpus))
+		return cpu;
+
+	cpu = cpumask_any_and(engine->service_cpus, cpu_online_mask);
+	return cpu < nr_cpu_ids ? cpu : WORK_CPU_UNBOUND;
+}
+
+/* engine_interrupts_resume() - re-enable the interrupts of the engine */
+static void engine_interrupts_resume(struct xdma_engine *engine)
+{
+	if (engine->lro->msix_enabled) {
+		iowrite32(engine->interrupt_enable_mask_value,
+			  &engine->regs->interrupt_enable_mask_w1s);
+	} else {
+		channel_interrupts_enable(engine->lro, engine->irq_bitmask);
+	}
+}
+
+/*
+ * engine_service_rates() - interrupts and polls per second
+ *
+ * Computed over windows of at least one second, a window following two idle
+ * seconds or more starts the count again. Must be called with engine->lock
+ * held.
+ */
+static void engine_service_rates(struct xdma_engine *engine)
+{
+	unsigned long elapsed = jiffies - engine->rate_stamp;
+
+	if (elapsed < HZ)
+		return;
+
+	if (elapsed < 2 * HZ) {
+		engine->irq_rate = div_u64(
+			(u64)(engine->irq_events - engine->irq_mark) * HZ,
+			elapsed);
+		engine->poll_rate = div_u64(
+			(u64)(engine->poll_events - engine->poll_mark) * HZ,
+			elapsed);
+	} else {
+		engine->irq_rate = 0;
+		engine->poll_rate = 0;
+	}
+	engine->irq_mark = engine->irq_events;
+	engine->poll_mark = engine->poll_events;
+	engine->rate_stamp = jiffies;
+}
+
+/*
+ * engine_service_poll_next() - keep servicing the C2H ring by polling
+ *
+ * An interrupt finding new blocks leaves the engine interrupts off, the ring
+ * is then polled every poll_interval_us for as long as blocks keep arriving:
+ * a busy ring costs one service per poll instead of one interrupt per block.
+ * Once poll_idle_budget polls in a row found nothing, the interrupts are
+ * enabled again, a block completed meanwhile raising its interrupt then.
+ *
+ * Returns true if the next poll is scheduled. Must be called with
+ * engine->lock held.
+ */
+static bool engine_service_poll_next(struct xdma_engine *engine, bool found)
+{
+	u32 interval = READ_ONCE(engine->poll_interval_us);
+
+	if (engine->polling)
+		engine->poll_events++;
+	else
+		engine->irq_events++;
+	engine_service_rates(engine);
+
+	if (found)
+		engine->poll_idle = 0;
+	else if (engine->polling)
+		engine->poll_idle++;
+
+	if (interval == 0 || !engine->running || (!engine->polling && !found) ||
+	    engine->poll_idle > READ_ONCE(engine->poll_idle_budget)) {
+		engine->polling = 0;
+		engine->poll_idle = 0;
+		return false;
+	}
+
+	engine->polling = 1;
+	hrtimer_start(&engine->poll_timer,
+		      ns_to_ktime((u64)interval * NSEC_PER_USEC),
+		      HRTIMER_MODE_REL);
+	return true;
+}
+
+/* engine_poll_timer() - poll the C2H ring from the engine work */
+static enum hrtimer_restart engine_poll_timer(struct hrtimer *timer)
+{
+	struct xdma_engine *engine =
+		container_of(timer, struct xdma_engine, poll_timer);
+
+	queue_work_on(engine_service_cpu(engine), system_wq, &engine->work);
+	return HRTIMER_NORESTART;
+}
+
 static void engine_service_work(struct work_struct *work)
 {
 	struct xdma_engine *engine;
+	int tail;
+	int overrun;
 
 	engine = container_of(work, struct xdma_engine, work);
 	BUG_ON(engine->magic != MAGIC_ENGINE);
@@ -1236,21 +1535,27 @@ static void engine_service_work(struct work_struct *work)
 	if (engine->rx_transfer_cyclic) {
 		dbg_tfr("engine_service_cyclic() for %s engine %p\n",
 			engine->name, engine);
+		tail = engine->rx_tail;
+		overrun = engine->rx_overrun;
 		engine_service_cyclic(engine);
+		trace_xdma_service(engine, tail, overrun);
+		/* the interrupts stay off while the ring is polled */
+		if (engine_service_poll_next(engine,
+					     engine->rx_tail != tail ||
+					     engine->rx_overrun != overrun)) {
+			spin_unlock(&engine->lock);
+			return;
+		}
 		/* no C2H streaming, default */
 	} else {
 		dbg_tfr("engine_service() for %s engine %p\n", engine->name,
 			engine);
+		engine->polling = 0;
 		engine_service(engine, 0);
 	}
 
 	/* re-enable interrupts for this engine */
-	if (engine->lro->msix_enabled) {
-		iowrite32(engine->interrupt_enable_mask_value,
-			  &engine->regs->interrupt_enable_mask_w1s);
-	} else {
-		channel_interrupts_enable(engine->lro, engine->irq_bitmask);
-	}
+	engine_interrupts_resume(engine);
 	/* unlock the engine */
 	spin_unlock(&engine->lock);
 }
@@ -1418,7 +1723,10 @@ static irqreturn_t xdma_isr(int irq, void *dev_id)
 		/* engine present and its interrupt fired? */
 		if (engine && (engine->irq_bitmask & ch_irq)) {
 			dbg_tfr("schedule_work(engine=%p)\n", engine);
-			schedule_work(&engine->work);
+			this_cpu_inc(engine->stats->irqs);
+			trace_xdma_irq(engine, irq);
+			queue_work_on(engine_service_cpu(engine), system_wq,
+				      &engine->work);
 		}
 	}
 
@@ -1428,7 +1736,10 @@ static irqreturn_t xdma_isr(int irq, void *dev_id)
 		/* engine present and its interrupt fired? */
 		if (engine && (engine->irq_bitmask & ch_irq)) {
 			dbg_tfr("schedule_work(engine=%p)\n", engine);
-			schedule_work(&engine->work);
+			this_cpu_inc(engine->stats->irqs);
+			trace_xdma_irq(engine, irq);
+			queue_work_on(engine_service_cpu(engine), system_wq,
+				      &engine->work);
 		}
 	}
 
@@ -1491,7 +1802,9 @@ static irqreturn_t xdma_channel_irq(int irq, void *dev_id)
 	/* Dummy read to flush the above write */
 	ioread32(&irq_regs->channel_int_pending);
 	/* Schedule the bottom half */
-	schedule_work(&engine->work);
+	this_cpu_inc(engine->stats->irqs);
+	trace_xdma_irq(engine, irq);
+	queue_work_on(engine_service_cpu(engine), system_wq, &engine->work);
 
 	/*
 	 * RTO - need to protect access here if multiple MSI-X are used for
@@ -1702,6 +2015,27 @@ success:
 	return rc;
 }
 
+/*
+ * perfmon_map() - find the AXI performance monitor named by perfmon_offset
+ *
+ * The monitor is optional, the link statistics go without it.
+ */
+static void perfmon_map(struct xdma_dev *lro, struct pci_dev *dev)
+{
+	if (!perfmon_offset || lro->user_bar_idx < 0)
+		return;
+
+	if ((perfmon_offset & 3) ||
+	    (resource_size_t)perfmon_offset + XAPM_CTL_OFFSET + sizeof(u32) >
+		    pci_resource_len(dev, lro->user_bar_idx)) {
+		pr_warn(DRV_NAME ": no performance monitor at 0x%x\n",
+			perfmon_offset);
+		return;
+	}
+
+	lro->perfmon = lro->bar[lro->user_bar_idx] + perfmon_offset;
+}
+
 static void dump_desc(struct xdma_desc *desc_virt)
 {
 	int j;
@@ -2168,14 +2502,21 @@ static void engine_destroy(struct xdma_dev *lro, struct xdma_engine *engine)
 
 	/* Disable interrupts to stop processing new events during shutdown */
 	iowrite32(0x0, &engine->regs->interrupt_enable_mask);
+	hrtimer_cancel(&engine->poll_timer);
 
 	engine_msix_teardown(engine);
 
+	/* the work is queued by both, and may start the timer again */
+	cancel_work_sync(&engine->work);
+	hrtimer_cancel(&engine->poll_timer);
+
 	/* Release memory use for descriptor writebacks */
 	if (poll_mode)
 		engine_writeback_teardown(engine);
 
 	/* Release memory for the engine */
+	free_percpu(engine->stats);
+	free_cpumask_var(engine->service_cpus);
 	kfree(engine);
 
 	/* Decrement the number of engines available */
@@ -2188,6 +2529,7 @@ static void engine_msix_teardown(struct xdma_engine *engine)
 	if (engine->msix_irq_line) {
 		dbg_sg("Release IRQ#%d for engine %p\n", engine->msix_irq_line,
 		       engine);
+		irq_set_affinity_hint(engine->msix_irq_line, NULL);
 		free_irq(engine->msix_irq_line, engine);
 	}
 }
@@ -2213,6 +2555,10 @@ static int engine_msix_setup(struct xdma_engine *engine)
 		dbg_init("Requested IRQ#%d for engine %d\n", vector,
 			 lro->engines_num);
 		engine->msix_irq_line = vector;
+		/* a hint for irqbalance, the ring is on the node of the card */
+		if (lro->node != NUMA_NO_NODE)
+			irq_set_affinity_hint(vector,
+					      cpumask_of_node(lro->node));
 	}
 
 	return rc;
@@ -2298,11 +2644,22 @@ static struct xdma_engine *engine_create(struct xdma_dev *lro, int offset,
 	/* allocate data structure for engine book keeping */
 	struct xdma_engine *engine;
 
-	engine = kzalloc(sizeof(struct xdma_engine), GFP_KERNEL);
+	engine = kzalloc_node(sizeof(struct xdma_engine), GFP_KERNEL,
+			      lro->node);
 
 	/* memory allocation failure? */
 	if (!engine)
 		return NULL;
+	if (!zalloc_cpumask_var(&engine->service_cpus, GFP_KERNEL)) {
+		kfree(engine);
+		return NULL;
+	}
+	engine->stats = alloc_percpu(struct xdma_ring_stats);
+	if (!engine->stats) {
+		free_cpumask_var(engine->service_cpus);
+		kfree(engine);
+		return NULL;
+	}
 
 	/* set magic */
 	engine->magic = MAGIC_ENGINE;
@@ -2329,12 +2686,21 @@ static struct xdma_engine *engine_create(struct xdma_dev *lro, int offset,
 	engine->dir_to_dev = dir_to_dev;
 	engine->name = engine->dir_to_dev ? "H2C" : "C2H";
 	engine->streaming = get_engine_type(engine->regs);
+	engine->rx_block = engine->rx_block_next = rx_block_size;
+	engine->rx_blocks = engine->rx_blocks_next = rx_block_count;
+	engine->poll_interval_us = irq_poll_interval;
+	engine->poll_idle_budget = irq_poll_idle;
+	engine->rate_stamp = jiffies;
+	engine->credit_policy = credit_policy;
+	engine->credit_fill = credit_fill;
 
 	dbg_init("engine %p name %s irq_bitmask=0x%08x\n", engine, engine->name,
 		 (int)engine->irq_bitmask);
 
 	/* initialize the deferred work for transfer completion */
 	INIT_WORK(&engine->work, engine_service_work);
+	hrtimer_init(&engine->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	engine->poll_timer.function = engine_poll_timer;
 
 	/* Configure per-engine MSI-X vector if MSI-X is enabled */
 	if (lro->msix_enabled) {
@@ -2393,6 +2759,8 @@ static struct xdma_engine *engine_create(struct xdma_dev *lro, int offset,
 fail_wb:
 	engine_msix_teardown(engine);
 fail_msix:
+	free_percpu(engine->stats);
+	free_cpumask_var(engine->service_cpus);
 	kfree(engine);
 	engine = NULL;
 
@@ -2937,17 +3305,21 @@ static ssize_t char_sgdma_read_write(struct file *file, char __user *buf,
 static int transfer_monitor_cyclic(struct xdma_engine *engine,
 				   struct xdma_transfer *transfer)
 {
-	struct xdma_result *result;
+	ktime_t start = 0;
+	bool waited = false;
+	s64 us;
 	int rc = 0;
 
 	BUG_ON(!engine);
 	BUG_ON(!transfer);
 
-	result = (struct xdma_result *)engine->rx_result_buffer_virt;
-	BUG_ON(!result);
-
-	do {
-		if (poll_mode) {
+	while (!cyclic_data_ready(engine)) {
+		if (!waited) {
+			trace_xdma_wait_start(engine);
+			start = ktime_get();
+			waited = true;
+		}
+		if (poll_mode && !engine->lro->soft_source) {
 			rc = engine_service_poll(engine, 0);
 			if (rc) {
 				dbg_tfr("engine_service_poll() = %d\n", rc);
@@ -2955,238 +3327,573 @@ static int transfer_monitor_cyclic(struct xdma_engine *engine,
 				break;
 			}
 		} else {
-			if (enable_credit_mp) {
-				rc = wait_event_interruptible(
-					transfer->wq,
-					(engine->rx_head != engine->rx_tail ||
-					 engine->rx_overrun));
-			} else {
-				rc = wait_event_interruptible(
-					transfer->wq, engine->eop_found);
-			}
+			rc = wait_event_interruptible(transfer->wq,
+						      cyclic_data_ready(engine));
 			if (rc) {
 				dbg_tfr("wait_event_interruptible()=%d\n", rc);
 				break;
 			}
 		}
-	} while (result[engine->rx_head].status == 0);
+	}
+
+	if (waited) {
+		us = ktime_us_delta(ktime_get(), start);
+		trace_xdma_wait_end(engine, us, rc);
+		if (rc == 0)
+			ring_wait_account(engine, us);
+	}
 
 	return rc;
 }
 
-static int copy_cyclic_to_user(struct xdma_dev *lro, struct xdma_engine *engine,
-			       size_t nb_result, int head, char __user *buf,
-			       size_t size)
+/* ring_wait_account() - count a read that waited us microseconds for data */
+static void ring_wait_account(struct xdma_engine *engine, s64 us)
 {
-	struct xdma_result *result;
-	char *rx_buffer;
-	int rc, copy;
-	size_t user_buffer_index = 0;
-	size_t copied = 0;
-	size_t i;
+	int bucket = us > 0 ? fls64(us) : 0;
 
-	BUG_ON(!engine);
-	BUG_ON(!buf);
+	if (bucket >= RING_WAIT_BUCKETS)
+		bucket = RING_WAIT_BUCKETS - 1;
+	this_cpu_inc(engine->stats->waits[bucket]);
+}
+
+/* cyclic_received() - blocks received and not yet given back to the card
+ *
+ * Must be called with engine->lock held.
+ */
+static int cyclic_received(struct xdma_engine *engine)
+{
+	if (engine->rx_overrun)
+		return engine->rx_blocks;
+	return (engine->rx_tail + engine->rx_blocks - engine->rx_head) %
+	       engine->rx_blocks;
+}
+
+/* cyclic_unclaimed() - bytes received and not claimed by a reader yet
+ *
+ * Must be called with engine->lock held.
+ */
+static u32 cyclic_unclaimed(struct xdma_engine *engine)
+{
+	struct xdma_result *result;
+	int received = cyclic_received(engine);
+	u32 bytes = 0;
+	int i;
 
 	result = (struct xdma_result *)engine->rx_result_buffer_virt;
 	BUG_ON(!result);
 
-	dbg_tfr("nb_result = %zu, size = %zu\n", nb_result, size);
-
-	rx_buffer = engine->rx_buffer;
+	for (i = engine->rx_claimed; i < received; i++)
+		bytes += min_t(u32, engine->rx_block,
+			       result[(engine->rx_head + i) %
+				      engine->rx_blocks].length);
 
-	for (i = 0; i < nb_result; i++) {
-		size_t len = result[head].length;
-		size_t remaining_in_user_buf = size - user_buffer_index;
-		copy = remaining_in_user_buf > len ? len :
-						     remaining_in_user_buf;
+	return bytes - min_t(u32, bytes, engine->rx_claim_offset);
+}
 
-		dbg_tfr("head = %u, len = %zu\n", head, len);
+/*
+ * cyclic_claim() - claim up to size bytes of the RX ring for one reader
+ *
+ * The bytes are taken from the first unclaimed byte on, a block being
+ * shared by several readers when they ask for less than a block. Each block
+ * claimed from counts one more copy in flight, so that it is not given back
+ * to the card before cyclic_unclaim(). A faulty result ends the claim.
+ * Must be called with engine->lock held.
+ */
+static void cyclic_claim(struct xdma_engine *engine, size_t size,
+			 struct xdma_cyclic_claim *claim)
+{
+	struct xdma_result *result;
+	int received = cyclic_received(engine);
+	int block;
+	size_t copy;
+	u32 len;
 
-		if (copy > 0) {
-			rc = copy_to_user(&buf[engine->user_buffer_index],
-					  &rx_buffer[head * RX_BUF_BLOCK],
-					  copy);
+	result = (struct xdma_result *)engine->rx_result_buffer_virt;
+	BUG_ON(!result);
 
-			if (rc) {
-				dbg_tfr("copy_to_user failed\n");
-				return rc;
-			}
-			copied += copy;
-#if USE_FIFO
-			if (copy < len) {
-				kfifo_in(&lro->remaining_bytes,
-					 &rx_buffer[head * RX_BUF_BLOCK + copy],
-					 len - copy);
-			}
-#endif
+	claim->block =
+		(engine->rx_head + engine->rx_claimed) % engine->rx_blocks;
+	claim->offset = engine->rx_claim_offset;
+	claim->blocks = 0;
+	claim->size = 0;
+	claim->fault = 0;
+
+	while (claim->size < size && engine->rx_claimed < received) {
+		block = (engine->rx_head + engine->rx_claimed) %
+			engine->rx_blocks;
+		len = result[block].length;
+
+		/* checked once, by the first reader claiming from the block */
+		if (engine->rx_claim_offset == 0 &&
+		    ((result[block].status >> 16) != C2H_WB || len == 0 ||
+		     len > engine->rx_block)) {
+			dbg_tfr("faulty result at block %d\n", block);
+			result[block].length = 0;
+			len = 0;
+			claim->fault = 1;
 		}
-#if USE_FIFO
-		else {
-			kfifo_in(&lro->remaining_bytes,
-				 &rx_buffer[head * RX_BUF_BLOCK], len);
+
+		copy = min_t(size_t, len - engine->rx_claim_offset,
+			     size - claim->size);
+		engine->rx_copies[block]++;
+		claim->blocks++;
+		claim->size += copy;
+		engine->rx_claim_offset += copy;
+		if (engine->rx_claim_offset == len) {
+			engine->rx_claim_offset = 0;
+			engine->rx_claimed++;
 		}
-#endif
-		result[head].length = 0;
 
-		user_buffer_index += copy;
-		head = (head + 1) % RX_BUF_PAGES;
+		if (claim->fault)
+			break;
 	}
 
-	return copied;
+	if (claim->blocks > 0)
+		engine->rx_readers++;
 }
 
-static int complete_cyclic(struct xdma_dev *lro, struct xdma_engine *engine,
-			   char __user *buf, size_t size)
+/*
+ * cyclic_free_blocks() - give the wholly read blocks back to the card
+ *
+ * Blocks go back in ring order, a block copied quickly waits for the slower
+ * copies of the blocks before it. Must be called with engine->lock held.
+ */
+static void cyclic_free_blocks(struct xdma_engine *engine)
 {
 	struct xdma_result *result;
-	int fault = 0;
-	int eop = 0;
-	int head;
-	int rc = 0;
 	int num_credit = 0;
 
-	BUG_ON(!engine);
 	result = (struct xdma_result *)engine->rx_result_buffer_virt;
 	BUG_ON(!result);
 
-	spin_lock(&engine->lock);
-
-	/* where the host currently is in the ring buffer */
-	head = engine->rx_head;
-
-	/* iterate over newly received results */
-	//while (result[engine->rx_head].status) {
-	while (engine->rx_head != engine->rx_tail || engine->rx_overrun) {
-		WARN_ON(result[engine->rx_head].status == 0);
-		dbg_tfr("result[engine->rx_head=%3d].status = 0x%08x\n",
-			engine->rx_head, (int)result[engine->rx_head].status);
-
-		dbg_tfr("result[engine->rx_head=%3d].length = %d\n",
-			engine->rx_head, (int)result[engine->rx_head].length);
-
-		if ((result[engine->rx_head].status >> 16) != C2H_WB) {
-			dbg_tfr("engine->rx_head has no result magic\n");
-			fault = 1;
-		} else if (result[engine->rx_head].length > RX_BUF_BLOCK) {
-			dbg_tfr("engine->rx_head length > %d\n", RX_BUF_BLOCK);
-			fault = 1;
-		} else if (result[engine->rx_head].length == 0) {
-			dbg_tfr("engine->rx_head length is zero\n");
-			fault = 1;
-			/* valid result */
-		} else {
-			num_credit++;
-			/* seen eop? */
-			if (result[engine->rx_head].status & RX_STATUS_EOP) {
-				eop = 1;
-				engine->eop_found = 1;
-			}
-
-			dbg_tfr("num_credit=%d (%s)\n", num_credit,
-				eop ? "with EOP" : "no EOP yet");
-		}
-		/* clear result */
+	while (engine->rx_claimed > 0 &&
+	       engine->rx_copies[engine->rx_head] == 0) {
 		result[engine->rx_head].status = 0;
-		/* proceed head pointer so we make progress, even when fault */
-		engine->rx_head = (engine->rx_head + 1) % RX_BUF_PAGES;
+		result[engine->rx_head].length = 0;
+		engine->rx_head = (engine->rx_head + 1) % engine->rx_blocks;
+		engine->rx_claimed--;
+		engine->rx_overrun = 0;
+		num_credit++;
+	}
 
-		/* stop processing if a fault/eop was detected */
-		if (fault || eop) {
-			break;
-		}
+	if (num_credit == 0)
+		return;
+	if (engine->credit_policy == CREDIT_POLICY_READ) {
+		engine_return_credits(engine, num_credit);
+	} else if (engine->rx_credits_out == 0) {
+		/* the card stopped, no completion is coming to refill it */
+		ring_refill(engine);
 	}
+}
 
-	spin_unlock(&engine->lock);
+/* cyclic_unclaim() - end the copies of a claim and free what they held
+ *
+ * Must be called with engine->lock held.
+ */
+static void cyclic_unclaim(struct xdma_engine *engine,
+			   const struct xdma_cyclic_claim *claim)
+{
+	int block = claim->block;
+	int i;
 
-	if (fault) {
-		printk("[complete_cyclic] fault!!!!  rc = -EIO!!!! \n");
-		rc = -EIO;
-	} else {
-		rc = copy_cyclic_to_user(lro, engine, num_credit, head, buf,
-					 size);
-		engine->rx_overrun = 0;
-		/* if copy is successful, release credits */
-		if (rc > 0) {
-			iowrite32(num_credit, &engine->sgdma_regs->credits);
-		}
+	if (claim->blocks == 0)
+		return;
+
+	for (i = 0; i < claim->blocks; i++) {
+		engine->rx_copies[block]--;
+		block = (block + 1) % engine->rx_blocks;
 	}
+	engine->rx_readers--;
 
-	return rc;
+	cyclic_free_blocks(engine);
 }
 
-static ssize_t char_sgdma_read_cyclic(struct file *file, char __user *buf,
-				      size_t size)
+/*
+ * copy_cyclic_span() - copy bytes contiguous in the RX ring in one go
+ *
+ * @offset where the bytes go in buf, an iov_iter advances by itself
+ */
+static int copy_cyclic_span(void *buf, size_t offset, const char *src,
+			    size_t size, enum cyclic_dest dest)
 {
-	int rc = 0;
-	int rc_len = 0;
-	struct xdma_char *lro_char;
-	struct xdma_dev *lro;
-	struct xdma_engine *engine;
-	struct xdma_transfer *transfer;
+	if (size == 0)
+		return 0;
 
-	/* fetch device specific data stored earlier during open */
-	lro_char = (struct xdma_char *)file->private_data;
-	BUG_ON(!lro_char);
-	BUG_ON(lro_char->magic != MAGIC_CHAR);
+	switch (dest) {
+	case CYCLIC_TO_KERNEL:
+		memcpy((char *)buf + offset, src, size);
+		break;
+	case CYCLIC_TO_USER:
+		if (copy_to_user((char __user *)buf + offset, src, size)) {
+			dbg_tfr("copy_to_user failed\n");
+			return -EFAULT;
+		}
+		break;
+	case CYCLIC_TO_ITER:
+		if (copy_to_iter(src, size, buf) != size) {
+			dbg_tfr("copy_to_iter failed\n");
+			return -EFAULT;
+		}
+		break;
+	}
+	return 0;
+}
 
-	lro = lro_char->lro;
-	BUG_ON(!lro);
-	BUG_ON(lro->magic != MAGIC_DEVICE);
+/*
+ * copy_cyclic() - copy the claimed bytes, without engine->lock held
+ *
+ * Full blocks follow each other in rx_buffer, the claimed bytes are copied
+ * as spans running over them: two copies for a claim wrapping around the
+ * ring, one for any other, unless a block was filled short.
+ *
+ * @buf buffer or struct iov_iter, as told by dest
+ */
+static int copy_cyclic(struct xdma_engine *engine,
+		       const struct xdma_cyclic_claim *claim, void *buf,
+		       enum cyclic_dest dest)
+{
+	struct xdma_result *result;
+	char *rx_buffer;
+	char *src;
+	char *span = NULL;
+	size_t span_size = 0;
+	size_t offset = claim->offset;
+	size_t copied = 0;
+	size_t copy;
+	int block = claim->block;
+	int i;
 
-	engine = lro_char->engine;
-	/* XXX detect non-supported directions XXX */
 	BUG_ON(!engine);
-	BUG_ON(engine->magic != MAGIC_ENGINE);
-
-	transfer = engine->rx_transfer_cyclic;
-	BUG_ON(!transfer);
+	BUG_ON(!buf);
 
-	dbg_tfr("char_sgdma_read_cyclic()");
-	engine->user_buffer_index = 0;
+	result = (struct xdma_result *)engine->rx_result_buffer_virt;
+	BUG_ON(!result);
 
-	do {
-		rc = transfer_monitor_cyclic(engine, transfer);
-		if (rc)
-			return rc;
-		rc_len += complete_cyclic(lro, engine, buf, size);
-	} while (!engine->eop_found);
+	dbg_tfr("block = %d, blocks = %d, size = %zu\n", claim->block,
+		claim->blocks, claim->size);
 
-	if (enable_credit_mp) {
-		engine->eop_found = 0;
-	}
-	dbg_tfr("returning %d\n", rc_len);
-	return rc_len;
-}
+	rx_buffer = engine->rx_buffer;
 
-static long modules_status_ioctl(struct xilinx_fpga_regs __iomem *user_regs,
-				 u_int32_t __user *arg)
-{
-	// FIXME: should take MODULES_MASK into account when implemented
-	u_int32_t status_result;
-	u_int32_t modules_status;
-	u_int32_t modules_error;
+	for (i = 0; i < claim->blocks && copied < claim->size; i++) {
+		/* the length of a claimed block does not change */
+		copy = min_t(size_t, result[block].length - offset,
+			     claim->size - copied);
+
+		src = &rx_buffer[(size_t)block * engine->rx_block + offset];
+		if (src != span + span_size) {
+			if (copy_cyclic_span(buf, copied - span_size, span,
+					     span_size, dest))
+				return -EFAULT;
+			span = src;
+			span_size = 0;
+		}
+		span_size += copy;
+		copied += copy;
 
-	if (Q400WaitForReady(user_regs, &status_result) == -1) {
-		modules_status = 0;
-	} else {
-		modules_status = status_result & Q400_SENSOR_BEING;
-		modules_error = (status_result & Q400_SENSOR_PKT_ERR) >>
-				Q400_SENSOR_PKT_ERR_SHIFT;
-		modules_status &= ~modules_error;
+		offset = 0;
+		block = (block + 1) % engine->rx_blocks;
 	}
 
-	return put_user(modules_status, arg);
+	if (copy_cyclic_span(buf, copied - span_size, span, span_size, dest))
+		return -EFAULT;
+
+	return copied;
 }
 
-static long card_count_ioctl(u_int32_t __user *arg)
+/*
+ * complete_cyclic() - read the received bytes of the RX ring
+ *
+ * Only claiming bytes and releasing them again is done under engine->lock,
+ * the copy is not, so that readers copy in parallel. The bytes go to user
+ * space for read(), to a kernel buffer for the hw_random device and to an
+ * iov_iter for splice().
+ *
+ * Returns the number of bytes read, 0 if another reader was faster, -EIO on a
+ * faulty result, -EBUSY if the ring got mapped and, for the hw_random
+ * device, -EAGAIN in SAMPLE mode.
+ */
+static int complete_cyclic(struct xdma_engine *engine, void *buf, size_t size,
+			   enum cyclic_dest dest)
 {
-	int card_count = 0;
-	int i;
-	for (i = 0; i < MAX_XDMA_DEVICES; i++) {
+	struct xdma_cyclic_claim claim;
+	int rc = 0;
+
+	BUG_ON(!engine);
+
+	spin_lock(&engine->lock);
+	if (engine->rx_map_file) {
+		spin_unlock(&engine->lock);
+		return -EBUSY;
+	}
+	/* a reset happened since the wait, wait for its flush */
+	if (!engine->lro->no_garbage_to_read) {
+		spin_unlock(&engine->lock);
+		return 0;
+	}
+	/* raw samples are no entropy, checked along with the claim */
+	if (dest == CYCLIC_TO_KERNEL &&
+	    engine->lro->current_qrng_mode == QUANTIS_QRNG_MODE_SAMPLE) {
+		spin_unlock(&engine->lock);
+		return -EAGAIN;
+	}
+	cyclic_claim(engine, size, &claim);
+	trace_xdma_read_claim(engine, &claim);
+	spin_unlock(&engine->lock);
+
+	if (claim.size > 0)
+		rc = copy_cyclic(engine, &claim, buf, dest);
+
+	spin_lock(&engine->lock);
+	cyclic_unclaim(engine, &claim);
+	spin_unlock(&engine->lock);
+
+	if (claim.fault)
+		this_cpu_inc(engine->stats->faults);
+	if (rc == 0 && claim.fault) {
+		printk("[complete_cyclic] fault!!!!  rc = -EIO!!!! \n");
+		rc = -EIO;
+	}
+	if (rc > 0) {
+		this_cpu_inc(engine->stats->reads);
+		this_cpu_add(engine->stats->bytes, rc);
+	}
+
+	return rc;
+}
+
+/*
+ * cyclic_flush_garbage() - drop the bytes received right after a reset
+ *
+ * Claims the garbage from the ring like a reader would, but gives the blocks
+ * straight back to the card instead of copying them. Called each time the
+ * ring is serviced, so the flush goes on as the bytes come in, and wakes the
+ * readers once it is over. The mapped ring flushes in ring_publish().
+ * Must be called with engine->lock held.
+ */
+static void cyclic_flush_garbage(struct xdma_engine *engine)
+{
+	struct xdma_dev *lro = engine->lro;
+	struct xdma_cyclic_claim claim;
+	unsigned int garbage = garbage_to_read(lro);
+
+	if (lro->no_garbage_to_read || lro->reset_pending || engine->rx_mapped)
+		return;
+
+	do {
+		if (engine->rx_garbage >= garbage)
+			break;
+		cyclic_claim(engine, garbage - engine->rx_garbage, &claim);
+		cyclic_unclaim(engine, &claim);
+		engine->rx_garbage += claim.size;
+		this_cpu_add(engine->stats->garbage, claim.size);
+	} while (claim.blocks > 0);
+
+	if (engine->rx_garbage >= garbage) {
+		garbage_flushed(engine);
+		wake_up_interruptible(&engine->rx_transfer_cyclic->wq);
+	}
+}
+
+/* cyclic_data_ready() - check if the RX ring holds unclaimed bytes */
+static bool cyclic_data_ready(struct xdma_engine *engine)
+{
+	bool ready;
+
+	spin_lock(&engine->lock);
+	/* without interrupts, results are only seen when looked for */
+	if (poll_mode && !engine->lro->soft_source) {
+		engine_ring_process(engine);
+		cyclic_flush_garbage(engine);
+	}
+	/* nothing is read before the garbage of the last reset is gone */
+	ready = engine->lro->no_garbage_to_read &&
+		engine->rx_claimed < cyclic_received(engine);
+	spin_unlock(&engine->lock);
+
+	return ready;
+}
+
+static ssize_t char_sgdma_read_cyclic(struct file *file, void *buf,
+				      size_t size, enum cyclic_dest dest,
+				      bool nonblock)
+{
+	int rc = 0;
+	struct xdma_char *lro_char;
+	struct xdma_dev *lro;
+	struct xdma_engine *engine;
+	struct xdma_transfer *transfer;
+
+	/* fetch device specific data stored earlier during open */
+	lro_char = (struct xdma_char *)file->private_data;
+	BUG_ON(!lro_char);
+	BUG_ON(lro_char->magic != MAGIC_CHAR);
+
+	lro = lro_char->lro;
+	BUG_ON(!lro);
+	BUG_ON(lro->magic != MAGIC_DEVICE);
+
+	engine = lro_char->engine;
+	/* XXX detect non-supported directions XXX */
+	BUG_ON(!engine);
+	BUG_ON(engine->magic != MAGIC_ENGINE);
+
+	transfer = engine->rx_transfer_cyclic;
+	BUG_ON(!transfer);
+
+	dbg_tfr("char_sgdma_read_cyclic()");
+	trace_xdma_read_enter(engine, size, dest);
+
+	/* other readers may claim the bytes between the wait and the claim */
+	do {
+		/* O_NONBLOCK: only what was received already */
+		if (nonblock && !cyclic_data_ready(engine)) {
+			rc = -EAGAIN;
+			break;
+		}
+		rc = transfer_monitor_cyclic(engine, transfer);
+		if (rc)
+			break;
+		rc = complete_cyclic(engine, buf, size, dest);
+	} while (rc == 0 && size > 0);
+
+	dbg_tfr("returning %d\n", rc);
+	trace_xdma_read_exit(engine, size, rc);
+	return rc;
+}
+
+/*
+ * status_monitor_work() - keep a recent copy of the modules status register
+ *
+ * Runs every status_interval, and every jiffy while the sensors are not
+ * ready, e.g. after a reset.
+ */
+static void status_monitor_work(struct work_struct *work)
+{
+	struct xdma_dev *lro =
+		container_of(to_delayed_work(work), struct xdma_dev, status_work);
+	struct xilinx_fpga_regs __iomem *user_regs =
+		lro->bar[lro->user_bar_idx];
+	u32 status_result;
+
+	status_result = ioread32(&user_regs->reg_init_status_chk);
+	WRITE_ONCE(lro->status_stamp, jiffies);
+	WRITE_ONCE(lro->status_reg, status_result);
+
+	if (status_result & Q400_SENSOR_READY) {
+		wake_up_interruptible(&lro->status_wq);
+		schedule_delayed_work(
+			&lro->status_work,
+			msecs_to_jiffies(max_t(unsigned int, status_interval, 1)));
+	} else {
+		schedule_delayed_work(&lro->status_work, 1);
+	}
+}
+
+/*
+ * card_init_work() - initialize the FPGA and the sensors of a card
+ *
+ * Queued by probe() on system_unbound_wq, so that the cards initialize in
+ * parallel and the module loads without waiting for them. Until it is done,
+ * /dev/qrandomN opens only once the card is ready and its state is
+ * "initializing".
+ */
+static void card_init_work(struct work_struct *work)
+{
+	struct xdma_dev *lro = container_of(work, struct xdma_dev, init_work);
+	struct xilinx_fpga_regs __iomem *user_reg = lro->bar[lro->user_bar_idx];
+	ktime_t start = ktime_get();
+
+	lro->flush_begin = start;
+	lro->flush_us = -1;
+	Q400RegInit(user_reg, lro->qrng_mode, lro->qrng_num);
+	lro->current_qrng_mode = lro->qrng_mode;
+	schedule_delayed_work(&lro->status_work, 0);
+	complete_all(&lro->init_done);
+	pr_debug(DRV_NAME ": card %d initialized in %lld ms\n", lro->instance,
+		 ktime_ms_delta(ktime_get(), start));
+
+	/* /dev/qrandomN works without it */
+	card_hwrng_register(lro);
+}
+
+/*
+ * modules_status_get() - modules status as last read by status_monitor_work()
+ *
+ * Only waits while the sensors are not ready yet, as long as
+ * Q400WaitForReady() would have, but sleeping instead of busy-waiting.
+ *
+ * @status the functional modules, 0 if the sensors are not ready
+ * @age milliseconds since the status was read
+ */
+static int modules_status_get(struct xdma_dev *lro, u32 *status, u32 *age)
+{
+	// FIXME: should take MODULES_MASK into account when implemented
+	u32 status_result;
+	u32 modules_error;
+	long rc;
+
+	rc = wait_event_interruptible_timeout(
+		lro->status_wq,
+		READ_ONCE(lro->status_reg) & Q400_SENSOR_READY,
+		msecs_to_jiffies(Q400_SENSOR_READY_MAX_CNT));
+	if (rc < 0)
+		return rc;
+
+	status_result = READ_ONCE(lro->status_reg);
+	if (!(status_result & Q400_SENSOR_READY)) {
+		*status = 0;
+	} else {
+		*status = status_result & Q400_SENSOR_BEING;
+		modules_error = (status_result & Q400_SENSOR_PKT_ERR) >>
+				Q400_SENSOR_PKT_ERR_SHIFT;
+		*status &= ~modules_error;
+	}
+	*age = jiffies_to_msecs(jiffies - READ_ONCE(lro->status_stamp));
+
+	return 0;
+}
+
+static long modules_status_ioctl(struct xdma_dev *lro, u_int32_t __user *arg)
+{
+	u32 modules_status;
+	u32 age;
+	int rc;
+
+	rc = modules_status_get(lro, &modules_status, &age);
+	if (rc)
+		return rc;
+
+	return put_user(modules_status, arg);
+}
+
+static long
+modules_status_age_ioctl(struct xdma_dev *lro,
+			 struct quantis_modules_status __user *arg)
+{
+	struct quantis_modules_status modules_status;
+	int rc;
+
+	rc = modules_status_get(lro, &modules_status.status,
+				&modules_status.age_ms);
+	if (rc)
+		return rc;
+
+	return copy_to_user(arg, &modules_status, sizeof(modules_status)) ?
+		       -EFAULT :
+		       0;
+}
+
+static long card_count_ioctl(u_int32_t __user *arg)
+{
+	int card_count = 0;
+	int i;
+	for (i = 0; i < MAX_XDMA_DEVICES; i++) {
 		if (dev_present[i]) {
 			card_count += 1;
 		}
+		/* the software data sources are not cards */
+		if (soft_devs[i])
+			card_count -= 1;
 	}
 
 	return put_user(card_count, arg);
@@ -3214,6 +3921,213 @@ static long get_modules_mask_ioctl(struct xilinx_fpga_regs __iomem *user_regs,
 	return put_user(modules_mask, arg);
 }
 
+/* perf_read64() - a 64-bit counter in two registers, read while it counts */
+static u64 perf_read64(u32 __iomem *lo, u32 __iomem *hi)
+{
+	u32 high;
+	u32 low;
+
+	do {
+		high = ioread32(hi);
+		low = ioread32(lo);
+	} while (ioread32(hi) != high);
+
+	return ((u64)high << 32) | low;
+}
+
+/* ring_stats_get() - all the counters of the RX ring, summed over CPUs */
+static void ring_stats_get(struct xdma_engine *engine,
+			   struct xdma_ring_stats *sum)
+{
+	size_t offset;
+
+	for (offset = 0; offset < sizeof(*sum); offset += sizeof(u64))
+		*(u64 *)((char *)sum + offset) = ring_stat_sum(engine, offset);
+}
+
+/*
+ * perf_start_ioctl() - clear and start the link statistics
+ *
+ * The performance counters of the C2H engine count the cycles of its clock,
+ * those it moved data and those it waited for the host, which tells a read
+ * bound by the link from one bound by the host or by the random source. The
+ * AXI performance monitor is only there if perfmon_offset names it, and the
+ * software data source has the ring counters only.
+ */
+static long perf_start_ioctl(struct xdma_dev *lro, struct xdma_engine *engine)
+{
+	u32 ctl;
+
+	if (!lro->soft_source) {
+		iowrite32(XDMA_PERF_CLEAR, &engine->regs->perf_ctrl);
+		iowrite32(XDMA_PERF_RUN, &engine->regs->perf_ctrl);
+	}
+	if (lro->perfmon) {
+		ctl = ioread32(lro->perfmon + XAPM_CTL_OFFSET);
+		ctl &= ~(XAPM_CR_MCNTR_ENABLE_MASK | XAPM_CR_GCC_ENABLE_MASK);
+		iowrite32(ctl | XAPM_CR_MCNTR_RESET_MASK |
+				  XAPM_CR_GCC_RESET_MASK,
+			  lro->perfmon + XAPM_CTL_OFFSET);
+		iowrite32(ctl | XAPM_CR_MCNTR_ENABLE_MASK |
+				  XAPM_CR_GCC_ENABLE_MASK,
+			  lro->perfmon + XAPM_CTL_OFFSET);
+	}
+
+	ring_stats_get(engine, &engine->perf_base);
+	engine->perf_begin = ktime_get();
+	engine->perf_running = 1;
+
+	return 0;
+}
+
+/* perf_stop_ioctl() - stop the link statistics, which keep their values */
+static long perf_stop_ioctl(struct xdma_dev *lro, struct xdma_engine *engine)
+{
+	u32 ctl;
+
+	if (!engine->perf_running)
+		return 0;
+
+	if (!lro->soft_source)
+		iowrite32(0, &engine->regs->perf_ctrl);
+	if (lro->perfmon) {
+		ctl = ioread32(lro->perfmon + XAPM_CTL_OFFSET);
+		ctl &= ~(XAPM_CR_MCNTR_ENABLE_MASK | XAPM_CR_GCC_ENABLE_MASK);
+		iowrite32(ctl, lro->perfmon + XAPM_CTL_OFFSET);
+	}
+
+	engine->perf_end = ktime_get();
+	ring_stats_get(engine, &engine->perf_last);
+	engine->perf_running = 0;
+
+	return 0;
+}
+
+static long perf_get_ioctl(struct xdma_dev *lro, struct xdma_engine *engine,
+			   struct quantis_perf_counters __user *arg)
+{
+	struct quantis_perf_counters perf;
+	struct xdma_ring_stats now;
+	const struct xdma_ring_stats *base = &engine->perf_base;
+	ktime_t end;
+	int i;
+
+	memset(&perf, 0, sizeof(perf));
+	perf.version = QUANTIS_PERF_VERSION;
+
+	/* never started, nothing counted */
+	if (!engine->perf_begin)
+		goto out;
+
+	if (engine->perf_running) {
+		perf.flags |= QUANTIS_PERF_RUNNING;
+		ring_stats_get(engine, &now);
+		end = ktime_get();
+	} else {
+		now = engine->perf_last;
+		end = engine->perf_end;
+	}
+	perf.elapsed_ns = ktime_to_ns(ktime_sub(end, engine->perf_begin));
+	perf.ring_bytes = now.bytes - base->bytes;
+	perf.ring_blocks = now.blocks - base->blocks;
+	perf.ring_overruns = now.overruns - base->overruns;
+	for (i = 0; i < RING_WAIT_BUCKETS; i++)
+		perf.ring_waits += now.waits[i] - base->waits[i];
+
+	/* the counters of the card stop counting with the run bits */
+	if (!lro->soft_source) {
+		perf.flags |= QUANTIS_PERF_ENGINE;
+		perf.clock_cycles = perf_read64(&engine->regs->perf_cyc_lo,
+						&engine->regs->perf_cyc_hi);
+		perf.data_cycles = perf_read64(&engine->regs->perf_dat_lo,
+					       &engine->regs->perf_dat_hi);
+		perf.pending_cycles = perf_read64(&engine->regs->perf_pnd_lo,
+						  &engine->regs->perf_pnd_hi);
+	}
+	if (lro->perfmon) {
+		perf.flags |= QUANTIS_PERF_APM;
+		perf.apm_clock_cycles =
+			perf_read64(lro->perfmon + XAPM_GCC_LOW_OFFSET,
+				    lro->perfmon + XAPM_GCC_HIGH_OFFSET);
+		for (i = 0; i < QUANTIS_PERF_APM_METRICS; i++)
+			perf.apm_metrics[i] = ioread32(
+				lro->perfmon + XAPM_MC0_OFFSET +
+				i * (XAPM_MC1_OFFSET - XAPM_MC0_OFFSET));
+	}
+
+out:
+	return copy_to_user(arg, &perf, sizeof(perf)) ? -EFAULT : 0;
+}
+
+/*
+ * qrng_mode_switch_ioctl() - switch between RNG and SAMPLE without a reset
+ *
+ * Only the post-processing of the FPGA is reprogrammed, the sensors keep
+ * running. The bytes of the previous mode are then flushed like the garbage
+ * of a reset: what the ring holds, the block the card is writing and
+ * garbage_to_switch bytes more, or what is left of a reset flush if that is
+ * more. The ioctl does not wait for the flush: the device gets readable
+ * again, and QUANTIS_IOCTL_GET_CURRENT_QRNG_MODE reports the new mode, once
+ * it is over. The registers are checked then, after the mode had the time of
+ * the flush to settle: if the card did not take the mode, the current mode
+ * stays the previous one, see garbage_flushed(). The software data source
+ * flushes the same, without registers.
+ *
+ * Returns 0, or -EINVAL for an unknown mode.
+ */
+static int qrng_mode_switch_ioctl(struct xdma_dev *lro,
+				  struct xdma_engine *engine,
+				  uint32_t __user *arg)
+{
+	unsigned int pending = 0;
+	uint32_t mode;
+	int rc;
+
+	rc = get_user(mode, arg);
+	if (rc)
+		return rc;
+	if (mode != QUANTIS_QRNG_MODE_RNG && mode != QUANTIS_QRNG_MODE_SAMPLE)
+		return -EINVAL;
+	/* a later reset keeps the mode */
+	lro->qrng_mode = mode;
+
+	spin_lock(&engine->lock);
+	if (mode == lro->current_qrng_mode && !lro->switch_garbage)
+		goto out;
+
+	if (!lro->soft_source)
+		Q400SetMode(lro->bar[lro->user_bar_idx], mode);
+
+	lro->flush_begin = ktime_get();
+	if (!engine->rx_transfer_cyclic) {
+		/* no ring, nothing received in the previous mode */
+		lro->current_qrng_mode = mode;
+		lro->switch_garbage = 0;
+		goto out;
+	}
+
+	/* the blocks the card completed already are held by the ring */
+	if (!lro->soft_source)
+		engine_ring_process(engine);
+	if (!lro->no_garbage_to_read)
+		pending = garbage_to_read(lro) -
+			  min(engine->rx_garbage, garbage_to_read(lro));
+
+	lro->switch_mode = mode;
+	lro->switch_garbage = max_t(unsigned int, pending,
+				    cyclic_unclaimed(engine) +
+					    engine->rx_block +
+					    garbage_to_switch);
+	lro->no_garbage_to_read = false;
+	engine->rx_garbage = 0;
+	WRITE_ONCE(lro->flush_us, -1);
+	cyclic_flush_garbage(engine);
+
+out:
+	spin_unlock(&engine->lock);
+	return rc;
+}
+
 static long char_sgdma_ioctl(struct file *file, unsigned int cmd,
 			     unsigned long arg)
 {
@@ -3223,6 +4137,7 @@ static long char_sgdma_ioctl(struct file *file, unsigned int cmd,
 	int rc = 0;
 	struct xilinx_fpga_regs __iomem *user_regs;
 	uint32_t mode_from_user;
+	bool exclusive;
 
 	/* fetch device specific data stored earlier during open */
 	lro_char = (struct xdma_char *)file->private_data;
@@ -3237,10 +4152,25 @@ static long char_sgdma_ioctl(struct file *file, unsigned int cmd,
 
 	user_regs = lro->bar[lro->user_bar_idx];
 
-	if (mutex_lock_interruptible(&(lro_char->device_mutex))) {
+	/* only the ioctls changing the card wait for each other, the others
+	 * neither wait behind them nor behind the readers */
+	exclusive = cmd == QUANTIS_IOCTL_RESET_BOARD ||
+		    cmd == QUANTIS_IOCTL_SET_QRNG_MODE ||
+		    cmd == QUANTIS_IOCTL_SWITCH_QRNG_MODE ||
+		    cmd == QUANTIS_IOCTL_PERF_START ||
+		    cmd == QUANTIS_IOCTL_PERF_STOP ||
+		    cmd == QUANTIS_IOCTL_PERF_GET;
+	if (exclusive && mutex_lock_interruptible(&(lro_char->device_mutex))) {
 		return -ERESTARTSYS;
 	}
 
+	/* the software data source has no registers to ask */
+	if (lro->soft_source && soft_source_ioctl(lro, cmd, arg, &rc)) {
+		if (exclusive)
+			mutex_unlock(&(lro_char->device_mutex));
+		return rc;
+	}
+
 	switch (cmd) {
 	case QUANTIS_IOCTL_GET_DRIVER_VERSION:
 		rc = put_user((uint32_t)DRV_MOD_VERSION_NUMBER, (uint32_t __user *)arg);
@@ -3256,15 +4186,38 @@ static long char_sgdma_ioctl(struct file *file, unsigned int cmd,
 			      (uint32_t __user *)arg);
 		break;
 	case QUANTIS_IOCTL_RESET_BOARD:
-		rc = Q400RegInit(user_regs, lro->qrng_mode, lro->qrng_num);
+		/*
+		 * Readers don't take device_mutex: nothing is handed out from
+		 * here on, and the flush only starts once Q400RegInit() is
+		 * done, so the bytes of the reset are never read.
+		 */
+		spin_lock(&engine->lock);
+		/* a mode switch still flushing is overtaken by the reset */
 		lro->current_qrng_mode = lro->qrng_mode;
+		lro->switch_garbage = 0;
 		lro->no_garbage_to_read = false;
-#if USE_FIFO
-		kfifo_reset(&lro->remaining_bytes);
-#endif
+		lro->reset_pending = true;
+		WRITE_ONCE(lro->flush_us, -1);
+		lro->flush_begin = ktime_get();
+		spin_unlock(&engine->lock);
+		rc = Q400RegInit(user_regs, lro->qrng_mode, lro->qrng_num);
+		/* the status read before the reset is no longer valid */
+		WRITE_ONCE(lro->status_reg, 0);
+		mod_delayed_work(system_wq, &lro->status_work, 0);
+		/* the flush starts with what the ring holds already */
+		spin_lock(&engine->lock);
+		lro->reset_pending = false;
+		engine->rx_garbage = 0;
+		if (engine->rx_transfer_cyclic)
+			cyclic_flush_garbage(engine);
+		spin_unlock(&engine->lock);
 		break;
 	case QUANTIS_IOCTL_GET_MODULES_STATUS:
-		rc = modules_status_ioctl(user_regs, (uint32_t __user *)arg);
+		rc = modules_status_ioctl(lro, (uint32_t __user *)arg);
+		break;
+	case QUANTIS_IOCTL_GET_MODULES_STATUS_AGE:
+		rc = modules_status_age_ioctl(
+			lro, (struct quantis_modules_status __user *)arg);
 		break;
 	case QUANTIS_IOCTL_GET_SERIAL:
 		rc = serial_number_ioctl(user_regs, (char __user *)arg);
@@ -3283,15 +4236,35 @@ static long char_sgdma_ioctl(struct file *file, unsigned int cmd,
 	case QUANTIS_IOCTL_GET_QRNG_MODE:
 		rc = put_user(lro->qrng_mode, (uint32_t __user *)arg);
 		break;
+	case QUANTIS_IOCTL_SWITCH_QRNG_MODE:
+		rc = qrng_mode_switch_ioctl(lro, engine, (uint32_t __user *)arg);
+		break;
 	case QUANTIS_IOCTL_GET_CURRENT_QRNG_MODE:
 		rc = put_user(lro->current_qrng_mode, (uint32_t __user *)arg);
 		break;
+	case QUANTIS_IOCTL_RING_WAIT:
+		rc = ring_wait_ioctl(file, engine, true);
+		break;
+	case QUANTIS_IOCTL_RING_RELEASE:
+		rc = ring_wait_ioctl(file, engine, false);
+		break;
+	case QUANTIS_IOCTL_PERF_START:
+		rc = perf_start_ioctl(lro, engine);
+		break;
+	case QUANTIS_IOCTL_PERF_STOP:
+		rc = perf_stop_ioctl(lro, engine);
+		break;
+	case QUANTIS_IOCTL_PERF_GET:
+		rc = perf_get_ioctl(
+			lro, engine, (struct quantis_perf_counters __user *)arg);
+		break;
 	default:
 		rc = -EINVAL;
 		break;
 	}
 
-	mutex_unlock(&(lro_char->device_mutex));
+	if (exclusive)
+		mutex_unlock(&(lro_char->device_mutex));
 
 	return rc;
 }
@@ -3324,202 +4297,851 @@ static ssize_t char_sgdma_write(struct file *file, const char __user *buf,
 
 	return rc;
 }
-/* char_xdma_throw_garbage() - read and throw away bytes from the card
+
+/* char_sgdma_read() - Read from the device
+ *
+ * @buf userspace buffer
+ * @count number of bytes in the userspace buffer
+ *
+ * Iterate over the userspace buffer, taking at most 255 * PAGE_SIZE bytes for
+ * each DMA transfer.
+ *
+ * For each transfer, get the user pages, build a sglist, map, build a
+ * descriptor table, submit the transfer, wait for the interrupt handler
+ * to wake us on completion, free the sglist and descriptors.
+ */
+static ssize_t char_sgdma_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *pos)
+{
+	ssize_t ret_sz;
+
+	struct xdma_dev *lro;
+	struct xdma_char *lro_char = (struct xdma_char *)file->private_data;
+	BUG_ON(!lro_char);
+	BUG_ON(lro_char->magic != MAGIC_CHAR);
+	lro = lro_char->lro;
+	BUG_ON(!lro);
+	BUG_ON(lro->magic != MAGIC_DEVICE);
+
+	/* the blocks go to the mapped ring, nothing left to copy */
+	if (lro_char->engine && READ_ONCE(lro_char->engine->rx_map_file))
+		return -EBUSY;
+
+	/* Module errors are reported through the read itself, so that readers
+	 * don't need the modules status ioctl on every read */
+	if (lro->soft_source)
+		ret_sz = 0;
+	else
+		ret_sz = Q400CheckStatus(lro->bar[lro->user_bar_idx]);
+	/* the garbage after a reset is flushed in the ring, see
+	 * cyclic_flush_garbage() */
+	if (ret_sz >= 0) {
+		ret_sz = char_xdma_read(file, buf, count, pos);
+	}
+
+	return ret_sz;
+}
+
+/* char_xdma_read() - Read for skrng
+ *
+ * @buf userspace buffer
+ * @count number of bytes in the userspace buffer
+ *
+ * Iterate over the userspace buffer, taking at most 255 * PAGE_SIZE bytes for
+ * each DMA transfer.
+ *
+ * For each transfer, get the user pages, build a sglist, map, build a
+ * descriptor table, submit the transfer, wait for the interrupt handler
+ * to wake us on completion, free the sglist and descriptors.
+ *
+ * Several readers may read at the same time, see complete_cyclic().
+ */
+static ssize_t char_xdma_read(struct file *file, char __user *buf, size_t count,
+			      loff_t *pos)
+{
+	int rc_len;
+	struct xdma_char *lro_char;
+	struct xdma_dev *lro;
+	struct xdma_engine *engine;
+
+	/* fetch device specific data stored earlier during open */
+	lro_char = (struct xdma_char *)file->private_data;
+	BUG_ON(!lro_char);
+	BUG_ON(lro_char->magic != MAGIC_CHAR);
+
+	lro = lro_char->lro;
+	BUG_ON(!lro);
+	BUG_ON(lro->magic != MAGIC_DEVICE);
+
+	engine = lro_char->engine;
+
+	BUG_ON(!engine);
+	BUG_ON(engine->magic != MAGIC_ENGINE);
+
+	if (!engine->dir_to_dev && engine->rx_buffer &&
+	    engine->rx_transfer_cyclic) {
+		rc_len = char_sgdma_read_cyclic(file, (void __force *)buf, count,
+						CYCLIC_TO_USER,
+						file->f_flags & O_NONBLOCK);
+	} else {
+		/* the descriptors of the engine are not shared, one at a time */
+		if (mutex_lock_interruptible(&(lro_char->device_mutex))) {
+			return -ERESTARTSYS;
+		}
+		rc_len = char_sgdma_read_write(file, buf, count, pos, 0);
+		mutex_unlock(&(lro_char->device_mutex));
+	}
+	return rc_len;
+}
+
+/*
+ * char_sgdma_read_iter() - read the RX ring into an iov_iter
+ *
+ * What splice(), sendfile() and copy_file_range() read through: the bytes
+ * are copied once, from the ring into the pages of the pipe. The blocks of
+ * the ring go back to the card as soon as read, they are never spliced
+ * themselves. read() keeps going through char_sgdma_read().
+ */
+static ssize_t char_sgdma_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct xdma_char *lro_char = (struct xdma_char *)file->private_data;
+	struct xdma_dev *lro;
+	struct xdma_engine *engine;
+	bool nonblock;
+	int rc;
+
+	BUG_ON(!lro_char);
+	BUG_ON(lro_char->magic != MAGIC_CHAR);
+	lro = lro_char->lro;
+	BUG_ON(!lro);
+	BUG_ON(lro->magic != MAGIC_DEVICE);
+
+	/* only the RX ring is read this way */
+	engine = lro_char->engine;
+	if (!engine || engine->dir_to_dev || !engine->rx_buffer ||
+	    !engine->rx_transfer_cyclic)
+		return -EINVAL;
+	if (READ_ONCE(engine->rx_map_file))
+		return -EBUSY;
+	if (iov_iter_count(to) == 0)
+		return 0;
+
+	/* module errors are reported as by char_sgdma_read() */
+	if (!lro->soft_source) {
+		rc = Q400CheckStatus(lro->bar[lro->user_bar_idx]);
+		if (rc < 0)
+			return rc;
+	}
+
+	nonblock = file->f_flags & O_NONBLOCK;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 13, 0)
+	nonblock = nonblock || (iocb->ki_flags & IOCB_NOWAIT);
+#endif
+	return char_sgdma_read_cyclic(file, to, iov_iter_count(to),
+				      CYCLIC_TO_ITER, nonblock);
+}
+
+/*
+ * garbage_to_read() - bytes to throw away after a mode switch, or after a
+ * reset in the current mode
+ */
+static unsigned int garbage_to_read(struct xdma_dev *lro)
+{
+	if (lro->switch_garbage)
+		return lro->switch_garbage;
+	if (lro->current_qrng_mode == QUANTIS_QRNG_MODE_SAMPLE)
+		return garbage_to_read_sample;
+	return garbage_to_read_rng;
+}
+
+/*
+ * garbage_flushed() - end the flush of a reset or of a mode switch
+ *
+ * Must be called with engine->lock held.
+ */
+static void garbage_flushed(struct xdma_engine *engine)
+{
+	struct xdma_dev *lro = engine->lro;
+
+	lro->no_garbage_to_read = true;
+	engine->rx_garbage = 0;
+	if (lro->switch_garbage) {
+		/* the bytes read from here on are of the new mode */
+		if (lro->soft_source ||
+		    Q400CheckMode(lro->bar[lro->user_bar_idx],
+				  lro->switch_mode) == 0)
+			lro->current_qrng_mode = lro->switch_mode;
+		lro->switch_garbage = 0;
+	}
+	WRITE_ONCE(lro->flush_us,
+		   ktime_us_delta(ktime_get(), lro->flush_begin));
+}
+
+/* engine_return_credits() - allow the engine to fill num_credit more blocks */
+static void engine_return_credits(struct xdma_engine *engine, int num_credit)
+{
+	this_cpu_add(engine->stats->credits, num_credit);
+	trace_xdma_credits(engine, num_credit);
+	engine->rx_credits_out += num_credit;
+	if (engine->lro->soft_source) {
+		atomic_add(num_credit, &engine->soft_credits);
+		if (engine->running)
+			mod_delayed_work_on(engine_service_cpu(engine),
+					    system_wq, &engine->soft_work, 0);
+		return;
+	}
+	iowrite32(num_credit, &engine->sgdma_regs->credits);
+}
+
+/* ring_fill_blocks() - blocks CREDIT_POLICY_FILL keeps ahead of the readers */
+static int ring_fill_blocks(struct xdma_engine *engine)
+{
+	int fill = engine->rx_blocks * engine->credit_fill / 100;
+
+	/* a full ring would look like an overrun */
+	return clamp(fill, 1, engine->rx_blocks - 1);
+}
+
+/* ring_initial_credits() - credits of the card when the ring is set up */
+static int ring_initial_credits(struct xdma_engine *engine)
+{
+	if (engine->credit_policy == CREDIT_POLICY_FILL)
+		return ring_fill_blocks(engine);
+	return RX_BUF_CREDITS(engine);
+}
+
+/*
+ * ring_refill() - top the RX ring up to its fill level
+ *
+ * With CREDIT_POLICY_FILL the card gets its credits back as its blocks
+ * complete rather than as they are read, so that the blocks received and
+ * those credited add up to the fill level whether readers are there or not,
+ * and read() only copies. Credits go back once an eighth of the fill level
+ * is missing, or at once when the card has none left. With
+ * CREDIT_POLICY_READ, and while the ring is mapped, the readers give the
+ * credits back instead. Must be called with engine->lock held.
+ */
+static void ring_refill(struct xdma_engine *engine)
+{
+	int fill;
+	int missing;
+
+	if (engine->credit_policy != CREDIT_POLICY_FILL || engine->rx_mapped)
+		return;
+
+	fill = ring_fill_blocks(engine);
+	missing = fill - cyclic_received(engine) - engine->rx_credits_out;
+	if (missing <= 0)
+		return;
+	if (engine->rx_credits_out > 0 && missing < max(fill / 8, 1))
+		return;
+
+	engine_return_credits(engine, missing);
+}
+
+/*
+ * char_sgdma_poll() - readiness of the RX ring for poll(), select and epoll
+ *
+ * Readable once received bytes wait to be claimed, or the mapped ring holds
+ * unreleased blocks. In poll_mode nothing wakes the wait
+ * queue, so the device is always reported readable.
+ */
+static unsigned int char_sgdma_poll(struct file *file, poll_table *wait)
+{
+	struct xdma_char *lro_char;
+	struct xdma_engine *engine;
+	unsigned int mask = 0;
+
+	lro_char = (struct xdma_char *)file->private_data;
+	BUG_ON(!lro_char);
+	BUG_ON(lro_char->magic != MAGIC_CHAR);
+
+	engine = lro_char->engine;
+	if (!engine || !engine->rx_transfer_cyclic)
+		return POLLERR;
+
+	poll_wait(file, &engine->rx_transfer_cyclic->wq, wait);
+
+	if (poll_mode && !engine->lro->soft_source)
+		mask |= POLLIN | POLLRDNORM;
+	else if (engine->rx_mapped)
+		mask |= (READ_ONCE(engine->rx_published) !=
+			 READ_ONCE(engine->rx_ctrl->consumer)) ?
+				POLLIN | POLLRDNORM :
+				0;
+	else if (cyclic_data_ready(engine))
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
+static struct quantis_ring_ctrl *ring_ctrl_alloc(struct xdma_engine *engine)
+{
+	struct quantis_ring_ctrl *ctrl;
+
+	BUILD_BUG_ON(sizeof(struct quantis_ring_ctrl) +
+			     RX_BUF_PAGES_MAX * sizeof(__u32) >
+		     QUANTIS_RING_CTRL_SIZE);
+
+	/* rvmalloc()ed so that it can be mapped like the ring */
+	ctrl = rvmalloc(QUANTIS_RING_CTRL_SIZE);
+	if (ctrl == NULL) {
+		dbg_tfr("rvmalloc(%d) failed\n", QUANTIS_RING_CTRL_SIZE);
+		return NULL;
+	}
+	memset(ctrl, 0, QUANTIS_RING_CTRL_SIZE);
+	ctrl->version = QUANTIS_RING_VERSION;
+	ctrl->block_size = engine->rx_block;
+	ctrl->block_count = engine->rx_blocks;
+
+	return ctrl;
+}
+
+static void ring_ctrl_free(struct quantis_ring_ctrl *ctrl)
+{
+	if (ctrl)
+		rvfree(ctrl, QUANTIS_RING_CTRL_SIZE);
+}
+
+/*
+ * ring_return_credits() - give the blocks released by user space back to
+ * the card
+ *
+ * Only the consumer index is taken from the control block, the other indices
+ * are kept by the driver so that user space cannot give back more than was
+ * published. Must be called with engine->lock held.
+ */
+static void ring_return_credits(struct xdma_engine *engine)
+{
+	struct quantis_ring_ctrl *ctrl = engine->rx_ctrl;
+	u32 held = engine->rx_published - engine->rx_credited;
+	u32 released = READ_ONCE(ctrl->consumer) - engine->rx_credited;
+
+	if (released > held)
+		released = held;
+	if (released == 0)
+		return;
+
+	engine->rx_credited += released;
+	WRITE_ONCE(ctrl->credited, engine->rx_credited);
+	engine_return_credits(engine, released);
+}
+
+/*
+ * ring_publish() - hand the received blocks over to the mapped ring
+ *
+ * Checks the results like complete_cyclic() does, but instead of copying
+ * the blocks it publishes their length in the control block and moves the
+ * producer index. Faulty blocks and the garbage left after a reset are
+ * published with a zero length, so that the producer index always matches
+ * the position in the ring. Must be called with engine->lock held.
+ */
+static void ring_publish(struct xdma_engine *engine)
+{
+	struct xdma_dev *lro = engine->lro;
+	struct quantis_ring_ctrl *ctrl = engine->rx_ctrl;
+	struct xdma_result *result;
+	u32 len;
+
+	result = (struct xdma_result *)engine->rx_result_buffer_virt;
+	BUG_ON(!result);
+
+	while (engine->rx_head != engine->rx_tail || engine->rx_overrun) {
+		len = result[engine->rx_head].length;
+
+		if ((result[engine->rx_head].status >> 16) != C2H_WB ||
+		    len == 0 || len > engine->rx_block) {
+			dbg_tfr("faulty result at engine->rx_head=%d\n",
+				engine->rx_head);
+			ctrl->errors++;
+			this_cpu_inc(engine->stats->faults);
+			len = 0;
+		} else if (!lro->no_garbage_to_read) {
+			/* the flush is counted from the end of the reset */
+			if (lro->reset_pending ||
+			    engine->rx_garbage < garbage_to_read(lro)) {
+				engine->rx_garbage += len;
+				this_cpu_add(engine->stats->garbage, len);
+				len = 0;
+			} else {
+				garbage_flushed(engine);
+			}
+		}
+
+		ctrl->length[engine->rx_head] = len;
+		result[engine->rx_head].status = 0;
+		result[engine->rx_head].length = 0;
+		engine->rx_head = (engine->rx_head + 1) % engine->rx_blocks;
+		engine->rx_overrun = 0;
+		engine->rx_published++;
+	}
+
+	/* lengths are visible before the blocks are */
+	smp_store_release(&ctrl->producer, engine->rx_published);
+
+	ring_return_credits(engine);
+}
+
+/* ring_owned() - check that file has the ring mapped */
+static bool ring_owned(struct file *file, struct xdma_engine *engine)
+{
+	return READ_ONCE(engine->rx_mapped) &&
+	       READ_ONCE(engine->rx_map_file) == file;
+}
+
+/*
+ * ring_wait_ioctl() - give back the released blocks of the mapped ring
+ *
+ * If wait is set, then waits for the ring to hold unreleased blocks. Only
+ * the file that mapped the ring may move its consumer index; -EINVAL for
+ * the others, and once the ring got unmapped while waiting.
+ */
+static long ring_wait_ioctl(struct file *file, struct xdma_engine *engine,
+			    bool wait)
+{
+	struct quantis_ring_ctrl *ctrl;
+	int rc = 0;
+
+	if (!engine)
+		return -EINVAL;
+
+	spin_lock(&engine->lock);
+	if (!engine->rx_mapped || engine->rx_map_file != file) {
+		spin_unlock(&engine->lock);
+		return -EINVAL;
+	}
+	ctrl = engine->rx_ctrl;
+	ring_return_credits(engine);
+	spin_unlock(&engine->lock);
+
+	while (wait && READ_ONCE(engine->rx_published) == READ_ONCE(ctrl->consumer)) {
+		/* ring_vm_close() wakes the waiters */
+		if (!ring_owned(file, engine))
+			return -EINVAL;
+		if (poll_mode && !engine->lro->soft_source) {
+			rc = engine_service_poll(engine, 0);
+			if (rc) {
+				dbg_tfr("engine_service_poll() = %d\n", rc);
+				return -ERESTARTSYS;
+			}
+		} else {
+			rc = wait_event_interruptible(
+				engine->rx_transfer_cyclic->wq,
+				READ_ONCE(engine->rx_published) !=
+						READ_ONCE(ctrl->consumer) ||
+					!ring_owned(file, engine));
+			if (rc)
+				return rc;
+		}
+	}
+
+	return 0;
+}
+
+static void ring_vm_open(struct vm_area_struct *vma)
+{
+	struct xdma_engine *engine = vma->vm_private_data;
+	struct quantis_ring_ctrl *ctrl = engine->rx_ctrl;
+	u32 skip;
+
+	spin_lock(&engine->lock);
+	if (engine->rx_mapped++ == 0) {
+		engine->rx_map_file = vma->vm_file;
+		/* the rest of a block read() started on cannot be published */
+		if (engine->rx_claim_offset > 0) {
+			engine->rx_claim_offset = 0;
+			engine->rx_claimed++;
+			cyclic_free_blocks(engine);
+		}
+		/* blocks read() went through, so that indices match the ring */
+		skip = (engine->rx_head + engine->rx_blocks -
+			engine->rx_published % engine->rx_blocks) %
+		       engine->rx_blocks;
+		engine->rx_published += skip;
+		engine->rx_credited = engine->rx_published;
+		ctrl->credited = engine->rx_published;
+		ctrl->consumer = engine->rx_published;
+		ctrl->producer = engine->rx_published;
+		/* what was received before the mapping */
+		ring_publish(engine);
+	}
+	spin_unlock(&engine->lock);
+}
+
+static void ring_vm_close(struct vm_area_struct *vma)
+{
+	struct xdma_engine *engine = vma->vm_private_data;
+
+	spin_lock(&engine->lock);
+	if (--engine->rx_mapped == 0) {
+		/* blocks still held by the reader go back to the card */
+		WRITE_ONCE(engine->rx_ctrl->consumer, engine->rx_published);
+		ring_return_credits(engine);
+		engine->rx_map_file = NULL;
+		/* RING_WAIT callers stop waiting for a ring that is gone */
+		wake_up_interruptible(&engine->rx_transfer_cyclic->wq);
+	}
+	spin_unlock(&engine->lock);
+}
+
+/*
+ * char_sgdma_mmap() - map the RX ring or its control block
+ *
+ * The ring is mapped read-only at QUANTIS_RING_DATA_OFFSET and the control
+ * block read-write at QUANTIS_RING_CTRL_OFFSET, see quantis_ioctl.h. While
+ * the ring is mapped, read() fails with -EBUSY. Only one open file may map
+ * the ring at a time, and not while readers copy from it, so that the same
+ * bytes are never handed out twice.
+ */
+static int char_sgdma_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct xdma_char *lro_char;
+	struct xdma_engine *engine;
+	unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long addr;
+	char *mem;
+	int rc = 0;
+
+	lro_char = (struct xdma_char *)file->private_data;
+	BUG_ON(!lro_char);
+	BUG_ON(lro_char->magic != MAGIC_CHAR);
+
+	engine = lro_char->engine;
+	if (!engine || engine->dir_to_dev || !engine->streaming)
+		return -ENODEV;
+
+	if (offset == QUANTIS_RING_CTRL_OFFSET) {
+		if (size != QUANTIS_RING_CTRL_SIZE)
+			return -EINVAL;
+	} else if (offset == QUANTIS_RING_DATA_OFFSET) {
+		/* the size of the ring is checked once it is known to exist */
+		/* only the card writes to the ring */
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	} else {
+		return -EINVAL;
+	}
+
+	if (mutex_lock_interruptible(&(lro_char->device_mutex))) {
+		return -ERESTARTSYS;
+	}
+
+	if (!engine->rx_buffer || !engine->rx_ctrl) {
+		rc = -ENODEV;
+		goto out;
+	}
+	if (offset == QUANTIS_RING_DATA_OFFSET && size != RX_BUF_SIZE(engine)) {
+		rc = -EINVAL;
+		goto out;
+	}
+
+	/* taken before mapping, so that no reader claims bytes meanwhile */
+	spin_lock(&engine->lock);
+	if (engine->rx_map_file && engine->rx_map_file != file)
+		rc = -EBUSY;
+	else if (!engine->rx_map_file && engine->rx_readers > 0)
+		rc = -EBUSY;
+	else
+		engine->rx_map_file = file;
+	spin_unlock(&engine->lock);
+	if (rc)
+		goto out;
+
+	if (offset == QUANTIS_RING_CTRL_OFFSET)
+		mem = (char *)engine->rx_ctrl;
+	else
+		mem = engine->rx_buffer;
+
+	/* vmalloc()ed or vmap()ed memory, mapped page by page */
+	for (addr = vma->vm_start; addr < vma->vm_end; addr += PAGE_SIZE) {
+		rc = remap_pfn_range(vma, addr, vmalloc_to_pfn(mem), PAGE_SIZE,
+				     vma->vm_page_prot);
+		if (rc) {
+			dbg_tfr("remap_pfn_range() = %d\n", rc);
+			spin_lock(&engine->lock);
+			if (engine->rx_mapped == 0)
+				engine->rx_map_file = NULL;
+			spin_unlock(&engine->lock);
+			goto out;
+		}
+		mem += PAGE_SIZE;
+	}
+
+	/* the blocks must not be shared with a child either */
+	vma->vm_flags |= VMEM_FLAGS | VM_DONTCOPY;
+	vma->vm_ops = &ring_vm_ops;
+	vma->vm_private_data = engine;
+	ring_vm_open(vma);
+
+out:
+	mutex_unlock(&(lro_char->device_mutex));
+
+	return rc;
+}
+
+/* ring_reset() - start the indices of a new RX ring, under engine->lock */
+static void ring_reset(struct xdma_engine *engine)
+{
+	engine->rx_tail = 0;
+	engine->rx_head = 0;
+	engine->rx_overrun = 0;
+	engine->eop_found = 0;
+	engine->rx_claimed = 0;
+	engine->rx_claim_offset = 0;
+	engine->rx_readers = 0;
+	memset(engine->rx_copies, 0, sizeof(engine->rx_copies));
+	engine->rx_published = 0;
+	engine->rx_credited = 0;
+	engine->rx_credits_out = 0;
+	engine->rx_garbage = 0;
+}
+
+/* ring_chunks_free() - unmap and free the chunks of the RX ring */
+static void ring_chunks_free(struct xdma_engine *engine)
+{
+	struct pci_dev *pdev = engine->lro->pci_dev;
+	size_t chunk = PAGE_SIZE << engine->rx_chunk_order;
+	int i, j;
+
+	for (i = 0; i < engine->rx_chunks_mapped; i++)
+		pci_unmap_page(pdev, engine->rx_chunks_bus[i], chunk,
+			       PCI_DMA_FROMDEVICE);
+	engine->rx_chunks_mapped = 0;
+
+	for (i = 0; engine->rx_chunks && i < engine->rx_chunk_count; i++) {
+		if (!engine->rx_chunks[i])
+			break;
+		for (j = 0; j < (1 << engine->rx_chunk_order); j++)
+			ClearPageReserved(engine->rx_chunks[i] + j);
+		__free_pages(engine->rx_chunks[i], engine->rx_chunk_order);
+	}
+	kfree(engine->rx_chunks);
+	engine->rx_chunks = NULL;
+	kfree(engine->rx_chunks_bus);
+	engine->rx_chunks_bus = NULL;
+	engine->rx_chunk_count = 0;
+}
+
+/*
+ * ring_chunks_alloc() - allocate the RX ring in chunks of 2^order pages
  *
- * @buf userspace buffer
- * @count number of bytes in the userspace buffer
- * @garbage_count the number of bytes th throw away
- * 
- * Use the userspace buffer to store the garbage to simplify integration with the rest of the code. This not ideal.
+ * Chunks larger than a block are only tried, without retrying nor warning.
  */
-static ssize_t char_xdma_throw_garbage(struct file *file, char __user *buf,
-				       size_t count, loff_t *user_pos,
-				       size_t garbage_count)
-{
-	ssize_t ret_sz = 0;
-	size_t remaining = garbage_count;
-	loff_t pos = *user_pos;
-
-	while (ret_sz >= 0 && remaining != 0) {
-		if (count > remaining) {
-			count = remaining;
-		}
-		ret_sz = char_xdma_read(file, buf, count, &pos);
+static int ring_chunks_alloc(struct xdma_engine *engine, int order, gfp_t gfp)
+{
+	int i, j;
+
+	engine->rx_chunk_order = order;
+	engine->rx_chunk_count = RX_BUF_SIZE(engine) >> (PAGE_SHIFT + order);
+	engine->rx_chunks = kcalloc(engine->rx_chunk_count,
+				    sizeof(*engine->rx_chunks), GFP_KERNEL);
+	engine->rx_chunks_bus = kcalloc(engine->rx_chunk_count,
+					sizeof(*engine->rx_chunks_bus),
+					GFP_KERNEL);
+	if (!engine->rx_chunks || !engine->rx_chunks_bus)
+		goto fail;
 
-		if (ret_sz > remaining) {
-			remaining = 0;
-		} else {
-			remaining -= ret_sz;
-		}
-		pos = *user_pos;
+	if (order > get_order(engine->rx_block))
+		gfp |= __GFP_NORETRY | __GFP_NOWARN;
+	for (i = 0; i < engine->rx_chunk_count; i++) {
+		engine->rx_chunks[i] =
+			alloc_pages_node(engine->lro->node, gfp, order);
+		if (!engine->rx_chunks[i])
+			goto fail;
+		/* mapped in user space with remap_pfn_range() */
+		for (j = 0; j < (1 << order); j++)
+			SetPageReserved(engine->rx_chunks[i] + j);
 	}
-	return ret_sz;
+
+	return 0;
+
+fail:
+	ring_chunks_free(engine);
+	return -ENOMEM;
 }
 
-/* char_sgdma_read() - Read from the device
- *
- * @buf userspace buffer
- * @count number of bytes in the userspace buffer
- *
- * Iterate over the userspace buffer, taking at most 255 * PAGE_SIZE bytes for
- * each DMA transfer.
+/*
+ * ring_buffer_alloc() - allocate the RX ring with the geometry of the engine
  *
- * For each transfer, get the user pages, build a sglist, map, build a
- * descriptor table, submit the transfer, wait for the interrupt handler
- * to wake us on completion, free the sglist and descriptors.
+ * The ring is made of physically contiguous chunks, as large as
+ * RX_BUF_CHUNK_MAX when memory allows and of one block otherwise, so that a
+ * block never spans two chunks and is filled through a single descriptor.
+ * The chunks are mapped one after the other in the kernel, for the copies
+ * and for mmap(), and mapped for DMA for a card.
  */
-static ssize_t char_sgdma_read(struct file *file, char __user *buf,
-			       size_t count, loff_t *pos)
-{
-	ssize_t ret_sz;
+static int ring_buffer_alloc(struct xdma_engine *engine)
+{
+	struct pci_dev *pdev = engine->lro->pci_dev;
+	size_t size = RX_BUF_SIZE(engine);
+	int order = get_order(engine->rx_block);
+	gfp_t gfp = GFP_KERNEL | __GFP_ZERO;
+	struct page **pages;
+	int i, j;
+	int rc;
 
-	struct xdma_dev *lro;
-	struct xdma_char *lro_char = (struct xdma_char *)file->private_data;
-	BUG_ON(!lro_char);
-	BUG_ON(lro_char->magic != MAGIC_CHAR);
-	lro = lro_char->lro;
-	BUG_ON(!lro);
-	BUG_ON(lro->magic != MAGIC_DEVICE);
+	/* the card may not reach above 4 GiB, as with vmalloc_32() */
+	if (pdev && dma_get_mask(&pdev->dev) <= DMA_BIT_MASK(32))
+		gfp |= GFP_DMA32;
+
+	rc = -ENOMEM;
+	if (rx_ring_contiguous)
+		rc = ring_chunks_alloc(
+			engine,
+			max_t(int, order,
+			      get_order(min_t(size_t, size, RX_BUF_CHUNK_MAX))),
+			gfp);
+	if (rc)
+		rc = ring_chunks_alloc(engine, order, gfp);
+	if (rc)
+		return rc;
+	dbg_init("RX ring of %d chunks of order %d\n", engine->rx_chunk_count,
+		 engine->rx_chunk_order);
 
-	if (mutex_lock_interruptible(&(lro_char->device_mutex))) {
-		return -ERESTARTSYS;
-	}
+	pages = kcalloc(size >> PAGE_SHIFT, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		goto fail;
+	for (i = 0; i < engine->rx_chunk_count; i++)
+		for (j = 0; j < (1 << engine->rx_chunk_order); j++)
+			pages[(i << engine->rx_chunk_order) + j] =
+				engine->rx_chunks[i] + j;
+	engine->rx_buffer =
+		vmap(pages, size >> PAGE_SHIFT, VM_MAP, PAGE_KERNEL);
+	kfree(pages);
+	if (!engine->rx_buffer)
+		goto fail;
 
-	ret_sz = 0;
-	if (!(lro->no_garbage_to_read)) {
-		if (lro->current_qrng_mode == QUANTIS_QRNG_MODE_SAMPLE) { // sample
-			ret_sz = char_xdma_throw_garbage(file, buf, count, pos,
-						 garbage_to_read_sample);
-		}
-		else { // RNG
-			ret_sz = char_xdma_throw_garbage(file, buf, count, pos,
-						 garbage_to_read_rng);
-		}
-		if (ret_sz >= 0) {
-			lro->no_garbage_to_read = true;
-		}
+	for (i = 0; pdev && i < engine->rx_chunk_count; i++) {
+		engine->rx_chunks_bus[i] =
+			pci_map_page(pdev, engine->rx_chunks[i], 0,
+				     PAGE_SIZE << engine->rx_chunk_order,
+				     PCI_DMA_FROMDEVICE);
+		if (pci_dma_mapping_error(pdev, engine->rx_chunks_bus[i]))
+			goto fail;
+		engine->rx_chunks_mapped++;
 	}
 
-	if (ret_sz >= 0) {
-		ret_sz = char_xdma_read(file, buf, count, pos);
-	}
+	return 0;
 
-	mutex_unlock(&(lro_char->device_mutex));
+fail:
+	ring_buffer_free(engine, engine->rx_buffer);
+	engine->rx_buffer = NULL;
+	return -ENOMEM;
+}
 
-	return ret_sz;
+/* ring_buffer_free() - free the RX ring, buffer being its kernel mapping */
+static void ring_buffer_free(struct xdma_engine *engine, void *buffer)
+{
+	if (buffer)
+		vunmap(buffer);
+	ring_chunks_free(engine);
 }
 
-/* char_xdma_read() - Read for skrng
- *
- * @buf userspace buffer
- * @count number of bytes in the userspace buffer
- *
- * Iterate over the userspace buffer, taking at most 255 * PAGE_SIZE bytes for
- * each DMA transfer.
- *
- * For each transfer, get the user pages, build a sglist, map, build a
- * descriptor table, submit the transfer, wait for the interrupt handler
- * to wake us on completion, free the sglist and descriptors.
- *
- * If there is still bytes available in the fifo, they are used first.
+/*
+ * ring_transfer_create() - the cyclic transfer filling the RX ring, with one
+ * descriptor per block
  */
-static ssize_t char_xdma_read(struct file *file, char __user *buf, size_t count,
-			      loff_t *pos)
+static struct xdma_transfer *ring_transfer_create(struct xdma_engine *engine)
 {
-	int rc_len;
-	struct xdma_char *lro_char;
-	struct xdma_dev *lro;
-	struct xdma_engine *engine;
-	unsigned int fifo_copied = 0;
-
-	/* fetch device specific data stored earlier during open */
-	lro_char = (struct xdma_char *)file->private_data;
-	BUG_ON(!lro_char);
-	BUG_ON(lro_char->magic != MAGIC_CHAR);
-
-	lro = lro_char->lro;
-	BUG_ON(!lro);
-	BUG_ON(lro->magic != MAGIC_DEVICE);
+	struct xdma_transfer *transfer;
+	int per_chunk;
+	dma_addr_t addr;
+	int i;
 
-	engine = lro_char->engine;
+	/* blocks per chunk, a block never spans two chunks */
+	per_chunk = (PAGE_SIZE << engine->rx_chunk_order) / engine->rx_block;
 
-	BUG_ON(!engine);
-	BUG_ON(engine->magic != MAGIC_ENGINE);
+	transfer = kzalloc(sizeof(struct xdma_transfer), GFP_KERNEL);
+	if (!transfer)
+		return NULL;
 
-#if USE_FIFO
-	rc_len = kfifo_to_user(&lro->remaining_bytes, buf, count, &fifo_copied);
-	if (rc_len < 0) {
-		return rc_len;
+	transfer->desc_virt = xdma_desc_alloc(engine->lro->pci_dev,
+					      engine->rx_blocks,
+					      &transfer->desc_bus, NULL);
+	if (!transfer->desc_virt) {
+		kfree(transfer);
+		return NULL;
 	}
-#endif
-	if (count - fifo_copied > 0) {
-		if (!engine->dir_to_dev && engine->rx_buffer &&
-		    engine->rx_transfer_cyclic) {
-			rc_len = char_sgdma_read_cyclic(file, buf + fifo_copied,
-							count - fifo_copied);
+	transfer->sgl_nents = engine->rx_blocks;
+	transfer->desc_num = transfer->desc_adjacent = engine->rx_blocks;
 
-		} else {
-			rc_len = char_sgdma_read_write(file, buf + fifo_copied,
-						       count - fifo_copied, pos,
-						       0);
-		}
-	}
-	if (rc_len >= 0) {
-		rc_len += fifo_copied;
+	for (i = 0; i < engine->rx_blocks; i++) {
+		addr = engine->rx_chunks_bus[i / per_chunk] +
+		       (dma_addr_t)(i % per_chunk) * engine->rx_block;
+		xdma_desc_set(transfer->desc_virt + i, addr, 0,
+			      engine->rx_block, engine->dir_to_dev);
+		xdma_desc_adjacent(transfer->desc_virt + i,
+				   engine->rx_blocks - i - 1);
 	}
-	return rc_len;
+
+	init_waitqueue_head(&transfer->wq);
+
+	return transfer;
 }
 
 static int cyclic_transfer_setup(struct xdma_engine *engine)
 {
 	int rc;
 	struct xdma_dev *lro;
+	struct quantis_ring_ctrl *ctrl;
+	struct xdma_transfer *transfer;
+	u8 *result;
+	dma_addr_t result_bus;
 	u32 w = XDMA_DESC_EOP | XDMA_DESC_COMPLETED;
 
 	BUG_ON(!engine);
 	lro = engine->lro;
 	BUG_ON(!lro);
 
-	spin_lock(&engine->lock);
-
 	if (engine->rx_buffer) {
 		dbg_tfr("Channel already open, cannot open twice\n");
-		spin_unlock(&engine->lock);
 		return -EBUSY;
 	}
 
-	engine->rx_tail = 0;
-	engine->rx_head = 0;
-	engine->rx_overrun = 0;
-	engine->eop_found = 0;
-	engine->user_buffer_index = 0;
+	/* the geometry set through sysfs applies from now on */
+	engine->rx_block = engine->rx_block_next;
+	engine->rx_blocks = engine->rx_blocks_next;
 
-	engine->rx_buffer = rvmalloc(RX_BUF_SIZE);
-	if (engine->rx_buffer == NULL) {
-		dbg_tfr("rvmalloc(%d) failed\n", RX_BUF_SIZE);
-		spin_unlock(&engine->lock);
+	/* allocated before the lock, as it may sleep */
+	ctrl = ring_ctrl_alloc(engine);
+	if (ctrl == NULL)
 		return -ENOMEM;
-	}
 
+	rc = ring_buffer_alloc(engine);
+	if (rc) {
+		dbg_tfr("ring_buffer_alloc(%zu) failed\n", RX_BUF_SIZE(engine));
+		goto fail_buffer;
+	}
 	dbg_init("engine->rx_buffer = %p\n", engine->rx_buffer);
-	engine->rx_transfer_cyclic =
-		transfer_create(lro, engine->rx_buffer, RX_BUF_SIZE, 0,
-				engine->dir_to_dev, 0, 1, 0);
-	if (engine->rx_buffer == NULL) {
-		dbg_tfr("transfer_create(%d) failed\n", RX_BUF_SIZE);
-		rc = -EINVAL;
+
+	transfer = ring_transfer_create(engine);
+	if (transfer == NULL) {
+		dbg_tfr("ring_transfer_create(%d) failed\n", engine->rx_blocks);
+		rc = -ENOMEM;
 		goto fail_transfer;
 	}
 
-	engine->rx_result_buffer_virt =
-		pci_alloc_consistent(lro->pci_dev, RX_RESULT_BUF_SIZE,
-				     &engine->rx_result_buffer_bus);
-
-	if (engine->rx_result_buffer_virt == NULL) {
-		dbg_tfr("pci_alloc_consistent(%d) failed\n", RX_BUF_SIZE);
+	result = pci_alloc_consistent(lro->pci_dev, RX_RESULT_BUF_SIZE(engine),
+				      &result_bus);
+	if (result == NULL) {
+		dbg_tfr("pci_alloc_consistent(%zu) failed\n",
+			RX_RESULT_BUF_SIZE(engine));
 		rc = -ENOMEM;
 		goto fail_result_buffer;
 	}
+	memset(result, 0, RX_RESULT_BUF_SIZE(engine));
+
+	spin_lock(&engine->lock);
+
+	ring_reset(engine);
+	if (enable_credit_mp)
+		engine->rx_credits_out = ring_initial_credits(engine);
+	engine->rx_ctrl = ctrl;
+	engine->rx_transfer_cyclic = transfer;
+	engine->rx_result_buffer_virt = result;
+	engine->rx_result_buffer_bus = result_bus;
 
 	dbg_init("engine->rx_result_buffer_virt = %p\n",
 		 engine->rx_result_buffer_virt);
@@ -3538,8 +5160,7 @@ static int cyclic_transfer_setup(struct xdma_engine *engine)
 
 	/* write initial credits */
 	if (enable_credit_mp) {
-		//iowrite32(RX_BUF_PAGES,&engine->sgdma_regs->credits);
-		iowrite32(128, &engine->sgdma_regs->credits);
+		iowrite32(engine->rx_credits_out, &engine->sgdma_regs->credits);
 	}
 
 	/* start cyclic transfer */
@@ -3550,12 +5171,12 @@ static int cyclic_transfer_setup(struct xdma_engine *engine)
 
 	/* unwind on errors */
 fail_result_buffer:
-	transfer_destroy(engine->lro, engine->rx_transfer_cyclic);
-	engine->rx_transfer_cyclic = NULL;
+	transfer_destroy(lro, transfer);
 fail_transfer:
-	rvfree(engine->rx_buffer, RX_BUF_SIZE);
+	ring_buffer_free(engine, engine->rx_buffer);
 	engine->rx_buffer = NULL;
-	spin_unlock(&engine->lock);
+fail_buffer:
+	ring_ctrl_free(ctrl);
 
 	return rc;
 }
@@ -3577,6 +5198,14 @@ static int char_sgdma_open(struct inode *inode, struct file *file)
 	lro = lro_char->lro;
 	BUG_ON(!lro);
 
+	/* the ring runs once the card is ready, see card_init_work() */
+	if (!completion_done(&lro->init_done)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_for_completion_interruptible(&lro->init_done))
+			return -ERESTARTSYS;
+	}
+
 	if (mutex_lock_interruptible(&(lro_char->device_mutex))) {
 		return -ERESTARTSYS;
 	}
@@ -3590,11 +5219,7 @@ static int char_sgdma_open(struct inode *inode, struct file *file)
 
 	dbg_tfr("char_sgdma_open(0x%p, 0x%p)\n", inode, file);
 
-	lro_char->users += 1;
-
-	/* AXI ST C2H? Set up RX ring buffer on host with a cyclic transfer */
-	if (lro_char->users == 1 && engine->streaming && !engine->dir_to_dev)
-		rc = cyclic_transfer_setup(engine);
+	rc = ring_get(lro_char);
 
 	mutex_unlock(&(lro_char->device_mutex));
 
@@ -3655,6 +5280,9 @@ static int cyclic_transfer_teardown(struct xdma_engine *engine)
 	int rc;
 	struct xdma_dev *lro;
 	struct xdma_transfer *transfer;
+	struct quantis_ring_ctrl *ctrl;
+	void *buffer;
+	u8 *result;
 
 	BUG_ON(!engine);
 	lro = engine->lro;
@@ -3680,27 +5308,40 @@ static int cyclic_transfer_teardown(struct xdma_engine *engine)
 		rc = cyclic_shutdown_polled(engine);
 	else
 		rc = cyclic_shutdown_interrupt(engine);
+	/* the ring is freed below, the engine must have stopped writing */
+	if (rc)
+		rc = cyclic_shutdown_polled(engine);
+
+	/* a poll may still be due if the wait was interrupted */
+	hrtimer_cancel(&engine->poll_timer);
 
 	/* obtain spin lock to atomically remove resources */
 	spin_lock(&engine->lock);
-
-	if (engine->rx_transfer_cyclic) {
-		transfer_destroy(engine->lro, engine->rx_transfer_cyclic);
-		engine->rx_transfer_cyclic = NULL;
-	}
-	if (engine->rx_buffer) {
-		rvfree(engine->rx_buffer, RX_BUF_SIZE);
-		engine->rx_buffer = NULL;
+	if (engine->polling) {
+		engine->polling = 0;
+		engine->poll_idle = 0;
+		engine_interrupts_resume(engine);
 	}
-	if (engine->rx_result_buffer_virt) {
+	transfer = engine->rx_transfer_cyclic;
+	engine->rx_transfer_cyclic = NULL;
+	buffer = engine->rx_buffer;
+	engine->rx_buffer = NULL;
+	result = engine->rx_result_buffer_virt;
+	engine->rx_result_buffer_virt = NULL;
+	ctrl = engine->rx_ctrl;
+	engine->rx_ctrl = NULL;
+	spin_unlock(&engine->lock);
+
+	/* freed without the lock, as it may sleep */
+	if (transfer)
+		transfer_destroy(engine->lro, transfer);
+	ring_buffer_free(engine, buffer);
+	if (result) {
 		/* free contiguous list */
-		pci_free_consistent(lro->pci_dev, RX_RESULT_BUF_SIZE,
-				    engine->rx_result_buffer_virt,
-				    engine->rx_result_buffer_bus);
-		engine->rx_result_buffer_virt = NULL;
+		pci_free_consistent(lro->pci_dev, RX_RESULT_BUF_SIZE(engine),
+				    result, engine->rx_result_buffer_bus);
 	}
-
-	spin_unlock(&engine->lock);
+	ring_ctrl_free(ctrl);
 
 	return rc;
 }
@@ -3726,8 +5367,6 @@ static int char_sgdma_close(struct inode *inode, struct file *file)
 		return -ERESTARTSYS;
 	}
 
-	lro_char->users -= 1;
-
 	/* fetch device specific data stored earlier during open */
 	engine = lro_char->engine;
 	BUG_ON(!engine);
@@ -3735,13 +5374,233 @@ static int char_sgdma_close(struct inode *inode, struct file *file)
 
 	dbg_tfr("char_sgdma_close(0x%p, 0x%p)\n", inode, file);
 
-	if (lro_char->users == 0 && engine->streaming && !engine->dir_to_dev)
-		rc = cyclic_transfer_teardown(engine);
+	rc = ring_put(lro_char);
+
+	mutex_unlock(&(lro_char->device_mutex));
+
+	return rc;
+}
+
+/*
+ * ring_get() - count one more user of the char device, and for a C2H engine
+ * set up its RX ring buffer on host with a cyclic transfer if needed
+ *
+ * Users are the open files and the hw_random device.
+ * Must be called with lro_char->device_mutex held.
+ */
+static int ring_get(struct xdma_char *lro_char)
+{
+	struct xdma_engine *engine = lro_char->engine;
+	int rc = 0;
+
+	lro_char->users += 1;
+
+	if (lro_char->users == 1 && engine->streaming && !engine->dir_to_dev) {
+		/* the ring may still run since the last close, see
+		 * ring_idle_work(), which gives up once users is set */
+		cancel_delayed_work(&lro_char->idle_work);
+		if (engine->rx_transfer_cyclic)
+			rc = 0;
+		else if (lro_char->lro->soft_source)
+			rc = soft_transfer_setup(engine);
+		else
+			rc = cyclic_transfer_setup(engine);
+		/* no ring_put() follows a failed ring_get() */
+		if (rc)
+			lro_char->users -= 1;
+	}
+
+	return rc;
+}
+
+/*
+ * ring_put() - count one user less, the RX ring is kept for the next user
+ * unless idle for too long
+ *
+ * Must be called with lro_char->device_mutex held.
+ */
+static int ring_put(struct xdma_char *lro_char)
+{
+	struct xdma_engine *engine = lro_char->engine;
+	int rc = 0;
+
+	lro_char->users -= 1;
+
+	if (lro_char->users == 0 && engine->streaming && !engine->dir_to_dev) {
+		if (ring_idle_timeout == 0)
+			rc = ring_teardown(lro_char);
+		else if (ring_idle_timeout > 0)
+			schedule_delayed_work(
+				&lro_char->idle_work,
+				msecs_to_jiffies(ring_idle_timeout));
+	}
+
+	return rc;
+}
+
+/*
+ * ring_teardown() - stop the RX ring and free it, if it is set up
+ *
+ * Must be called with lro_char->device_mutex held.
+ */
+static int ring_teardown(struct xdma_char *lro_char)
+{
+	struct xdma_engine *engine = lro_char->engine;
+
+	if (!engine || !engine->rx_transfer_cyclic)
+		return 0;
+	if (lro_char->lro->soft_source)
+		return soft_transfer_teardown(engine);
+	return cyclic_transfer_teardown(engine);
+}
+
+/* ring_idle_work() - tear down the RX ring nobody opened again in time */
+static void ring_idle_work(struct work_struct *work)
+{
+	struct xdma_char *lro_char =
+		container_of(to_delayed_work(work), struct xdma_char, idle_work);
+
+	mutex_lock(&(lro_char->device_mutex));
+	if (lro_char->users == 0)
+		ring_teardown(lro_char);
+	mutex_unlock(&(lro_char->device_mutex));
+}
+
+#if IS_ENABLED(CONFIG_HW_RANDOM)
+/* card_hwrng_char() - the C2H char device whose ring feeds the hw_random device */
+static struct xdma_char *card_hwrng_char(struct hwrng *rng)
+{
+	struct xdma_dev *lro = container_of(rng, struct xdma_dev, hwrng);
+
+	return lro->sgdma_char_dev[0][1];
+}
+
+/* card_hwrng_init() - the card became the current hw_random device */
+static int card_hwrng_init(struct hwrng *rng)
+{
+	struct xdma_char *lro_char = card_hwrng_char(rng);
+	int rc;
+
+	mutex_lock(&(lro_char->device_mutex));
+	rc = ring_get(lro_char);
+	mutex_unlock(&(lro_char->device_mutex));
+
+	return rc;
+}
+
+static void card_hwrng_cleanup(struct hwrng *rng)
+{
+	struct xdma_char *lro_char = card_hwrng_char(rng);
 
+	mutex_lock(&(lro_char->device_mutex));
+	ring_put(lro_char);
 	mutex_unlock(&(lro_char->device_mutex));
+}
+
+/* longest card_hwrng_read() waits for the card, so that a card that stopped
+ * producing does not hold hwrng_unregister() forever */
+#define CARD_HWRNG_WAIT_MS 1000
+
+/*
+ * card_hwrng_read() - read for /dev/hwrng and the kernel entropy pool
+ *
+ * Claims from the RX ring like any reader of the char device, so both share
+ * the bytes without one of them waiting behind the other. Without wait, only
+ * what was received already is returned, possibly nothing. With wait, at
+ * most CARD_HWRNG_WAIT_MS before returning nothing. The bytes of a card
+ * whose modules failed are not credited as entropy: -EIO then. Neither are
+ * the raw samples of SAMPLE mode, nor anything while a reset or a mode
+ * switch is flushed: -EAGAIN then, so that the hw_random core backs off
+ * rather than polling.
+ */
+static int card_hwrng_read(struct hwrng *rng, void *data, size_t max,
+			   bool wait)
+{
+	struct xdma_engine *engine = card_hwrng_char(rng)->engine;
+	struct xdma_dev *lro = engine->lro;
+	long timeout;
+	int rc;
+
+	/* as char_sgdma_read() does */
+	if (!lro->soft_source) {
+		rc = Q400CheckStatus(lro->bar[lro->user_bar_idx]);
+		if (rc < 0)
+			return rc;
+	}
+	if (READ_ONCE(lro->current_qrng_mode) == QUANTIS_QRNG_MODE_SAMPLE ||
+	    !READ_ONCE(lro->no_garbage_to_read))
+		return -EAGAIN;
+
+	do {
+		if (!cyclic_data_ready(engine)) {
+			if (!wait)
+				return 0;
+			timeout = wait_event_interruptible_timeout(
+				engine->rx_transfer_cyclic->wq,
+				cyclic_data_ready(engine),
+				msecs_to_jiffies(CARD_HWRNG_WAIT_MS));
+			if (timeout < 0)
+				return timeout;
+			if (timeout == 0)
+				return 0;
+		}
+		rc = complete_cyclic(engine, data, max, CYCLIC_TO_KERNEL);
+	} while (rc == 0 && wait);
+
+	return rc;
+}
+
+/*
+ * card_hwrng_register() - make the card available through /dev/hwrng
+ *
+ * The RX ring only runs while the card is the current hw_random device or
+ * its char device is open.
+ */
+static int card_hwrng_register(struct xdma_dev *lro)
+{
+	int rc;
+
+	if (hwrng_quality == 0 || !lro->sgdma_char_dev[0][1])
+		return 0;
+
+	snprintf(lro->hwrng_name, sizeof(lro->hwrng_name), "quantis%d",
+		 lro->instance + device_file_first_index);
+	lro->hwrng.name = lro->hwrng_name;
+	lro->hwrng.init = card_hwrng_init;
+	lro->hwrng.cleanup = card_hwrng_cleanup;
+	lro->hwrng.read = card_hwrng_read;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 15, 0)
+	lro->hwrng.quality = min_t(unsigned int, hwrng_quality, 1024);
+#endif
+
+	rc = hwrng_register(&lro->hwrng);
+	if (rc) {
+		pr_err(DRV_NAME ": hwrng_register(%s) failed, rc = %d\n",
+		       lro->hwrng_name, rc);
+		return rc;
+	}
+	lro->hwrng_registered = true;
+
+	return 0;
+}
+
+static void card_hwrng_unregister(struct xdma_dev *lro)
+{
+	if (!lro->hwrng_registered)
+		return;
+	hwrng_unregister(&lro->hwrng);
+	lro->hwrng_registered = false;
+}
+#else
+static int card_hwrng_register(struct xdma_dev *lro)
+{
+	return 0;
+}
 
-	return rc;
+static void card_hwrng_unregister(struct xdma_dev *lro)
+{
 }
+#endif /* CONFIG_HW_RANDOM */
 
 /*
  * RTO - code to detect if MSI/MSI-X capability exists is derived
@@ -3786,14 +5645,17 @@ static struct xdma_dev *alloc_dev_instance(struct pci_dev *pdev)
 	BUG_ON(!pdev);
 
 	/* allocate zeroed device book keeping structure */
-	lro = kzalloc(sizeof(struct xdma_dev), GFP_KERNEL);
+	lro = kzalloc_node(sizeof(struct xdma_dev), GFP_KERNEL,
+			   dev_to_node(&pdev->dev));
 	if (!lro) {
 		dbg_init("Could not kzalloc(xdma_dev).\n");
 		return NULL;
 	}
-#if USE_FIFO
-	INIT_KFIFO(lro->remaining_bytes);
-#endif
+	lro->node = dev_to_node(&pdev->dev);
+	INIT_DELAYED_WORK(&lro->status_work, status_monitor_work);
+	init_waitqueue_head(&lro->status_wq);
+	INIT_WORK(&lro->init_work, card_init_work);
+	init_completion(&lro->init_done);
 	lro->magic = MAGIC_DEVICE;
 	lro->config_bar_idx = -1;
 	lro->user_bar_idx = -1;
@@ -4375,7 +6237,6 @@ static int probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	u32 w;
 	int stream;
 
-	struct xilinx_fpga_regs __iomem *user_reg = NULL;
 
 	enable_credit_mp = 1;
 
@@ -4419,6 +6280,8 @@ static int probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	if (rc)
 		goto unmap_bar;
 
+	perfmon_map(lro, pdev);
+
 	pcie_check_extended_tag(lro, pdev);
 
 	rc = set_dma_mask(pdev);
@@ -4447,10 +6310,6 @@ static int probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	if (rc)
 		goto rmv_interface;
 
-	user_reg = lro->bar[lro->user_bar_idx];
-	Q400RegInit(user_reg, lro->qrng_mode, lro->qrng_num);
-	lro->current_qrng_mode = lro->qrng_mode;
-
 	/* enable user interrupts */
 	user_interrupts_enable(lro, ~0);
 
@@ -4461,86 +6320,641 @@ static int probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	/* Flush writes */
 	read_interrupts(lro);
 
-	if (rc == 0)
-		return 0;
+	/* the FPGA and the sensors take half a second, not waited for here */
+	queue_work(system_unbound_wq, &lro->init_work);
+
+	if (rc == 0)
+		return 0;
+
+rmv_interface:
+	destroy_interfaces(lro);
+rmv_engine:
+	remove_engines(lro);
+disable_irq:
+	irq_teardown(lro);
+unmap_bar:
+	unmap_bars(lro, pdev);
+rel_region:
+	if (lro->got_regions) {
+		pci_release_regions(pdev);
+		lro->got_regions = 0;
+	}
+disable_msi:
+	if (lro->msix_enabled) {
+		pci_disable_msix(pdev);
+		lro->msix_enabled = 0;
+	} else if (lro->msi_enabled) {
+		pci_disable_msi(pdev);
+		lro->msi_enabled = 0;
+	}
+	if (!lro->regions_in_use)
+		pci_disable_device(pdev);
+free_alloc:
+	kfree(lro);
+
+	dev_present[lro->instance] = 0;
+	dbg_init("probe() returning %d\n", rc);
+	return -1;
+}
+
+/*
+ * rings_teardown() - stop the RX rings that outlived their last close
+ *
+ * ring_idle_timeout keeps the rings running after the last close. They must
+ * be stopped while the engine interrupts still come, as
+ * cyclic_shutdown_interrupt() waits for one.
+ */
+static void rings_teardown(struct xdma_dev *lro)
+{
+	struct xdma_char *lro_char;
+	int channel;
+	int dir;
+
+	for (channel = 0; channel < XDMA_CHANNEL_NUM_MAX; channel++) {
+		for (dir = 0; dir < 2; dir++) {
+			lro_char = lro->sgdma_char_dev[channel][dir];
+			if (!lro_char)
+				continue;
+			cancel_delayed_work_sync(&lro_char->idle_work);
+			mutex_lock(&(lro_char->device_mutex));
+			ring_teardown(lro_char);
+			mutex_unlock(&(lro_char->device_mutex));
+		}
+	}
+}
+
+static void remove(struct pci_dev *pdev)
+{
+	struct xdma_dev *lro;
+
+	dbg_sg("remove(0x%p)\n", pdev);
+	if ((pdev == NULL) || (dev_get_drvdata(&pdev->dev) == NULL)) {
+		dbg_sg("remove(dev = 0x%p) pdev->dev.driver_data = 0x%p\n",
+		       pdev, dev_get_drvdata(&pdev->dev));
+		return;
+	}
+	lro = (struct xdma_dev *)dev_get_drvdata(&pdev->dev);
+	dbg_sg("remove(dev = 0x%p) where pdev->dev.driver_data = 0x%p\n", pdev,
+	       lro);
+	if (lro->pci_dev != pdev) {
+		dbg_sg("pdev->dev.driver_data->pci_dev(0x%lx) != pdev(0x%lx)\n",
+		       (unsigned long)lro->pci_dev, (unsigned long)pdev);
+	}
+
+	/* a card still initializing registers its hwrng when done */
+	flush_work(&lro->init_work);
+	/* the ring must run until the hw_random core stopped reading */
+	card_hwrng_unregister(lro);
+	rings_teardown(lro);
+
+	channel_interrupts_disable(lro, ~0);
+	user_interrupts_disable(lro, ~0);
+	read_interrupts(lro);
+
+	cancel_delayed_work_sync(&lro->status_work);
+	destroy_interfaces(lro);
+	remove_engines(lro);
+	irq_teardown(lro);
+	unmap_bars(lro, pdev);
+
+	if (lro->got_regions)
+		pci_release_regions(pdev);
+
+	if (lro->msix_enabled) {
+		pci_disable_msix(pdev);
+		lro->msix_enabled = 0;
+	} else if (lro->msi_enabled) {
+		pci_disable_msi(pdev);
+		lro->msi_enabled = 0;
+	}
+
+	if (!lro->regions_in_use)
+		pci_disable_device(pdev);
+
+	dev_present[lro->instance] = 0;
+
+	kfree(lro);
+}
+
+/* garbage_remaining_show() - bytes still to flush after the last reset */
+static ssize_t garbage_remaining_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	struct xdma_engine *engine = lro_char->engine;
+	struct xdma_dev *lro = lro_char->lro;
+	unsigned int remaining = 0;
+
+	spin_lock(&engine->lock);
+	if (!lro->no_garbage_to_read &&
+	    engine->rx_garbage < garbage_to_read(lro))
+		remaining = garbage_to_read(lro) - engine->rx_garbage;
+	spin_unlock(&engine->lock);
+
+	return sprintf(buf, "%u\n", remaining);
+}
+static DEVICE_ATTR_RO(garbage_remaining);
+
+/*
+ * flush_time_us - microseconds from the last reset or mode switch to the end
+ * of its flush, -1 while it goes on
+ */
+static ssize_t flush_time_us_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%lld\n", READ_ONCE(lro_char->lro->flush_us));
+}
+static DEVICE_ATTR_RO(flush_time_us);
+
+/*
+ * ring_geometry_valid() - check a block size and count for the RX ring
+ *
+ * Both are powers of two, so that the free running indices of a mapped ring
+ * wrap around on a block boundary.
+ */
+static bool ring_geometry_valid(unsigned int block, unsigned int blocks)
+{
+	return is_power_of_2(block) && block >= PAGE_SIZE &&
+	       block <= RX_BUF_BLOCK_MAX && is_power_of_2(blocks) &&
+	       blocks >= RX_BUF_PAGES_MIN && blocks <= RX_BUF_PAGES_MAX;
+}
+
+/*
+ * ring_block_size and ring_block_count apply from the next ring setup, once
+ * the ring was torn down, see ring_idle_timeout
+ */
+static ssize_t ring_block_size_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(lro_char->engine->rx_block_next));
+}
+
+static ssize_t ring_block_size_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	struct xdma_engine *engine = lro_char->engine;
+	unsigned int block;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &block);
+	if (rc)
+		return rc;
+
+	mutex_lock(&(lro_char->device_mutex));
+	if (ring_geometry_valid(block, engine->rx_blocks_next))
+		engine->rx_block_next = block;
+	else
+		rc = -EINVAL;
+	mutex_unlock(&(lro_char->device_mutex));
+
+	return rc ? rc : count;
+}
+static DEVICE_ATTR_RW(ring_block_size);
+
+static ssize_t ring_block_count_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n",
+		       READ_ONCE(lro_char->engine->rx_blocks_next));
+}
+
+static ssize_t ring_block_count_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	struct xdma_engine *engine = lro_char->engine;
+	unsigned int blocks;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &blocks);
+	if (rc)
+		return rc;
+
+	mutex_lock(&(lro_char->device_mutex));
+	if (ring_geometry_valid(engine->rx_block_next, blocks))
+		engine->rx_blocks_next = blocks;
+	else
+		rc = -EINVAL;
+	mutex_unlock(&(lro_char->device_mutex));
+
+	return rc ? rc : count;
+}
+static DEVICE_ATTR_RW(ring_block_count);
+
+/* poll_interval_us and poll_idle_budget apply from the next service */
+static ssize_t poll_interval_us_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n",
+		       READ_ONCE(lro_char->engine->poll_interval_us));
+}
+
+static ssize_t poll_interval_us_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	unsigned int interval;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &interval);
+	if (rc)
+		return rc;
+
+	WRITE_ONCE(lro_char->engine->poll_interval_us, interval);
+	return count;
+}
+static DEVICE_ATTR_RW(poll_interval_us);
+
+static ssize_t poll_idle_budget_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n",
+		       READ_ONCE(lro_char->engine->poll_idle_budget));
+}
+
+static ssize_t poll_idle_budget_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	unsigned int budget;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &budget);
+	if (rc)
+		return rc;
+
+	WRITE_ONCE(lro_char->engine->poll_idle_budget, budget);
+	return count;
+}
+static DEVICE_ATTR_RW(poll_idle_budget);
+
+/* irq_rate and poll_rate drop to 0 after two seconds without a service */
+static ssize_t irq_rate_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	struct xdma_engine *engine = lro_char->engine;
+	u32 rate = 0;
+
+	spin_lock(&engine->lock);
+	if (time_before(jiffies, engine->rate_stamp + 2 * HZ))
+		rate = engine->irq_rate;
+	spin_unlock(&engine->lock);
+
+	return sprintf(buf, "%u\n", rate);
+}
+static DEVICE_ATTR_RO(irq_rate);
+
+static ssize_t poll_rate_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	struct xdma_engine *engine = lro_char->engine;
+	u32 rate = 0;
+
+	spin_lock(&engine->lock);
+	if (time_before(jiffies, engine->rate_stamp + 2 * HZ))
+		rate = engine->poll_rate;
+	spin_unlock(&engine->lock);
+
+	return sprintf(buf, "%u\n", rate);
+}
+static DEVICE_ATTR_RO(poll_rate);
+
+/* CPUs running the work of the ring, as a list like 0-3,8, empty for any */
+static ssize_t service_cpus_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%*pbl\n",
+		       cpumask_pr_args(lro_char->engine->service_cpus));
+}
+
+static ssize_t service_cpus_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	cpumask_var_t cpus;
+	int rc;
+
+	if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	rc = cpulist_parse(buf, cpus);
+	if (rc == 0 && !cpumask_empty(cpus) &&
+	    !cpumask_intersects(cpus, cpu_online_mask))
+		rc = -EINVAL;
+	/* a work queued meanwhile may still see the former CPUs */
+	if (rc == 0)
+		cpumask_copy(lro_char->engine->service_cpus, cpus);
+
+	free_cpumask_var(cpus);
+	return rc ? rc : count;
+}
+static DEVICE_ATTR_RW(service_cpus);
+
+static ssize_t numa_node_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", lro_char->lro->node);
+}
+static DEVICE_ATTR_RO(numa_node);
+
+/* credit_policy and credit_fill top the ring up at once when raised */
+static ssize_t credit_policy_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", READ_ONCE(lro_char->engine->credit_policy));
+}
+
+static ssize_t credit_policy_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	struct xdma_engine *engine = lro_char->engine;
+	unsigned int policy;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &policy);
+	if (rc)
+		return rc;
+	if (policy > CREDIT_POLICY_FILL)
+		return -EINVAL;
+
+	spin_lock(&engine->lock);
+	engine->credit_policy = policy;
+	if (engine->rx_buffer)
+		ring_refill(engine);
+	spin_unlock(&engine->lock);
+
+	return count;
+}
+static DEVICE_ATTR_RW(credit_policy);
+
+static ssize_t credit_fill_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(lro_char->engine->credit_fill));
+}
+
+static ssize_t credit_fill_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	struct xdma_engine *engine = lro_char->engine;
+	unsigned int fill;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &fill);
+	if (rc)
+		return rc;
+	if (fill < 1 || fill > 100)
+		return -EINVAL;
+
+	spin_lock(&engine->lock);
+	engine->credit_fill = fill;
+	if (engine->rx_buffer)
+		ring_refill(engine);
+	spin_unlock(&engine->lock);
+
+	return count;
+}
+static DEVICE_ATTR_RW(credit_fill);
+
+/* ring_fill - blocks received and not read yet, out of ring_block_count */
+static ssize_t ring_fill_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	struct xdma_engine *engine = lro_char->engine;
+	int fill = 0;
+
+	spin_lock(&engine->lock);
+	if (engine->rx_buffer)
+		fill = cyclic_received(engine);
+	spin_unlock(&engine->lock);
+
+	return sprintf(buf, "%d\n", fill);
+}
+static DEVICE_ATTR_RO(ring_fill);
+
+/* ring_credits - blocks the card may still fill */
+static ssize_t ring_credits_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n",
+		       READ_ONCE(lro_char->engine->rx_credits_out));
+}
+static DEVICE_ATTR_RO(ring_credits);
 
-rmv_interface:
-	destroy_interfaces(lro);
-rmv_engine:
-	remove_engines(lro);
-disable_irq:
-	irq_teardown(lro);
-unmap_bar:
-	unmap_bars(lro, pdev);
-rel_region:
-	if (lro->got_regions) {
-		pci_release_regions(pdev);
-		lro->got_regions = 0;
-	}
-disable_msi:
-	if (lro->msix_enabled) {
-		pci_disable_msix(pdev);
-		lro->msix_enabled = 0;
-	} else if (lro->msi_enabled) {
-		pci_disable_msi(pdev);
-		lro->msi_enabled = 0;
-	}
-	if (!lro->regions_in_use)
-		pci_disable_device(pdev);
-free_alloc:
-	kfree(lro);
+/* state - "initializing" until card_init_work() is done, then "ready" */
+static ssize_t state_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
 
-	dev_present[lro->instance] = 0;
-	dbg_init("probe() returning %d\n", rc);
-	return -1;
+	return sprintf(buf, "%s\n", completion_done(&lro_char->lro->init_done) ?
+				      "ready" : "initializing");
 }
+static DEVICE_ATTR_RO(state);
 
-static void remove(struct pci_dev *pdev)
+/* state of the RX ring, under /sys/class/<DRV_NAME>/qrandomN/ */
+static struct attribute *ring_attrs[] = {
+	&dev_attr_garbage_remaining.attr,
+	&dev_attr_flush_time_us.attr,
+	&dev_attr_ring_block_size.attr,
+	&dev_attr_ring_block_count.attr,
+	&dev_attr_poll_interval_us.attr,
+	&dev_attr_poll_idle_budget.attr,
+	&dev_attr_irq_rate.attr,
+	&dev_attr_poll_rate.attr,
+	&dev_attr_service_cpus.attr,
+	&dev_attr_numa_node.attr,
+	&dev_attr_credit_policy.attr,
+	&dev_attr_credit_fill.attr,
+	&dev_attr_ring_fill.attr,
+	&dev_attr_ring_credits.attr,
+	&dev_attr_state.attr,
+	NULL,
+};
+
+static const struct attribute_group ring_attr_group = {
+	.attrs = ring_attrs,
+};
+
+/* ring_stat_sum() - a counter of struct xdma_ring_stats, summed over CPUs */
+static u64 ring_stat_sum(struct xdma_engine *engine, size_t offset)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(u64 *)((char *)per_cpu_ptr(engine->stats, cpu) +
+				offset);
+	return sum;
+}
+
+#define RING_STAT_ATTR(field)						\
+	static ssize_t stat_##field##_show(struct device *dev,		\
+					   struct device_attribute *attr, \
+					   char *buf)			\
+	{								\
+		struct xdma_char *lro_char = dev_get_drvdata(dev);	\
+									\
+		return sprintf(buf, "%llu\n",				\
+			       ring_stat_sum(lro_char->engine,		\
+					     offsetof(struct xdma_ring_stats, \
+						      field)));		\
+	}								\
+	static struct device_attribute dev_attr_stat_##field =		\
+		__ATTR(field, 0444, stat_##field##_show, NULL)
+
+RING_STAT_ATTR(bytes);
+RING_STAT_ATTR(reads);
+RING_STAT_ATTR(blocks);
+RING_STAT_ATTR(overruns);
+RING_STAT_ATTR(faults);
+RING_STAT_ATTR(irqs);
+RING_STAT_ATTR(credits);
+RING_STAT_ATTR(garbage);
+
+/*
+ * One line per bucket of the read wait histogram: the bound of the bucket in
+ * microseconds, waits below it and not below the bound of the line before,
+ * then the number of reads. The last bucket has no bound.
+ */
+static ssize_t wait_histogram_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
 {
-	struct xdma_dev *lro;
+	struct xdma_char *lro_char = dev_get_drvdata(dev);
+	size_t offset = offsetof(struct xdma_ring_stats, waits);
+	ssize_t len = 0;
+	u64 count;
+	int i;
 
-	dbg_sg("remove(0x%p)\n", pdev);
-	if ((pdev == NULL) || (dev_get_drvdata(&pdev->dev) == NULL)) {
-		dbg_sg("remove(dev = 0x%p) pdev->dev.driver_data = 0x%p\n",
-		       pdev, dev_get_drvdata(&pdev->dev));
-		return;
-	}
-	lro = (struct xdma_dev *)dev_get_drvdata(&pdev->dev);
-	dbg_sg("remove(dev = 0x%p) where pdev->dev.driver_data = 0x%p\n", pdev,
-	       lro);
-	if (lro->pci_dev != pdev) {
-		dbg_sg("pdev->dev.driver_data->pci_dev(0x%lx) != pdev(0x%lx)\n",
-		       (unsigned long)lro->pci_dev, (unsigned long)pdev);
-	}
+	for (i = 0; i < RING_WAIT_BUCKETS; i++) {
+		count = ring_stat_sum(lro_char->engine,
+				      offset + i * sizeof(u64));
+		if (i < RING_WAIT_BUCKETS - 1)
+			len += sprintf(buf + len, "%8lu %llu\n", 1UL << i,
+				       count);
+		else
+			len += sprintf(buf + len, "%8s %llu\n", "inf", count);
+	}
+	return len;
+}
+static DEVICE_ATTR_RO(wait_histogram);
+
+/* activity of the RX ring, under /sys/class/<DRV_NAME>/qrandomN/stats/ */
+static struct attribute *ring_stats_attrs[] = {
+	&dev_attr_stat_bytes.attr,
+	&dev_attr_stat_reads.attr,
+	&dev_attr_stat_blocks.attr,
+	&dev_attr_stat_overruns.attr,
+	&dev_attr_stat_faults.attr,
+	&dev_attr_stat_irqs.attr,
+	&dev_attr_stat_credits.attr,
+	&dev_attr_stat_garbage.attr,
+	&dev_attr_wait_histogram.attr,
+	NULL,
+};
 
-	channel_interrupts_disable(lro, ~0);
-	user_interrupts_disable(lro, ~0);
-	read_interrupts(lro);
+static const struct attribute_group ring_stats_group = {
+	.name = "stats",
+	.attrs = ring_stats_attrs,
+};
 
-	destroy_interfaces(lro);
-	remove_engines(lro);
-	irq_teardown(lro);
-	unmap_bars(lro, pdev);
+static const struct attribute_group *ring_attr_groups[] = {
+	&ring_attr_group,
+	&ring_stats_group,
+	NULL,
+};
 
-	if (lro->got_regions)
-		pci_release_regions(pdev);
+/*
+ * ring_debug_show() - state of the RX ring, in debugfs <DRV_NAME>/qrandomN/ring
+ *
+ * The indices of the ring, then one line per block: its result status and
+ * length as written back by the card, and the copies of it in flight.
+ */
+static int ring_debug_show(struct seq_file *s, void *unused)
+{
+	struct xdma_char *lro_char = s->private;
+	struct xdma_engine *engine = lro_char->engine;
+	struct xdma_result *result;
+	int i;
 
-	if (lro->msix_enabled) {
-		pci_disable_msix(pdev);
-		lro->msix_enabled = 0;
-	} else if (lro->msi_enabled) {
-		pci_disable_msi(pdev);
-		lro->msi_enabled = 0;
+	/* the ring is set up and torn down under device_mutex */
+	if (mutex_lock_interruptible(&lro_char->device_mutex))
+		return -ERESTARTSYS;
+
+	if (!engine->rx_transfer_cyclic) {
+		seq_puts(s, "not set up\n");
+		goto out;
 	}
 
-	if (!lro->regions_in_use)
-		pci_disable_device(pdev);
+	spin_lock(&engine->lock);
+	seq_printf(s, "block size: %u\nblocks: %d\n", engine->rx_block,
+		   engine->rx_blocks);
+	seq_printf(s, "rx_head: %d\nrx_tail: %d\nrx_overrun: %d\n",
+		   engine->rx_head, engine->rx_tail, engine->rx_overrun);
+	seq_printf(s, "rx_claimed: %d\nrx_claim_offset: %u\nrx_readers: %d\n",
+		   engine->rx_claimed, engine->rx_claim_offset,
+		   engine->rx_readers);
+	seq_printf(s, "rx_mapped: %d\npolling: %d\nno_garbage_to_read: %d\n",
+		   engine->rx_mapped, engine->polling,
+		   engine->lro->no_garbage_to_read);
+	seq_puts(s, "block     status     length copies\n");
+	result = (struct xdma_result *)engine->rx_result_buffer_virt;
+	for (i = 0; i < engine->rx_blocks; i++)
+		seq_printf(s, "%5d 0x%08x %10u %6u\n", i, result[i].status,
+			   result[i].length, engine->rx_copies[i]);
+	spin_unlock(&engine->lock);
 
-	dev_present[lro->instance] = 0;
+out:
+	mutex_unlock(&lro_char->device_mutex);
+	return 0;
+}
 
-	kfree(lro);
+static int ring_debug_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ring_debug_show, inode->i_private);
 }
 
+static const struct file_operations ring_debug_fops = {
+	.owner = THIS_MODULE,
+	.open = ring_debug_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int destroy_sg_char(struct xdma_char *lro_char)
 {
 	BUG_ON(!lro_char);
@@ -4548,8 +6962,22 @@ static int destroy_sg_char(struct xdma_char *lro_char)
 	BUG_ON(!lro_char->lro);
 	BUG_ON(!g_xdma_class);
 
-	if (lro_char->sys_device)
+	/* waits for the readers of the ring dump */
+	debugfs_remove_recursive(lro_char->debug_dir);
+
+	/* the RX ring may have outlived the last close */
+	cancel_delayed_work_sync(&lro_char->idle_work);
+	mutex_lock(&(lro_char->device_mutex));
+	ring_teardown(lro_char);
+	mutex_unlock(&(lro_char->device_mutex));
+
+	if (lro_char->sys_device) {
+		if (lro_char->engine && lro_char->engine->streaming &&
+		    !lro_char->engine->dir_to_dev)
+			sysfs_remove_groups(&lro_char->sys_device->kobj,
+					    ring_attr_groups);
 		device_destroy(g_xdma_class, lro_char->cdevno);
+	}
 
 	cdev_del(&lro_char->cdev);
 	unregister_chrdev_region(lro_char->cdevno, 1);
@@ -4636,14 +7064,36 @@ static int create_dev(struct xdma_char *lro_char, enum chardev_type type)
 
 	engine = lro_char->engine;
 
+	/* software data sources have no parent device */
 	lro_char->sys_device =
-		device_create(g_xdma_class, &lro->pci_dev->dev,
-			      lro_char->cdevno, NULL, devnode_names[type],
+		device_create(g_xdma_class,
+			      lro->pci_dev ? &lro->pci_dev->dev : NULL,
+			      lro_char->cdevno, lro_char, devnode_names[type],
 			      lro->instance + device_file_first_index,
 			      engine ? engine->channel : 0);
 	if (!lro_char->sys_device) {
 		dbg_init("device_create(%s) failed\n", devnode_names[type]);
-		rc = -1;
+		return -1;
+	}
+
+	/* only the C2H engine has a RX ring */
+	if (engine && engine->streaming && !engine->dir_to_dev) {
+		rc = sysfs_create_groups(&lro_char->sys_device->kobj,
+					 ring_attr_groups);
+		if (rc) {
+			dbg_init("sysfs_create_groups(%s) failed\n",
+				 devnode_names[type]);
+			device_destroy(g_xdma_class, lro_char->cdevno);
+			lro_char->sys_device = NULL;
+			return rc;
+		}
+
+		/* debugfs is optional, its errors are ignored */
+		lro_char->debug_dir =
+			debugfs_create_dir(dev_name(lro_char->sys_device),
+					   xdma_debugfs);
+		debugfs_create_file("ring", 0444, lro_char->debug_dir, lro_char,
+				    &ring_debug_fops);
 	}
 
 	return rc;
@@ -4677,6 +7127,7 @@ static struct xdma_char *create_sg_char(struct xdma_dev *lro, int bar,
 	lro_char->magic = MAGIC_CHAR;
 
 	mutex_init(&(lro_char->device_mutex));
+	INIT_DELAYED_WORK(&lro_char->idle_work, ring_idle_work);
 
 	/* new instance? */
 	if (lro->major == 0) {
@@ -4757,6 +7208,283 @@ success:
 	return lro_char;
 }
 
+/* SECTION: Software data source */
+
+/*
+ * soft_source_work() - fill the credited blocks of the ring
+ *
+ * Stands in for the card and its C2H engine: each block gets random bytes
+ * and a result with the write-back magic and EOP, then the ring is serviced
+ * as the interrupt handler does.
+ */
+static void soft_source_work(struct work_struct *work)
+{
+	struct xdma_engine *engine;
+	struct xdma_result *result;
+	unsigned long now = jiffies;
+	int blocks;
+	int i;
+
+	engine = container_of(to_delayed_work(work), struct xdma_engine,
+			      soft_work);
+	BUG_ON(engine->magic != MAGIC_ENGINE);
+	result = (struct xdma_result *)engine->rx_result_buffer_virt;
+
+	blocks = atomic_read(&engine->soft_credits);
+	if (soft_source_rate) {
+		engine->soft_budget += (u64)(now - engine->soft_stamp) *
+				       soft_source_rate * 1024 / HZ;
+		if (engine->soft_budget > RX_BUF_SIZE(engine))
+			engine->soft_budget = RX_BUF_SIZE(engine);
+		if (blocks > engine->soft_budget / engine->rx_block)
+			blocks = engine->soft_budget / engine->rx_block;
+		engine->soft_budget -= (u64)blocks * engine->rx_block;
+	}
+	engine->soft_stamp = now;
+
+	for (i = 0; i < blocks; i++) {
+		get_random_bytes(engine->rx_buffer +
+					 (size_t)engine->soft_index *
+						 engine->rx_block,
+				 engine->rx_block);
+		result[engine->soft_index].length = engine->rx_block;
+		wmb();
+		result[engine->soft_index].status =
+			(C2H_WB << 16) | RX_STATUS_EOP;
+		engine->soft_index =
+			(engine->soft_index + 1) % engine->rx_blocks;
+	}
+	atomic_sub(blocks, &engine->soft_credits);
+
+	if (blocks > 0) {
+		spin_lock(&engine->lock);
+		if (engine_ring_process(engine) > 0)
+			engine->eop_found = 1;
+		if (engine->rx_mapped)
+			ring_publish(engine);
+		else
+			cyclic_flush_garbage(engine);
+		spin_unlock(&engine->lock);
+		wake_up_interruptible(&engine->rx_transfer_cyclic->wq);
+	}
+
+	/* returned credits reschedule the work right away */
+	if (engine->running && atomic_read(&engine->soft_credits) > 0)
+		queue_delayed_work_on(engine_service_cpu(engine), system_wq,
+				      &engine->soft_work, 1);
+}
+
+static int soft_transfer_setup(struct xdma_engine *engine)
+{
+	struct xdma_transfer *transfer;
+
+	BUG_ON(!engine);
+
+	if (engine->rx_buffer) {
+		dbg_tfr("Channel already open, cannot open twice\n");
+		return -EBUSY;
+	}
+
+	ring_reset(engine);
+	/* the geometry set through sysfs applies from now on */
+	engine->rx_block = engine->rx_block_next;
+	engine->rx_blocks = engine->rx_blocks_next;
+
+	engine->rx_ctrl = ring_ctrl_alloc(engine);
+	ring_buffer_alloc(engine);
+	engine->rx_result_buffer_virt =
+		kzalloc(RX_RESULT_BUF_SIZE(engine), GFP_KERNEL);
+	transfer = kzalloc(sizeof(struct xdma_transfer), GFP_KERNEL);
+	if (!engine->rx_ctrl || !engine->rx_buffer ||
+	    !engine->rx_result_buffer_virt || !transfer) {
+		kfree(transfer);
+		soft_transfer_teardown(engine);
+		return -ENOMEM;
+	}
+
+	INIT_LIST_HEAD(&transfer->entry);
+	init_waitqueue_head(&transfer->wq);
+	transfer->cyclic = 1;
+	engine->rx_transfer_cyclic = transfer;
+
+	engine->soft_index = 0;
+	engine->soft_budget = 0;
+	engine->soft_stamp = jiffies;
+	engine->rx_credits_out = ring_initial_credits(engine);
+	atomic_set(&engine->soft_credits, engine->rx_credits_out);
+	engine->running = 1;
+	queue_delayed_work_on(engine_service_cpu(engine), system_wq,
+			      &engine->soft_work, 0);
+
+	return 0;
+}
+
+static int soft_transfer_teardown(struct xdma_engine *engine)
+{
+	BUG_ON(!engine);
+
+	spin_lock(&engine->lock);
+	engine->running = 0;
+	spin_unlock(&engine->lock);
+	cancel_delayed_work_sync(&engine->soft_work);
+
+	kfree(engine->rx_transfer_cyclic);
+	engine->rx_transfer_cyclic = NULL;
+	ring_buffer_free(engine, engine->rx_buffer);
+	engine->rx_buffer = NULL;
+	kfree(engine->rx_result_buffer_virt);
+	engine->rx_result_buffer_virt = NULL;
+	ring_ctrl_free(engine->rx_ctrl);
+	engine->rx_ctrl = NULL;
+
+	return 0;
+}
+
+/*
+ * soft_source_ioctl() - answer the ioctls that need the card registers
+ *
+ * Returns true if cmd was handled, with the result in rc.
+ */
+static bool soft_source_ioctl(struct xdma_dev *lro, unsigned int cmd,
+			      unsigned long arg, int *rc)
+{
+	static const char serial[QUANTIS_IOCTL_GET_SERIAL_MAX_LENGTH] =
+		QUANTIS_SOFT_SOURCE_SERIAL;
+	static const struct quantis_modules_status modules_status = { 1, 0 };
+	struct xdma_engine *engine;
+
+	switch (cmd) {
+	case QUANTIS_IOCTL_GET_MODULES_MASK:
+	case QUANTIS_IOCTL_GET_MODULES_STATUS:
+		*rc = put_user(1, (uint32_t __user *)arg);
+		break;
+	case QUANTIS_IOCTL_GET_MODULES_STATUS_AGE:
+		*rc = copy_to_user((void __user *)arg, &modules_status,
+				   sizeof(modules_status)) ?
+			      -EFAULT :
+			      0;
+		break;
+	case QUANTIS_IOCTL_GET_BOARD_VERSION:
+		*rc = put_user(0, (uint32_t __user *)arg);
+		break;
+	case QUANTIS_IOCTL_RESET_BOARD:
+		engine = lro->engine[0][1];
+		spin_lock(&engine->lock);
+		/* ends a mode switch still flushing, as on a card */
+		lro->current_qrng_mode = lro->qrng_mode;
+		lro->switch_garbage = 0;
+		if (!lro->no_garbage_to_read) {
+			garbage_flushed(engine);
+			if (engine->rx_transfer_cyclic)
+				wake_up_interruptible(
+					&engine->rx_transfer_cyclic->wq);
+		}
+		spin_unlock(&engine->lock);
+		*rc = 0;
+		break;
+	case QUANTIS_IOCTL_GET_SERIAL:
+		*rc = copy_to_user((char __user *)arg, serial, sizeof(serial)) ?
+			      -EFAULT :
+			      0;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * soft_source_create() - create a /dev file fed by the software data source
+ *
+ * Takes the next free device instance, like a card would.
+ */
+static struct xdma_dev *soft_source_create(void)
+{
+	struct xdma_dev *lro;
+	struct xdma_engine *engine;
+	struct xdma_char *lro_char;
+
+	lro = kzalloc(sizeof(struct xdma_dev), GFP_KERNEL);
+	engine = kzalloc(sizeof(struct xdma_engine), GFP_KERNEL);
+	if (!lro || !engine)
+		goto fail;
+	if (!zalloc_cpumask_var(&engine->service_cpus, GFP_KERNEL))
+		goto fail;
+	engine->stats = alloc_percpu(struct xdma_ring_stats);
+	if (!engine->stats)
+		goto fail;
+
+	lro->magic = MAGIC_DEVICE;
+	lro->node = NUMA_NO_NODE;
+	lro->config_bar_idx = -1;
+	lro->user_bar_idx = -1;
+	lro->bypass_bar_idx = -1;
+	lro->irq_line = -1;
+	lro->qrng_mode = default_qrng_mode;
+	lro->current_qrng_mode = default_qrng_mode;
+	lro->qrng_num = default_qrng_num;
+	/* there is no fifo to flush */
+	lro->no_garbage_to_read = true;
+	lro->soft_source = 1;
+	/* nor a card to initialize */
+	init_completion(&lro->init_done);
+	complete_all(&lro->init_done);
+
+	engine->magic = MAGIC_ENGINE;
+	engine->lro = lro;
+	engine->name = "C2H";
+	engine->streaming = 1;
+	engine->rx_block = engine->rx_block_next = rx_block_size;
+	engine->rx_blocks = engine->rx_blocks_next = rx_block_count;
+	engine->credit_policy = credit_policy;
+	engine->credit_fill = credit_fill;
+	engine->number_in_channel = 1;
+	spin_lock_init(&engine->lock);
+	INIT_LIST_HEAD(&engine->transfer_list);
+	init_waitqueue_head(&engine->shutdown_wq);
+	init_waitqueue_head(&engine->xdma_perf_wq);
+	INIT_DELAYED_WORK(&engine->soft_work, soft_source_work);
+	lro->engine[0][1] = engine;
+	lro->engines_num = 1;
+
+	/* the ring is always run with credits, as with a card */
+	enable_credit_mp = 1;
+
+	lro_char = create_sg_char(lro, -1, engine, CHAR_XDMA_C2H);
+	if (!lro_char)
+		goto fail;
+	lro->sgdma_char_dev[0][1] = lro_char;
+
+	pr_info(DRV_NAME ": software data source qrandom%d\n",
+		lro->instance + device_file_first_index);
+
+	return lro;
+
+fail:
+	dbg_init("could not create a software data source\n");
+	if (engine) {
+		free_percpu(engine->stats);
+		free_cpumask_var(engine->service_cpus);
+	}
+	kfree(engine);
+	kfree(lro);
+	return NULL;
+}
+
+static void soft_source_destroy(struct xdma_dev *lro)
+{
+	BUG_ON(!lro);
+	BUG_ON(lro->magic != MAGIC_DEVICE);
+
+	destroy_sg_char(lro->sgdma_char_dev[0][1]);
+	dev_present[lro->instance] = 0;
+	free_percpu(lro->engine[0][1]->stats);
+	free_cpumask_var(lro->engine[0][1]->service_cpus);
+	kfree(lro->engine[0][1]);
+	kfree(lro);
+}
+
 static int __init xdma_init(void)
 {
 	int rc = 0;
@@ -4765,23 +7493,52 @@ static int __init xdma_init(void)
 
 	dbg_init(DRV_NAME " init()\n");
 	/* dbg_init(DRV_NAME " built " __DATE__ " " __TIME__ "\n"); */
+	if (!ring_geometry_valid(rx_block_size, rx_block_count)) {
+		pr_err(DRV_NAME ": invalid rx_block_size or rx_block_count\n");
+		return -EINVAL;
+	}
+	if (credit_policy > CREDIT_POLICY_FILL || credit_fill < 1 ||
+	    credit_fill > 100) {
+		pr_err(DRV_NAME ": invalid credit_policy or credit_fill\n");
+		return -EINVAL;
+	}
 	g_xdma_class = class_create(THIS_MODULE, DRV_NAME);
 	if (IS_ERR(g_xdma_class)) {
 		dbg_init(DRV_NAME ": failed to create class");
 		rc = -1;
 		goto err_class;
 	}
+	xdma_debugfs = debugfs_create_dir(DRV_NAME, NULL);
 
 	rc = pci_register_driver(&pci_driver);
+	if (rc == 0) {
+		int i;
+
+		for (i = 0; i < soft_source && i < MAX_XDMA_DEVICES; i++) {
+			soft_devs[i] = soft_source_create();
+			if (!soft_devs[i])
+				break;
+		}
+	} else {
+		debugfs_remove_recursive(xdma_debugfs);
+	}
 err_class:
 	return rc;
 }
 
 static void __exit xdma_exit(void)
 {
+	int i;
+
 	dbg_init(DRV_NAME " exit()\n");
+	for (i = 0; i < MAX_XDMA_DEVICES; i++) {
+		if (soft_devs[i])
+			soft_source_destroy(soft_devs[i]);
+		soft_devs[i] = NULL;
+	}
 	/* unregister this driver from the PCI bus driver */
 	pci_unregister_driver(&pci_driver);
+	debugfs_remove_recursive(xdma_debugfs);
 	if (g_xdma_class)
 		class_destroy(g_xdma_class);
 }
@@ -82,9 +82,12 @@ struct xilinx_fpga_regs {
 
 int Q400RegInit(struct xilinx_fpga_regs __iomem *regs, uint qrng_mode,
 		uint qrng_num);
+void Q400SetMode(struct xilinx_fpga_regs __iomem *regs, uint qrng_mode);
+int Q400CheckMode(struct xilinx_fpga_regs __iomem *regs, uint qrng_mode);
 int Q400RegExit(struct xilinx_fpga_regs __iomem *);
 int QrngPciGetSensorNum(struct xilinx_fpga_regs __iomem *);
 int Q400WaitForReady(struct xilinx_fpga_regs __iomem *regs, u32 *result);
 unsigned int Q400RegGetStatus(struct xilinx_fpga_regs __iomem *);
+int Q400CheckStatus(struct xilinx_fpga_regs __iomem *regs);
 unsigned int QrngPciGetBoardVersion(struct xilinx_fpga_regs __iomem *);
 int Q400GetSerialNumber(struct xilinx_fpga_regs __iomem *regs, char result[12]);
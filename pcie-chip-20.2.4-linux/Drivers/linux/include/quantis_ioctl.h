@@ -44,6 +44,9 @@
 #define QUANTIS_IOCTL_GET_SERIAL                                               \
 	_IOR(QUANTIS_IOC_MAGIC, 12, char[QUANTIS_IOCTL_GET_SERIAL_MAX_LENGTH])
 
+/* serial number of the software data sources (soft_source parameter) */
+#define QUANTIS_SOFT_SOURCE_SERIAL "SOFTWARE"
+
 #define QUANTIS_QRNG_MODE_RNG 0
 #define QUANTIS_QRNG_MODE_SAMPLE 1
 
@@ -54,3 +57,90 @@
 /* Get the mode that is currently used */
 #define QUANTIS_IOCTL_GET_CURRENT_QRNG_MODE                                    \
 	_IOR(QUANTIS_IOC_MAGIC, 15, unsigned int)
+/*
+ * Switch to the mode without resetting the board. Returns at once; the
+ * device gets readable, and QUANTIS_IOCTL_GET_CURRENT_QRNG_MODE reports the
+ * mode, once the bytes of the previous mode are flushed.
+ */
+#define QUANTIS_IOCTL_SWITCH_QRNG_MODE _IOW(QUANTIS_IOC_MAGIC, 22, unsigned int)
+
+/*
+ * The RX ring can be mapped instead of read(): the control block at
+ * QUANTIS_RING_CTRL_OFFSET (read-write) and the ring itself at
+ * QUANTIS_RING_DATA_OFFSET (read-only, block_size * block_count bytes).
+ * Block i of the ring is valid once producer has gone past i, holds
+ * length[i % block_count] bytes and is handed back to the card by moving
+ * consumer past it.
+ */
+#define QUANTIS_RING_CTRL_OFFSET 0x0
+#define QUANTIS_RING_CTRL_SIZE 0x4000
+#define QUANTIS_RING_DATA_OFFSET 0x10000
+#define QUANTIS_RING_VERSION 1
+
+struct quantis_ring_ctrl {
+	__u32 version; /* QUANTIS_RING_VERSION */
+	__u32 block_size; /* bytes between two blocks of the ring */
+	__u32 block_count; /* number of blocks in the ring */
+	__u32 errors; /* faulty blocks, published with a zero length */
+	__u32 producer; /* blocks published by the driver, free running */
+	__u32 consumer; /* blocks released by the reader, free running */
+	__u32 credited; /* blocks given back to the card, free running */
+	__u32 reserved[9];
+	__u32 length[]; /* valid bytes of each block */
+};
+
+/* give back the released blocks and wait for a block to be published */
+#define QUANTIS_IOCTL_RING_WAIT _IO(QUANTIS_IOC_MAGIC, 16)
+
+/* give back the released blocks without waiting */
+#define QUANTIS_IOCTL_RING_RELEASE _IO(QUANTIS_IOC_MAGIC, 17)
+
+/* status of modules, with the time since the driver read it */
+struct quantis_modules_status {
+	__u32 status; /* as QUANTIS_IOCTL_GET_MODULES_STATUS */
+	__u32 age_ms; /* milliseconds since the status was read */
+};
+
+/* get status of modules as last read by the driver, without waiting */
+#define QUANTIS_IOCTL_GET_MODULES_STATUS_AGE                                   \
+	_IOR(QUANTIS_IOC_MAGIC, 18, struct quantis_modules_status)
+
+/*
+ * Link statistics, to tell whether reads are bound by the PCIe link, the
+ * host or the random source. The cycle counters of the C2H engine, and of
+ * the AXI performance monitor when the driver was given one, count from
+ * QUANTIS_IOCTL_PERF_START to QUANTIS_IOCTL_PERF_STOP; the ring counters
+ * are taken over the same span.
+ */
+#define QUANTIS_PERF_VERSION 1
+#define QUANTIS_PERF_APM_METRICS 10
+
+#define QUANTIS_PERF_RUNNING 0x1 /* started and not stopped yet */
+#define QUANTIS_PERF_ENGINE 0x2 /* the engine cycle counters are valid */
+#define QUANTIS_PERF_APM 0x4 /* the performance monitor counters are valid */
+
+struct quantis_perf_counters {
+	__u32 version; /* QUANTIS_PERF_VERSION */
+	__u32 flags; /* QUANTIS_PERF_* */
+	__u64 elapsed_ns; /* time from start to stop, or to now */
+	__u64 clock_cycles; /* engine clock cycles */
+	__u64 data_cycles; /* cycles the engine moved data */
+	__u64 pending_cycles; /* cycles the engine waited for the host */
+	__u64 ring_bytes; /* bytes read from the RX ring */
+	__u64 ring_blocks; /* blocks received in the RX ring */
+	__u64 ring_overruns; /* times the RX ring was full */
+	__u64 ring_waits; /* times a reader found the RX ring empty */
+	__u64 apm_clock_cycles; /* global clock counter of the monitor */
+	__u32 apm_metrics[QUANTIS_PERF_APM_METRICS]; /* metric counters */
+	__u32 reserved[6];
+};
+
+/* clear and start the link statistics */
+#define QUANTIS_IOCTL_PERF_START _IO(QUANTIS_IOC_MAGIC, 19)
+
+/* stop the link statistics, they keep their values */
+#define QUANTIS_IOCTL_PERF_STOP _IO(QUANTIS_IOC_MAGIC, 20)
+
+/* get the link statistics */
+#define QUANTIS_IOCTL_PERF_GET                                                 \
+	_IOR(QUANTIS_IOC_MAGIC, 21, struct quantis_perf_counters)
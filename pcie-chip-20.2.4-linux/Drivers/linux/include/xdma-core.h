@@ -2,23 +2,29 @@
 #define XDMA_CORE_H
 
 #include <linux/cdev.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/dma-mapping.h>
 #include <linux/fb.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/hw_random.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
-#include <linux/kfifo.h>
 #include <linux/mm_types.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/pci.h>
+#include <linux/percpu.h>
 #include <linux/poll.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/splice.h>
 #include <linux/types.h>
@@ -52,13 +58,6 @@
 /* testing purposes; request interrupt on each descriptor */
 #define FORCE_IR_DESC_COMPLETED 0
 
-/* use a fifo to keep extra bytes when the read length is not a multiple a 4096 */
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 36)
-#define USE_FIFO 1
-#else
-#define USE_FIFO 0
-#endif
-
 /* SECTION: Preprocessor macros/constants */
 
 #define PCIE_VENDOR_ID 0x1e89
@@ -137,13 +136,31 @@
 
 /* Specifies buffer size used for C2H AXI-ST mode */
 #define K_MAX_RD_SIZE 2048 //kernel area max size to read.
-#define RX_BUF_BLOCK 4096
+#define RX_BUF_BLOCK 4096 /* default bytes per block of the RX ring */
 #define RX_DBUF_BLOCK 3520 //4096-128(ptail)-440(hash)-8
-#define RX_BUF_PAGES 256
-#define RX_BUF_SIZE (RX_BUF_PAGES * RX_BUF_BLOCK)
-#define RX_RESULT_BUF_SIZE (RX_BUF_PAGES * sizeof(struct xdma_result))
+#define RX_BUF_PAGES 256 /* default number of blocks of the RX ring */
+/*
+ * largest block: a block is filled through a single descriptor, which holds
+ * at most XDMA_DESC_MAX_BYTES (256 KiB - 1), and is a power of two so that
+ * the free running indices of a mapped ring wrap around on a block boundary
+ */
+#define RX_BUF_BLOCK_MAX (128 * 1024)
+#define RX_BUF_PAGES_MIN 8
+/* most blocks whose lengths fit in the control block of a mapped ring */
+#define RX_BUF_PAGES_MAX 2048
+/* largest physically contiguous chunk of the RX ring, a huge page on x86 */
+#define RX_BUF_CHUNK_MAX (2 * 1024 * 1024)
+#define RX_BUF_SIZE(engine) ((size_t)(engine)->rx_blocks * (engine)->rx_block)
+#define RX_RESULT_BUF_SIZE(engine)                                             \
+	((engine)->rx_blocks * sizeof(struct xdma_result))
+/* blocks the card may fill ahead of the reader */
+#define RX_BUF_CREDITS(engine) ((engine)->rx_blocks / 2)
+
+/* credits go back to the card as blocks are read, see ring_refill() */
+#define CREDIT_POLICY_READ 0
+/* the ring is kept filled from the completions, see ring_refill() */
+#define CREDIT_POLICY_FILL 1
 
-#define REMAINING_BYTES_FIFO_SIZE 4096
 
 #define LS_BYTE_MASK 0x000000FFUL
 
@@ -417,6 +434,38 @@ struct xdma_transfer {
 	ssize_t size_of_request; /* request size */
 };
 
+/* Part of the RX ring claimed by one reader, see complete_cyclic() */
+struct xdma_cyclic_claim {
+	int block; /* first block claimed from */
+	u32 offset; /* bytes already taken from the first block */
+	int blocks; /* number of blocks claimed from */
+	size_t size; /* bytes claimed */
+	int fault; /* flag if the claim ended on a faulty result */
+};
+
+/* Where copy_cyclic() puts the claimed bytes */
+enum cyclic_dest {
+	CYCLIC_TO_KERNEL, /* kernel buffer, for the hw_random device */
+	CYCLIC_TO_USER, /* user space buffer, for read() */
+	CYCLIC_TO_ITER, /* struct iov_iter, for read_iter() and splice() */
+};
+
+/* Buckets of the read wait histogram, bucket n for waits below 2^n us */
+#define RING_WAIT_BUCKETS 24
+
+/* Activity of a RX ring, counted per CPU and summed when shown */
+struct xdma_ring_stats {
+	u64 bytes; /* bytes read, the mapped ring aside */
+	u64 reads; /* reads that returned bytes */
+	u64 blocks; /* blocks received from the card */
+	u64 overruns; /* times the card filled the whole ring */
+	u64 faults; /* faulty results met by readers */
+	u64 irqs; /* interrupts taken for the engine */
+	u64 credits; /* blocks given back to the card */
+	u64 garbage; /* bytes dropped after a reset */
+	u64 waits[RING_WAIT_BUCKETS]; /* reads that waited, by wait time */
+};
+
 struct xdma_performance_ioctl {
 	/* IOCTL_XDMA_IOCTL_Vx */
 	uint32_t version;
@@ -429,6 +478,8 @@ struct xdma_performance_ioctl {
 	uint64_t pending_count;
 };
 
+struct quantis_ring_ctrl;
+
 struct xdma_engine {
 	unsigned long magic; /* structure ID for sanity checks */
 	struct xdma_dev *lro; /* parent device */
@@ -470,6 +521,20 @@ struct xdma_engine {
 	struct xdma_transfer *rx_transfer_cyclic; /* Transfer list */
 	u8 *rx_result_buffer_virt; /* virt addr for transfer */
 	dma_addr_t rx_result_buffer_bus; /* bus addr for transfer */
+	u32 rx_block; /* bytes per block, one descriptor each */
+	int rx_blocks; /* number of blocks, a power of two */
+	u32 rx_block_next; /* rx_block of the next ring setup */
+	int rx_blocks_next; /* rx_blocks of the next ring setup */
+	struct page **rx_chunks; /* physically contiguous chunks of rx_buffer */
+	dma_addr_t *rx_chunks_bus; /* bus addr of each chunk, for a card */
+	int rx_chunk_count; /* number of chunks */
+	int rx_chunk_order; /* page order of each chunk */
+	int rx_chunks_mapped; /* chunks mapped for DMA */
+
+	/* Members applicable to the credits of the RX ring, see ring_refill() */
+	int credit_policy; /* CREDIT_POLICY_* */
+	u32 credit_fill; /* percent of the ring kept filled by the policy */
+	int rx_credits_out; /* blocks credited to the card, not yet received */
 
 	/* Members associated with polled mode support */
 	u8 *poll_mode_addr_virt; /* virt addr for descriptor writeback */
@@ -482,12 +547,56 @@ struct xdma_engine {
 	int msix_irq_line; /* MSI-X vector for this engine */
 	u32 irq_bitmask; /* IRQ bit mask for this engine */
 	struct work_struct work; /* Work queue for interrupt handling */
+	cpumask_var_t service_cpus; /* CPUs running work, empty for any */
+
+	/* Members applicable to the C2H ring serviced by polling */
+	struct hrtimer poll_timer; /* schedules the next poll of the ring */
+	int polling; /* interrupts off, the ring is serviced by poll_timer */
+	int poll_idle; /* polls in a row that found no new block */
+	u32 poll_interval_us; /* between two polls, 0 for interrupts only */
+	u32 poll_idle_budget; /* empty polls before interrupts come back */
+	u32 irq_events; /* services after an interrupt, free running */
+	u32 poll_events; /* services by poll_timer, free running */
+	u32 irq_mark; /* irq_events at rate_stamp */
+	u32 poll_mark; /* poll_events at rate_stamp */
+	u32 irq_rate; /* interrupts per second */
+	u32 poll_rate; /* polls per second */
+	unsigned long rate_stamp; /* jiffies the rates were last computed */
+
+	struct xdma_ring_stats __percpu *stats; /* RX ring counters */
+
+	/* Link statistics, see perf_start_ioctl() */
+	int perf_running; /* counting since perf_begin */
+	ktime_t perf_begin; /* when the counting started, 0 if never */
+	ktime_t perf_end; /* when the counting stopped */
+	struct xdma_ring_stats perf_base; /* ring counters at perf_begin */
+	struct xdma_ring_stats perf_last; /* ring counters at perf_end */
 
 	/* Members associated with performance test support */
 	struct xdma_performance_ioctl *xdma_perf; /* perf test control */
 	wait_queue_head_t xdma_perf_wq; /* Perf test sync */
 	u8 eop_found; /* used only for cyclic(rx:c2h) */
-	u32 user_buffer_index;
+
+	/* Members applicable to concurrent readers of the RX ring */
+	int rx_claimed; /* blocks from rx_head wholly claimed by readers */
+	u32 rx_claim_offset; /* bytes claimed in the next block */
+	int rx_readers; /* readers between claim and release */
+	u16 rx_copies[RX_BUF_PAGES_MAX]; /* copies in flight per block */
+
+	/* Members applicable to a ring mapped in user space */
+	struct quantis_ring_ctrl *rx_ctrl; /* control block shared with user */
+	int rx_mapped; /* number of user mappings of the ring */
+	struct file *rx_map_file; /* open file owning the mappings */
+	u32 rx_published; /* blocks published, free running */
+	u32 rx_credited; /* published blocks given back to the card */
+	u32 rx_garbage; /* bytes dropped after a reset */
+
+	/* Members applicable to the software data source */
+	struct delayed_work soft_work; /* fills the ring in place of the card */
+	atomic_t soft_credits; /* blocks the source may fill */
+	int soft_index; /* next block filled by the source */
+	u64 soft_budget; /* bytes allowed by soft_source_rate */
+	unsigned long soft_stamp; /* jiffies of the last fill */
 };
 
 /*
@@ -505,6 +614,8 @@ struct xdma_char {
 	struct device *sys_device; /* sysfs device */
 	struct mutex device_mutex;
 	unsigned long users; /* number of times the device is open at this time */
+	struct delayed_work idle_work; /* tears the unused RX ring down */
+	struct dentry *debug_dir; /* debugfs directory, if any */
 };
 
 struct xdma_irq {
@@ -518,6 +629,7 @@ struct xdma_irq {
 struct xdma_dev {
 	unsigned long magic; /* structure ID for sanity checks */
 	struct pci_dev *pci_dev; /* pci device struct from probe() */
+	int node; /* NUMA node of the card, NUMA_NO_NODE if unknown */
 	int major; /* major number */
 	int instance; /* instance number */
 	dev_t cdevno_base; /* character device major:minor base */
@@ -535,6 +647,7 @@ struct xdma_dev {
 	int user_bar_idx; /* BAR index of user logic */
 	int config_bar_idx; /* BAR index of XDMA config logic */
 	int bypass_bar_idx; /* BAR index of XDMA bypass logic */
+	void __iomem *perfmon; /* AXI performance monitor, if any */
 	int regions_in_use; /* flag if dev was in use during probe() */
 	int got_regions; /* flag if probe() obtained the regions */
 
@@ -551,14 +664,34 @@ struct xdma_dev {
 	int engines_num; /* Total engine count */
 	struct xdma_engine *engine[XDMA_CHANNEL_NUM_MAX][2]; /* instances */
 
+	int soft_source; /* flag if data comes from the software source */
 	bool no_garbage_to_read; /* false if we need to read to remove garbage before sending the values to userspace */
+	bool reset_pending; /* QUANTIS_IOCTL_RESET_BOARD is resetting the card */
 	unsigned int qrng_mode;
 	unsigned int current_qrng_mode;
 	unsigned int qrng_num;
-#if USE_FIFO
-	DECLARE_KFIFO(
-		remaining_bytes, char,
-		REMAINING_BYTES_FIFO_SIZE); /* if we didn't use all the bytes we received, they are stored here for the next call */
+
+	/* Mode switch without a reset, see qrng_mode_switch_ioctl() */
+	unsigned int switch_mode; /* mode of the bytes after the flush */
+	unsigned int switch_garbage; /* bytes to flush, 0 if no switch */
+	ktime_t flush_begin; /* when the last reset or switch started */
+	s64 flush_us; /* how long its flush took, -1 while it goes on */
+
+	/* Card initialization, left by probe() to card_init_work() */
+	struct work_struct init_work; /* runs Q400RegInit() */
+	struct completion init_done; /* completed once the card is ready */
+
+	/* Modules status kept by the driver, see modules_status_get() */
+	struct delayed_work status_work; /* reads the status register */
+	wait_queue_head_t status_wq; /* woken once the sensors are ready */
+	u32 status_reg; /* last value read from reg_init_status_chk */
+	unsigned long status_stamp; /* jiffies when status_reg was read */
+
+#if IS_ENABLED(CONFIG_HW_RANDOM)
+	/* hw_random device, fed by the ring of the first C2H engine */
+	struct hwrng hwrng;
+	char hwrng_name[16];
+	bool hwrng_registered;
 #endif
 };
 
@@ -0,0 +1,232 @@
+/*
+ * Tracepoints of the RX ring read path, under events/quantis_chip_pcie/ in
+ * tracefs. Off, each costs a static branch; on, they carry the byte counts
+ * and the ring indices at the time of the event.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM quantis_chip_pcie
+
+#if !defined(XDMA_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define XDMA_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include "xdma-core.h"
+
+TRACE_DEFINE_ENUM(CYCLIC_TO_KERNEL);
+TRACE_DEFINE_ENUM(CYCLIC_TO_USER);
+TRACE_DEFINE_ENUM(CYCLIC_TO_ITER);
+
+#define show_cyclic_dest(dest)                                                 \
+	__print_symbolic(dest, { CYCLIC_TO_KERNEL, "kernel" },                 \
+			 { CYCLIC_TO_USER, "user" },                           \
+			 { CYCLIC_TO_ITER, "iter" })
+
+/* indices of the ring, for the events that carry nothing else */
+DECLARE_EVENT_CLASS(xdma_ring,
+	TP_PROTO(struct xdma_engine *engine),
+	TP_ARGS(engine),
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, head)
+		__field(int, tail)
+		__field(int, claimed)
+		__field(int, overrun)
+	),
+	TP_fast_assign(
+		__entry->instance = engine->lro->instance;
+		__entry->head = engine->rx_head;
+		__entry->tail = engine->rx_tail;
+		__entry->claimed = engine->rx_claimed;
+		__entry->overrun = engine->rx_overrun;
+	),
+	TP_printk("dev=%d head=%d tail=%d claimed=%d overrun=%d",
+		  __entry->instance, __entry->head, __entry->tail,
+		  __entry->claimed, __entry->overrun)
+);
+
+/* a reader found no unclaimed byte and waits for the card */
+DEFINE_EVENT(xdma_ring, xdma_wait_start,
+	TP_PROTO(struct xdma_engine *engine),
+	TP_ARGS(engine)
+);
+
+/* the card filled the whole ring, it stops until credits come back */
+DEFINE_EVENT(xdma_ring, xdma_overrun,
+	TP_PROTO(struct xdma_engine *engine),
+	TP_ARGS(engine)
+);
+
+TRACE_EVENT(xdma_read_enter,
+	TP_PROTO(struct xdma_engine *engine, size_t size, int dest),
+	TP_ARGS(engine, size, dest),
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(size_t, size)
+		__field(int, dest)
+		__field(int, head)
+		__field(int, tail)
+	),
+	TP_fast_assign(
+		__entry->instance = engine->lro->instance;
+		__entry->size = size;
+		__entry->dest = dest;
+		__entry->head = engine->rx_head;
+		__entry->tail = engine->rx_tail;
+	),
+	TP_printk("dev=%d size=%zu dest=%s head=%d tail=%d",
+		  __entry->instance, __entry->size,
+		  show_cyclic_dest(__entry->dest), __entry->head, __entry->tail)
+);
+
+TRACE_EVENT(xdma_read_exit,
+	TP_PROTO(struct xdma_engine *engine, size_t size, ssize_t rc),
+	TP_ARGS(engine, size, rc),
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(size_t, size)
+		__field(ssize_t, rc)
+		__field(int, head)
+		__field(int, tail)
+	),
+	TP_fast_assign(
+		__entry->instance = engine->lro->instance;
+		__entry->size = size;
+		__entry->rc = rc;
+		__entry->head = engine->rx_head;
+		__entry->tail = engine->rx_tail;
+	),
+	TP_printk("dev=%d size=%zu rc=%zd head=%d tail=%d",
+		  __entry->instance, __entry->size, __entry->rc,
+		  __entry->head, __entry->tail)
+);
+
+/* the bytes a reader took from the ring, before its copy */
+TRACE_EVENT(xdma_read_claim,
+	TP_PROTO(struct xdma_engine *engine,
+		 const struct xdma_cyclic_claim *claim),
+	TP_ARGS(engine, claim),
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, block)
+		__field(int, blocks)
+		__field(u32, offset)
+		__field(size_t, size)
+		__field(int, readers)
+	),
+	TP_fast_assign(
+		__entry->instance = engine->lro->instance;
+		__entry->block = claim->block;
+		__entry->blocks = claim->blocks;
+		__entry->offset = claim->offset;
+		__entry->size = claim->size;
+		__entry->readers = engine->rx_readers;
+	),
+	TP_printk("dev=%d block=%d blocks=%d offset=%u size=%zu readers=%d",
+		  __entry->instance, __entry->block, __entry->blocks,
+		  __entry->offset, __entry->size, __entry->readers)
+);
+
+TRACE_EVENT(xdma_wait_end,
+	TP_PROTO(struct xdma_engine *engine, s64 us, int rc),
+	TP_ARGS(engine, us, rc),
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(s64, us)
+		__field(int, rc)
+		__field(int, head)
+		__field(int, tail)
+	),
+	TP_fast_assign(
+		__entry->instance = engine->lro->instance;
+		__entry->us = us;
+		__entry->rc = rc;
+		__entry->head = engine->rx_head;
+		__entry->tail = engine->rx_tail;
+	),
+	TP_printk("dev=%d us=%lld rc=%d head=%d tail=%d",
+		  __entry->instance, __entry->us, __entry->rc,
+		  __entry->head, __entry->tail)
+);
+
+/* blocks given back to the card, or to the software data source */
+TRACE_EVENT(xdma_credits,
+	TP_PROTO(struct xdma_engine *engine, int credits),
+	TP_ARGS(engine, credits),
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, credits)
+		__field(u32, bytes)
+		__field(int, head)
+		__field(int, tail)
+	),
+	TP_fast_assign(
+		__entry->instance = engine->lro->instance;
+		__entry->credits = credits;
+		__entry->bytes = credits * engine->rx_block;
+		__entry->head = engine->rx_head;
+		__entry->tail = engine->rx_tail;
+	),
+	TP_printk("dev=%d credits=%d bytes=%u head=%d tail=%d",
+		  __entry->instance, __entry->credits, __entry->bytes,
+		  __entry->head, __entry->tail)
+);
+
+TRACE_EVENT(xdma_irq,
+	TP_PROTO(struct xdma_engine *engine, int irq),
+	TP_ARGS(engine, irq),
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, irq)
+		__field(int, channel)
+		__field(int, c2h)
+	),
+	TP_fast_assign(
+		__entry->instance = engine->lro->instance;
+		__entry->irq = irq;
+		__entry->channel = engine->channel;
+		__entry->c2h = !engine->dir_to_dev;
+	),
+	TP_printk("dev=%d irq=%d %s%d", __entry->instance, __entry->irq,
+		  __entry->c2h ? "C2H" : "H2C", __entry->channel)
+);
+
+/*
+ * The ring serviced after an interrupt or a poll of poll_timer, tail and
+ * overrun as they were before the service.
+ */
+TRACE_EVENT(xdma_service,
+	TP_PROTO(struct xdma_engine *engine, int tail, int overrun),
+	TP_ARGS(engine, tail, overrun),
+	TP_STRUCT__entry(
+		__field(int, instance)
+		__field(int, blocks)
+		__field(u32, bytes)
+		__field(int, head)
+		__field(int, tail)
+		__field(int, polling)
+	),
+	TP_fast_assign(
+		__entry->instance = engine->lro->instance;
+		__entry->blocks = engine->rx_overrun && !overrun ?
+					  engine->rx_blocks :
+					  (engine->rx_tail + engine->rx_blocks -
+					   tail) % engine->rx_blocks;
+		__entry->bytes = __entry->blocks * engine->rx_block;
+		__entry->head = engine->rx_head;
+		__entry->tail = engine->rx_tail;
+		__entry->polling = engine->polling;
+	),
+	TP_printk("dev=%d blocks=%d bytes=%u head=%d tail=%d polling=%d",
+		  __entry->instance, __entry->blocks, __entry->bytes,
+		  __entry->head, __entry->tail, __entry->polling)
+);
+
+#endif /* XDMA_TRACE_H */
+
+/* found through the include directory of the Makefile */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE xdma-trace
+#include <trace/define_trace.h>
@@ -0,0 +1,218 @@
+/*
+ * CPU cost per GiB read for each block size of the RX ring
+ *
+ * Copyright (C) 2019 ID Quantique
+ *
+ * Usage: qrandom_block_bench [-d device] [-m MiB] [block_size ...]
+ *
+ * For each block size (4, 16, 64 and 128 KiB by default), sets the
+ * ring_block_size of the device, reads MiB (1024 by default) in 1 MiB
+ * reads and prints the CPU time the whole system spent per GiB read, and
+ * the part of it spent by the reader. The system time covers the work of
+ * the driver outside of the reader: interrupts, servicing of the ring and,
+ * for the software data source, filling it. Run it on an otherwise idle
+ * host; it needs root.
+ *
+ * ring_idle_timeout is set to 0 during the run, so that the ring is set up
+ * again, with the new block size, at each open; both parameters are
+ * restored at the end. Nothing else may keep the device open. Meant for
+ * the software data source, or a card:
+ *
+ *   insmod quantis_chip_pcie.ko soft_source=1
+ *   ./qrandom_block_bench -d /dev/qrandom0
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define PARAM_DIR "/sys/module/quantis_chip_pcie/parameters/"
+#define CLASS_DIR "/sys/class/quantis_chip_pcie/"
+#define READ_SIZE (1024 * 1024)
+
+static const char *device = "/dev/qrandom0";
+static uint64_t total_bytes = 1024ull * 1024 * 1024;
+
+static int attr_read(const char *path, char *value, size_t length)
+{
+	FILE *file = fopen(path, "r");
+	int rc;
+
+	if (!file) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	rc = fgets(value, length, file) ? 0 : -1;
+	fclose(file);
+	return rc;
+}
+
+static int attr_write(const char *path, const char *value)
+{
+	FILE *file = fopen(path, "w");
+	int rc;
+
+	if (!file) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	rc = fputs(value, file) < 0 ? -1 : 0;
+	if (fclose(file))
+		rc = -1;
+	if (rc)
+		fprintf(stderr, "%s: cannot write %s\n", path, value);
+	return rc;
+}
+
+/* CPU time the whole system was busy, in seconds */
+static double system_busy(void)
+{
+	unsigned long long user, nice, system, idle, iowait, irq, softirq,
+		steal;
+	FILE *file = fopen("/proc/stat", "r");
+	int fields;
+
+	if (!file)
+		return -1.0;
+	fields = fscanf(file, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+			&user, &nice, &system, &idle, &iowait, &irq, &softirq,
+			&steal);
+	fclose(file);
+	if (fields != 8)
+		return -1.0;
+
+	return (double)(user + nice + system + irq + softirq + steal) /
+	       sysconf(_SC_CLK_TCK);
+}
+
+/* CPU time of this process, in seconds */
+static double process_busy(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	       usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static int bench(const char *block_attr, const char *block, char *buf)
+{
+	double system_start, process_start, gib;
+	struct timespec start, end;
+	uint64_t done = 0;
+	int fd;
+
+	if (attr_write(block_attr, block))
+		return -1;
+
+	fd = open(device, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", device, strerror(errno));
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	system_start = system_busy();
+	process_start = process_busy();
+	while (done < total_bytes) {
+		ssize_t rc = read(fd, buf, READ_SIZE);
+
+		if (rc <= 0) {
+			fprintf(stderr, "read: %s\n",
+				rc < 0 ? strerror(errno) : "end of file");
+			close(fd);
+			return -1;
+		}
+		done += rc;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	gib = done / (1024.0 * 1024.0 * 1024.0);
+	printf("%8s %10.1f %12.3f %12.3f\n", block,
+	       done / (1024.0 * 1024.0) /
+		       (end.tv_sec - start.tv_sec +
+			(end.tv_nsec - start.tv_nsec) / 1e9),
+	       (system_busy() - system_start) / gib,
+	       (process_busy() - process_start) / gib);
+	fflush(stdout);
+
+	/* tears the ring down */
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *default_blocks[] = { "4096", "16384", "65536",
+						"131072" };
+	const char **blocks = default_blocks;
+	int block_count = 4;
+	char block_attr[256];
+	char saved_block[32];
+	char saved_timeout[32];
+	char name[64];
+	char *buf;
+	int option;
+	int rc = 0;
+	int i;
+
+	while ((option = getopt(argc, argv, "d:m:")) != -1) {
+		switch (option) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'm':
+			total_bytes = strtoull(optarg, NULL, 0) * 1024 * 1024;
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d device] [-m MiB] [block_size ...]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc) {
+		blocks = (const char **)argv + optind;
+		block_count = argc - optind;
+	}
+	if (total_bytes == 0) {
+		fprintf(stderr, "invalid amount\n");
+		return 1;
+	}
+
+	snprintf(name, sizeof(name), "%s", device);
+	snprintf(block_attr, sizeof(block_attr), CLASS_DIR "%s/ring_block_size",
+		 basename(name));
+	buf = malloc(READ_SIZE);
+	if (!buf) {
+		fprintf(stderr, "no memory\n");
+		return 1;
+	}
+	if (attr_read(block_attr, saved_block, sizeof(saved_block)) ||
+	    attr_read(PARAM_DIR "ring_idle_timeout", saved_timeout,
+		      sizeof(saved_timeout)) ||
+	    attr_write(PARAM_DIR "ring_idle_timeout", "0")) {
+		free(buf);
+		return 1;
+	}
+
+	printf("%s: %llu MiB per block size\n", device,
+	       (unsigned long long)(total_bytes / (1024 * 1024)));
+	printf("%8s %10s %12s %12s\n", "block", "MiB/s", "CPU s/GiB",
+	       "reader s/GiB");
+	for (i = 0; i < block_count && !rc; i++)
+		rc = bench(block_attr, blocks[i], buf);
+
+	if (attr_write(block_attr, saved_block) ||
+	    attr_write(PARAM_DIR "ring_idle_timeout", saved_timeout))
+		rc = -1;
+
+	free(buf);
+	return rc ? 1 : 0;
+}
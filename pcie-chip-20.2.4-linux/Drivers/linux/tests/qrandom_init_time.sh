@@ -0,0 +1,39 @@
+#!/bin/bash
+# usage: ./qrandom_init_time.sh [module parameters]
+# Example:
+#   ./qrandom_init_time.sh default_qrng_mode=0
+#
+# Loads the driver and prints the time insmod took, then the time until
+# every card reports "ready" in its state attribute. The cards are
+# initialized asynchronously after probe() (card_init_work), in parallel:
+# insmod should return at once, and the time to ready should not grow with
+# the number of cards. Needs root, and the driver built in ../driver.
+
+set -eu
+
+driver=$(dirname "$0")/../driver/quantis_chip_pcie.ko
+class=/sys/class/quantis_chip_pcie
+
+rmmod quantis_chip_pcie 2>/dev/null || true
+
+start=$(date +%s%N)
+insmod "$driver" "$@"
+loaded=$(date +%s%N)
+
+cards=0
+for state in "$class"/*/state; do
+  [ -e "$state" ] || continue
+  cards=$((cards + 1))
+  while [ "$(cat "$state")" != ready ]; do
+    if [ $(( ($(date +%s%N) - start) / 1000000 )) -gt 30000 ]; then
+      echo "$(dirname "$state") not ready after 30 s"
+      exit 1
+    fi
+    sleep 0.01
+  done
+done
+ready=$(date +%s%N)
+
+echo "cards: $cards"
+echo "insmod: $(( (loaded - start) / 1000000 )) ms"
+echo "ready: $(( (ready - start) / 1000000 )) ms"
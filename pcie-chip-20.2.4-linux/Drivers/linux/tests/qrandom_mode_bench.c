@@ -0,0 +1,203 @@
+/*
+ * Time of a QRNG mode switch against a board reset
+ *
+ * Copyright (C) 2019 ID Quantique
+ *
+ * Usage: qrandom_mode_bench [-d device] [-n rounds]
+ *
+ * Alternates the device between the RNG and SAMPLE modes, rounds times (10
+ * by default) with QUANTIS_IOCTL_SWITCH_QRNG_MODE, then rounds times with
+ * QUANTIS_IOCTL_SET_QRNG_MODE and QUANTIS_IOCTL_RESET_BOARD. For each way,
+ * prints the mean time until the ioctl returns, until
+ * QUANTIS_IOCTL_GET_CURRENT_QRNG_MODE reports the new mode and until the
+ * first byte of the new mode is read, and the flush time the driver reports
+ * (flush_time_us). The device is left in the mode it was in. The numbers
+ * only mean something on a card: the software data source has no registers
+ * to program and its reset is immediate.
+ *
+ *   ./qrandom_mode_bench -d /dev/qrandom0
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/types.h>
+#include <sys/ioctl.h>
+
+#include "quantis_ioctl.h"
+
+#define CLASS_DIR "/sys/class/quantis_chip_pcie/"
+/* a switch not over by then failed */
+#define SWITCH_TIMEOUT_US (60 * 1000000ull)
+
+struct timing {
+	uint64_t ioctl_us;
+	uint64_t mode_us;
+	uint64_t read_us;
+	uint64_t flush_us;
+	int flush_count;
+};
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* flush_time_us of the device, -1 while a flush goes on or if unknown */
+static long long flush_time(const char *flush_attr)
+{
+	FILE *file = fopen(flush_attr, "r");
+	long long us = -1;
+
+	if (file) {
+		if (fscanf(file, "%lld", &us) != 1)
+			us = -1;
+		fclose(file);
+	}
+	return us;
+}
+
+static int change_mode(int fd, const char *flush_attr, unsigned int mode,
+		       int reset, struct timing *timing)
+{
+	unsigned int current;
+	unsigned char byte;
+	uint64_t start = now_us();
+	long long flush_us;
+	int rc;
+
+	if (reset) {
+		rc = ioctl(fd, QUANTIS_IOCTL_SET_QRNG_MODE, &mode);
+		if (rc == 0)
+			rc = ioctl(fd, QUANTIS_IOCTL_RESET_BOARD);
+	} else {
+		rc = ioctl(fd, QUANTIS_IOCTL_SWITCH_QRNG_MODE, &mode);
+	}
+	if (rc < 0) {
+		fprintf(stderr, "%s: %s\n", reset ? "reset" : "switch",
+			strerror(errno));
+		return -1;
+	}
+	timing->ioctl_us += now_us() - start;
+
+	/* the mode is reported once the bytes of the previous one are gone */
+	do {
+		if (ioctl(fd, QUANTIS_IOCTL_GET_CURRENT_QRNG_MODE, &current) <
+		    0) {
+			fprintf(stderr, "current mode: %s\n", strerror(errno));
+			return -1;
+		}
+		if (current == mode)
+			break;
+		usleep(100);
+	} while (now_us() - start < SWITCH_TIMEOUT_US);
+	if (current != mode) {
+		fprintf(stderr, "mode %u not reached\n", mode);
+		return -1;
+	}
+	timing->mode_us += now_us() - start;
+
+	if (read(fd, &byte, 1) != 1) {
+		fprintf(stderr, "read: %s\n", strerror(errno));
+		return -1;
+	}
+	timing->read_us += now_us() - start;
+
+	flush_us = flush_time(flush_attr);
+	if (flush_us >= 0) {
+		timing->flush_us += flush_us;
+		timing->flush_count++;
+	}
+	return 0;
+}
+
+static int bench(int fd, const char *flush_attr, unsigned int initial,
+		 int rounds, int reset)
+{
+	struct timing timing = { 0 };
+	unsigned int mode = initial;
+	int i;
+
+	for (i = 0; i < rounds * 2; i++) {
+		mode = mode == QUANTIS_QRNG_MODE_RNG ? QUANTIS_QRNG_MODE_SAMPLE :
+						       QUANTIS_QRNG_MODE_RNG;
+		if (change_mode(fd, flush_attr, mode, reset, &timing))
+			return -1;
+	}
+
+	printf("%-7s %12.1f %12.1f %12.1f", reset ? "reset" : "switch",
+	       timing.ioctl_us / 1e3 / (rounds * 2),
+	       timing.mode_us / 1e3 / (rounds * 2),
+	       timing.read_us / 1e3 / (rounds * 2));
+	if (timing.flush_count)
+		printf(" %12.1f\n", timing.flush_us / 1e3 / timing.flush_count);
+	else
+		printf(" %12s\n", "-");
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *device = "/dev/qrandom0";
+	char flush_attr[256];
+	char name[64];
+	unsigned int initial;
+	int rounds = 10;
+	int option;
+	int rc;
+	int fd;
+
+	while ((option = getopt(argc, argv, "d:n:")) != -1) {
+		switch (option) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-d device] [-n rounds]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (rounds < 1) {
+		fprintf(stderr, "invalid number of rounds\n");
+		return 1;
+	}
+
+	snprintf(name, sizeof(name), "%s", device);
+	snprintf(flush_attr, sizeof(flush_attr), CLASS_DIR "%s/flush_time_us",
+		 basename(name));
+	fd = open(device, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", device, strerror(errno));
+		return 1;
+	}
+	if (ioctl(fd, QUANTIS_IOCTL_GET_CURRENT_QRNG_MODE, &initial) < 0) {
+		fprintf(stderr, "current mode: %s\n", strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	printf("%s: %d round trips between RNG and SAMPLE, mean ms\n", device,
+	       rounds);
+	printf("%-7s %12s %12s %12s %12s\n", "", "ioctl", "mode", "first byte",
+	       "flush");
+	/* an even number of changes ends in the initial mode */
+	rc = bench(fd, flush_attr, initial, rounds, 0);
+	if (!rc)
+		rc = bench(fd, flush_attr, initial, rounds, 1);
+
+	close(fd);
+	return rc ? 1 : 0;
+}
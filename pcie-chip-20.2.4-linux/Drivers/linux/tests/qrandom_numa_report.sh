@@ -0,0 +1,61 @@
+#!/bin/bash
+# usage: ./qrandom_numa_report.sh [device] [MiB]
+# Example:
+#   ./qrandom_numa_report.sh /dev/qrandom0 1024
+#
+# Reports the cross-node traffic of a reader of the device, pinned with its
+# memory to each NUMA node in turn. The reader is qrandom_perf, run under
+# "perf stat -a" with the node-load/store miss events and, when the host has
+# them, the uncore UPI or QPI flit counters. The reader on the card's node
+# should see no more remote traffic than the idle host: the ring, its
+# results and descriptors are on the card's node. Run it once with each
+# driver to compare them. Needs perf, numactl and root.
+
+set -eu
+
+device=${1:-/dev/qrandom0}
+mib=${2:-1024}
+attrs=/sys/class/quantis_chip_pcie/$(basename "$device")
+perf_reader=$(dirname "$0")/qrandom_perf
+
+card_node=$(cat "$attrs/numa_node")
+nodes=$(numactl --hardware | sed -n 's/^available: [0-9]* nodes (\(.*\))$/\1/p')
+case $nodes in
+*-*) nodes=$(seq -s " " "${nodes%-*}" "${nodes#*-}") ;;
+*) nodes=$(echo "$nodes" | tr , ' ') ;;
+esac
+
+events=node-loads,node-load-misses,node-stores,node-store-misses
+for pmu in uncore_upi uncore_qpi; do
+  if ls -d /sys/bus/event_source/devices/${pmu}_0 >/dev/null 2>&1; then
+    events=$events,$pmu/txl_flits_all_data/
+    break
+  fi
+done
+
+echo "device $device, card on node $card_node, service_cpus $(cat "$attrs/service_cpus")"
+echo "nodes: $nodes, $mib MiB per run"
+printf "%-6s %-7s %10s %14s %14s %14s %10s\n" node where MiB/s \
+  load-misses store-misses uncore-flits pending%
+
+for node in $nodes; do
+  out=$(mktemp)
+  stats=$(mktemp)
+  numactl --cpunodebind="$node" --membind="$node" \
+    perf stat -a -x, -e "$events" -o "$stats" \
+    "$perf_reader" -d "$device" -m "$mib" >"$out"
+
+  value() { sed -n "s/^$1 //p" "$out"; }
+  count() { awk -F, -v e="$1" 'index($3, e) == 1 { print $1; exit }' "$stats"; }
+
+  pending=-
+  if [ -n "$(value clock_cycles)" ] && [ "$(value clock_cycles)" -gt 0 ]; then
+    pending=$(( 100 * $(value pending_cycles) / $(value clock_cycles) ))
+  fi
+  where=remote
+  [ "$node" = "$card_node" ] && where=local
+  printf "%-6s %-7s %10s %14s %14s %14s %10s\n" "$node" "$where" \
+    "$(value read_mib_s)" "$(count node-load-misses)" \
+    "$(count node-store-misses)" "$(count uncore_)" "$pending"
+  rm -f "$out" "$stats"
+done
@@ -0,0 +1,220 @@
+/*
+ * Latency of open/read/close rounds on one device
+ *
+ * Copyright (C) 2019 ID Quantique
+ *
+ * Usage: qrandom_open_bench [-d device] [-n rounds] [-s size] [-c]
+ *
+ * Times rounds of open(), one read() of size bytes (4096 by default) and
+ * close(), then the same read() on a device kept open, and prints the
+ * latency of both. A round costs no more than a read once the RX ring
+ * outlives the close (ring_idle_timeout). With -c, the rounds are timed
+ * again with ring_idle_timeout set to 0, where every close tears the ring
+ * down and every open sets it up, and the parameter is restored afterwards
+ * (this needs root). Meant for the software data source:
+ *
+ *   insmod quantis_chip_pcie.ko soft_source=1
+ *   ./qrandom_open_bench -d /dev/qrandom0 -c
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IDLE_TIMEOUT_PARAM \
+	"/sys/module/quantis_chip_pcie/parameters/ring_idle_timeout"
+
+static const char *device = "/dev/qrandom0";
+static size_t size = 4096;
+static int rounds = 100000;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void print(const char *name, uint64_t *samples)
+{
+	uint64_t sum = 0;
+	int i;
+
+	qsort(samples, rounds, sizeof(*samples), compare);
+	for (i = 0; i < rounds; i++)
+		sum += samples[i];
+	printf("%-22s mean %8.1f us, p50 %8.1f us, p99 %8.1f us, max %8.1f us\n",
+	       name, sum / 1e3 / rounds, samples[rounds / 2] / 1e3,
+	       samples[(int)(rounds * 0.99)] / 1e3, samples[rounds - 1] / 1e3);
+}
+
+static int read_all(int fd, char *buf)
+{
+	size_t done = 0;
+
+	while (done < size) {
+		ssize_t rc = read(fd, buf + done, size - done);
+
+		if (rc <= 0) {
+			fprintf(stderr, "read: %s\n",
+				rc < 0 ? strerror(errno) : "end of file");
+			return -1;
+		}
+		done += rc;
+	}
+	return 0;
+}
+
+/* open, read and close rounds */
+static int bench_rounds(const char *name, uint64_t *samples, char *buf)
+{
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		uint64_t start = now_ns();
+		int fd = open(device, O_RDONLY);
+
+		if (fd < 0) {
+			fprintf(stderr, "%s: %s\n", device, strerror(errno));
+			return -1;
+		}
+		if (read_all(fd, buf)) {
+			close(fd);
+			return -1;
+		}
+		close(fd);
+		samples[i] = now_ns() - start;
+	}
+	print(name, samples);
+	return 0;
+}
+
+/* reads on a device kept open */
+static int bench_reads(uint64_t *samples, char *buf)
+{
+	int fd = open(device, O_RDONLY);
+	int i;
+
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", device, strerror(errno));
+		return -1;
+	}
+	for (i = 0; i < rounds; i++) {
+		uint64_t start = now_ns();
+
+		if (read_all(fd, buf)) {
+			close(fd);
+			return -1;
+		}
+		samples[i] = now_ns() - start;
+	}
+	close(fd);
+	print("read", samples);
+	return 0;
+}
+
+static int param_read(char *value, size_t length)
+{
+	FILE *file = fopen(IDLE_TIMEOUT_PARAM, "r");
+	int rc;
+
+	if (!file) {
+		fprintf(stderr, IDLE_TIMEOUT_PARAM ": %s\n", strerror(errno));
+		return -1;
+	}
+	rc = fgets(value, length, file) ? 0 : -1;
+	fclose(file);
+	return rc;
+}
+
+static int param_write(const char *value)
+{
+	FILE *file = fopen(IDLE_TIMEOUT_PARAM, "w");
+	int rc;
+
+	if (!file) {
+		fprintf(stderr, IDLE_TIMEOUT_PARAM ": %s\n", strerror(errno));
+		return -1;
+	}
+	rc = fputs(value, file) < 0 ? -1 : 0;
+	if (fclose(file))
+		rc = -1;
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	char saved[32];
+	uint64_t *samples;
+	char *buf;
+	int compare_teardown = 0;
+	int option;
+	int rc;
+
+	while ((option = getopt(argc, argv, "d:n:s:c")) != -1) {
+		switch (option) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			compare_teardown = 1;
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d device] [-n rounds] [-s size] [-c]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (rounds < 1 || size < 1) {
+		fprintf(stderr, "invalid number of rounds or size\n");
+		return 1;
+	}
+
+	samples = malloc(rounds * sizeof(*samples));
+	buf = malloc(size);
+	if (!samples || !buf) {
+		fprintf(stderr, "no memory\n");
+		return 1;
+	}
+
+	printf("%s: %d rounds of %zu bytes\n", device, rounds, size);
+	fflush(stdout);
+	rc = bench_reads(samples, buf);
+	if (!rc)
+		rc = bench_rounds("open/read/close", samples, buf);
+
+	if (!rc && compare_teardown) {
+		if (param_read(saved, sizeof(saved)) || param_write("0")) {
+			rc = -1;
+		} else {
+			rc = bench_rounds("ring_idle_timeout=0", samples, buf);
+			if (param_write(saved))
+				rc = -1;
+		}
+	}
+
+	free(buf);
+	free(samples);
+	return rc ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Reads from a device and prints its link statistics
+ *
+ * Copyright (C) 2019 ID Quantique
+ *
+ * Usage: qrandom_perf [-d device] [-m MiB]
+ *
+ * Starts the link statistics of the device (QUANTIS_IOCTL_PERF_START),
+ * reads MiB (256 by default) in 1 MiB reads, stops them and prints them
+ * with the rate seen by the reader, one "name value" pair per line. The
+ * engine counters tell how much of the time the C2H engine waited for the
+ * host, and the counters of the AXI performance monitor (perfmon_offset)
+ * how the card's bus was used. Used by qrandom_numa_report.sh.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/types.h>
+#include <sys/ioctl.h>
+
+#include "quantis_ioctl.h"
+
+#define READ_SIZE (1024 * 1024)
+
+int main(int argc, char *argv[])
+{
+	const char *device = "/dev/qrandom0";
+	uint64_t total_bytes = 256ull * 1024 * 1024;
+	struct quantis_perf_counters perf;
+	struct timespec start, end;
+	uint64_t done = 0;
+	double seconds;
+	char *buf;
+	int option;
+	int fd;
+	int i;
+
+	while ((option = getopt(argc, argv, "d:m:")) != -1) {
+		switch (option) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'm':
+			total_bytes = strtoull(optarg, NULL, 0) * 1024 * 1024;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-d device] [-m MiB]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	buf = malloc(READ_SIZE);
+	fd = open(device, O_RDONLY);
+	if (!buf || fd < 0) {
+		fprintf(stderr, "%s: %s\n", device,
+			buf ? strerror(errno) : "no memory");
+		return 1;
+	}
+	if (ioctl(fd, QUANTIS_IOCTL_PERF_START) < 0) {
+		fprintf(stderr, "QUANTIS_IOCTL_PERF_START: %s\n",
+			strerror(errno));
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (done < total_bytes) {
+		ssize_t rc = read(fd, buf, READ_SIZE);
+
+		if (rc <= 0) {
+			fprintf(stderr, "read: %s\n",
+				rc < 0 ? strerror(errno) : "end of file");
+			return 1;
+		}
+		done += rc;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (ioctl(fd, QUANTIS_IOCTL_PERF_STOP) < 0 ||
+	    ioctl(fd, QUANTIS_IOCTL_PERF_GET, &perf) < 0) {
+		fprintf(stderr, "link statistics: %s\n", strerror(errno));
+		return 1;
+	}
+	close(fd);
+	free(buf);
+
+	seconds = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("read_bytes %llu\n", (unsigned long long)done);
+	printf("read_mib_s %.1f\n", done / (1024.0 * 1024.0) / seconds);
+	printf("elapsed_ns %llu\n", (unsigned long long)perf.elapsed_ns);
+	printf("ring_bytes %llu\n", (unsigned long long)perf.ring_bytes);
+	printf("ring_blocks %llu\n", (unsigned long long)perf.ring_blocks);
+	printf("ring_overruns %llu\n", (unsigned long long)perf.ring_overruns);
+	printf("ring_waits %llu\n", (unsigned long long)perf.ring_waits);
+	if (perf.flags & QUANTIS_PERF_ENGINE) {
+		printf("clock_cycles %llu\n",
+		       (unsigned long long)perf.clock_cycles);
+		printf("data_cycles %llu\n",
+		       (unsigned long long)perf.data_cycles);
+		printf("pending_cycles %llu\n",
+		       (unsigned long long)perf.pending_cycles);
+	}
+	if (perf.flags & QUANTIS_PERF_APM) {
+		printf("apm_clock_cycles %llu\n",
+		       (unsigned long long)perf.apm_clock_cycles);
+		for (i = 0; i < QUANTIS_PERF_APM_METRICS; i++)
+			printf("apm_metric%d %u\n", i, perf.apm_metrics[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,345 @@
+/*
+ * Stress test of concurrent readers of one device
+ *
+ * Copyright (C) 2019 ID Quantique
+ *
+ * Usage: qrandom_stress [-d device] [-r readers] [-m MiB] [-s max_read]
+ *
+ * Starts readers (64 by default) reading random sizes from their own open of
+ * the device, plus a thread asking the modules status and the serial number
+ * in a loop, until the given amount of data is read. Meant for the software
+ * data source:
+ *
+ *   insmod quantis_chip_pcie.ko soft_source=1
+ *   ./qrandom_stress -d /dev/qrandom0
+ *
+ * Checks that no byte range is handed out twice: the 8 bytes following
+ * each zero byte of the data are kept, and no such key may show up twice.
+ * The keys don't depend on how the data is split into reads, so a range
+ * read by two readers is found whatever the offsets of the reads. Prints
+ * the throughput and the latency of the reads and of the ioctls, which
+ * must not wait behind the reads.
+ *
+ * Returns 0 when the checks pass, 1 otherwise.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/types.h>
+#include <sys/ioctl.h>
+
+#include "quantis_ioctl.h"
+
+#define MAX_READERS 256
+#define MAX_READ_SIZE (1024 * 1024)
+/* latency histogram buckets, bucket i counts latencies below 2^i us */
+#define LATENCY_BUCKETS 32
+
+struct latency {
+	uint64_t count;
+	uint64_t max_us;
+	uint64_t buckets[LATENCY_BUCKETS];
+};
+
+struct reader {
+	pthread_t thread;
+	unsigned int seed;
+	uint64_t *keys;
+	size_t key_count;
+	size_t key_size;
+	uint64_t bytes;
+	int error;
+	struct latency latency;
+};
+
+static const char *device = "/dev/qrandom0";
+static size_t max_read = 12 * 1024;
+static uint64_t total_bytes = 1024ull * 1024 * 1024;
+static uint64_t read_bytes; /* shared, updated atomically */
+static volatile int done;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void latency_add(struct latency *latency, uint64_t us)
+{
+	int bucket = 0;
+
+	while (bucket < LATENCY_BUCKETS - 1 && (1ull << bucket) <= us)
+		bucket++;
+	latency->buckets[bucket]++;
+	latency->count++;
+	if (us > latency->max_us)
+		latency->max_us = us;
+}
+
+/* upper bound of the bucket holding the given fraction of the samples */
+static uint64_t latency_percentile(const struct latency *latency,
+				   double fraction)
+{
+	uint64_t target = (uint64_t)(latency->count * fraction);
+	uint64_t seen = 0;
+	int bucket;
+
+	for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+		seen += latency->buckets[bucket];
+		if (seen > target)
+			return 1ull << bucket;
+	}
+	return latency->max_us;
+}
+
+static void latency_print(const char *name, const struct latency *latency)
+{
+	printf("%-8s %10llu calls, p50 < %llu us, p99 < %llu us, max %llu us\n",
+	       name, (unsigned long long)latency->count,
+	       (unsigned long long)latency_percentile(latency, 0.5),
+	       (unsigned long long)latency_percentile(latency, 0.99),
+	       (unsigned long long)latency->max_us);
+}
+
+static int key_add(struct reader *reader, uint64_t key)
+{
+	if (reader->key_count == reader->key_size) {
+		size_t size = reader->key_size ? reader->key_size * 2 : 65536;
+		uint64_t *keys = realloc(reader->keys, size * sizeof(*keys));
+
+		if (!keys)
+			return -ENOMEM;
+		reader->keys = keys;
+		reader->key_size = size;
+	}
+	reader->keys[reader->key_count++] = key;
+	return 0;
+}
+
+/* keeps the 8 bytes following each zero byte of the buffer */
+static int keys_collect(struct reader *reader, const unsigned char *buf,
+			size_t size)
+{
+	const unsigned char *p = buf;
+	const unsigned char *end = buf + size;
+	uint64_t key;
+
+	while ((p = memchr(p, 0, end - p)) && end - p > 8) {
+		memcpy(&key, p + 1, sizeof(key));
+		if (key_add(reader, key))
+			return -ENOMEM;
+		p++;
+	}
+	return 0;
+}
+
+static void *reader_run(void *arg)
+{
+	struct reader *reader = arg;
+	unsigned char *buf;
+	int fd;
+
+	buf = malloc(max_read);
+	fd = open(device, O_RDONLY);
+	if (!buf || fd < 0) {
+		reader->error = errno ? errno : ENOMEM;
+		done = 1;
+		free(buf);
+		if (fd >= 0)
+			close(fd);
+		return NULL;
+	}
+
+	while (!done) {
+		size_t size = 1 + rand_r(&reader->seed) % max_read;
+		uint64_t start = now_us();
+		ssize_t rc = read(fd, buf, size);
+
+		latency_add(&reader->latency, now_us() - start);
+		if (rc <= 0) {
+			reader->error = rc < 0 ? errno : EIO;
+			done = 1;
+			break;
+		}
+		if (keys_collect(reader, buf, rc)) {
+			reader->error = ENOMEM;
+			done = 1;
+			break;
+		}
+		reader->bytes += rc;
+		if (__atomic_add_fetch(&read_bytes, (uint64_t)rc,
+				       __ATOMIC_RELAXED) >= total_bytes)
+			done = 1;
+	}
+
+	close(fd);
+	free(buf);
+	return NULL;
+}
+
+/* asks the ioctls the readers must not hold up, until the readers stop */
+static void *ioctl_run(void *arg)
+{
+	struct latency *latency = arg;
+	char serial[QUANTIS_IOCTL_GET_SERIAL_MAX_LENGTH];
+	unsigned int status;
+	int fd = open(device, O_RDONLY);
+
+	if (fd < 0)
+		return (void *)(intptr_t)errno;
+
+	while (!done) {
+		uint64_t start = now_us();
+
+		if (ioctl(fd, QUANTIS_IOCTL_GET_MODULES_STATUS, &status) < 0 ||
+		    ioctl(fd, QUANTIS_IOCTL_GET_SERIAL, serial) < 0) {
+			close(fd);
+			return (void *)(intptr_t)errno;
+		}
+		latency_add(latency, now_us() - start);
+		usleep(1000);
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static int key_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct reader readers[MAX_READERS];
+	struct latency read_latency = { 0 };
+	struct latency ioctl_latency = { 0 };
+	pthread_t ioctl_thread;
+	void *ioctl_error;
+	uint64_t *keys;
+	size_t key_count = 0;
+	size_t duplicates = 0;
+	uint64_t start;
+	double seconds;
+	int reader_count = 64;
+	int errors = 0;
+	int option;
+	int i, j;
+	size_t k;
+
+	while ((option = getopt(argc, argv, "d:r:m:s:")) != -1) {
+		switch (option) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'r':
+			reader_count = atoi(optarg);
+			break;
+		case 'm':
+			total_bytes = strtoull(optarg, NULL, 0) * 1024 * 1024;
+			break;
+		case 's':
+			max_read = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"Usage: %s [-d device] [-r readers] [-m MiB] [-s max_read]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (reader_count < 1 || reader_count > MAX_READERS || max_read < 1 ||
+	    max_read > MAX_READ_SIZE || total_bytes == 0) {
+		fprintf(stderr, "invalid number of readers, size or amount\n");
+		return 1;
+	}
+
+	printf("%s: %d readers of 1 to %zu bytes, %llu MiB\n", device,
+	       reader_count, max_read,
+	       (unsigned long long)(total_bytes / (1024 * 1024)));
+	fflush(stdout);
+
+	start = now_us();
+	for (i = 0; i < reader_count; i++) {
+		readers[i].seed = (unsigned int)(start + i);
+		if (pthread_create(&readers[i].thread, NULL, reader_run,
+				   &readers[i])) {
+			fprintf(stderr, "cannot start reader %d\n", i);
+			return 1;
+		}
+	}
+	if (pthread_create(&ioctl_thread, NULL, ioctl_run, &ioctl_latency)) {
+		fprintf(stderr, "cannot start the ioctl thread\n");
+		return 1;
+	}
+
+	for (i = 0; i < reader_count; i++)
+		pthread_join(readers[i].thread, NULL);
+	seconds = (now_us() - start) / 1e6;
+	done = 1;
+	pthread_join(ioctl_thread, &ioctl_error);
+
+	for (i = 0; i < reader_count; i++) {
+		if (readers[i].error) {
+			fprintf(stderr, "reader %d: %s\n", i,
+				strerror(readers[i].error));
+			errors++;
+		}
+		read_latency.count += readers[i].latency.count;
+		if (readers[i].latency.max_us > read_latency.max_us)
+			read_latency.max_us = readers[i].latency.max_us;
+		for (j = 0; j < LATENCY_BUCKETS; j++)
+			read_latency.buckets[j] += readers[i].latency.buckets[j];
+		key_count += readers[i].key_count;
+	}
+	if (ioctl_error) {
+		fprintf(stderr, "ioctl: %s\n",
+			strerror((int)(intptr_t)ioctl_error));
+		errors++;
+	}
+
+	/* a key showing up twice is data handed out twice */
+	keys = malloc((key_count ? key_count : 1) * sizeof(*keys));
+	if (!keys) {
+		fprintf(stderr, "no memory for %zu keys\n", key_count);
+		return 1;
+	}
+	key_count = 0;
+	for (i = 0; i < reader_count; i++) {
+		memcpy(keys + key_count, readers[i].keys,
+		       readers[i].key_count * sizeof(*keys));
+		key_count += readers[i].key_count;
+		free(readers[i].keys);
+	}
+	qsort(keys, key_count, sizeof(*keys), key_compare);
+	for (k = 1; k < key_count; k++)
+		duplicates += keys[k] == keys[k - 1];
+	free(keys);
+
+	printf("%.1f MiB/s over %.2f s\n",
+	       __atomic_load_n(&read_bytes, __ATOMIC_RELAXED) /
+		       (1024.0 * 1024.0) / seconds,
+	       seconds);
+	latency_print("read", &read_latency);
+	latency_print("ioctl", &ioctl_latency);
+	printf("%zu keys, %zu duplicates\n", key_count, duplicates);
+
+	if (errors || duplicates) {
+		printf("FAILED\n");
+		return 1;
+	}
+	printf("PASSED\n");
+	return 0;
+}
@@ -105,7 +105,9 @@ int idQ::EasyQuantis::EasyQuantisCmd::Exec()
                                                                                                                                                                                                                  pa::value<double>(),
                                                                                                                                                                                                                  "Specify the minimal value of the number")("max",
                                                                                                                                                                                                                                                             pa::value<double>(),
-                                                                                                                                                                                                                                                            "Specify the maximal value of the number");
+                                                                                                                                                                                                                                                            "Specify the maximal value of the number")("splice",
+                                                                                                                                                                                                                                                                                                       "Write the binary file with splice(2), without copying the data through EasyQuantis (Linux, Quantis PCI only)")("link-stats",
+                                                                                                                                                                                                                                                                                                                  "Measure the PCIe link during the acquisition, to tell whether the link, the host or the random source bounds the throughput (Quantis PCI only)");
 
   pa::options_description extraction("Extraction options");
   extraction.add_options()("matrix-file,m", pa::value<string>()->default_value(""), "The path of the matrix file. If not defined, extraction processing is disabled")("matrix-size-in,I", pa::value<int>()->default_value(1024), "The matrix input size in bits (default 1024)")("matrix-size-out,O", pa::value<int>()->default_value(768), "The matrix output size in bits (default 768)")("extraction-from-file", "If defined perform extraction processing from 'extraction-input-file' and save to 'extraction-output-file'")("extraction-input-file", pa::value<string>(), "The path of the binary input file")("extraction-output-file", pa::value<string>(), "The path of the binary output file");
@@ -231,6 +233,28 @@ int idQ::EasyQuantis::EasyQuantisCmd::Exec()
       cerr << "No output format provided! " << endl;
       return -1;
     }
+
+    if (vm.count("splice"))
+    {
+      if ((randomDataGenerationInfo.dataType != RANDOM_DATA_TYPE_BINARY) ||
+          (randomDataGenerationInfo.deviceType != QUANTIS_DEVICE_PCI))
+      {
+        cerr << "splice is only available for binary files from a Quantis PCI device!" << endl;
+        return -1;
+      }
+      randomDataGenerationInfo.spliceEnabled = true;
+    }
+    else
+    {
+      randomDataGenerationInfo.spliceEnabled = false;
+    }
+
+    if (vm.count("link-stats") &&
+        (randomDataGenerationInfo.deviceType != QUANTIS_DEVICE_PCI))
+    {
+      cerr << "link-stats is only available for a Quantis PCI device!" << endl;
+      return -1;
+    }
   }
 
   //Parse extraction options
@@ -259,6 +283,12 @@ int idQ::EasyQuantis::EasyQuantisCmd::Exec()
     randomDataGenerationInfo.extractorEnabled = true;
   }
 
+  if (vm.count("splice") && randomDataGenerationInfo.extractorEnabled)
+  {
+    cerr << "splice cannot be used with extraction processing!" << endl;
+    return -1;
+  }
+
   if (vm.count("extraction-input-file"))
   {
     QFile inputFile(QString::fromStdString(vm["extraction-input-file"].as<string>()));
@@ -278,7 +308,28 @@ int idQ::EasyQuantis::EasyQuantisCmd::Exec()
     fileExtractionGenerationInfo.outputFile = vm["extraction-output-file"].as<string>();
   }
 
-  if (action == ACTION_ACQUISITION)
+  if ((action == ACTION_ACQUISITION) && vm.count("link-stats"))
+  {
+    // The statistics count for the whole device, from start to stop
+    int result = QuantisStartLinkStats(randomDataGenerationInfo.deviceType,
+                                       randomDataGenerationInfo.deviceNumber);
+    if (result < 0)
+    {
+      cerr << "Link statistics are not available: "
+           << QuantisStrError(static_cast<QuantisError>(result)) << endl;
+      return -1;
+    }
+
+    result = Acquisition(randomDataGenerationInfo, filename);
+    QuantisStopLinkStats(randomDataGenerationInfo.deviceType,
+                         randomDataGenerationInfo.deviceNumber);
+    if (result == 0)
+    {
+      result = PrintLinkStats(randomDataGenerationInfo.deviceNumber);
+    }
+    return result;
+  }
+  else if (action == ACTION_ACQUISITION)
   {
     return Acquisition(randomDataGenerationInfo, filename);
   }
@@ -479,6 +530,13 @@ void idQ::EasyQuantis::EasyQuantisCmd::PrintUsage(
   cout << "  first Quantis PCI device:" << endl;
   cout << "    " << programPath.filename() << " -p 0 -b random.dat -n 1073741824" << endl;
   cout << endl;
+  cout << "  The same, the data being moved from the driver to the file with splice:" << endl;
+  cout << "    " << programPath.filename() << " -p 0 -b random.dat -n 1073741824 --splice" << endl;
+  cout << endl;
+  cout << "  The same, telling afterwards whether the PCIe link, the host or the random" << endl;
+  cout << "  source limited the throughput:" << endl;
+  cout << "    " << programPath.filename() << " -p 0 -b random.dat -n 1073741824 --link-stats" << endl;
+  cout << endl;
   cout << "  The following generates the file integers.dat with 10 numbers (one number " << endl;
   cout << "  per line) whose values are between 1 and 6 with first Quantis USB device:" << endl;
   cout << "    " << programPath.filename() << " -u 0 -i integers.dat -n 10 --min 1 --max 6" << endl;
@@ -496,6 +554,79 @@ void idQ::EasyQuantis::EasyQuantisCmd::PrintUsage(
        << endl;
 }
 
+int idQ::EasyQuantis::EasyQuantisCmd::PrintLinkStats(unsigned int deviceNumber)
+{
+  // Busy ratios above which the link is taken as the bound
+  const double LINK_BOUND_DATA_RATIO = 0.8;
+  const double LINK_BOUND_PENDING_RATIO = 0.5;
+
+  QuantisLinkStats stats;
+  int result = QuantisGetLinkStats(QUANTIS_DEVICE_PCI, deviceNumber, &stats);
+  if (result < 0)
+  {
+    cerr << "Error while getting the link statistics: "
+         << QuantisStrError(static_cast<QuantisError>(result)) << endl;
+    return -1;
+  }
+
+  double seconds = static_cast<double>(stats.elapsedNs) / 1e9;
+  cout << dec << "Link statistics of Quantis PCI device #" << deviceNumber << ":" << endl;
+  cout << "  elapsed time: " << seconds << " s" << endl;
+  cout << "  bytes read from the ring: " << stats.ringBytes;
+  if (seconds > 0.0)
+  {
+    cout << " (" << static_cast<double>(stats.ringBytes) / seconds / 1e6 << " MB/s)";
+  }
+  cout << endl;
+  cout << "  blocks received: " << stats.ringBlocks << endl;
+  cout << "  ring overruns: " << stats.ringOverruns << endl;
+  cout << "  reader waits: " << stats.ringWaits << endl;
+
+  double dataRatio = 0.0;
+  double pendingRatio = 0.0;
+  if (stats.flags & QUANTIS_LINK_STATS_ENGINE)
+  {
+    if (stats.clockCycles > 0u)
+    {
+      dataRatio = static_cast<double>(stats.dataCycles) / stats.clockCycles;
+      pendingRatio = static_cast<double>(stats.pendingCycles) / stats.clockCycles;
+    }
+    cout << "  engine clock cycles: " << stats.clockCycles << endl;
+    cout << "  engine data cycles: " << stats.dataCycles
+         << " (" << 100.0 * dataRatio << "%)" << endl;
+    cout << "  engine pending cycles: " << stats.pendingCycles
+         << " (" << 100.0 * pendingRatio << "%)" << endl;
+  }
+  if (stats.flags & QUANTIS_LINK_STATS_MONITOR)
+  {
+    cout << "  monitor clock cycles: " << stats.monitorClockCycles << endl;
+    for (int i = 0; i < QUANTIS_LINK_STATS_METRICS; i++)
+    {
+      cout << "  monitor metric " << i << ": " << stats.monitorMetrics[i] << endl;
+    }
+  }
+
+  if (stats.ringOverruns > 0u)
+  {
+    cout << "Bound by the host: the ring got full, the readers did not keep up." << endl;
+  }
+  else if (!(stats.flags & QUANTIS_LINK_STATS_ENGINE))
+  {
+    cout << "No engine counters, the link can't be told from the random source." << endl;
+  }
+  else if ((dataRatio >= LINK_BOUND_DATA_RATIO) ||
+           (pendingRatio >= LINK_BOUND_PENDING_RATIO))
+  {
+    cout << "Bound by the PCIe link: the engine was busy or waiting on it." << endl;
+  }
+  else
+  {
+    cout << "Bound by the random source: the link and the readers were idle." << endl;
+  }
+
+  return 0;
+}
+
 void idQ::EasyQuantis::EasyQuantisCmd::PrintDevicesList()
 {
   PrintDevicesList(QUANTIS_DEVICE_PCI);
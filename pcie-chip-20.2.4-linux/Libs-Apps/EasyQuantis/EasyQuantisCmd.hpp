@@ -82,6 +82,8 @@ private:
   void PrintUsage(char *programName,
                   boost::program_options::options_description &desc);
 
+  int PrintLinkStats(unsigned int deviceNumber);
+
   void PrintDevicesList();
   void PrintDevicesList(QuantisDeviceType deviceType);
 
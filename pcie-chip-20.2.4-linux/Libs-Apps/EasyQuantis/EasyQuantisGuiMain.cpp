@@ -767,6 +767,7 @@ void idQ::EasyQuantis::EasyQuantisGuiMain::on_pushButtonDataGenerate_clicked()
   GetCurrentQuantisInfo(&randomDataGenerationInfo.deviceType,
                         &randomDataGenerationInfo.deviceNumber);
   randomDataGenerationInfo.scaleData = groupBoxDataScaling->isChecked();
+  randomDataGenerationInfo.spliceEnabled = false;
   randomDataGenerationInfo.min = doubleSpinBoxDataScalingMin->value();
   randomDataGenerationInfo.max = doubleSpinBoxDataScalingMax->value();
 
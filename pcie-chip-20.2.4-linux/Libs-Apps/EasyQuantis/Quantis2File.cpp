@@ -50,6 +50,14 @@
 
 #include <limits>
 
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "Quantis/Conversion.h"
 
 #include "Quantis2File.hpp"
@@ -59,6 +67,50 @@ using namespace std;
 /* Set to a multiple of 64 to avoid any problem */
 const size_t idQ::EasyQuantis::Quantis2File::CHUNK_SIZE = 8192u;
 
+/* Also the size asked for the pipe, the default maximum for a user */
+const size_t idQ::EasyQuantis::Quantis2File::SPLICE_CHUNK_SIZE = 1048576u;
+
+#ifdef __linux__
+namespace
+{
+/* Releases what SpliceBinaryFile() opened, however it returns */
+struct SpliceResources
+{
+  QuantisDeviceHandle *deviceHandle;
+  int outputFd;
+  int pipeFds[2];
+
+  SpliceResources() : deviceHandle(NULL), outputFd(-1)
+  {
+    pipeFds[0] = -1;
+    pipeFds[1] = -1;
+  }
+
+  ~SpliceResources()
+  {
+    if (pipeFds[0] >= 0)
+    {
+      close(pipeFds[0]);
+      close(pipeFds[1]);
+    }
+    if (outputFd >= 0)
+    {
+      close(outputFd);
+    }
+    if (deviceHandle != NULL)
+    {
+      QuantisClose(deviceHandle);
+    }
+  }
+};
+
+std::runtime_error SpliceError(const std::string &what)
+{
+  return std::runtime_error("Quantis2File: " + what + ": " + strerror(errno));
+}
+} // namespace
+#endif
+
 idQ::EasyQuantis::Quantis2File::Quantis2File() : remaining(0u)
 {
 }
@@ -116,6 +168,114 @@ unsigned long long idQ::EasyQuantis::Quantis2File::GenerateBinaryFile(
   return outputFile.GetSize();
 }
 
+unsigned long long idQ::EasyQuantis::Quantis2File::SpliceBinaryFile(
+    QuantisDeviceType deviceType,
+    unsigned int deviceNumber,
+    const std::string &filename,
+    bool discardContent,
+    unsigned long long size) throw(std::runtime_error)
+{
+#ifdef __linux__
+  SpliceResources resources;
+  struct stat outputStat;
+
+  if (deviceType != QUANTIS_DEVICE_PCI)
+  {
+    throw runtime_error("Quantis2File: splice needs a Quantis PCI device");
+  }
+
+  int result = QuantisOpen(deviceType, deviceNumber, &resources.deviceHandle);
+  if (result != QUANTIS_SUCCESS)
+  {
+    resources.deviceHandle = NULL;
+    throw runtime_error(QuantisStrError(static_cast<QuantisError>(result)));
+  }
+
+  int deviceFd = QuantisGetFd(resources.deviceHandle);
+  if (deviceFd < 0)
+  {
+    throw runtime_error(QuantisStrError(static_cast<QuantisError>(deviceFd)));
+  }
+
+  resources.outputFd = open(filename.c_str(),
+                            O_WRONLY | O_CREAT | (discardContent ? O_TRUNC : O_APPEND),
+                            0644);
+  if (resources.outputFd < 0)
+  {
+    throw SpliceError("unable to open " + filename);
+  }
+
+  if (pipe(resources.pipeFds) < 0)
+  {
+    throw SpliceError("unable to create a pipe");
+  }
+  // Fewer and larger moves, the default pipe holds 64 KiB
+  fcntl(resources.pipeFds[1], F_SETPIPE_SZ, static_cast<int>(SPLICE_CHUNK_SIZE));
+
+  size_t chunkSize = SPLICE_CHUNK_SIZE;
+  remaining = size;
+
+  canRead = true;
+
+  while ((remaining > 0u) && canRead)
+  {
+    // Chunk size
+    if (remaining < chunkSize)
+    {
+      chunkSize = static_cast<size_t>(remaining);
+    }
+
+    // Driver to pipe, the pipe being empty
+    ssize_t spliced = splice(deviceFd, NULL, resources.pipeFds[1], NULL,
+                             chunkSize, SPLICE_F_MOVE);
+    if (spliced < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (spliced <= 0)
+    {
+      throw SpliceError("unable to splice from the Quantis device");
+    }
+
+    // Pipe to file, until the pipe is empty again
+    size_t inPipe = static_cast<size_t>(spliced);
+    while (inPipe > 0u)
+    {
+      ssize_t written = splice(resources.pipeFds[0], NULL, resources.outputFd,
+                               NULL, inPipe, SPLICE_F_MOVE);
+      if (written < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (written <= 0)
+      {
+        throw SpliceError("unable to splice to " + filename);
+      }
+      inPipe -= static_cast<size_t>(written);
+    }
+
+    // Update info
+    remaining -= static_cast<unsigned long long>(spliced);
+  }
+
+  canRead = false;
+
+  if (fstat(resources.outputFd, &outputStat) < 0)
+  {
+    throw SpliceError("unable to get the size of " + filename);
+  }
+
+  return static_cast<unsigned long long>(outputStat.st_size);
+#else
+  (void)deviceType;
+  (void)deviceNumber;
+  (void)filename;
+  (void)discardContent;
+  (void)size;
+  throw runtime_error("Quantis2File: splice is only available on Linux");
+#endif
+}
+
 unsigned long long idQ::EasyQuantis::Quantis2File::GenerateIntsFile(
     QuantisDeviceType deviceType,
     unsigned int deviceNumber,
@@ -411,11 +571,22 @@ void idQ::EasyQuantis::Quantis2File::GenerateRandomFile(
       {
       // Binary data
       case RANDOM_DATA_TYPE_BINARY:
-        quantis2File->GenerateBinaryFile(randomDataGenerationInfo->deviceType,
+        if (randomDataGenerationInfo->spliceEnabled)
+        {
+          quantis2File->SpliceBinaryFile(randomDataGenerationInfo->deviceType,
                                          randomDataGenerationInfo->deviceNumber,
                                          filename,
                                          true,
                                          randomDataGenerationInfo->count);
+        }
+        else
+        {
+          quantis2File->GenerateBinaryFile(randomDataGenerationInfo->deviceType,
+                                           randomDataGenerationInfo->deviceNumber,
+                                           filename,
+                                           true,
+                                           randomDataGenerationInfo->count);
+        }
         break;
 
       // Integers
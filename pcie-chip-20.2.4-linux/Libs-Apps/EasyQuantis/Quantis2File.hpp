@@ -113,6 +113,21 @@ public:
       bool discardContent,
       unsigned long long size) throw(std::runtime_error);
 
+  /**
+         * Same as GenerateBinaryFile(), but the data is moved from the
+         * driver to the output file with splice(2), through a pipe, instead
+         * of being read into EasyQuantis then written. Only for a Quantis
+         * PCI device on Linux.
+         * @param size The size in bytes to read from the Quantis and write
+         * to the output file.
+         */
+  unsigned long long SpliceBinaryFile(
+      QuantisDeviceType deviceType,
+      unsigned int deviceNumber,
+      const std::string &filename,
+      bool discardContent,
+      unsigned long long size) throw(std::runtime_error);
+
   unsigned long long GenerateIntsFile(
       QuantisDeviceType deviceType,
       unsigned int deviceNumber,
@@ -234,6 +249,9 @@ private:
   /** Size of the chunk that will be requested */
   static const size_t CHUNK_SIZE;
 
+  /** Size of the chunk moved at once by SpliceBinaryFile() */
+  static const size_t SPLICE_CHUNK_SIZE;
+
   unsigned long long ProcessExtraction(idQ::EasyQuantis::FileExtractionGenerationInfo *fileExtractionGenerationInfo) throw(std::runtime_error);
 
   unsigned long long GenerateElementaryMatrix(const idQ::EasyQuantis::ElementaryMatrixExtractionGenerationInfo *elementaryMatrixExtractionGenerationInfo) throw(std::runtime_error);
@@ -87,6 +87,7 @@ struct RandomDataGenerationInfo
   int extractorMatrixSizeIn;
   int extractorMatrixSizeOut;
   std::string extractorMatrixFilename;
+  bool spliceEnabled;
 };
 
 struct FileExtractionGenerationInfo
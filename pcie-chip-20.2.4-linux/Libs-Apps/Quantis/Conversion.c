@@ -58,6 +58,17 @@
 
 #include "Conversion.h"
 
+/*
+ * Array conversions have SSE2, AVX2 and AVX-512 kernels, selected at runtime
+ * according to the CPU. Every kernel gives exactly the same values as the
+ * scalar ConvertToDouble_01()/ConvertToFloat_01(): the integer is converted
+ * with a single rounding to nearest, then scaled by a power of two.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERSION_X86_SIMD
+#include <immintrin.h>
+#endif
+
 double ConvertToDouble_01(const char *buffer)
 {
   uint64_t value;
@@ -72,6 +83,200 @@ float ConvertToFloat_01(const char *buffer)
   return (float)value / ((float)0xFFFFFFFFu + 1.0f);
 }
 
+/* Scalar kernels, also used for the tail of the SIMD kernels */
+static void ConvertToDoubles_01Scalar(double *values, const char *buffer, size_t count)
+{
+  size_t i;
+  for (i = 0u; i < count; i++)
+  {
+    values[i] = ConvertToDouble_01(buffer + i * sizeof(uint64_t));
+  }
+}
+
+static void ConvertToFloats_01Scalar(float *values, const char *buffer, size_t count)
+{
+  size_t i;
+  for (i = 0u; i < count; i++)
+  {
+    values[i] = ConvertToFloat_01(buffer + i * sizeof(uint32_t));
+  }
+}
+
+#ifdef CONVERSION_X86_SIMD
+
+/*
+ * uint64 to double without AVX-512: the high and low 32-bit halves are
+ * turned into exact doubles with the 2^84 and 2^52 exponent tricks and
+ * added, which rounds only once.
+ */
+__attribute__((target("sse2"))) static void ConvertToDoubles_01Sse2(double *values, const char *buffer, size_t count)
+{
+  const __m128i lowMask = _mm_set1_epi64x(0xFFFFFFFFll);
+  const __m128i exp52 = _mm_castpd_si128(_mm_set1_pd(4503599627370496.0));         /* 2^52 */
+  const __m128i exp84 = _mm_castpd_si128(_mm_set1_pd(19342813113834066795298816.0)); /* 2^84 */
+  const __m128d exp84_52 = _mm_set1_pd(19342813118337666422669312.0);                /* 2^84 + 2^52 */
+  const __m128d scale = _mm_set1_pd(1.0 / 18446744073709551616.0);                   /* 2^-64 */
+  size_t i;
+
+  for (i = 0u; i + 2u <= count; i += 2u)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(buffer + i * sizeof(uint64_t)));
+    __m128i high = _mm_or_si128(_mm_srli_epi64(x, 32), exp84);
+    __m128i low = _mm_or_si128(_mm_and_si128(x, lowMask), exp52);
+    __m128d d = _mm_add_pd(_mm_sub_pd(_mm_castsi128_pd(high), exp84_52), _mm_castsi128_pd(low));
+    _mm_storeu_pd(values + i, _mm_mul_pd(d, scale));
+  }
+  ConvertToDoubles_01Scalar(values + i, buffer + i * sizeof(uint64_t), count - i);
+}
+
+__attribute__((target("avx2"))) static void ConvertToDoubles_01Avx2(double *values, const char *buffer, size_t count)
+{
+  const __m256i lowMask = _mm256_set1_epi64x(0xFFFFFFFFll);
+  const __m256i exp52 = _mm256_castpd_si256(_mm256_set1_pd(4503599627370496.0));
+  const __m256i exp84 = _mm256_castpd_si256(_mm256_set1_pd(19342813113834066795298816.0));
+  const __m256d exp84_52 = _mm256_set1_pd(19342813118337666422669312.0);
+  const __m256d scale = _mm256_set1_pd(1.0 / 18446744073709551616.0);
+  size_t i;
+
+  for (i = 0u; i + 4u <= count; i += 4u)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(buffer + i * sizeof(uint64_t)));
+    __m256i high = _mm256_or_si256(_mm256_srli_epi64(x, 32), exp84);
+    __m256i low = _mm256_or_si256(_mm256_and_si256(x, lowMask), exp52);
+    __m256d d = _mm256_add_pd(_mm256_sub_pd(_mm256_castsi256_pd(high), exp84_52), _mm256_castsi256_pd(low));
+    _mm256_storeu_pd(values + i, _mm256_mul_pd(d, scale));
+  }
+  ConvertToDoubles_01Scalar(values + i, buffer + i * sizeof(uint64_t), count - i);
+}
+
+__attribute__((target("avx512f,avx512dq"))) static void ConvertToDoubles_01Avx512(double *values, const char *buffer, size_t count)
+{
+  const __m512d scale = _mm512_set1_pd(1.0 / 18446744073709551616.0);
+  size_t i;
+
+  for (i = 0u; i + 8u <= count; i += 8u)
+  {
+    __m512i x = _mm512_loadu_si512((const void *)(buffer + i * sizeof(uint64_t)));
+    _mm512_storeu_pd(values + i, _mm512_mul_pd(_mm512_cvtepu64_pd(x), scale));
+  }
+  ConvertToDoubles_01Scalar(values + i, buffer + i * sizeof(uint64_t), count - i);
+}
+
+/*
+ * uint32 to float without AVX-512: both 16-bit halves convert exactly and
+ * their sum rounds only once.
+ */
+__attribute__((target("sse2"))) static void ConvertToFloats_01Sse2(float *values, const char *buffer, size_t count)
+{
+  const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+  const __m128 exp16 = _mm_set1_ps(65536.0f);
+  const __m128 scale = _mm_set1_ps(1.0f / 4294967296.0f); /* 2^-32 */
+  size_t i;
+
+  for (i = 0u; i + 4u <= count; i += 4u)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(buffer + i * sizeof(uint32_t)));
+    __m128 high = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 16)), exp16);
+    __m128 low = _mm_cvtepi32_ps(_mm_and_si128(x, lowMask));
+    _mm_storeu_ps(values + i, _mm_mul_ps(_mm_add_ps(high, low), scale));
+  }
+  ConvertToFloats_01Scalar(values + i, buffer + i * sizeof(uint32_t), count - i);
+}
+
+__attribute__((target("avx2"))) static void ConvertToFloats_01Avx2(float *values, const char *buffer, size_t count)
+{
+  const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+  const __m256 exp16 = _mm256_set1_ps(65536.0f);
+  const __m256 scale = _mm256_set1_ps(1.0f / 4294967296.0f);
+  size_t i;
+
+  for (i = 0u; i + 8u <= count; i += 8u)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(buffer + i * sizeof(uint32_t)));
+    __m256 high = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 16)), exp16);
+    __m256 low = _mm256_cvtepi32_ps(_mm256_and_si256(x, lowMask));
+    _mm256_storeu_ps(values + i, _mm256_mul_ps(_mm256_add_ps(high, low), scale));
+  }
+  ConvertToFloats_01Scalar(values + i, buffer + i * sizeof(uint32_t), count - i);
+}
+
+__attribute__((target("avx512f"))) static void ConvertToFloats_01Avx512(float *values, const char *buffer, size_t count)
+{
+  const __m512 scale = _mm512_set1_ps(1.0f / 4294967296.0f);
+  size_t i;
+
+  for (i = 0u; i + 16u <= count; i += 16u)
+  {
+    __m512i x = _mm512_loadu_si512((const void *)(buffer + i * sizeof(uint32_t)));
+    _mm512_storeu_ps(values + i, _mm512_mul_ps(_mm512_cvtepu32_ps(x), scale));
+  }
+  ConvertToFloats_01Scalar(values + i, buffer + i * sizeof(uint32_t), count - i);
+}
+
+#endif /* CONVERSION_X86_SIMD */
+
+void ConvertToDoubles_01(double *values, const char *buffer, size_t count)
+{
+#ifdef CONVERSION_X86_SIMD
+  static void (*kernel)(double *, const char *, size_t) = NULL;
+
+  if (kernel == NULL)
+  {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+    {
+      kernel = ConvertToDoubles_01Avx512;
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+      kernel = ConvertToDoubles_01Avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+      kernel = ConvertToDoubles_01Sse2;
+    }
+    else
+    {
+      kernel = ConvertToDoubles_01Scalar;
+    }
+  }
+  kernel(values, buffer, count);
+#else
+  ConvertToDoubles_01Scalar(values, buffer, count);
+#endif
+}
+
+void ConvertToFloats_01(float *values, const char *buffer, size_t count)
+{
+#ifdef CONVERSION_X86_SIMD
+  static void (*kernel)(float *, const char *, size_t) = NULL;
+
+  if (kernel == NULL)
+  {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+      kernel = ConvertToFloats_01Avx512;
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+      kernel = ConvertToFloats_01Avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+      kernel = ConvertToFloats_01Sse2;
+    }
+    else
+    {
+      kernel = ConvertToFloats_01Scalar;
+    }
+  }
+  kernel(values, buffer, count);
+#else
+  ConvertToFloats_01Scalar(values, buffer, count);
+#endif
+}
+
 int ConvertToInt(const char *buffer)
 {
   int value;
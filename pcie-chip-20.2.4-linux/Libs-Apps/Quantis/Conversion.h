@@ -83,6 +83,26 @@ extern "C"
    */
   DLL_EXPORT float ConvertToFloat_01(const char *buffer);
 
+  /**
+   * Convert a buffer to an array of double values between 0.0 (inclusive)
+   * and 1.0 (exclusive), each value being equal to ConvertToDouble_01() of
+   * the corresponding 8 bytes. Uses SIMD instructions when available.
+   * @param values the array to fill. May be the same memory as buffer.
+   * @param buffer the buffer (at least count * sizeof(double) long) to convert.
+   * @param count the number of values to convert.
+   */
+  DLL_EXPORT void ConvertToDoubles_01(double *values, const char *buffer, size_t count);
+
+  /**
+   * Convert a buffer to an array of float values between 0.0 (inclusive)
+   * and 1.0 (exclusive), each value being equal to ConvertToFloat_01() of
+   * the corresponding 4 bytes. Uses SIMD instructions when available.
+   * @param values the array to fill. May be the same memory as buffer.
+   * @param buffer the buffer (at least count * sizeof(float) long) to convert.
+   * @param count the number of values to convert.
+   */
+  DLL_EXPORT void ConvertToFloats_01(float *values, const char *buffer, size_t count);
+
   /**
    * Convert a C string to a int value.
    * @param buffer the buffer (at least sizeof(int) long) to convert.
@@ -72,10 +72,14 @@ extern "C"
     QUANTIS_DEVICE_PCI = 1,
 
     /** Quantis USB */
-    QUANTIS_DEVICE_USB = 2
+    QUANTIS_DEVICE_USB = 2,
+
+    /** Virtual device reading from all Quantis PCI and USB devices in
+        parallel. There is a single aggregate device, number 0. */
+    QUANTIS_DEVICE_AGGREGATE = 4
 
     /* Next Quantis device type
-    QUANTIS_DEVICE_XXX = 4 */
+    QUANTIS_DEVICE_XXX = 8 */
   } QuantisDeviceType;
 
   /**
@@ -115,6 +119,9 @@ extern "C"
     /** Module status error */
     QUANTIS_ERROR_INVALID_STATUS = -110,
 
+    /** No data available and the operation would block */
+    QUANTIS_ERROR_WOULD_BLOCK = -111,
+
     /** Other error */
     QUANTIS_ERROR_OTHER = -199
   } QuantisError;
@@ -198,6 +205,97 @@ extern "C"
    */
 #define QUANTIS_MAX_READ_SIZE (16 * 1024 * 1024)
 
+  /** QuantisPoolEnable flag: block readers until data is available instead
+   * of failing with QUANTIS_ERROR_WOULD_BLOCK */
+#define QUANTIS_POOL_BLOCK 0x1
+
+  /** QuantisPoolEnable flag: allocate the pool on huge pages if possible */
+#define QUANTIS_POOL_HUGEPAGES 0x2
+
+  /**
+   * Statistics of the prefetch pool of a device handle.
+   */
+  typedef struct
+  {
+    /** Number of reads served from the pool without waiting */
+    unsigned long long hits;
+
+    /** Number of reads that had to wait, failed or bypassed the pool */
+    unsigned long long misses;
+
+    /** Number of bytes currently available in the pool */
+    unsigned long long level;
+
+    /** Total number of bytes read from the device into the pool */
+    unsigned long long produced;
+  } QuantisPoolStats;
+
+  /** Number of metric counters of the AXI performance monitor */
+#define QUANTIS_LINK_STATS_METRICS 10
+
+  /** QuantisLinkStats flag: the statistics are still counting */
+#define QUANTIS_LINK_STATS_RUNNING 0x1
+
+  /** QuantisLinkStats flag: the cycle counters of the DMA engine are valid */
+#define QUANTIS_LINK_STATS_ENGINE 0x2
+
+  /** QuantisLinkStats flag: the counters of the AXI performance monitor are
+   * valid */
+#define QUANTIS_LINK_STATS_MONITOR 0x4
+
+  /**
+   * Statistics of the PCIe link of a device, counted between
+   * QuantisStartLinkStats and QuantisStopLinkStats.
+   */
+  typedef struct
+  {
+    /** A combination of QUANTIS_LINK_STATS_* flags */
+    unsigned int flags;
+
+    /** Nanoseconds from the start to the stop, or to now if still counting */
+    unsigned long long elapsedNs;
+
+    /** Clock cycles of the DMA engine */
+    unsigned long long clockCycles;
+
+    /** Cycles the DMA engine moved data */
+    unsigned long long dataCycles;
+
+    /** Cycles the DMA engine waited for the host */
+    unsigned long long pendingCycles;
+
+    /** Number of bytes read from the ring buffer of the driver */
+    unsigned long long ringBytes;
+
+    /** Number of blocks the device wrote to the ring buffer */
+    unsigned long long ringBlocks;
+
+    /** Number of times the ring buffer was full, the device having to wait */
+    unsigned long long ringOverruns;
+
+    /** Number of times a reader found the ring buffer empty */
+    unsigned long long ringWaits;
+
+    /** Global clock counter of the AXI performance monitor */
+    unsigned long long monitorClockCycles;
+
+    /** Metric counters of the AXI performance monitor */
+    unsigned int monitorMetrics[QUANTIS_LINK_STATS_METRICS];
+  } QuantisLinkStats;
+
+  /**
+   * Callback of an asynchronous read.
+   * @param deviceHandle the handle given to QuantisReadAsync.
+   * @param buffer the buffer given to QuantisReadAsync.
+   * @param result the number of read bytes on success or a QUANTIS_ERROR code
+   * on failure.
+   * @param user the user pointer given to QuantisReadAsync.
+   */
+  typedef void (*QuantisReadCallback)(QuantisDeviceHandle *deviceHandle,
+                                      void *buffer,
+                                      int result,
+                                      void *user);
+
   /**
    * Resets the Quantis board.
    * @param deviceType specify the type of Quantis device.
@@ -310,6 +408,62 @@ extern "C"
   DLL_EXPORT int QuantisGetModulesStatus(QuantisDeviceType deviceType,
                                          unsigned int deviceNumber);
 
+  /**
+   * Same as QuantisGetModulesStatus, but also returns how old the status is.
+   * The PCI driver reads the status in the background and returns the last
+   * one without waiting, so this is cheap enough to be polled by monitoring
+   * agents. Devices reading the status on each call report an age of 0.
+   * @param deviceType specify the type of Quantis device.
+   * @param deviceNumber the number of the Quantis device.
+   * @param ageMs receives the age of the status in milliseconds.
+   * @return A bitmask with the status of the modules or a QUANTIS_ERROR code
+   * on failure.
+   * @see QuantisGetModulesStatus
+   */
+  DLL_EXPORT int QuantisGetModulesStatusAge(QuantisDeviceType deviceType,
+                                            unsigned int deviceNumber,
+                                            unsigned int *ageMs);
+
+  /**
+   * Clears and starts the statistics of the PCIe link of a Quantis PCI
+   * device. They count for all the readers of the device until
+   * QuantisStopLinkStats is called.
+   * @param deviceType specify the type of Quantis device.
+   * @param deviceNumber the number of the Quantis device.
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   * QUANTIS_ERROR_OPERATION_NOT_SUPPORTED is returned for devices or drivers
+   * without link statistics.
+   * @see QuantisGetLinkStats
+   */
+  DLL_EXPORT int QuantisStartLinkStats(QuantisDeviceType deviceType,
+                                       unsigned int deviceNumber);
+
+  /**
+   * Stops the statistics of the PCIe link of a Quantis PCI device. They keep
+   * their values until the next QuantisStartLinkStats.
+   * @param deviceType specify the type of Quantis device.
+   * @param deviceNumber the number of the Quantis device.
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisStopLinkStats(QuantisDeviceType deviceType,
+                                      unsigned int deviceNumber);
+
+  /**
+   * Gets the statistics of the PCIe link of a Quantis PCI device. A link
+   * kept busy (data cycles close to the clock cycles) bounds the throughput,
+   * so do many pending cycles (the host is slow to take the data) or ring
+   * overruns (readers are slow to empty the ring buffer). Otherwise the
+   * random source itself is the bound.
+   * @param deviceType specify the type of Quantis device.
+   * @param deviceNumber the number of the Quantis device.
+   * @param stats a pointer to the structure receiving the statistics.
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   * @see QuantisStartLinkStats
+   */
+  DLL_EXPORT int QuantisGetLinkStats(QuantisDeviceType deviceType,
+                                     unsigned int deviceNumber,
+                                     QuantisLinkStats *stats);
+
   /**
    * Get a pointer to the serial number string of the Quantis device.
    * @param deviceType specify the type of Quantis device.
@@ -393,6 +547,22 @@ extern "C"
    */
   DLL_EXPORT void QuantisClose(QuantisDeviceHandle *deviceHandle);
 
+  /**
+   * Closes all the handles cached by the functions taking a device type and
+   * number (QuantisRead, QuantisGetModulesStatus, ...). The next call opens
+   * the device again.
+   */
+  DLL_EXPORT void QuantisFlushHandleCache();
+
+  /**
+   * Sets how long a handle used by the functions taking a device type and
+   * number is kept open once idle. Keeping the handle open avoids reopening
+   * the device (and restarting its DMA ring) on every call.
+   * @param timeout the idle timeout in milliseconds. 0 disables the cache and
+   * closes all cached handles.
+   */
+  DLL_EXPORT void QuantisSetHandleCacheTimeout(unsigned int timeout);
+
   /**
    * Reads random data from the Quantis device.
    * This function expect the device has been previously opened
@@ -406,6 +576,259 @@ extern "C"
                                     void *buffer,
                                     size_t size);
 
+  /**
+   * Sets how often the modules status is checked when reading. By default it
+   * is only checked on the first read of a handle and after an I/O error,
+   * since the driver reports module errors through the read itself. Older
+   * drivers don't, setting an interval makes reads notice a failed module.
+   * @param interval the interval in milliseconds, 0 to never check again
+   * while reads succeed.
+   */
+  DLL_EXPORT void QuantisSetModulesStatusCheckInterval(unsigned int interval);
+
+  /**
+   * Enables the prefetch pool on an opened device. A background thread then
+   * keeps a ring buffer filled with large reads and QuantisReadHandled()
+   * serves small requests from it without any system call. The ring is
+   * refilled up to highWatermark once it drops to lowWatermark.
+   * @param deviceHandle a pointer to a handle the device
+   * @param size the size of the ring in bytes (rounded up to a power of two).
+   * @param lowWatermark the fill level (in bytes) at which refilling starts,
+   * 0 for half of highWatermark.
+   * @param highWatermark the fill level (in bytes) at which refilling stops,
+   * 0 for the whole ring. Larger requests bypass the pool.
+   * @param flags a combination of QUANTIS_POOL_BLOCK and QUANTIS_POOL_HUGEPAGES.
+   * Without QUANTIS_POOL_BLOCK a read that can't be served from the pool fails
+   * with QUANTIS_ERROR_WOULD_BLOCK.
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   * QUANTIS_ERROR_OPERATION_NOT_SUPPORTED is returned for a handle with a
+   * mapped ring (see QuantisMapRing), which can't have a pool.
+   */
+  DLL_EXPORT int QuantisPoolEnable(QuantisDeviceHandle *deviceHandle,
+                                   size_t size,
+                                   size_t lowWatermark,
+                                   size_t highWatermark,
+                                   int flags);
+
+  /**
+   * Stops the prefetch pool of a device and frees it. No read may be pending
+   * on the handle. Also done by QuantisClose().
+   * @param deviceHandle a pointer to a handle the device
+   */
+  DLL_EXPORT void QuantisPoolDisable(QuantisDeviceHandle *deviceHandle);
+
+  /**
+   * Gets the statistics of the prefetch pool of a device.
+   * @param deviceHandle a pointer to a handle the device
+   * @param stats a pointer to the structure receiving the statistics.
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisPoolGetStats(QuantisDeviceHandle *deviceHandle,
+                                     QuantisPoolStats *stats);
+
+  /**
+   * Starts reading random bytes from an opened device without waiting for
+   * them. Once the read is done its callback is run by QuantisAsyncPoll()
+   * or QuantisAsyncWait(), in the calling thread. PCI devices are read
+   * through io_uring when the kernel supports it, other devices by a pool of
+   * threads. The buffer and the handle must remain valid until the callback
+   * ran, several reads may be pending on the same handle. Reads of a handle
+   * with a mapped ring (QuantisMapRing) are done one at a time.
+   * @param deviceHandle a pointer to a handle the device
+   * @param buffer a pointer to a destination buffer.
+   * @param size the number of bytes to read (not larger than QUANTIS_MAX_READ_SIZE).
+   * @param callback the function called with the result of the read.
+   * @param user a pointer given to the callback.
+   * @return QUANTIS_SUCCESS if the read is started (the callback will be
+   * called) or a QUANTIS_ERROR code on failure (the callback won't be called).
+   */
+  DLL_EXPORT int QuantisReadAsync(QuantisDeviceHandle *deviceHandle,
+                                  void *buffer,
+                                  size_t size,
+                                  QuantisReadCallback callback,
+                                  void *user);
+
+  /**
+   * Runs the callbacks of the asynchronous reads that completed, without
+   * waiting.
+   * @return The number of callbacks run.
+   */
+  DLL_EXPORT int QuantisAsyncPoll(void);
+
+  /**
+   * Waits for asynchronous reads to complete and runs their callbacks.
+   * Returns at once when no read is pending.
+   * @param timeout the maximum time to wait in milliseconds, -1 for no limit.
+   * @return The number of callbacks run.
+   */
+  DLL_EXPORT int QuantisAsyncWait(int timeout);
+
+  /**
+   * Gets a file descriptor which becomes readable when asynchronous reads
+   * complete, to add to an event loop (select, poll, epoll...). When it does
+   * QuantisAsyncPoll() must be called. The descriptor belongs to the library
+   * and must not be read nor closed.
+   * @return The file descriptor on success or a QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisAsyncGetFd(void);
+
+  /**
+   * Sets an opened Quantis PCI device in non-blocking mode, or back in
+   * blocking mode. In non-blocking mode QuantisReadHandled() returns the bytes
+   * the driver already holds, possibly fewer than requested, or fails with
+   * QUANTIS_ERROR_WOULD_BLOCK when there are none. QuantisReadDoubles_01(),
+   * QuantisReadFloats_01(), QuantisReadInts() and QuantisReadShorts() return
+   * the number of values they could fill the same way. QuantisGetFd() gives a
+   * descriptor to wait for data with poll, select or epoll. The prefetch pool
+   * and asynchronous reads can't be used on a non-blocking handle.
+   * @param deviceHandle a pointer to a handle the device
+   * @param nonBlocking non-zero for the non-blocking mode.
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisSetNonBlocking(QuantisDeviceHandle *deviceHandle,
+                                       int nonBlocking);
+
+  /**
+   * Gets the file descriptor of an opened Quantis PCI device, which becomes
+   * readable when random bytes are available, to add to an event loop. The
+   * descriptor belongs to the handle and must not be read nor closed.
+   * @param deviceHandle a pointer to a handle the device
+   * @return The file descriptor on success or a QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisGetFd(QuantisDeviceHandle *deviceHandle);
+
+  /**
+   * Maps the ring buffer of the driver of an opened Quantis PCI device, so
+   * that random bytes are read in place with QuantisRingAcquire() and
+   * QuantisRingRelease() instead of being copied by the driver. Reads from
+   * the handle, QuantisReadHandled() included, then go through the ring as
+   * well. Only one handle can map a device at a time, and read() on other
+   * handles of the device fails while it is mapped.
+   * @param deviceHandle a pointer to a handle the device
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   * QUANTIS_ERROR_OPERATION_NOT_SUPPORTED is returned for devices or drivers
+   * without a ring to map, and for a handle with a prefetch pool.
+   */
+  DLL_EXPORT int QuantisMapRing(QuantisDeviceHandle *deviceHandle);
+
+  /**
+   * Unmaps the ring mapped with QuantisMapRing(). Unreleased bytes are lost.
+   * QuantisClose() unmaps the ring as well.
+   * @param deviceHandle a pointer to a handle the device
+   */
+  DLL_EXPORT void QuantisUnmapRing(QuantisDeviceHandle *deviceHandle);
+
+  /**
+   * Waits for random bytes in the mapped ring. In non-blocking mode, fails
+   * with QUANTIS_ERROR_WOULD_BLOCK instead of waiting.
+   * @param deviceHandle a pointer to a handle the device
+   * @param data set to the first unreleased byte. The bytes are read-only and
+   * remain valid until they are released.
+   * @return the number of contiguous bytes at data on success or a
+   * QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisRingAcquire(QuantisDeviceHandle *deviceHandle,
+                                    const void **data);
+
+  /**
+   * Gives bytes obtained with QuantisRingAcquire() back to the driver, so
+   * that the card can fill them again. They must not be used afterwards.
+   * @param deviceHandle a pointer to a handle the device
+   * @param size the number of bytes to release, at most the size returned by
+   * QuantisRingAcquire().
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisRingRelease(QuantisDeviceHandle *deviceHandle,
+                                    size_t size);
+
+  /**
+   * Fills an array of random double values between 0.0 (inclusive) and 1.0
+   * (exclusive) from an opened device. The data is read with as few device
+   * reads as possible and converted with SIMD instructions when available.
+   * @param deviceHandle a pointer to a handle the device
+   * @param values a pointer to the array to fill.
+   * @param count the number of values to read.
+   * @return QUANTIS_SUCCESS on success, the number of values read from a
+   * non-blocking handle (see QuantisSetNonBlocking()) or a QUANTIS_ERROR code
+   * on failure.
+   */
+  DLL_EXPORT int QuantisReadDoubles_01(QuantisDeviceHandle *deviceHandle,
+                                       double *values,
+                                       size_t count);
+
+  /**
+   * Fills an array of random float values between 0.0 (inclusive) and 1.0
+   * (exclusive) from an opened device. See QuantisReadDoubles_01().
+   * @param deviceHandle a pointer to a handle the device
+   * @param values a pointer to the array to fill.
+   * @param count the number of values to read.
+   * @return QUANTIS_SUCCESS on success, the number of values read from a
+   * non-blocking handle (see QuantisSetNonBlocking()) or a QUANTIS_ERROR code
+   * on failure.
+   */
+  DLL_EXPORT int QuantisReadFloats_01(QuantisDeviceHandle *deviceHandle,
+                                      float *values,
+                                      size_t count);
+
+  /**
+   * Fills an array of random int values from an opened device.
+   * @param deviceHandle a pointer to a handle the device
+   * @param values a pointer to the array to fill.
+   * @param count the number of values to read.
+   * @return QUANTIS_SUCCESS on success, the number of values read from a
+   * non-blocking handle (see QuantisSetNonBlocking()) or a QUANTIS_ERROR code
+   * on failure.
+   */
+  DLL_EXPORT int QuantisReadInts(QuantisDeviceHandle *deviceHandle,
+                                 int *values,
+                                 size_t count);
+
+  /**
+   * Fills an array of random short values from an opened device.
+   * @param deviceHandle a pointer to a handle the device
+   * @param values a pointer to the array to fill.
+   * @param count the number of values to read.
+   * @return QUANTIS_SUCCESS on success, the number of values read from a
+   * non-blocking handle (see QuantisSetNonBlocking()) or a QUANTIS_ERROR code
+   * on failure.
+   */
+  DLL_EXPORT int QuantisReadShorts(QuantisDeviceHandle *deviceHandle,
+                                   short *values,
+                                   size_t count);
+
+  /**
+   * Fills an array of random int values between min and max (inclusive) from
+   * an opened device. Several values are extracted from each random draw so
+   * that only about log2(max - min + 1) bits are read per value.
+   * @param deviceHandle a pointer to a handle the device
+   * @param values a pointer to the array to fill.
+   * @param count the number of values to read.
+   * @param min the minimal value the random numbers can take.
+   * @param max the maximal value the random numbers can take.
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisReadScaledInts(QuantisDeviceHandle *deviceHandle,
+                                       int *values,
+                                       size_t count,
+                                       int min,
+                                       int max);
+
+  /**
+   * Fills an array of random short values between min and max (inclusive)
+   * from an opened device. See QuantisReadScaledInts().
+   * @param deviceHandle a pointer to a handle the device
+   * @param values a pointer to the array to fill.
+   * @param count the number of values to read.
+   * @param min the minimal value the random numbers can take.
+   * @param max the maximal value the random numbers can take.
+   * @return QUANTIS_SUCCESS on success or a QUANTIS_ERROR code on failure.
+   */
+  DLL_EXPORT int QuantisReadScaledShorts(QuantisDeviceHandle *deviceHandle,
+                                         short *values,
+                                         size_t count,
+                                         short min,
+                                         short max);
+
   /**
    * Reads random data from the Quantis device.
    * This function perform open read and close
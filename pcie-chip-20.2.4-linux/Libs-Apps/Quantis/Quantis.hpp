@@ -53,6 +53,7 @@
 
 #include <string>
 #include <stdexcept>
+#include <vector>
 
 #include "Quantis.h"
 
@@ -345,6 +346,126 @@ public:
     short ReadShort(short min, short max) const
         throw(std::runtime_error);
 
+    /**
+      * Fills an array with random double floating precision values between 0.0
+      * (inclusive) and 1.0 (exclusive) from the Quantis device, with as few
+      * reads as possible.
+      * @param values a pointer to the array to fill.
+      * @param count the number of values to read.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadDoubles(double *values, size_t count) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills a vector with random values. See ReadDoubles(double *, size_t).
+      * @param values the vector to fill, its size is the number of values to read.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadDoubles(std::vector<double> &values) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills an array with random float floating precision values between 0.0
+      * (inclusive) and 1.0 (exclusive) from the Quantis device, with as few
+      * reads as possible.
+      * @param values a pointer to the array to fill.
+      * @param count the number of values to read.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadFloats(float *values, size_t count) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills a vector with random values. See ReadFloats(float *, size_t).
+      * @param values the vector to fill, its size is the number of values to read.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadFloats(std::vector<float> &values) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills an array with random integer precision values from the Quantis device, with as few
+      * reads as possible.
+      * @param values a pointer to the array to fill.
+      * @param count the number of values to read.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadInts(int *values, size_t count) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills a vector with random values. See ReadInts(int *, size_t).
+      * @param values the vector to fill, its size is the number of values to read.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadInts(std::vector<int> &values) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills an array with random short integer precision values from the Quantis device, with as few
+      * reads as possible.
+      * @param values a pointer to the array to fill.
+      * @param count the number of values to read.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadShorts(short *values, size_t count) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills a vector with random values. See ReadShorts(short *, size_t).
+      * @param values the vector to fill, its size is the number of values to read.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadShorts(std::vector<short> &values) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills an array with random integers between min and max (inclusive),
+      * reading only about log2(max - min + 1) bits per value.
+      * @param values a pointer to the array to fill.
+      * @param count the number of values to read.
+      * @param min the minimal value the random numbers can take.
+      * @param max the maximal value the random numbers can take.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadInts(int *values, size_t count, int min, int max) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills a vector with random values between min and max (inclusive).
+      * See ReadInts(int *, size_t, int, int).
+      * @param values the vector to fill, its size is the number of values to read.
+      * @param min the minimal value the random numbers can take.
+      * @param max the maximal value the random numbers can take.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadInts(std::vector<int> &values, int min, int max) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills an array with random short integers between min and max (inclusive),
+      * reading only about log2(max - min + 1) bits per value.
+      * @param values a pointer to the array to fill.
+      * @param count the number of values to read.
+      * @param min the minimal value the random numbers can take.
+      * @param max the maximal value the random numbers can take.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadShorts(short *values, size_t count, short min, short max) const
+        throw(std::runtime_error);
+
+    /**
+      * Fills a vector with random values between min and max (inclusive).
+      * See ReadShorts(short *, size_t, short, short).
+      * @param values the vector to fill, its size is the number of values to read.
+      * @param min the minimal value the random numbers can take.
+      * @param max the maximal value the random numbers can take.
+      * @throw runtime_error QUANTIS_ERROR code on failure.
+      */
+    void ReadShorts(std::vector<short> &values, short min, short max) const
+        throw(std::runtime_error);
+
 private:
     QuantisDeviceType _deviceType;
     unsigned int _deviceNumber;
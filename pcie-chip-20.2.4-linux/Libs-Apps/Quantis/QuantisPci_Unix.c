@@ -58,10 +58,13 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <dirent.h>      // for CountFiles
@@ -87,6 +90,13 @@ typedef struct QuantisPrivateData
 {
   int fd; /* File descriptor */
   char serialNumber[QUANTIS_IOCTL_GET_SERIAL_MAX_LENGTH];
+  int statusValid;              /* Modules status checked and valid */
+  struct timespec statusExpiry; /* When the modules status must be checked again */
+  struct quantis_ring_ctrl *ringCtrl; /* Control block of the mapped ring, NULL if not mapped */
+  const unsigned char *ringData;      /* Mapped ring */
+  size_t ringSize;                    /* Size of the mapped ring */
+  unsigned int ringOffset;            /* Bytes released in the block at the consumer index */
+  pthread_mutex_t ringMutex;          /* Serializes reads through the mapped ring */
 } QuantisPrivateData;
 
 typedef struct LinuxDirectory
@@ -176,12 +186,32 @@ void QuantisPciClose(QuantisDeviceHandle *deviceHandle)
     return;
   }
 
+  QuantisPciUnmapRing(deviceHandle);
   close(_privateData->fd);
 
+  pthread_mutex_destroy(&_privateData->ringMutex);
   free(_privateData);
   _privateData = NULL;
 }
 
+/* Closes a handle inherited through fork(), in the child. The driver does not
+ * copy the ring mapping (VM_DONTCOPY) and the close only drops the child's
+ * reference to the file: the parent's ring and device are left untouched. */
+void QuantisPciCloseInChild(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+
+  if (!_privateData)
+  {
+    return;
+  }
+
+  close(_privateData->fd);
+
+  free(_privateData);
+  deviceHandle->privateData = NULL;
+}
+
 /* Count */
 int QuantisPciCount()
 {
@@ -409,7 +439,8 @@ int QuantisPciOpen(QuantisDeviceHandle *deviceHandle)
   /* Open device */
   sprintf(filename, "/dev/%s%d", QUANTIS_PCI_DEVICE_NAME, deviceHandle->deviceNumber);
 
-  fd = open(filename, O_RDONLY);
+  /* Not inherited by exec'd programs, see also QuantisPciCloseInChild */
+  fd = open(filename, O_RDONLY | O_CLOEXEC);
   if (fd < 0)
   {
     return QUANTIS_ERROR_NO_DEVICE;
@@ -428,6 +459,12 @@ int QuantisPciOpen(QuantisDeviceHandle *deviceHandle)
   _privateData->fd = fd;
   /* The real serial number will be loaded in QuantisPciGetSerialNumber */
   _privateData->serialNumber[0] = '\0';
+  /* Modules status will be checked on first read */
+  _privateData->statusValid = 0;
+  /* The ring is only mapped on request */
+  _privateData->ringCtrl = NULL;
+  _privateData->ringData = NULL;
+  pthread_mutex_init(&_privateData->ringMutex, NULL);
 
   deviceHandle->privateData = _privateData;
 
@@ -459,11 +496,62 @@ int QuantisPciOpen(QuantisDeviceHandle *deviceHandle)
   return QUANTIS_SUCCESS;
 }
 
+/**
+ * Checks the modules status if it has never been checked on this handle, if
+ * the last check failed or if quantisModulesStatusCheckInterval elapsed. The
+ * driver reports module errors through read() itself, so the ioctl is kept
+ * off the read path.
+ */
+static int QuantisPciCheckModulesStatus(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+  unsigned int interval = quantisModulesStatusCheckInterval;
+  struct timespec now;
+
+  if (_privateData->statusValid)
+  {
+    if (interval == 0u)
+    {
+      return QUANTIS_SUCCESS;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec < _privateData->statusExpiry.tv_sec) ||
+        ((now.tv_sec == _privateData->statusExpiry.tv_sec) &&
+         (now.tv_nsec < _privateData->statusExpiry.tv_nsec)))
+    {
+      return QUANTIS_SUCCESS;
+    }
+  }
+
+  /* Check if status is ok */
+  _privateData->statusValid = 0;
+  if (QuantisPciGetModulesStatus(deviceHandle) <= 0)
+  {
+    return QUANTIS_ERROR_INVALID_STATUS;
+  }
+
+  if (interval != 0u)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &_privateData->statusExpiry);
+    _privateData->statusExpiry.tv_sec += interval / 1000u;
+    _privateData->statusExpiry.tv_nsec += (long)(interval % 1000u) * 1000000L;
+    if (_privateData->statusExpiry.tv_nsec >= 1000000000L)
+    {
+      _privateData->statusExpiry.tv_sec++;
+      _privateData->statusExpiry.tv_nsec -= 1000000000L;
+    }
+  }
+  _privateData->statusValid = 1;
+
+  return QUANTIS_SUCCESS;
+}
+
 /* Read */
 int QuantisPciRead(QuantisDeviceHandle *deviceHandle, void *buffer, size_t size)
 {
   /* Check if status is ok */
-  if (QuantisPciGetModulesStatus(deviceHandle) <= 0)
+  if (QuantisPciCheckModulesStatus(deviceHandle) < 0)
   {
     return QUANTIS_ERROR_INVALID_STATUS;
   }
@@ -476,6 +564,38 @@ int QuantisPciRead(QuantisDeviceHandle *deviceHandle, void *buffer, size_t size)
   size_t readBytes = 0u;
   int result = QUANTIS_ERROR_IO;
   QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+  if (_privateData->ringCtrl != NULL)
+  {
+    /* The driver hands blocks over to the ring instead of copying them. The
+     * consumer index and offset belong to the handle: concurrent readers
+     * (QuantisReadAsync workers, the pool producer) must take turns, or they
+     * would be given the same bytes. */
+    const void *data;
+    pthread_mutex_lock(&_privateData->ringMutex);
+    while (readBytes < size)
+    {
+      result = QuantisPciRingAcquire(deviceHandle, &data);
+      if ((result == QUANTIS_ERROR_WOULD_BLOCK) && (readBytes > 0u))
+      {
+        break;
+      }
+      if (result < 0)
+      {
+        pthread_mutex_unlock(&_privateData->ringMutex);
+        return result;
+      }
+      if ((size_t)result > size - readBytes)
+      {
+        result = (int)(size - readBytes);
+      }
+      memcpy((unsigned char *)buffer + readBytes, data, (size_t)result);
+      QuantisPciRingRelease(deviceHandle, (size_t)result);
+      readBytes += result;
+    }
+    pthread_mutex_unlock(&_privateData->ringMutex);
+    return readBytes;
+  }
+
   while (readBytes < size)
   {
     result = read(_privateData->fd,
@@ -488,18 +608,372 @@ int QuantisPciRead(QuantisDeviceHandle *deviceHandle, void *buffer, size_t size)
         /* Read have been interrupted, try again...*/
         continue;
       }
+      else if (errno == EAGAIN)
+      {
+        /* Non-blocking and nothing held by the driver */
+        return QUANTIS_ERROR_WOULD_BLOCK;
+      }
       else
       {
+        /* Find out whether a module failed */
+        _privateData->statusValid = 0;
+        if (QuantisPciCheckModulesStatus(deviceHandle) < 0)
+        {
+          return QUANTIS_ERROR_INVALID_STATUS;
+        }
         return QUANTIS_ERROR_IO;
       }
     }
 
     readBytes += result;
+
+    /* Non-blocking: what the driver holds, without asking again */
+    if (QUANTIS_HANDLE_STATE(deviceHandle)->nonBlocking)
+    {
+      break;
+    }
   }
 
   return readBytes;
 }
 
+int QuantisPciAsyncPrepare(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+
+  /* Check if status is ok, as QuantisPciRead does */
+  if (QuantisPciCheckModulesStatus(deviceHandle) < 0)
+  {
+    return QUANTIS_ERROR_INVALID_STATUS;
+  }
+
+  /* The driver refuses read() while the ring is mapped, the threads copy
+   * from the ring instead, one at a time (see QuantisPciRead) */
+  if (_privateData->ringCtrl != NULL)
+  {
+    return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+  }
+
+  return _privateData->fd;
+}
+
+int QuantisPciAsyncError(QuantisDeviceHandle *deviceHandle)
+{
+  /* Find out whether a module failed */
+  ((QuantisPrivateData *)deviceHandle->privateData)->statusValid = 0;
+  if (QuantisPciCheckModulesStatus(deviceHandle) < 0)
+  {
+    return QUANTIS_ERROR_INVALID_STATUS;
+  }
+  return QUANTIS_ERROR_IO;
+}
+
+int QuantisPciMapRing(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+  struct quantis_ring_ctrl *ctrl;
+  void *data;
+  size_t size;
+
+  if (_privateData->ringCtrl != NULL)
+  {
+    return QUANTIS_SUCCESS;
+  }
+
+  ctrl = (struct quantis_ring_ctrl *)mmap(NULL,
+                                          QUANTIS_RING_CTRL_SIZE,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED,
+                                          _privateData->fd,
+                                          QUANTIS_RING_CTRL_OFFSET);
+  if (ctrl == MAP_FAILED)
+  {
+    /* Drivers without mmap support fail with ENODEV */
+    if ((errno == ENODEV) || (errno == EINVAL) || (errno == ENOSYS))
+    {
+      return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+    }
+    return (errno == ENOMEM) ? QUANTIS_ERROR_NO_MEMORY : QUANTIS_ERROR_IO;
+  }
+  if ((ctrl->version != QUANTIS_RING_VERSION) || (ctrl->block_count == 0u))
+  {
+    munmap(ctrl, QUANTIS_RING_CTRL_SIZE);
+    return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+  }
+
+  size = (size_t)ctrl->block_size * ctrl->block_count;
+  data = mmap(NULL, size, PROT_READ, MAP_SHARED, _privateData->fd, QUANTIS_RING_DATA_OFFSET);
+  if (data == MAP_FAILED)
+  {
+    munmap(ctrl, QUANTIS_RING_CTRL_SIZE);
+    return (errno == ENOMEM) ? QUANTIS_ERROR_NO_MEMORY : QUANTIS_ERROR_IO;
+  }
+
+  _privateData->ringCtrl = ctrl;
+  _privateData->ringData = (const unsigned char *)data;
+  _privateData->ringSize = size;
+  _privateData->ringOffset = 0u;
+
+  return QUANTIS_SUCCESS;
+}
+
+int QuantisPciRingMapped(QuantisDeviceHandle *deviceHandle)
+{
+  return ((QuantisPrivateData *)deviceHandle->privateData)->ringCtrl != NULL;
+}
+
+void QuantisPciUnmapRing(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+
+  if (_privateData->ringCtrl == NULL)
+  {
+    return;
+  }
+
+  /* The driver gives the unreleased blocks back to the card */
+  munmap((void *)_privateData->ringData, _privateData->ringSize);
+  munmap(_privateData->ringCtrl, QUANTIS_RING_CTRL_SIZE);
+  _privateData->ringCtrl = NULL;
+  _privateData->ringData = NULL;
+}
+
+int QuantisPciRingAcquire(QuantisDeviceHandle *deviceHandle, const void **data)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+  struct quantis_ring_ctrl *ctrl = _privateData->ringCtrl;
+  unsigned int consumer;
+  unsigned int producer;
+  unsigned int index;
+  unsigned int size;
+
+  if (ctrl == NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+  /* Check if status is ok */
+  if (QuantisPciCheckModulesStatus(deviceHandle) < 0)
+  {
+    return QUANTIS_ERROR_INVALID_STATUS;
+  }
+
+  consumer = ctrl->consumer;
+  while (1)
+  {
+    /* Lengths are written before the producer index */
+    producer = __atomic_load_n(&ctrl->producer, __ATOMIC_ACQUIRE);
+    while (consumer != producer)
+    {
+      index = consumer % ctrl->block_count;
+      if (_privateData->ringOffset < ctrl->length[index])
+      {
+        *data = _privateData->ringData + (size_t)index * ctrl->block_size + _privateData->ringOffset;
+        size = ctrl->length[index] - _privateData->ringOffset;
+
+        /* Following full blocks are contiguous, up to the end of the ring */
+        while ((ctrl->length[index] == ctrl->block_size)
+               && (++consumer != producer)
+               && (++index < ctrl->block_count))
+        {
+          size += ctrl->length[index];
+        }
+        return (int)size;
+      }
+
+      /* Block used up, or empty because faulty */
+      consumer++;
+      _privateData->ringOffset = 0u;
+      __atomic_store_n(&ctrl->consumer, consumer, __ATOMIC_RELEASE);
+    }
+
+    /* Empty, gives the released blocks back and waits for more */
+    if (QUANTIS_HANDLE_STATE(deviceHandle)->nonBlocking)
+    {
+      ioctl(_privateData->fd, QUANTIS_IOCTL_RING_RELEASE);
+      return QUANTIS_ERROR_WOULD_BLOCK;
+    }
+    if (ioctl(_privateData->fd, QUANTIS_IOCTL_RING_WAIT) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      /* Find out whether a module failed */
+      _privateData->statusValid = 0;
+      if (QuantisPciCheckModulesStatus(deviceHandle) < 0)
+      {
+        return QUANTIS_ERROR_INVALID_STATUS;
+      }
+      return QUANTIS_ERROR_IO;
+    }
+  }
+}
+
+int QuantisPciRingRelease(QuantisDeviceHandle *deviceHandle, size_t size)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+  struct quantis_ring_ctrl *ctrl = _privateData->ringCtrl;
+  unsigned int consumer;
+  unsigned int producer;
+  unsigned int length;
+
+  if (ctrl == NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+  consumer = ctrl->consumer;
+  producer = __atomic_load_n(&ctrl->producer, __ATOMIC_ACQUIRE);
+  while ((size > 0u) && (consumer != producer))
+  {
+    length = ctrl->length[consumer % ctrl->block_count] - _privateData->ringOffset;
+    if (size < length)
+    {
+      _privateData->ringOffset += (unsigned int)size;
+      break;
+    }
+    size -= length;
+    consumer++;
+    _privateData->ringOffset = 0u;
+  }
+  __atomic_store_n(&ctrl->consumer, consumer, __ATOMIC_RELEASE);
+
+  /* The card runs on credits, do not let it wait for a quarter of the ring */
+  if (consumer - ctrl->credited >= ctrl->block_count / 4u)
+  {
+    ioctl(_privateData->fd, QUANTIS_IOCTL_RING_RELEASE);
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+int QuantisPciSetNonBlocking(QuantisDeviceHandle *deviceHandle, int nonBlocking)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+  int flags = fcntl(_privateData->fd, F_GETFL);
+
+  if (flags < 0)
+  {
+    return QUANTIS_ERROR_IO;
+  }
+  flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  if (fcntl(_privateData->fd, F_SETFL, flags) < 0)
+  {
+    return QUANTIS_ERROR_IO;
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+int QuantisPciSoftSource(QuantisDeviceHandle *deviceHandle)
+{
+  return strcmp(QuantisPciGetSerialNumber(deviceHandle), QUANTIS_SOFT_SOURCE_SERIAL) == 0;
+}
+
+int QuantisPciGetFd(QuantisDeviceHandle *deviceHandle)
+{
+  return ((QuantisPrivateData *)deviceHandle->privateData)->fd;
+}
+
+/* GetModulesStatusAge */
+int QuantisPciGetModulesStatusAge(QuantisDeviceHandle *deviceHandle,
+                                  unsigned int *ageMs)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+  struct quantis_modules_status modulesStatus;
+
+  if (ioctl(_privateData->fd, QUANTIS_IOCTL_GET_MODULES_STATUS_AGE, &modulesStatus) < 0)
+  {
+    /* Drivers without a cached status only know the plain ioctl */
+    if (errno == EINVAL || errno == ENOTTY)
+    {
+      return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+    }
+    return QUANTIS_ERROR_IO;
+  }
+
+  *ageMs = modulesStatus.age_ms;
+  return (int)modulesStatus.status;
+}
+
+/* Link statistics, counted by the driver for all the readers of the device */
+static int QuantisPciLinkStatsIoCtl(QuantisDeviceHandle *deviceHandle,
+                                    unsigned long request,
+                                    struct quantis_perf_counters *counters)
+{
+  QuantisPrivateData *_privateData = (QuantisPrivateData *)deviceHandle->privateData;
+
+  if (ioctl(_privateData->fd, request, counters) < 0)
+  {
+    /* Drivers without link statistics */
+    if (errno == EINVAL || errno == ENOTTY)
+    {
+      return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+    }
+    return QUANTIS_ERROR_IO;
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+int QuantisPciStartLinkStats(QuantisDeviceHandle *deviceHandle)
+{
+  return QuantisPciLinkStatsIoCtl(deviceHandle, QUANTIS_IOCTL_PERF_START, NULL);
+}
+
+int QuantisPciStopLinkStats(QuantisDeviceHandle *deviceHandle)
+{
+  return QuantisPciLinkStatsIoCtl(deviceHandle, QUANTIS_IOCTL_PERF_STOP, NULL);
+}
+
+int QuantisPciGetLinkStats(QuantisDeviceHandle *deviceHandle,
+                           QuantisLinkStats *stats)
+{
+  struct quantis_perf_counters counters;
+  int result;
+  int i;
+
+  result = QuantisPciLinkStatsIoCtl(deviceHandle, QUANTIS_IOCTL_PERF_GET, &counters);
+  if (result < 0)
+  {
+    return result;
+  }
+  if (counters.version != QUANTIS_PERF_VERSION)
+  {
+    return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+  }
+
+  stats->flags = 0u;
+  if (counters.flags & QUANTIS_PERF_RUNNING)
+  {
+    stats->flags |= QUANTIS_LINK_STATS_RUNNING;
+  }
+  if (counters.flags & QUANTIS_PERF_ENGINE)
+  {
+    stats->flags |= QUANTIS_LINK_STATS_ENGINE;
+  }
+  if (counters.flags & QUANTIS_PERF_APM)
+  {
+    stats->flags |= QUANTIS_LINK_STATS_MONITOR;
+  }
+  stats->elapsedNs = counters.elapsed_ns;
+  stats->clockCycles = counters.clock_cycles;
+  stats->dataCycles = counters.data_cycles;
+  stats->pendingCycles = counters.pending_cycles;
+  stats->ringBytes = counters.ring_bytes;
+  stats->ringBlocks = counters.ring_blocks;
+  stats->ringOverruns = counters.ring_overruns;
+  stats->ringWaits = counters.ring_waits;
+  stats->monitorClockCycles = counters.apm_clock_cycles;
+  for (i = 0; i < QUANTIS_LINK_STATS_METRICS; i++)
+  {
+    stats->monitorMetrics[i] = counters.apm_metrics[i];
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
 /* GetBusDeviceId */
 int QuantisPciGetBusDeviceId(QuantisDeviceHandle *deviceHandle)
 {
@@ -0,0 +1,827 @@
+/*
+ * Quantis aggregate device
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Quantis.h"
+#include "Quantis_Internal.h"
+
+/* Smallest stripe read from a single device, smaller reads aren't split */
+#define QUANTIS_AGGREGATE_MIN_STRIPE (64 * 1024)
+
+/* Delay (in milliseconds) between two checks of a dropped device */
+#define QUANTIS_AGGREGATE_RETRY_DELAY 1000
+
+/* Size of the test read done before re-admitting a dropped device */
+#define QUANTIS_AGGREGATE_TEST_SIZE 64
+
+/* Time (in milliseconds) a device may take to read its stripe, on top of
+   twice the time its data rate needs, before it is dropped */
+#define QUANTIS_AGGREGATE_TIMEOUT 1000
+
+/*
+ * The aggregate device opens every PCI and USB device of the system, except
+ * the software data sources of the driver, and splits each read into
+ * stripes, one per device, in proportion to the data rate of the device.
+ * Each device has a worker thread reading its stripe into the caller's
+ * buffer. A device whose read fails (e.g. because of a bad modules status)
+ * or takes too long is dropped and its stripe is read again from the other
+ * devices. The workers read through a buffer of their own, so that a device
+ * dropped in the middle of a read never writes to the caller's buffer
+ * afterwards. The worker of a dropped device checks it periodically and
+ * re-admits it once its modules status and a test read are fine again.
+ * Readers never wait for a dropped device.
+ */
+struct QuantisAggregate;
+
+typedef struct
+{
+  QuantisDeviceHandle *deviceHandle;
+  struct QuantisAggregate *aggregate;
+  pthread_t thread;
+  pthread_cond_t cond;
+  int threadStarted;
+  size_t weight;
+  /* Buffer of QUANTIS_AGGREGATE_MIN_STRIPE bytes the worker reads into */
+  char *chunk;
+  /* Protected by the aggregate mutex */
+  int active;
+  char *buffer;
+  size_t size;
+  int pending;
+  /* Set when the reader gave up on the pending stripe */
+  int cancelled;
+  int result;
+} QuantisAggregateMember;
+
+typedef struct QuantisAggregate
+{
+  QuantisAggregateMember *members;
+  unsigned int memberCount;
+  /* Serialises reads, the members having a single job slot */
+  pthread_mutex_t readMutex;
+  pthread_mutex_t mutex;
+  pthread_cond_t doneCond;
+  unsigned int pendingJobs;
+  unsigned int nextMember;
+  int stop;
+  char serialNumber[256];
+} QuantisAggregate;
+
+/* Reads size bytes from a device, which may return less than requested */
+static int QuantisAggregateReadMember(QuantisDeviceHandle *deviceHandle,
+                                      char *buffer,
+                                      size_t size)
+{
+  size_t readBytes = 0u;
+
+  while (readBytes < size)
+  {
+    int result = deviceHandle->ops->Read(deviceHandle, buffer + readBytes, size - readBytes);
+    if (result < 0)
+    {
+      return result;
+    }
+    else if (result == 0)
+    {
+      return QUANTIS_ERROR_IO;
+    }
+    readBytes += (size_t)result;
+  }
+
+  return (int)readBytes;
+}
+
+/* Checks if a dropped device can be used again */
+static int QuantisAggregateCheckMember(QuantisDeviceHandle *deviceHandle)
+{
+  char buffer[QUANTIS_AGGREGATE_TEST_SIZE];
+  int result;
+
+  if (deviceHandle->ops->GetModulesStatus(deviceHandle) <= 0)
+  {
+    return QUANTIS_ERROR_INVALID_STATUS;
+  }
+
+  result = QuantisAggregateReadMember(deviceHandle, buffer, sizeof(buffer));
+  memset(buffer, 0, sizeof(buffer));
+
+  return (result < 0) ? result : QUANTIS_SUCCESS;
+}
+
+/* Sets deadline to delay milliseconds from now, for pthread_cond_timedwait */
+static void QuantisAggregateDeadline(struct timespec *deadline,
+                                     unsigned long delay)
+{
+  clock_gettime(CLOCK_REALTIME, deadline);
+  deadline->tv_sec += (time_t)(delay / 1000u);
+  deadline->tv_nsec += (long)(delay % 1000u) * 1000000L;
+  if (deadline->tv_nsec >= 1000000000L)
+  {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000L;
+  }
+}
+
+/*
+ * Reads the pending stripe of a member, called with the aggregate mutex held.
+ * The data is copied to the caller's buffer with the mutex held, so nothing
+ * is written there once the reader has cancelled the stripe.
+ */
+static void QuantisAggregateReadPending(QuantisAggregateMember *member)
+{
+  QuantisAggregate *aggregate = member->aggregate;
+  size_t readBytes = 0u;
+  int result = 0;
+
+  while ((readBytes < member->size) && !member->cancelled)
+  {
+    size_t chunkSize = member->size - readBytes;
+    if (chunkSize > QUANTIS_AGGREGATE_MIN_STRIPE)
+    {
+      chunkSize = QUANTIS_AGGREGATE_MIN_STRIPE;
+    }
+
+    pthread_mutex_unlock(&aggregate->mutex);
+    result = QuantisAggregateReadMember(member->deviceHandle, member->chunk, chunkSize);
+    pthread_mutex_lock(&aggregate->mutex);
+
+    if ((result < 0) || member->cancelled)
+    {
+      break;
+    }
+    memcpy(member->buffer + readBytes, member->chunk, chunkSize);
+    readBytes += chunkSize;
+  }
+  memset(member->chunk, 0, QUANTIS_AGGREGATE_MIN_STRIPE);
+
+  member->pending = 0;
+  if (member->cancelled)
+  {
+    /* The reader already counted the stripe as failed */
+    member->cancelled = 0;
+    return;
+  }
+
+  member->result = (result < 0) ? result : (int)readBytes;
+  aggregate->pendingJobs--;
+  if (aggregate->pendingJobs == 0u)
+  {
+    pthread_cond_signal(&aggregate->doneCond);
+  }
+}
+
+static void *QuantisAggregateWorker(void *arg)
+{
+  QuantisAggregateMember *member = (QuantisAggregateMember *)arg;
+  QuantisAggregate *aggregate = member->aggregate;
+  struct timespec deadline;
+  int result;
+
+  pthread_mutex_lock(&aggregate->mutex);
+  while (!aggregate->stop)
+  {
+    if (member->pending)
+    {
+      QuantisAggregateReadPending(member);
+    }
+    else if (!member->active)
+    {
+      /* Wait, then check if the dropped device works again */
+      QuantisAggregateDeadline(&deadline, QUANTIS_AGGREGATE_RETRY_DELAY);
+      if (pthread_cond_timedwait(&member->cond, &aggregate->mutex, &deadline) == 0)
+      {
+        continue;
+      }
+      if (aggregate->stop)
+      {
+        break;
+      }
+
+      pthread_mutex_unlock(&aggregate->mutex);
+      result = QuantisAggregateCheckMember(member->deviceHandle);
+      pthread_mutex_lock(&aggregate->mutex);
+
+      if (result == QUANTIS_SUCCESS)
+      {
+        member->active = 1;
+      }
+    }
+    else
+    {
+      pthread_cond_wait(&member->cond, &aggregate->mutex);
+    }
+  }
+  pthread_mutex_unlock(&aggregate->mutex);
+
+  return NULL;
+}
+
+/*
+ * Reads size bytes from the active members. Stripes of dropped members are
+ * read again from the remaining ones.
+ */
+static int QuantisAggregateReadStripes(QuantisAggregate *aggregate,
+                                       char *buffer,
+                                       size_t size)
+{
+  QuantisAggregateMember *stripes[MAX_QUANTIS_DEVICE * 2];
+  char *stripeBuffers[MAX_QUANTIS_DEVICE * 2];
+  size_t stripeSizes[MAX_QUANTIS_DEVICE * 2];
+  unsigned int stripeCount = 0u;
+  unsigned int maxStripes;
+  unsigned int i;
+  size_t totalWeight = 0u;
+  size_t offset = 0u;
+  double timeout = 0.0;
+  struct timespec deadline;
+  int result;
+
+  /* Chooses the stripes, starting from a different member each time so that
+     small reads are spread over the devices */
+  maxStripes = (unsigned int)((size + QUANTIS_AGGREGATE_MIN_STRIPE - 1u) / QUANTIS_AGGREGATE_MIN_STRIPE);
+  pthread_mutex_lock(&aggregate->mutex);
+  for (i = 0u; (i < aggregate->memberCount) && (stripeCount < maxStripes); i++)
+  {
+    QuantisAggregateMember *member = &aggregate->members[(aggregate->nextMember + i) % aggregate->memberCount];
+    if (member->active)
+    {
+      stripes[stripeCount++] = member;
+      totalWeight += member->weight;
+    }
+  }
+  aggregate->nextMember = (aggregate->nextMember + 1u) % aggregate->memberCount;
+
+  if (stripeCount == 0u)
+  {
+    pthread_mutex_unlock(&aggregate->mutex);
+    return QUANTIS_ERROR_INVALID_STATUS;
+  }
+
+  /* Splits the buffer in proportion to the data rates, and hands the stripes
+     to the workers */
+  for (i = 0u; i < stripeCount; i++)
+  {
+    double stripeTime;
+
+    stripeBuffers[i] = buffer + offset;
+    if (i == stripeCount - 1u)
+    {
+      stripeSizes[i] = size - offset;
+    }
+    else
+    {
+      stripeSizes[i] = (size_t)((double)size * stripes[i]->weight / totalWeight);
+    }
+    offset += stripeSizes[i];
+
+    stripes[i]->buffer = stripeBuffers[i];
+    stripes[i]->size = stripeSizes[i];
+    stripes[i]->pending = 1;
+    aggregate->pendingJobs++;
+    pthread_cond_signal(&stripes[i]->cond);
+
+    /* Milliseconds the device needs at its data rate */
+    stripeTime = (double)stripeSizes[i] * 1000.0 / (double)stripes[i]->weight;
+    if (stripeTime > timeout)
+    {
+      timeout = stripeTime;
+    }
+  }
+
+  /* Drops the devices that don't read their stripe in time */
+  QuantisAggregateDeadline(&deadline, QUANTIS_AGGREGATE_TIMEOUT + (unsigned long)(2.0 * timeout));
+  while (aggregate->pendingJobs > 0u)
+  {
+    if (pthread_cond_timedwait(&aggregate->doneCond, &aggregate->mutex, &deadline) == ETIMEDOUT)
+    {
+      for (i = 0u; i < stripeCount; i++)
+      {
+        if (stripes[i]->pending)
+        {
+          stripes[i]->cancelled = 1;
+          stripes[i]->result = QUANTIS_ERROR_IO;
+        }
+      }
+      aggregate->pendingJobs = 0u;
+    }
+  }
+
+  /* Drops the failed members */
+  for (i = 0u; i < stripeCount; i++)
+  {
+    if (stripes[i]->result < 0)
+    {
+      stripes[i]->active = 0;
+      pthread_cond_signal(&stripes[i]->cond);
+    }
+  }
+  pthread_mutex_unlock(&aggregate->mutex);
+
+  /* Reads the failed stripes again from the remaining members */
+  for (i = 0u; i < stripeCount; i++)
+  {
+    if (stripes[i]->result < 0)
+    {
+      result = QuantisAggregateReadStripes(aggregate, stripeBuffers[i], stripeSizes[i]);
+      if (result < 0)
+      {
+        return result;
+      }
+    }
+  }
+
+  return (int)size;
+}
+
+/* Adds the devices of a type to the aggregate */
+static void QuantisAggregateAddMembers(QuantisAggregate *aggregate,
+                                       QuantisDeviceType deviceType)
+{
+  int count = QuantisCount(deviceType);
+  int deviceNumber;
+
+  for (deviceNumber = 0; (deviceNumber < count) && (aggregate->memberCount < MAX_QUANTIS_DEVICE * 2); deviceNumber++)
+  {
+    QuantisAggregateMember *member = &aggregate->members[aggregate->memberCount];
+    int dataRate;
+
+    if (QuantisOpenInternal(deviceType, (unsigned int)deviceNumber, &member->deviceHandle) < 0)
+    {
+      continue;
+    }
+
+#ifndef DISABLE_QUANTIS_PCI
+    /* The software data sources of the driver are not cards */
+    if ((deviceType == QUANTIS_DEVICE_PCI) && QuantisPciSoftSource(member->deviceHandle))
+    {
+      QuantisCloseInternal(member->deviceHandle);
+      continue;
+    }
+#endif /* DISABLE_QUANTIS_PCI */
+
+    member->chunk = (char *)malloc(QUANTIS_AGGREGATE_MIN_STRIPE);
+    if (member->chunk == NULL)
+    {
+      QuantisCloseInternal(member->deviceHandle);
+      continue;
+    }
+
+    dataRate = member->deviceHandle->ops->GetModulesDataRate(member->deviceHandle);
+    member->weight = (dataRate > 0) ? (size_t)dataRate : QUANTIS_MODULE_DATA_RATE;
+    member->active = (member->deviceHandle->ops->GetModulesStatus(member->deviceHandle) > 0);
+    member->aggregate = aggregate;
+    aggregate->memberCount++;
+  }
+}
+
+int QuantisAggregateBoardReset(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+  int result = QUANTIS_SUCCESS;
+
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisDeviceHandle *member = aggregate->members[i].deviceHandle;
+    int memberResult = member->ops->BoardReset(member);
+    if ((memberResult < 0) && (result == QUANTIS_SUCCESS))
+    {
+      result = memberResult;
+    }
+  }
+
+  return result;
+}
+
+void QuantisAggregateClose(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+
+  if (aggregate == NULL)
+  {
+    return;
+  }
+
+  /* Stop workers */
+  pthread_mutex_lock(&aggregate->mutex);
+  aggregate->stop = 1;
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    pthread_cond_signal(&aggregate->members[i].cond);
+  }
+  pthread_mutex_unlock(&aggregate->mutex);
+
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisAggregateMember *member = &aggregate->members[i];
+    if (member->threadStarted)
+    {
+      pthread_join(member->thread, NULL);
+    }
+    pthread_cond_destroy(&member->cond);
+    QuantisCloseInternal(member->deviceHandle);
+    free(member->chunk);
+  }
+
+  pthread_cond_destroy(&aggregate->doneCond);
+  pthread_mutex_destroy(&aggregate->mutex);
+  pthread_mutex_destroy(&aggregate->readMutex);
+  free(aggregate->members);
+  free(aggregate);
+  deviceHandle->privateData = NULL;
+}
+
+int QuantisAggregateCount()
+{
+  int count = 0;
+
+#ifndef DISABLE_QUANTIS_PCI
+  count += QuantisCount(QUANTIS_DEVICE_PCI);
+#endif /* DISABLE_QUANTIS_PCI */
+
+#ifndef DISABLE_QUANTIS_USB
+  count += QuantisCount(QUANTIS_DEVICE_USB);
+#endif /* DISABLE_QUANTIS_USB */
+
+  /* A single aggregate device, when there is at least a device to aggregate */
+  return (count > 0) ? 1 : 0;
+}
+
+int QuantisAggregateGetBoardVersion(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  QuantisDeviceHandle *member = aggregate->members[0].deviceHandle;
+
+  return member->ops->GetBoardVersion(member);
+}
+
+float QuantisAggregateGetDriverVersion()
+{
+#ifndef DISABLE_QUANTIS_PCI
+  if (QuantisCount(QUANTIS_DEVICE_PCI) > 0)
+  {
+    return QuantisGetDriverVersion(QUANTIS_DEVICE_PCI);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+#ifndef DISABLE_QUANTIS_USB
+  if (QuantisCount(QUANTIS_DEVICE_USB) > 0)
+  {
+    return QuantisGetDriverVersion(QUANTIS_DEVICE_USB);
+  }
+#endif /* DISABLE_QUANTIS_USB */
+
+  return (float)QUANTIS_ERROR_NO_DRIVER;
+}
+
+char *QuantisAggregateGetManufacturer(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  QuantisDeviceHandle *member = aggregate->members[0].deviceHandle;
+
+  return member->ops->GetManufacturer(member);
+}
+
+int QuantisAggregateGetModulesMask(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+  int mask = 0;
+
+  /* Modules present on at least one device */
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisDeviceHandle *member = aggregate->members[i].deviceHandle;
+    int result = member->ops->GetModulesMask(member);
+    if (result < 0)
+    {
+      return result;
+    }
+    mask |= result;
+  }
+
+  return mask;
+}
+
+int QuantisAggregateGetModulesDataRate(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+  int dataRate = 0;
+
+  /* Data rate of the devices in use */
+  pthread_mutex_lock(&aggregate->mutex);
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    if (aggregate->members[i].active)
+    {
+      dataRate += (int)aggregate->members[i].weight;
+    }
+  }
+  pthread_mutex_unlock(&aggregate->mutex);
+
+  return dataRate;
+}
+
+int QuantisAggregateGetModulesPower(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+
+  /* Powered when all devices are */
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisDeviceHandle *member = aggregate->members[i].deviceHandle;
+    int result = member->ops->GetModulesPower(member);
+    if (result <= 0)
+    {
+      return result;
+    }
+  }
+
+  return 1;
+}
+
+int QuantisAggregateGetModulesStatus(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+  int status = 0;
+
+  /* Valid modules of the devices in use */
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisAggregateMember *member = &aggregate->members[i];
+    int result;
+    int active;
+
+    pthread_mutex_lock(&aggregate->mutex);
+    active = member->active;
+    pthread_mutex_unlock(&aggregate->mutex);
+    if (!active)
+    {
+      continue;
+    }
+
+    result = member->deviceHandle->ops->GetModulesStatus(member->deviceHandle);
+    if (result > 0)
+    {
+      status |= result;
+    }
+  }
+
+  return status;
+}
+
+char *QuantisAggregateGetSerialNumber(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  size_t length = 0u;
+  unsigned int i;
+
+  /* Serial numbers of all devices, separated by '+' */
+  aggregate->serialNumber[0] = '\0';
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisDeviceHandle *member = aggregate->members[i].deviceHandle;
+    int written = snprintf(aggregate->serialNumber + length,
+                           sizeof(aggregate->serialNumber) - length,
+                           (i == 0u) ? "%s" : "+%s",
+                           member->ops->GetSerialNumber(member));
+    if ((written < 0) || ((size_t)written >= sizeof(aggregate->serialNumber) - length))
+    {
+      break;
+    }
+    length += (size_t)written;
+  }
+
+  return aggregate->serialNumber;
+}
+
+int QuantisAggregateModulesDisable(QuantisDeviceHandle *deviceHandle,
+                                   int moduleMask)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+  int result = QUANTIS_SUCCESS;
+
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisDeviceHandle *member = aggregate->members[i].deviceHandle;
+    int memberResult = member->ops->ModulesDisable(member, moduleMask);
+    if ((memberResult < 0) && (result == QUANTIS_SUCCESS))
+    {
+      result = memberResult;
+    }
+  }
+
+  return result;
+}
+
+int QuantisAggregateModulesEnable(QuantisDeviceHandle *deviceHandle,
+                                  int moduleMask)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+  int result = QUANTIS_SUCCESS;
+
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisDeviceHandle *member = aggregate->members[i].deviceHandle;
+    int memberResult = member->ops->ModulesEnable(member, moduleMask);
+    if ((memberResult < 0) && (result == QUANTIS_SUCCESS))
+    {
+      result = memberResult;
+    }
+  }
+
+  return result;
+}
+
+int QuantisAggregateOpen(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate;
+  unsigned int i;
+
+  deviceHandle->privateData = NULL;
+
+  /* There is a single aggregate device */
+  if (deviceHandle->deviceNumber != 0)
+  {
+    return QUANTIS_ERROR_INVALID_DEVICE_NUMBER;
+  }
+
+  aggregate = (QuantisAggregate *)calloc(1u, sizeof(*aggregate));
+  if (aggregate == NULL)
+  {
+    return QUANTIS_ERROR_NO_MEMORY;
+  }
+  aggregate->members = (QuantisAggregateMember *)calloc(MAX_QUANTIS_DEVICE * 2, sizeof(*aggregate->members));
+  if (aggregate->members == NULL)
+  {
+    free(aggregate);
+    return QUANTIS_ERROR_NO_MEMORY;
+  }
+
+  /* Open all devices */
+#ifndef DISABLE_QUANTIS_PCI
+  QuantisAggregateAddMembers(aggregate, QUANTIS_DEVICE_PCI);
+#endif /* DISABLE_QUANTIS_PCI */
+
+#ifndef DISABLE_QUANTIS_USB
+  QuantisAggregateAddMembers(aggregate, QUANTIS_DEVICE_USB);
+#endif /* DISABLE_QUANTIS_USB */
+
+  if (aggregate->memberCount == 0u)
+  {
+    free(aggregate->members);
+    free(aggregate);
+    return QUANTIS_ERROR_NO_DEVICE;
+  }
+
+  pthread_mutex_init(&aggregate->readMutex, NULL);
+  pthread_mutex_init(&aggregate->mutex, NULL);
+  pthread_cond_init(&aggregate->doneCond, NULL);
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    pthread_cond_init(&aggregate->members[i].cond, NULL);
+  }
+  deviceHandle->privateData = aggregate;
+
+  /* Start a worker per device */
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisAggregateMember *member = &aggregate->members[i];
+    if (pthread_create(&member->thread, NULL, QuantisAggregateWorker, member) != 0)
+    {
+      QuantisAggregateClose(deviceHandle);
+      return QUANTIS_ERROR_NO_MEMORY;
+    }
+    member->threadStarted = 1;
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+int QuantisAggregateRead(QuantisDeviceHandle *deviceHandle,
+                         void *buffer,
+                         size_t size)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  int result;
+
+  if (size == 0u)
+  {
+    return 0;
+  }
+
+  pthread_mutex_lock(&aggregate->readMutex);
+  result = QuantisAggregateReadStripes(aggregate, (char *)buffer, size);
+  pthread_mutex_unlock(&aggregate->readMutex);
+
+  return result;
+}
+
+int QuantisAggregateGetBusDeviceId(QuantisDeviceHandle *deviceHandle)
+{
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+char *QuantisAggregateTypeStrError(int errorNumber)
+{
+  errorNumber = errorNumber; /* Avoids unused parameter warning */
+  return (char *)NULL;
+}
+
+int QuantisAggregateGetAis31StartupTestsRequestFlag(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+
+  /* Requested when any device requests it */
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisDeviceHandle *member = aggregate->members[i].deviceHandle;
+    int result = member->ops->GetAis31StartupTestsRequestFlag(member);
+    if (result != 0)
+    {
+      return result;
+    }
+  }
+
+  return 0;
+}
+
+int QuantisAggregateClearAis31StartupTestsRequestFlag(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisAggregate *aggregate = (QuantisAggregate *)deviceHandle->privateData;
+  unsigned int i;
+  int result = QUANTIS_SUCCESS;
+
+  for (i = 0u; i < aggregate->memberCount; i++)
+  {
+    QuantisDeviceHandle *member = aggregate->members[i].deviceHandle;
+    int memberResult = member->ops->ClearAis31StartupTestsRequestFlag(member);
+    if ((memberResult < 0) && (result == QUANTIS_SUCCESS))
+    {
+      result = memberResult;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,750 @@
+/*
+ * Quantis asynchronous reads
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "Quantis.h"
+#include "Quantis_Internal.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && !defined(DISABLE_QUANTIS_PCI)
+#define QUANTIS_ASYNC_URING
+#endif
+
+/* Number of threads of the fallback thread pool */
+#define QUANTIS_ASYNC_THREADS 16
+
+/* Number of entries of the io_uring submission queue */
+#define QUANTIS_ASYNC_URING_ENTRIES 256
+
+/*
+ * Asynchronous reads complete in the background and their callbacks are run
+ * by QuantisAsyncPoll()/QuantisAsyncWait(), in the thread of the caller.
+ * Completions are signalled on a file descriptor (an eventfd on Linux) that
+ * event loops can watch.
+ *
+ * Reads from PCI devices are submitted to an io_uring, so that no thread
+ * waits for them. Other devices (or PCI devices with a prefetch pool, or when
+ * io_uring isn't available) are read by a pool of threads.
+ */
+typedef struct QuantisAsyncRequest
+{
+  QuantisDeviceHandle *deviceHandle;
+  char *buffer;
+  size_t size;
+  size_t done;
+  QuantisReadCallback callback;
+  void *user;
+  int result;
+  struct QuantisAsyncRequest *next;
+} QuantisAsyncRequest;
+
+typedef struct
+{
+  QuantisAsyncRequest *first;
+  QuantisAsyncRequest *last;
+} QuantisAsyncQueue;
+
+#ifdef QUANTIS_ASYNC_URING
+typedef struct
+{
+  int fd;
+  unsigned int entries;
+  unsigned int inFlight;
+  void *sqRing;
+  size_t sqRingSize;
+  void *cqRing;
+  size_t cqRingSize;
+  struct io_uring_sqe *sqes;
+  size_t sqesSize;
+  unsigned int *sqHead;
+  unsigned int *sqTail;
+  unsigned int *sqMask;
+  unsigned int *sqArray;
+  unsigned int *cqHead;
+  unsigned int *cqTail;
+  unsigned int *cqMask;
+  struct io_uring_cqe *cqes;
+} QuantisAsyncUring;
+#endif /* QUANTIS_ASYNC_URING */
+
+static pthread_mutex_t asyncMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t asyncWorkerCond = PTHREAD_COND_INITIALIZER;
+static int asyncInitialized = 0;
+static int asyncShutdown = 0;
+static int asyncAtForkRegistered = 0;
+static int asyncEventFd = -1;
+static int asyncEventWriteFd = -1;
+static unsigned int asyncInFlight = 0u;
+static QuantisAsyncQueue asyncPending = {NULL, NULL};
+static QuantisAsyncQueue asyncCompleted = {NULL, NULL};
+static pthread_t asyncWorkers[QUANTIS_ASYNC_THREADS];
+static unsigned int asyncWorkerCount = 0u;
+#ifdef QUANTIS_ASYNC_URING
+static QuantisAsyncUring asyncUring;
+static int asyncUringEnabled = 0;
+#endif
+
+static void QuantisAsyncQueuePush(QuantisAsyncQueue *queue,
+                                  QuantisAsyncRequest *request)
+{
+  request->next = NULL;
+  if (queue->last == NULL)
+  {
+    queue->first = request;
+  }
+  else
+  {
+    queue->last->next = request;
+  }
+  queue->last = request;
+}
+
+static QuantisAsyncRequest *QuantisAsyncQueuePop(QuantisAsyncQueue *queue)
+{
+  QuantisAsyncRequest *request = queue->first;
+  if (request != NULL)
+  {
+    queue->first = request->next;
+    if (queue->first == NULL)
+    {
+      queue->last = NULL;
+    }
+  }
+  return request;
+}
+
+/* Signals a completion on the event file descriptor */
+static void QuantisAsyncSignal(void)
+{
+  uint64_t one = 1u;
+  ssize_t result;
+
+  do
+  {
+    result = write(asyncEventWriteFd, &one, (asyncEventWriteFd == asyncEventFd) ? sizeof(one) : 1u);
+  } while ((result < 0) && (errno == EINTR));
+}
+
+/* Completes a request, asyncMutex being held */
+static void QuantisAsyncComplete(QuantisAsyncRequest *request, int result)
+{
+  request->result = result;
+  QuantisAsyncQueuePush(&asyncCompleted, request);
+  QuantisAsyncSignal();
+}
+
+static void *QuantisAsyncWorker(void *arg)
+{
+  QuantisAsyncRequest *request;
+  int result;
+
+  arg = arg; /* Avoids unused parameter warning */
+
+  pthread_mutex_lock(&asyncMutex);
+  while (!asyncShutdown)
+  {
+    request = QuantisAsyncQueuePop(&asyncPending);
+    if (request == NULL)
+    {
+      pthread_cond_wait(&asyncWorkerCond, &asyncMutex);
+      continue;
+    }
+
+    pthread_mutex_unlock(&asyncMutex);
+    result = QuantisReadHandled(request->deviceHandle,
+                                request->buffer + request->done,
+                                request->size - request->done);
+    if (result >= 0)
+    {
+      result += (int)request->done;
+    }
+    pthread_mutex_lock(&asyncMutex);
+
+    QuantisAsyncComplete(request, result);
+  }
+  pthread_mutex_unlock(&asyncMutex);
+
+  return NULL;
+}
+
+/* Queues a request for the thread pool, asyncMutex being held */
+static int QuantisAsyncQueueToPool(QuantisAsyncRequest *request)
+{
+  /* One more thread while some are missing */
+  if (asyncWorkerCount < QUANTIS_ASYNC_THREADS)
+  {
+    if (pthread_create(&asyncWorkers[asyncWorkerCount], NULL, QuantisAsyncWorker, NULL) == 0)
+    {
+      asyncWorkerCount++;
+    }
+    else if (asyncWorkerCount == 0u)
+    {
+      return QUANTIS_ERROR_NO_MEMORY;
+    }
+  }
+
+  QuantisAsyncQueuePush(&asyncPending, request);
+  pthread_cond_signal(&asyncWorkerCond);
+
+  return QUANTIS_SUCCESS;
+}
+
+#ifdef QUANTIS_ASYNC_URING
+
+static void QuantisAsyncUringDestroy(QuantisAsyncUring *ring)
+{
+  if (ring->sqes != NULL)
+  {
+    munmap(ring->sqes, ring->sqesSize);
+  }
+  if ((ring->cqRing != NULL) && (ring->cqRing != ring->sqRing))
+  {
+    munmap(ring->cqRing, ring->cqRingSize);
+  }
+  if (ring->sqRing != NULL)
+  {
+    munmap(ring->sqRing, ring->sqRingSize);
+  }
+  if (ring->fd >= 0)
+  {
+    close(ring->fd);
+  }
+  memset(ring, 0, sizeof(*ring));
+  ring->fd = -1;
+}
+
+/* Sets the io_uring up, signalling completions on eventFd */
+static int QuantisAsyncUringSetup(QuantisAsyncUring *ring, int eventFd)
+{
+  struct io_uring_params params;
+  char *sq;
+  char *cq;
+
+  memset(ring, 0, sizeof(*ring));
+  memset(&params, 0, sizeof(params));
+
+  ring->fd = (int)syscall(__NR_io_uring_setup, QUANTIS_ASYNC_URING_ENTRIES, &params);
+  if (ring->fd < 0)
+  {
+    ring->fd = -1;
+    return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+  }
+  ring->entries = params.sq_entries;
+
+  /* Map the rings */
+  ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if (ring->cqRingSize > ring->sqRingSize)
+    {
+      ring->sqRingSize = ring->cqRingSize;
+    }
+    ring->cqRingSize = ring->sqRingSize;
+  }
+  ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sqRing == MAP_FAILED)
+  {
+    ring->sqRing = NULL;
+    QuantisAsyncUringDestroy(ring);
+    return QUANTIS_ERROR_NO_MEMORY;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    ring->cqRing = ring->sqRing;
+  }
+  else
+  {
+    ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED)
+    {
+      ring->cqRing = NULL;
+      QuantisAsyncUringDestroy(ring);
+      return QUANTIS_ERROR_NO_MEMORY;
+    }
+  }
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+  {
+    ring->sqes = NULL;
+    QuantisAsyncUringDestroy(ring);
+    return QUANTIS_ERROR_NO_MEMORY;
+  }
+
+  sq = (char *)ring->sqRing;
+  cq = (char *)ring->cqRing;
+  ring->sqHead = (unsigned int *)(sq + params.sq_off.head);
+  ring->sqTail = (unsigned int *)(sq + params.sq_off.tail);
+  ring->sqMask = (unsigned int *)(sq + params.sq_off.ring_mask);
+  ring->sqArray = (unsigned int *)(sq + params.sq_off.array);
+  ring->cqHead = (unsigned int *)(cq + params.cq_off.head);
+  ring->cqTail = (unsigned int *)(cq + params.cq_off.tail);
+  ring->cqMask = (unsigned int *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  /* Completions are signalled like the thread pool ones */
+  if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_EVENTFD, &eventFd, 1) < 0)
+  {
+    QuantisAsyncUringDestroy(ring);
+    return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+/* Submits a read of the rest of a request, asyncMutex being held */
+static int QuantisAsyncUringSubmit(QuantisAsyncUring *ring,
+                                   int fd,
+                                   QuantisAsyncRequest *request)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int tail;
+  unsigned int index;
+  long result;
+
+  /* Never more requests than completion entries, so none is lost */
+  if (ring->inFlight >= ring->entries)
+  {
+    return QUANTIS_ERROR_WOULD_BLOCK;
+  }
+
+  tail = *ring->sqTail;
+  index = tail & *ring->sqMask;
+  sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)(request->buffer + request->done);
+  sqe->len = (uint32_t)(request->size - request->done);
+  sqe->off = (uint64_t)-1; /* Current position, the device isn't seekable */
+  sqe->user_data = (uint64_t)(uintptr_t)request;
+  ring->sqArray[index] = index;
+  __atomic_store_n(ring->sqTail, tail + 1u, __ATOMIC_RELEASE);
+
+  do
+  {
+    result = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+  } while ((result < 0) && (errno == EINTR));
+  if (result < 1)
+  {
+    /* Not consumed by the kernel, take it back */
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+    return QUANTIS_ERROR_IO;
+  }
+
+  ring->inFlight++;
+  return QUANTIS_SUCCESS;
+}
+
+/*
+ * Handles the io_uring completions, asyncMutex being held. Short reads are
+ * submitted again for the rest, failed reads get the error of the device and
+ * reads rejected by a kernel without IORING_OP_READ go to the thread pool.
+ */
+static void QuantisAsyncUringReap(QuantisAsyncUring *ring)
+{
+  unsigned int head = *ring->cqHead;
+  unsigned int tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+  QuantisAsyncQueue failed = {NULL, NULL};
+  QuantisAsyncRequest *request;
+
+  while (head != tail)
+  {
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+    int res = cqe->res;
+
+    request = (QuantisAsyncRequest *)(uintptr_t)cqe->user_data;
+    head++;
+    ring->inFlight--;
+
+    if ((res == -EINVAL) || (res == -EOPNOTSUPP))
+    {
+      asyncUringEnabled = 0;
+      if (QuantisAsyncQueueToPool(request) < 0)
+      {
+        QuantisAsyncComplete(request, QUANTIS_ERROR_NO_MEMORY);
+      }
+    }
+    else if (res <= 0)
+    {
+      request->result = res;
+      QuantisAsyncQueuePush(&failed, request);
+    }
+    else
+    {
+      request->done += (size_t)res;
+      if (request->done == request->size)
+      {
+        QuantisAsyncComplete(request, (int)request->size);
+      }
+      else
+      {
+        /* Short read, the rest is read the same way if possible */
+        int fd = QuantisPciAsyncPrepare(request->deviceHandle);
+        if (((fd < 0) || (QuantisAsyncUringSubmit(ring, fd, request) < 0))
+            && (QuantisAsyncQueueToPool(request) < 0))
+        {
+          QuantisAsyncComplete(request, QUANTIS_ERROR_NO_MEMORY);
+        }
+      }
+    }
+  }
+  __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+  /* Errors need an ioctl to find out if a module failed */
+  while ((request = QuantisAsyncQueuePop(&failed)) != NULL)
+  {
+    QuantisAsyncComplete(request, (request->result == 0) ? QUANTIS_ERROR_IO : QuantisPciAsyncError(request->deviceHandle));
+  }
+}
+
+#endif /* QUANTIS_ASYNC_URING */
+
+/* Forgets the background state in a child process, only the thread that forked exists */
+static void QuantisAsyncChildFork(void)
+{
+  pthread_mutex_init(&asyncMutex, NULL);
+  pthread_cond_init(&asyncWorkerCond, NULL);
+  if (asyncInitialized)
+  {
+#ifdef QUANTIS_ASYNC_URING
+    if (asyncUringEnabled)
+    {
+      QuantisAsyncUringDestroy(&asyncUring);
+    }
+    asyncUringEnabled = 0;
+#endif
+    if (asyncEventWriteFd != asyncEventFd)
+    {
+      close(asyncEventWriteFd);
+    }
+    close(asyncEventFd);
+  }
+  asyncInitialized = 0;
+  asyncEventFd = -1;
+  asyncEventWriteFd = -1;
+  asyncInFlight = 0u;
+  asyncPending.first = asyncPending.last = NULL;
+  asyncCompleted.first = asyncCompleted.last = NULL;
+  asyncWorkerCount = 0u;
+}
+
+static void QuantisAsyncPrepareFork(void)
+{
+  pthread_mutex_lock(&asyncMutex);
+}
+
+static void QuantisAsyncParentFork(void)
+{
+  pthread_mutex_unlock(&asyncMutex);
+}
+
+/* Creates the event file descriptor and the io_uring, asyncMutex being held */
+static int QuantisAsyncInit(void)
+{
+  if (asyncInitialized)
+  {
+    return QUANTIS_SUCCESS;
+  }
+
+  if (!asyncAtForkRegistered)
+  {
+    pthread_atfork(QuantisAsyncPrepareFork, QuantisAsyncParentFork, QuantisAsyncChildFork);
+    asyncAtForkRegistered = 1;
+  }
+
+#ifdef __linux__
+  asyncEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (asyncEventFd < 0)
+  {
+    return QUANTIS_ERROR_OTHER;
+  }
+  asyncEventWriteFd = asyncEventFd;
+#else
+  {
+    int fds[2];
+    if (pipe(fds) < 0)
+    {
+      return QUANTIS_ERROR_OTHER;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    asyncEventFd = fds[0];
+    asyncEventWriteFd = fds[1];
+  }
+#endif
+
+#ifdef QUANTIS_ASYNC_URING
+  asyncUringEnabled = (QuantisAsyncUringSetup(&asyncUring, asyncEventFd) == QUANTIS_SUCCESS);
+#endif
+
+  asyncInitialized = 1;
+  return QUANTIS_SUCCESS;
+}
+
+/* Stops the thread pool when the library is unloaded */
+static void __attribute__((destructor)) QuantisAsyncExit(void)
+{
+  unsigned int workerCount;
+  unsigned int i;
+
+  pthread_mutex_lock(&asyncMutex);
+  asyncShutdown = 1;
+  workerCount = asyncWorkerCount;
+  asyncWorkerCount = 0u;
+  pthread_cond_broadcast(&asyncWorkerCond);
+  pthread_mutex_unlock(&asyncMutex);
+
+  for (i = 0u; i < workerCount; i++)
+  {
+    pthread_join(asyncWorkers[i], NULL);
+  }
+}
+
+int QuantisReadAsync(QuantisDeviceHandle *deviceHandle,
+                     void *buffer,
+                     size_t size,
+                     QuantisReadCallback callback,
+                     void *user)
+{
+  QuantisAsyncRequest *request;
+  int result;
+
+  if (deviceHandle == NULL)
+  {
+    return QUANTIS_ERROR_IO;
+  }
+  else if ((callback == NULL) || ((buffer == NULL) && (size > 0u)) ||
+           QUANTIS_HANDLE_STATE(deviceHandle)->nonBlocking)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+  else if (size > QUANTIS_MAX_READ_SIZE)
+  {
+    return QUANTIS_ERROR_INVALID_READ_SIZE;
+  }
+
+  request = (QuantisAsyncRequest *)malloc(sizeof(*request));
+  if (request == NULL)
+  {
+    return QUANTIS_ERROR_NO_MEMORY;
+  }
+  request->deviceHandle = deviceHandle;
+  request->buffer = (char *)buffer;
+  request->size = size;
+  request->done = 0u;
+  request->callback = callback;
+  request->user = user;
+  request->result = 0;
+
+  pthread_mutex_lock(&asyncMutex);
+  result = QuantisAsyncInit();
+  if (result < 0)
+  {
+    pthread_mutex_unlock(&asyncMutex);
+    free(request);
+    return result;
+  }
+
+  if (size == 0u)
+  {
+    /* Nothing to read */
+    QuantisAsyncComplete(request, 0);
+    asyncInFlight++;
+    pthread_mutex_unlock(&asyncMutex);
+    return QUANTIS_SUCCESS;
+  }
+
+#ifdef QUANTIS_ASYNC_URING
+  if (asyncUringEnabled && (deviceHandle->deviceType == QUANTIS_DEVICE_PCI) &&
+      (QUANTIS_HANDLE_STATE(deviceHandle)->pool == NULL))
+  {
+    /* Checks the modules status like a synchronous read */
+    int fd = QuantisPciAsyncPrepare(deviceHandle);
+    if ((fd < 0) && (fd != QUANTIS_ERROR_OPERATION_NOT_SUPPORTED))
+    {
+      pthread_mutex_unlock(&asyncMutex);
+      free(request);
+      return fd;
+    }
+    if ((fd >= 0) && (QuantisAsyncUringSubmit(&asyncUring, fd, request) == QUANTIS_SUCCESS))
+    {
+      asyncInFlight++;
+      pthread_mutex_unlock(&asyncMutex);
+      return QUANTIS_SUCCESS;
+    }
+  }
+#endif
+
+  result = QuantisAsyncQueueToPool(request);
+  if (result < 0)
+  {
+    pthread_mutex_unlock(&asyncMutex);
+    free(request);
+    return result;
+  }
+  asyncInFlight++;
+  pthread_mutex_unlock(&asyncMutex);
+
+  return QUANTIS_SUCCESS;
+}
+
+int QuantisAsyncPoll(void)
+{
+  QuantisAsyncQueue completed;
+  QuantisAsyncRequest *request;
+  int count = 0;
+
+  pthread_mutex_lock(&asyncMutex);
+  if (!asyncInitialized)
+  {
+    pthread_mutex_unlock(&asyncMutex);
+    return 0;
+  }
+
+  /* Clear the event before looking for completions, none can be missed */
+  {
+    uint64_t value;
+    while (read(asyncEventFd, &value, sizeof(value)) > 0)
+    {
+    }
+  }
+
+#ifdef QUANTIS_ASYNC_URING
+  if (asyncUring.fd >= 0)
+  {
+    QuantisAsyncUringReap(&asyncUring);
+  }
+#endif
+
+  completed = asyncCompleted;
+  asyncCompleted.first = asyncCompleted.last = NULL;
+  pthread_mutex_unlock(&asyncMutex);
+
+  /* Run callbacks without holding the lock, they may submit new reads */
+  while ((request = QuantisAsyncQueuePop(&completed)) != NULL)
+  {
+    request->callback(request->deviceHandle, request->buffer, request->result, request->user);
+    free(request);
+    count++;
+  }
+
+  if (count > 0)
+  {
+    pthread_mutex_lock(&asyncMutex);
+    asyncInFlight -= (unsigned int)count;
+    pthread_mutex_unlock(&asyncMutex);
+  }
+
+  return count;
+}
+
+int QuantisAsyncWait(int timeout)
+{
+  struct pollfd pollFd;
+  unsigned int inFlight;
+  int count;
+  int result;
+
+  count = QuantisAsyncPoll();
+  if (count != 0)
+  {
+    return count;
+  }
+
+  pthread_mutex_lock(&asyncMutex);
+  inFlight = asyncInFlight;
+  pollFd.fd = asyncEventFd;
+  pthread_mutex_unlock(&asyncMutex);
+  if (inFlight == 0u)
+  {
+    /* Nothing to wait for */
+    return 0;
+  }
+
+  pollFd.events = POLLIN;
+  pollFd.revents = 0;
+  do
+  {
+    result = poll(&pollFd, 1, timeout);
+  } while ((result < 0) && (errno == EINTR));
+
+  return QuantisAsyncPoll();
+}
+
+int QuantisAsyncGetFd(void)
+{
+  int result;
+
+  pthread_mutex_lock(&asyncMutex);
+  result = QuantisAsyncInit();
+  if (result == QUANTIS_SUCCESS)
+  {
+    result = asyncEventFd;
+  }
+  pthread_mutex_unlock(&asyncMutex);
+
+  return result;
+}
@@ -0,0 +1,626 @@
+/*
+ * Quantis bounded integers
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Quantis.h"
+#include "Quantis_Internal.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BOUNDED_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Size of the buffer of the bit source */
+#define QUANTIS_BOUNDED_BUFFER_SIZE 4096
+
+/* Number of values decoded at once before being stored */
+#define QUANTIS_BOUNDED_TILE_SIZE 1024
+
+/* Maximal number of values extracted from a single draw (range 2, 32 bits) */
+#define QUANTIS_BOUNDED_MAX_DIGITS 32
+
+/*
+ * Bounded integers are generated with Lemire's multiply-shift rejection,
+ * batched as described by Brackett-Rozinsky and Lemire: a draw x of b bits
+ * (b <= 32) is multiplied in turn by the range r of each value. The high part
+ * of each product is a value in [0, r), the low part is carried to the next
+ * multiplication. k values are extracted this way from one draw, which is
+ * equivalent to drawing a single value in [0, r^k). Lemire's test on the
+ * final low part (reject if below 2^b mod r^k) makes the k values uniform and
+ * independent. Only multiplications are needed and, k and b being chosen to
+ * minimise the expected number of bits per value, close to log2(r) bits of
+ * entropy are consumed per value (e.g. 2.6 for a die instead of 32).
+ */
+typedef struct
+{
+  uint64_t range;
+  unsigned int digits;
+  unsigned int bits;
+  uint64_t threshold;
+  double cost;
+} QuantisBoundedParams;
+
+/*
+ * Bits read from the device, consumed a few at a time. Reads are sized on
+ * the number of bits still expected to be needed so that little entropy is
+ * left unused when the call returns.
+ */
+typedef struct
+{
+  QuantisDeviceHandle *deviceHandle;
+  unsigned char buffer[QUANTIS_BOUNDED_BUFFER_SIZE];
+  size_t position;
+  size_t length;
+  uint64_t bits;
+  unsigned int bitCount;
+  double bitsNeeded;
+  unsigned int extraReads;
+} QuantisBitSource;
+
+static int QuantisBitSourceRefill(QuantisBitSource *source)
+{
+  int result;
+  size_t size = QUANTIS_BOUNDED_BUFFER_SIZE;
+  double bytesNeeded;
+
+  /* Reads what is still expected to be needed, plus a little for rejections.
+     Once the estimate is exhausted, reads twice more each time. */
+  if (source->bitsNeeded > 0.0)
+  {
+    bytesNeeded = source->bitsNeeded / 8.0;
+    bytesNeeded += bytesNeeded / 32.0 + 1.0;
+  }
+  else
+  {
+    bytesNeeded = (double)(1u << source->extraReads);
+    if (source->extraReads < 12u)
+    {
+      source->extraReads++;
+    }
+  }
+  if (bytesNeeded < (double)size)
+  {
+    size = (size_t)bytesNeeded;
+  }
+
+  result = QuantisReadHandled(source->deviceHandle, source->buffer, size);
+  if (result < 0)
+  {
+    return result;
+  }
+  else if (result == 0)
+  {
+    return QUANTIS_ERROR_IO;
+  }
+
+  source->position = 0u;
+  source->length = (size_t)result;
+  source->bitsNeeded -= 8.0 * result;
+
+  return QUANTIS_SUCCESS;
+}
+
+/* Gets a value of count bits (1 to 32) */
+static inline int QuantisBitSourceGet(QuantisBitSource *source,
+                                      unsigned int count,
+                                      uint32_t *value)
+{
+  while (source->bitCount < count)
+  {
+    if (source->length - source->position >= sizeof(uint32_t))
+    {
+      /* The order of random bytes doesn't matter, no endianness issue */
+      uint32_t word;
+      memcpy(&word, source->buffer + source->position, sizeof(word));
+      source->position += sizeof(word);
+      source->bits |= (uint64_t)word << source->bitCount;
+      source->bitCount += 32u;
+    }
+    else if (source->position < source->length)
+    {
+      source->bits |= (uint64_t)source->buffer[source->position++] << source->bitCount;
+      source->bitCount += 8u;
+    }
+    else
+    {
+      int result = QuantisBitSourceRefill(source);
+      if (result < 0)
+      {
+        return result;
+      }
+    }
+  }
+
+  *value = (uint32_t)(source->bits & ((1ull << count) - 1u));
+  source->bits >>= count;
+  source->bitCount -= count;
+
+  return QUANTIS_SUCCESS;
+}
+
+/* Number of bits needed to write value */
+static unsigned int QuantisBitLength(uint64_t value)
+{
+  unsigned int length = 0u;
+  while (value != 0u)
+  {
+    length++;
+    value >>= 1;
+  }
+  return length;
+}
+
+/*
+ * Chooses how many values to extract per draw (never more than count) and
+ * the size of a draw, minimising the expected number of bits per value.
+ */
+static void QuantisBoundedChooseParams(uint64_t range,
+                                       size_t count,
+                                       QuantisBoundedParams *params)
+{
+  const uint64_t MAX_PRODUCT = 1ull << 32;
+  uint64_t product = range;
+  unsigned int digits;
+
+  params->range = range;
+  params->digits = 1u;
+  params->bits = 32u;
+  params->threshold = 0u;
+  params->cost = 1e300;
+
+  for (digits = 1u; digits <= count; digits++)
+  {
+    unsigned int bits;
+
+    for (bits = QuantisBitLength(product - 1u); bits <= 32u; bits++)
+    {
+      uint64_t draws = 1ull << bits;
+      uint64_t threshold = (draws - product) % product;
+      double cost = (double)bits * (double)draws / ((double)(draws - threshold) * digits);
+
+      if (cost < params->cost)
+      {
+        params->digits = digits;
+        params->bits = bits;
+        params->threshold = threshold;
+        params->cost = cost;
+      }
+    }
+
+    if ((digits == QUANTIS_BOUNDED_MAX_DIGITS) || (product > MAX_PRODUCT / range))
+    {
+      break;
+    }
+    product *= range;
+  }
+}
+
+/*
+ * Decodes a draw into params->digits values, stored stride values apart.
+ * @return 1 if the values are accepted, 0 if the draw must be rejected.
+ */
+static inline int QuantisBoundedDecode(const QuantisBoundedParams *params,
+                                       uint64_t draw,
+                                       uint32_t *values,
+                                       size_t stride)
+{
+  const uint64_t mask = (1ull << params->bits) - 1u;
+  unsigned int i;
+
+  for (i = 0u; i < params->digits; i++)
+  {
+    uint64_t product = draw * params->range;
+    values[i * stride] = (uint32_t)(product >> params->bits);
+    draw = product & mask;
+  }
+
+  return (draw >= params->threshold);
+}
+
+/*
+ * Draws until a draw is accepted and decodes it, values being stored stride
+ * values apart.
+ */
+static int QuantisBoundedDraw(QuantisBitSource *source,
+                              const QuantisBoundedParams *params,
+                              uint32_t *values,
+                              size_t stride)
+{
+  uint32_t draw;
+  int result;
+
+  do
+  {
+    result = QuantisBitSourceGet(source, params->bits, &draw);
+    if (result < 0)
+    {
+      return result;
+    }
+  } while (!QuantisBoundedDecode(params, draw, values, stride));
+
+  return QUANTIS_SUCCESS;
+}
+
+#ifdef BOUNDED_X86_SIMD
+/*
+ * The vector kernels decode one draw per lane. Value i of lane j is stored at
+ * values[i * lanes + j], so that each multiplication step ends with a single
+ * store; the order of independent uniform values doesn't matter. A lane whose
+ * draw is rejected is decoded again from a new draw, which only depends on
+ * that draw and therefore doesn't bias the other lanes. Only for ranges below
+ * 2^32 since the multiplications use the low 32 bits of each lane.
+ */
+__attribute__((target("avx2"))) static int QuantisBoundedFillAvx2(QuantisBitSource *source,
+                                                                  const QuantisBoundedParams *params,
+                                                                  uint32_t *values)
+{
+  const __m256i range = _mm256_set1_epi64x((long long)params->range);
+  const __m256i mask = _mm256_set1_epi64x((long long)((1ull << params->bits) - 1u));
+  const __m256i threshold = _mm256_set1_epi64x((long long)params->threshold);
+  const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const __m128i shift = _mm_cvtsi32_si128((int)params->bits);
+  uint32_t draws[4];
+  __m256i draw;
+  unsigned int i;
+  int rejected;
+  int result;
+
+  for (i = 0u; i < 4u; i++)
+  {
+    result = QuantisBitSourceGet(source, params->bits, &draws[i]);
+    if (result < 0)
+    {
+      return result;
+    }
+  }
+  draw = _mm256_setr_epi64x(draws[0], draws[1], draws[2], draws[3]);
+
+  for (i = 0u; i < params->digits; i++)
+  {
+    __m256i product = _mm256_mul_epu32(draw, range);
+    __m256i digits = _mm256_permutevar8x32_epi32(_mm256_srl_epi64(product, shift), pack);
+    _mm_storeu_si128((__m128i *)(values + i * 4u), _mm256_castsi256_si128(digits));
+    draw = _mm256_and_si256(product, mask);
+  }
+
+  rejected = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(threshold, draw)));
+  for (i = 0u; rejected != 0; i++, rejected >>= 1)
+  {
+    if (rejected & 1)
+    {
+      result = QuantisBoundedDraw(source, params, values + i, 4u);
+      if (result < 0)
+      {
+        return result;
+      }
+    }
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+__attribute__((target("avx512f"))) static int QuantisBoundedFillAvx512(QuantisBitSource *source,
+                                                                       const QuantisBoundedParams *params,
+                                                                       uint32_t *values)
+{
+  const __m512i range = _mm512_set1_epi64((long long)params->range);
+  const __m512i mask = _mm512_set1_epi64((long long)((1ull << params->bits) - 1u));
+  const __m512i threshold = _mm512_set1_epi64((long long)params->threshold);
+  const __m128i shift = _mm_cvtsi32_si128((int)params->bits);
+  uint32_t draws[8];
+  __m512i draw;
+  unsigned int i;
+  int rejected;
+  int result;
+
+  for (i = 0u; i < 8u; i++)
+  {
+    result = QuantisBitSourceGet(source, params->bits, &draws[i]);
+    if (result < 0)
+    {
+      return result;
+    }
+  }
+  draw = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *)draws));
+
+  for (i = 0u; i < params->digits; i++)
+  {
+    __m512i product = _mm512_mul_epu32(draw, range);
+    _mm256_storeu_si256((__m256i *)(values + i * 8u), _mm512_cvtepi64_epi32(_mm512_srl_epi64(product, shift)));
+    draw = _mm512_and_si512(product, mask);
+  }
+
+  rejected = (int)_mm512_cmplt_epu64_mask(draw, threshold);
+  for (i = 0u; rejected != 0; i++, rejected >>= 1)
+  {
+    if (rejected & 1)
+    {
+      result = QuantisBoundedDraw(source, params, values + i, 8u);
+      if (result < 0)
+      {
+        return result;
+      }
+    }
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+static unsigned int QuantisBoundedLanes(void)
+{
+  static unsigned int lanes = 0u;
+  if (lanes == 0u)
+  {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+      lanes = 8u;
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+      lanes = 4u;
+    }
+    else
+    {
+      lanes = 1u;
+    }
+  }
+  return lanes;
+}
+#endif /* BOUNDED_X86_SIMD */
+
+/*
+ * Fills values with count uniform values in [0, params->range), count being
+ * at most QUANTIS_BOUNDED_TILE_SIZE.
+ */
+static int QuantisBoundedFill(QuantisBitSource *source,
+                              const QuantisBoundedParams *params,
+                              uint32_t *values,
+                              size_t count)
+{
+  uint32_t extra[QUANTIS_BOUNDED_MAX_DIGITS];
+  const size_t digits = params->digits;
+  size_t filled = 0u;
+  int result;
+
+#ifdef BOUNDED_X86_SIMD
+  if (params->range < (1ull << 32))
+  {
+    const size_t lanes = QuantisBoundedLanes();
+
+    while ((lanes > 1u) && (filled + lanes * digits <= count))
+    {
+      if (lanes == 8u)
+      {
+        result = QuantisBoundedFillAvx512(source, params, values + filled);
+      }
+      else
+      {
+        result = QuantisBoundedFillAvx2(source, params, values + filled);
+      }
+      if (result < 0)
+      {
+        return result;
+      }
+      filled += lanes * digits;
+    }
+  }
+#endif
+
+  while (filled + digits <= count)
+  {
+    result = QuantisBoundedDraw(source, params, values + filled, 1u);
+    if (result < 0)
+    {
+      return result;
+    }
+    filled += digits;
+  }
+
+  /* Last values, when count is no multiple of the number of values per draw */
+  if (filled < count)
+  {
+    result = QuantisBoundedDraw(source, params, extra, 1u);
+    if (result < 0)
+    {
+      return result;
+    }
+    memcpy(values + filled, extra, (count - filled) * sizeof(*values));
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+/*
+ * Fills an array of ints or shorts (according to valueSize) with uniform
+ * values between min and max (inclusive).
+ */
+static int QuantisReadBounded(QuantisDeviceHandle *deviceHandle,
+                              void *values,
+                              size_t valueSize,
+                              size_t count,
+                              long long min,
+                              long long max)
+{
+  QuantisBitSource *source;
+  QuantisBoundedParams params;
+  uint32_t tile[QUANTIS_BOUNDED_TILE_SIZE];
+  size_t done = 0u;
+  int result = QUANTIS_SUCCESS;
+
+  if ((min > max) || (values == NULL && count > 0u))
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+  if (deviceHandle == NULL)
+  {
+    return QUANTIS_ERROR_IO;
+  }
+
+  params.range = (uint64_t)(max - min) + 1u;
+  if (params.range == 1u)
+  {
+    /* No entropy needed */
+    for (done = 0u; done < count; done++)
+    {
+      if (valueSize == sizeof(int))
+      {
+        ((int *)values)[done] = (int)min;
+      }
+      else
+      {
+        ((short *)values)[done] = (short)min;
+      }
+    }
+    return QUANTIS_SUCCESS;
+  }
+  else if (params.range == (1ull << (8u * valueSize)))
+  {
+    /* Every bit pattern is a valid value */
+    if (valueSize == sizeof(int))
+    {
+      result = QuantisReadInts(deviceHandle, (int *)values, count);
+    }
+    else
+    {
+      result = QuantisReadShorts(deviceHandle, (short *)values, count);
+    }
+    /* Non-blocking handles may fill only some of the values, while bounded
+     * reads fill all of them or fail */
+    if (result > 0)
+    {
+      result = ((size_t)result == count) ? QUANTIS_SUCCESS : QUANTIS_ERROR_WOULD_BLOCK;
+    }
+    return result;
+  }
+
+  source = (QuantisBitSource *)malloc(sizeof(*source));
+  if (source == NULL)
+  {
+    return QUANTIS_ERROR_NO_MEMORY;
+  }
+  source->deviceHandle = deviceHandle;
+  source->position = 0u;
+  source->length = 0u;
+  source->bits = 0u;
+  source->bitCount = 0u;
+  source->extraReads = 0u;
+
+  QuantisBoundedChooseParams(params.range, count, &params);
+  source->bitsNeeded = params.cost * (double)count;
+
+  while (done < count)
+  {
+    size_t n = count - done;
+    size_t i;
+
+    if (n > QUANTIS_BOUNDED_TILE_SIZE)
+    {
+      /* Whole draws only, no value may be thrown away before the end */
+      n = QUANTIS_BOUNDED_TILE_SIZE - QUANTIS_BOUNDED_TILE_SIZE % (8u * params.digits);
+    }
+    else if (n < params.digits)
+    {
+      /* Fewer draws would be wasted on the last values */
+      QuantisBoundedChooseParams(params.range, n, &params);
+    }
+
+    result = QuantisBoundedFill(source, &params, tile, n);
+    if (result < 0)
+    {
+      break;
+    }
+
+    if (valueSize == sizeof(int))
+    {
+      int *ints = (int *)values + done;
+      for (i = 0u; i < n; i++)
+      {
+        ints[i] = (int)(min + (long long)tile[i]);
+      }
+    }
+    else
+    {
+      short *shorts = (short *)values + done;
+      for (i = 0u; i < n; i++)
+      {
+        shorts[i] = (short)(min + (long long)tile[i]);
+      }
+    }
+    done += n;
+  }
+
+  /* Wipes unused random data */
+  memset(source, 0, sizeof(*source));
+  free(source);
+
+  return result;
+}
+
+int QuantisReadScaledInts(QuantisDeviceHandle *deviceHandle,
+                          int *values,
+                          size_t count,
+                          int min,
+                          int max)
+{
+  return QuantisReadBounded(deviceHandle, values, sizeof(*values), count, min, max);
+}
+
+int QuantisReadScaledShorts(QuantisDeviceHandle *deviceHandle,
+                            short *values,
+                            size_t count,
+                            short min,
+                            short max)
+{
+  return QuantisReadBounded(deviceHandle, values, sizeof(*values), count, min, max);
+}
@@ -48,9 +48,13 @@
  * For history of changes, see ChangeLog.txt
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "Conversion.h"
 #include "Quantis.h"
@@ -62,6 +66,9 @@ char serialNumber[256];
 /* Internal variable to store manufactuer's name */
 char manufactuer[256];
 
+/* Interval between two modules status checks on the read path */
+unsigned int quantisModulesStatusCheckInterval = 0u;
+
 /* Size of the buffer used for QuantisReadXXX methods */
 #define QUANTIS_READ_XXX_BUFFER_SIZE 8
 
@@ -115,6 +122,425 @@ QuantisOperations QuantisOperationsUsb =
 };
 #endif /* DISABLE_QUANTIS_USB */
 
+QuantisOperations QuantisOperationsAggregate =
+    {
+        /*.BoardReset = */ QuantisAggregateBoardReset,
+        /*.Close = */ QuantisAggregateClose,
+        /*.Count = */ QuantisAggregateCount,
+        /*.GetBoardVersion = */ QuantisAggregateGetBoardVersion,
+        /*.GetDriverVersion = */ QuantisAggregateGetDriverVersion,
+        /*.GetManufacturer = */ QuantisAggregateGetManufacturer,
+        /*.GetModulesMask = */ QuantisAggregateGetModulesMask,
+        /*.GetModulesDataRate = */ QuantisAggregateGetModulesDataRate,
+        /*.GetModulesPower = */ QuantisAggregateGetModulesPower,
+        /*.GetModulesStatus = */ QuantisAggregateGetModulesStatus,
+        /*.GetSerialNumber = */ QuantisAggregateGetSerialNumber,
+        /*.ModulesDisable = */ QuantisAggregateModulesDisable,
+        /*.ModulesEnable = */ QuantisAggregateModulesEnable,
+        /*.Open = */ QuantisAggregateOpen,
+        /*.Read = */ QuantisAggregateRead,
+        /*.GetBusDeviceId = */ QuantisAggregateGetBusDeviceId,
+        /*.QuantisTypeStrError = */ QuantisAggregateTypeStrError,
+        /*.GetAis31StartupTestsRequestFlag*/ QuantisAggregateGetAis31StartupTestsRequestFlag,
+        /*.ClearAis31StartupTestsRequestFlag*/ QuantisAggregateClearAis31StartupTestsRequestFlag};
+
+/****************************** Handle cache ******************************
+ *
+ * The stateless functions (QuantisRead, QuantisGetModulesStatus, ...) used to
+ * open and close the device on every call. On the PCIe driver the first open
+ * of a device node also allocates and starts the cyclic DMA ring and the last
+ * close tears it down again. Handles released by the stateless functions are
+ * therefore kept in a small process-wide cache and reused by the next call on
+ * the same (deviceType, deviceNumber).
+ *
+ * The slots of the cache are taken and filled with atomic operations: a
+ * stateless call costs two of them and never waits for handleCacheMutex,
+ * which only protects the reaper thread.
+ *
+ * The reaper sweeps the cache every handleCacheTimeout milliseconds: a
+ * handle that stayed unused during a whole period is closed, so an idle
+ * handle is kept open between one and two periods.
+ *
+ * The hardware-less library (QUANTIS_NO_HARDWARE) opens PCI and USB devices
+ * with a plain malloc, which costs less than the cache: they are not cached.
+ */
+
+/* Maximal number of idle handles kept in the cache */
+#define QUANTIS_HANDLE_CACHE_SIZE 16
+
+/* Default time (in milliseconds) an idle handle is kept open */
+#define QUANTIS_HANDLE_CACHE_DEFAULT_TIMEOUT 2000
+
+/* Idle handles, NULL for a free slot */
+static QuantisDeviceHandle *handleCache[QUANTIS_HANDLE_CACHE_SIZE];
+/* Device of the handle in the slot, a hint only: it is not updated
+ * atomically with the slot */
+static int handleCacheKey[QUANTIS_HANDLE_CACHE_SIZE];
+/* Set by each sweep, cleared when a handle is released in the slot */
+static int handleCacheStale[QUANTIS_HANDLE_CACHE_SIZE];
+static unsigned int handleCacheTimeout = QUANTIS_HANDLE_CACHE_DEFAULT_TIMEOUT;
+
+static pthread_mutex_t handleCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t handleCacheCond = PTHREAD_COND_INITIALIZER;
+static pthread_t handleCacheReaper;
+static int handleCacheReaperStarted = 0;
+static int handleCacheReaperIdle = 0;
+static int handleCacheShutdown = 0;
+static int handleCacheAtForkRegistered = 0;
+
+#define QUANTIS_HANDLE_CACHE_KEY(deviceType, deviceNumber) \
+  ((int)(deviceType) * MAX_QUANTIS_DEVICE + (int)(deviceNumber))
+
+/* Whether opening a device of this type is worth caching the handle */
+#ifdef QUANTIS_NO_HARDWARE
+#define QUANTIS_HANDLE_CACHEABLE(deviceType) ((deviceType) == QUANTIS_DEVICE_AGGREGATE)
+#else
+#define QUANTIS_HANDLE_CACHEABLE(deviceType) 1
+#endif
+
+static void QuantisHandleCachePrepareFork(void)
+{
+  pthread_mutex_lock(&handleCacheMutex);
+}
+
+static void QuantisHandleCacheParentFork(void)
+{
+  pthread_mutex_unlock(&handleCacheMutex);
+}
+
+static void QuantisHandleCacheChildFork(void)
+{
+  QuantisDeviceHandle *cachedHandle;
+  unsigned int i;
+
+  /* The reaper thread does not exist in the child and the cached handles
+   * share their underlying device with the parent. The PCI ones only hold a
+   * file descriptor, closed without touching the parent's device state. The
+   * others are abandoned (a USB handle can't even be used from another
+   * process). */
+  for (i = 0u; i < QUANTIS_HANDLE_CACHE_SIZE; i++)
+  {
+    cachedHandle = handleCache[i];
+    handleCache[i] = NULL;
+#ifndef DISABLE_QUANTIS_PCI
+    if ((cachedHandle != NULL) &&
+        (cachedHandle->deviceType == QUANTIS_DEVICE_PCI))
+    {
+      QuantisPciCloseInChild(cachedHandle);
+      free(cachedHandle);
+    }
+#endif /* DISABLE_QUANTIS_PCI */
+  }
+  handleCacheReaperStarted = 0;
+  handleCacheReaperIdle = 0;
+  pthread_mutex_init(&handleCacheMutex, NULL);
+  pthread_cond_init(&handleCacheCond, NULL);
+}
+
+static int QuantisHandleCacheEmpty(void)
+{
+  unsigned int i;
+
+  for (i = 0u; i < QUANTIS_HANDLE_CACHE_SIZE; i++)
+  {
+    if (__atomic_load_n(&handleCache[i], __ATOMIC_SEQ_CST) != NULL)
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static void *QuantisHandleCacheReaper(void *arg)
+{
+  unsigned int timeout;
+  unsigned int i;
+  struct timespec deadline;
+
+  arg = arg; /* Avoids unused parameter warning */
+
+  pthread_mutex_lock(&handleCacheMutex);
+  while (!handleCacheShutdown)
+  {
+    /* Sleep while the cache is empty. The flag is raised before the slots
+     * are checked and QuantisHandleCachePut fills a slot before checking the
+     * flag, so either the reaper sees the handle or it gets woken up. */
+    __atomic_store_n(&handleCacheReaperIdle, 1, __ATOMIC_SEQ_CST);
+    if (QuantisHandleCacheEmpty())
+    {
+      pthread_cond_wait(&handleCacheCond, &handleCacheMutex);
+      __atomic_store_n(&handleCacheReaperIdle, 0, __ATOMIC_SEQ_CST);
+      continue;
+    }
+    __atomic_store_n(&handleCacheReaperIdle, 0, __ATOMIC_SEQ_CST);
+
+    /* Wait for a whole period */
+    timeout = __atomic_load_n(&handleCacheTimeout, __ATOMIC_RELAXED);
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000u;
+    deadline.tv_nsec += (long)(timeout % 1000u) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    if (pthread_cond_timedwait(&handleCacheCond,
+                               &handleCacheMutex,
+                               &deadline) != ETIMEDOUT)
+    {
+      continue;
+    }
+
+    /* Close handles not used since last sweep and mark the others. The
+     * slots don't need the lock, the closes are done without it. */
+    pthread_mutex_unlock(&handleCacheMutex);
+    for (i = 0u; i < QUANTIS_HANDLE_CACHE_SIZE; i++)
+    {
+      if (__atomic_load_n(&handleCacheStale[i], __ATOMIC_RELAXED))
+      {
+        QuantisCloseInternal(__atomic_exchange_n(&handleCache[i],
+                                                 NULL,
+                                                 __ATOMIC_ACQUIRE));
+      }
+      else
+      {
+        __atomic_store_n(&handleCacheStale[i], 1, __ATOMIC_RELAXED);
+      }
+    }
+    pthread_mutex_lock(&handleCacheMutex);
+  }
+  pthread_mutex_unlock(&handleCacheMutex);
+
+  return NULL;
+}
+
+/**
+ * Closes all cached handles and stops the reaper thread when the library is
+ * unloaded.
+ */
+static void __attribute__((destructor)) QuantisHandleCacheExit(void)
+{
+  int reaperStarted;
+
+  pthread_mutex_lock(&handleCacheMutex);
+  handleCacheShutdown = 1;
+  reaperStarted = handleCacheReaperStarted;
+  __atomic_store_n(&handleCacheReaperStarted, 0, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&handleCacheCond);
+  pthread_mutex_unlock(&handleCacheMutex);
+
+  if (reaperStarted)
+  {
+    pthread_join(handleCacheReaper, NULL);
+  }
+
+  QuantisFlushHandleCache();
+}
+
+/**
+ * Starts the reaper thread on first use. Returns 0 if handles can't be
+ * cached: without a reaper idle handles would never be closed.
+ */
+static int QuantisHandleCacheStartReaper(void)
+{
+  int started;
+
+  if (__atomic_load_n(&handleCacheReaperStarted, __ATOMIC_ACQUIRE))
+  {
+    return 1;
+  }
+
+  pthread_mutex_lock(&handleCacheMutex);
+  if (!handleCacheReaperStarted && !handleCacheShutdown)
+  {
+    if (!handleCacheAtForkRegistered)
+    {
+      pthread_atfork(QuantisHandleCachePrepareFork,
+                     QuantisHandleCacheParentFork,
+                     QuantisHandleCacheChildFork);
+      handleCacheAtForkRegistered = 1;
+    }
+
+    if (pthread_create(&handleCacheReaper,
+                       NULL,
+                       QuantisHandleCacheReaper,
+                       NULL) == 0)
+    {
+      __atomic_store_n(&handleCacheReaperStarted, 1, __ATOMIC_RELEASE);
+    }
+  }
+  started = handleCacheReaperStarted;
+  pthread_mutex_unlock(&handleCacheMutex);
+
+  return started;
+}
+
+/**
+ * Puts an idle handle in a free slot of the cache, or closes it if there is
+ * none.
+ */
+static void QuantisHandleCachePut(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisDeviceHandle *freeSlot;
+  unsigned int i;
+
+  for (i = 0u; i < QUANTIS_HANDLE_CACHE_SIZE; i++)
+  {
+    if (__atomic_load_n(&handleCache[i], __ATOMIC_RELAXED) != NULL)
+    {
+      continue;
+    }
+
+    __atomic_store_n(&handleCacheKey[i],
+                     QUANTIS_HANDLE_CACHE_KEY(deviceHandle->deviceType,
+                                              deviceHandle->deviceNumber),
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&handleCacheStale[i], 0, __ATOMIC_RELAXED);
+    freeSlot = NULL;
+    if (__atomic_compare_exchange_n(&handleCache[i],
+                                    &freeSlot,
+                                    deviceHandle,
+                                    0,
+                                    __ATOMIC_SEQ_CST,
+                                    __ATOMIC_RELAXED))
+    {
+      /* Wake up reaper waiting on an empty cache */
+      if (__atomic_load_n(&handleCacheReaperIdle, __ATOMIC_SEQ_CST))
+      {
+        pthread_mutex_lock(&handleCacheMutex);
+        pthread_cond_signal(&handleCacheCond);
+        pthread_mutex_unlock(&handleCacheMutex);
+      }
+      return;
+    }
+  }
+
+  QuantisCloseInternal(deviceHandle);
+}
+
+/**
+ * Gets a handle from the cache, or opens the device if none is cached.
+ */
+static int QuantisHandleCacheGet(QuantisDeviceType deviceType,
+                                 unsigned int deviceNumber,
+                                 QuantisDeviceHandle **deviceHandle)
+{
+  QuantisDeviceHandle *cachedHandle;
+  int key = QUANTIS_HANDLE_CACHE_KEY(deviceType, deviceNumber);
+  unsigned int i;
+
+  for (i = 0u; i < QUANTIS_HANDLE_CACHE_SIZE; i++)
+  {
+    if ((__atomic_load_n(&handleCache[i], __ATOMIC_RELAXED) == NULL) ||
+        (__atomic_load_n(&handleCacheKey[i], __ATOMIC_RELAXED) != key))
+    {
+      continue;
+    }
+
+    cachedHandle = __atomic_exchange_n(&handleCache[i], NULL, __ATOMIC_ACQUIRE);
+    if (cachedHandle == NULL)
+    {
+      continue;
+    }
+    if ((cachedHandle->deviceType == deviceType) &&
+        (cachedHandle->deviceNumber == (int)deviceNumber))
+    {
+      *deviceHandle = cachedHandle;
+      return QUANTIS_SUCCESS;
+    }
+
+    /* The slot was refilled with another device in between */
+    QuantisHandleCachePut(cachedHandle);
+  }
+
+  return QuantisOpenInternal(deviceType, deviceNumber, deviceHandle);
+}
+
+/**
+ * Gives an idle handle to the cache, or closes it if the cache is disabled.
+ */
+static void QuantisHandleCacheRelease(QuantisDeviceHandle *deviceHandle)
+{
+  if ((__atomic_load_n(&handleCacheTimeout, __ATOMIC_RELAXED) == 0u) ||
+      !QuantisHandleCacheStartReaper())
+  {
+    QuantisCloseInternal(deviceHandle);
+    return;
+  }
+
+  QuantisHandleCachePut(deviceHandle);
+}
+
+/**
+ * Gets a handle for the stateless functions, either from the cache or by
+ * opening the device. Inlined, so that devices which are not cached cost
+ * no more than before the cache.
+ */
+static inline int QuantisAcquireHandle(QuantisDeviceType deviceType,
+                                       unsigned int deviceNumber,
+                                       QuantisDeviceHandle **deviceHandle)
+{
+  if (!QUANTIS_HANDLE_CACHEABLE(deviceType))
+  {
+    return QuantisOpenInternal(deviceType, deviceNumber, deviceHandle);
+  }
+  return QuantisHandleCacheGet(deviceType, deviceNumber, deviceHandle);
+}
+
+/**
+ * Gives back a handle obtained with QuantisAcquireHandle. The handle is kept
+ * in the cache unless the request failed, in which case the device may have
+ * been disconnected and the handle is closed.
+ */
+static inline void QuantisReleaseHandle(QuantisDeviceHandle *deviceHandle,
+                                        int result)
+{
+  if (!deviceHandle)
+  {
+    return;
+  }
+
+  if ((result < 0) || !QUANTIS_HANDLE_CACHEABLE(deviceHandle->deviceType))
+  {
+    QuantisCloseInternal(deviceHandle);
+    return;
+  }
+
+  QuantisHandleCacheRelease(deviceHandle);
+}
+
+void QuantisSetModulesStatusCheckInterval(unsigned int interval)
+{
+  quantisModulesStatusCheckInterval = interval;
+}
+
+void QuantisFlushHandleCache()
+{
+  unsigned int i;
+
+  for (i = 0u; i < QUANTIS_HANDLE_CACHE_SIZE; i++)
+  {
+    QuantisCloseInternal(__atomic_exchange_n(&handleCache[i],
+                                             NULL,
+                                             __ATOMIC_ACQUIRE));
+  }
+}
+
+void QuantisSetHandleCacheTimeout(unsigned int timeout)
+{
+  pthread_mutex_lock(&handleCacheMutex);
+  __atomic_store_n(&handleCacheTimeout, timeout, __ATOMIC_RELAXED);
+  /* Restart current period with the new timeout */
+  pthread_cond_signal(&handleCacheCond);
+  pthread_mutex_unlock(&handleCacheMutex);
+
+  if (timeout == 0u)
+  {
+    QuantisFlushHandleCache();
+  }
+}
+
 int QuantisBoardReset(QuantisDeviceType deviceType,
                       unsigned int deviceNumber)
 {
@@ -122,7 +548,7 @@ int QuantisBoardReset(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -131,8 +557,8 @@ int QuantisBoardReset(QuantisDeviceType deviceType,
   /* Perform request */
   result = deviceHandle->ops->BoardReset(deviceHandle);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -144,6 +570,12 @@ void QuantisCloseInternal(QuantisDeviceHandle *deviceHandle)
     return;
   }
 
+  /* Stops prefetch pool */
+  if (QUANTIS_HANDLE_STATE(deviceHandle)->pool != NULL)
+  {
+    QuantisPoolDisable(deviceHandle);
+  }
+
   /* Frees privateData */
   if (deviceHandle->ops)
   {
@@ -163,7 +595,7 @@ int QuantisGetBoardVersion(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -172,8 +604,8 @@ int QuantisGetBoardVersion(QuantisDeviceType deviceType,
   /* Perform request */
   result = deviceHandle->ops->GetBoardVersion(deviceHandle);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -195,6 +627,10 @@ int QuantisCount(QuantisDeviceType deviceType)
     break;
 #endif /* DISABLE_QUANTIS_USB */
 
+  case QUANTIS_DEVICE_AGGREGATE:
+    result = QuantisOperationsAggregate.Count();
+    break;
+
   default:
     result = 0;
     break;
@@ -234,6 +670,10 @@ float QuantisGetDriverVersion(QuantisDeviceType deviceType)
     break;
 #endif /* DISABLE_QUANTIS_USB */
 
+  case QUANTIS_DEVICE_AGGREGATE:
+    result = QuantisOperationsAggregate.GetDriverVersion();
+    break;
+
   default:
     result = (float)QUANTIS_ERROR_NO_DRIVER;
     break;
@@ -250,7 +690,7 @@ char *QuantisGetManufacturer(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return (char *)QUANTIS_NOT_AVAILABLE;
@@ -261,7 +701,8 @@ char *QuantisGetManufacturer(QuantisDeviceType deviceType,
   memcpy(manufactuer, sn, strlen(sn));
   manufactuer[strlen(sn)] = 0;
 
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return manufactuer;
 }
@@ -285,7 +726,7 @@ int QuantisGetModulesMask(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -294,8 +735,8 @@ int QuantisGetModulesMask(QuantisDeviceType deviceType,
   /* Perform request */
   result = deviceHandle->ops->GetModulesMask(deviceHandle);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -312,7 +753,7 @@ int QuantisGetModulesDataRate(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -321,8 +762,8 @@ int QuantisGetModulesDataRate(QuantisDeviceType deviceType,
   /* Perform request */
   result = deviceHandle->ops->GetModulesDataRate(deviceHandle);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -334,7 +775,7 @@ int QuantisGetModulesPower(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -343,8 +784,8 @@ int QuantisGetModulesPower(QuantisDeviceType deviceType,
   /* Perform request */
   result = deviceHandle->ops->GetModulesPower(deviceHandle);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -356,7 +797,7 @@ int QuantisGetModulesStatus(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -365,8 +806,137 @@ int QuantisGetModulesStatus(QuantisDeviceType deviceType,
   /* Perform request */
   result = deviceHandle->ops->GetModulesStatus(deviceHandle);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
+
+  return result;
+}
+
+int QuantisGetModulesStatusAge(QuantisDeviceType deviceType,
+                               unsigned int deviceNumber,
+                               unsigned int *ageMs)
+{
+  int result;
+  QuantisDeviceHandle *deviceHandle = NULL;
+
+  if (ageMs == NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+  *ageMs = 0u;
+
+  /* Open device */
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
+  if (result < 0)
+  {
+    return result;
+  }
+
+  /* Perform request */
+  result = QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+#ifndef DISABLE_QUANTIS_PCI
+  if (deviceHandle->deviceType == QUANTIS_DEVICE_PCI)
+  {
+    result = QuantisPciGetModulesStatusAge(deviceHandle, ageMs);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+  if (result == QUANTIS_ERROR_OPERATION_NOT_SUPPORTED)
+  {
+    result = deviceHandle->ops->GetModulesStatus(deviceHandle);
+  }
+
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
+
+  return result;
+}
+
+int QuantisStartLinkStats(QuantisDeviceType deviceType,
+                          unsigned int deviceNumber)
+{
+  int result;
+  QuantisDeviceHandle *deviceHandle = NULL;
+
+  /* Open device */
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
+  if (result < 0)
+  {
+    return result;
+  }
+
+  /* Perform request */
+  result = QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+#ifndef DISABLE_QUANTIS_PCI
+  if (deviceHandle->deviceType == QUANTIS_DEVICE_PCI)
+  {
+    result = QuantisPciStartLinkStats(deviceHandle);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
+
+  return result;
+}
+
+int QuantisStopLinkStats(QuantisDeviceType deviceType,
+                         unsigned int deviceNumber)
+{
+  int result;
+  QuantisDeviceHandle *deviceHandle = NULL;
+
+  /* Open device */
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
+  if (result < 0)
+  {
+    return result;
+  }
+
+  /* Perform request */
+  result = QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+#ifndef DISABLE_QUANTIS_PCI
+  if (deviceHandle->deviceType == QUANTIS_DEVICE_PCI)
+  {
+    result = QuantisPciStopLinkStats(deviceHandle);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
+
+  return result;
+}
+
+int QuantisGetLinkStats(QuantisDeviceType deviceType,
+                        unsigned int deviceNumber,
+                        QuantisLinkStats *stats)
+{
+  int result;
+  QuantisDeviceHandle *deviceHandle = NULL;
+
+  if (stats == NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+  /* Open device */
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
+  if (result < 0)
+  {
+    return result;
+  }
+
+  /* Perform request */
+  result = QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+#ifndef DISABLE_QUANTIS_PCI
+  if (deviceHandle->deviceType == QUANTIS_DEVICE_PCI)
+  {
+    result = QuantisPciGetLinkStats(deviceHandle, stats);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -379,7 +949,7 @@ char *QuantisGetSerialNumber(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return (char *)QUANTIS_NO_SERIAL;
@@ -390,7 +960,8 @@ char *QuantisGetSerialNumber(QuantisDeviceType deviceType,
   memcpy(serialNumber, sn, strlen(sn));
   serialNumber[strlen(sn)] = 0;
 
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return serialNumber;
 }
@@ -403,7 +974,7 @@ int QuantisModulesDisable(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -412,8 +983,8 @@ int QuantisModulesDisable(QuantisDeviceType deviceType,
   /* Perform request */
   result = deviceHandle->ops->ModulesDisable(deviceHandle, modulesMask);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -426,7 +997,7 @@ int QuantisModulesEnable(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -435,8 +1006,8 @@ int QuantisModulesEnable(QuantisDeviceType deviceType,
   /* Perform request */
   result = deviceHandle->ops->ModulesEnable(deviceHandle, modulesMask);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -449,7 +1020,7 @@ int QuantisModulesReset(QuantisDeviceType deviceType,
   QuantisDeviceHandle *deviceHandle = NULL;
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -462,8 +1033,8 @@ int QuantisModulesReset(QuantisDeviceType deviceType,
     result = deviceHandle->ops->ModulesEnable(deviceHandle, modulesMask);
   }
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
 
   return result;
 }
@@ -526,13 +1097,17 @@ int QuantisOpenInternal(QuantisDeviceType deviceType,
     break;
 #endif /* DISABLE_QUANTIS_USB */
 
+  case QUANTIS_DEVICE_AGGREGATE:
+    quantisOperations = &QuantisOperationsAggregate;
+    break;
+
   default:
     return QUANTIS_ERROR_NO_DEVICE;
     break;
   }
 
   /* Allocate memory */
-  _deviceHandle = malloc(sizeof(QuantisDeviceHandle));
+  _deviceHandle = malloc(sizeof(QuantisHandleState));
   if (!_deviceHandle)
   {
     return QUANTIS_ERROR_NO_MEMORY;
@@ -543,6 +1118,8 @@ int QuantisOpenInternal(QuantisDeviceType deviceType,
   _deviceHandle->deviceType = deviceType;
   _deviceHandle->ops = quantisOperations;
   _deviceHandle->privateData = NULL;
+  QUANTIS_HANDLE_STATE(_deviceHandle)->pool = NULL;
+  QUANTIS_HANDLE_STATE(_deviceHandle)->nonBlocking = 0;
 
   /* Open device */
   result = _deviceHandle->ops->Open(_deviceHandle);
@@ -576,7 +1153,7 @@ int QuantisRead(QuantisDeviceType deviceType,
   }
 
   /* Open device */
-  result = QuantisOpenInternal(deviceType, deviceNumber, &deviceHandle);
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
   if (result < 0)
   {
     return result;
@@ -585,8 +1162,8 @@ int QuantisRead(QuantisDeviceType deviceType,
   /* Read data */
   result = deviceHandle->ops->Read(deviceHandle, buffer, size);
 
-  /* Close device */
-  QuantisCloseInternal(deviceHandle);
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
   deviceHandle = NULL;
 
   return result;
@@ -626,12 +1203,258 @@ int QuantisReadHandled(QuantisDeviceHandle *deviceHandle,
     return QUANTIS_ERROR_INVALID_READ_SIZE;
   }
 
-  // Read data
+  // Read data, from prefetch pool if enabled
+  if (QUANTIS_HANDLE_STATE(deviceHandle)->pool != NULL)
+  {
+    return QuantisPoolRead(deviceHandle, buffer, size);
+  }
   result = deviceHandle->ops->Read(deviceHandle, buffer, size);
 
   return result;
 }
 
+int QuantisSetNonBlocking(QuantisDeviceHandle *deviceHandle,
+                          int nonBlocking)
+{
+  int result = QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+
+  if (deviceHandle == NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+  /* The pool has its own non-blocking mode, see QUANTIS_POOL_BLOCK */
+  if (QUANTIS_HANDLE_STATE(deviceHandle)->pool != NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+#ifndef DISABLE_QUANTIS_PCI
+  if (deviceHandle->deviceType == QUANTIS_DEVICE_PCI)
+  {
+    result = QuantisPciSetNonBlocking(deviceHandle, nonBlocking);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  if (result == QUANTIS_SUCCESS)
+  {
+    QUANTIS_HANDLE_STATE(deviceHandle)->nonBlocking = (nonBlocking != 0);
+  }
+  return result;
+}
+
+int QuantisGetFd(QuantisDeviceHandle *deviceHandle)
+{
+  if (deviceHandle == NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+#ifndef DISABLE_QUANTIS_PCI
+  if (deviceHandle->deviceType == QUANTIS_DEVICE_PCI)
+  {
+    return QuantisPciGetFd(deviceHandle);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+int QuantisMapRing(QuantisDeviceHandle *deviceHandle)
+{
+  if (deviceHandle == NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+#ifndef DISABLE_QUANTIS_PCI
+  /* The pool producer reads the device, see QuantisPoolEnable */
+  if ((deviceHandle->deviceType == QUANTIS_DEVICE_PCI) &&
+      (QUANTIS_HANDLE_STATE(deviceHandle)->pool == NULL))
+  {
+    return QuantisPciMapRing(deviceHandle);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+void QuantisUnmapRing(QuantisDeviceHandle *deviceHandle)
+{
+#ifndef DISABLE_QUANTIS_PCI
+  if ((deviceHandle != NULL) && (deviceHandle->deviceType == QUANTIS_DEVICE_PCI))
+  {
+    QuantisPciUnmapRing(deviceHandle);
+  }
+#else
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+#endif /* DISABLE_QUANTIS_PCI */
+}
+
+int QuantisRingAcquire(QuantisDeviceHandle *deviceHandle,
+                       const void **data)
+{
+  if ((deviceHandle == NULL) || (data == NULL))
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+#ifndef DISABLE_QUANTIS_PCI
+  if (deviceHandle->deviceType == QUANTIS_DEVICE_PCI)
+  {
+    return QuantisPciRingAcquire(deviceHandle, data);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+int QuantisRingRelease(QuantisDeviceHandle *deviceHandle,
+                       size_t size)
+{
+  if (deviceHandle == NULL)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+#ifndef DISABLE_QUANTIS_PCI
+  if (deviceHandle->deviceType == QUANTIS_DEVICE_PCI)
+  {
+    return QuantisPciRingRelease(deviceHandle, size);
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+/*
+ * Fills an array of count values of valueSize bytes from an opened device,
+ * splitting it in reads of at most QUANTIS_MAX_READ_SIZE bytes. Returns
+ * QUANTIS_SUCCESS once the whole array is filled.
+ *
+ * Reads from a non-blocking handle stop at the first short read: the number
+ * of complete values read is returned instead, or QUANTIS_ERROR_WOULD_BLOCK
+ * if there is none. The bytes of an incomplete last value are dropped.
+ * readCount, if not NULL, is set to the number of values read.
+ */
+static int QuantisReadArray(QuantisDeviceHandle *deviceHandle,
+                            char *buffer,
+                            size_t count,
+                            size_t valueSize,
+                            size_t *readCount)
+{
+  size_t readBytes = 0u;
+  size_t size;
+  int nonBlocking;
+  int result;
+
+  if (deviceHandle == NULL)
+  {
+    return QUANTIS_ERROR_IO;
+  }
+  nonBlocking = QUANTIS_HANDLE_STATE(deviceHandle)->nonBlocking;
+
+  if (count > ((size_t)-1) / valueSize)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+  if (nonBlocking && (count > (size_t)INT_MAX))
+  {
+    /* The count must fit in the result */
+    count = (size_t)INT_MAX;
+  }
+  size = count * valueSize;
+
+  while (readBytes < size)
+  {
+    size_t chunkSize = size - readBytes;
+    if (chunkSize > QUANTIS_MAX_READ_SIZE)
+    {
+      chunkSize = QUANTIS_MAX_READ_SIZE;
+    }
+
+    result = QuantisReadHandled(deviceHandle, buffer + readBytes, chunkSize);
+    if ((result == QUANTIS_ERROR_WOULD_BLOCK) && nonBlocking && (readBytes >= valueSize))
+    {
+      break;
+    }
+    else if (result < 0)
+    {
+      return result;
+    }
+    readBytes += (size_t)result;
+    if ((size_t)result != chunkSize)
+    {
+      if (!nonBlocking)
+      {
+        return QUANTIS_ERROR_IO;
+      }
+      break;
+    }
+  }
+
+  count = readBytes / valueSize;
+  if (readCount != NULL)
+  {
+    *readCount = count;
+  }
+  if (!nonBlocking)
+  {
+    return QUANTIS_SUCCESS;
+  }
+  return ((count > 0u) || (size == 0u)) ? (int)count : QUANTIS_ERROR_WOULD_BLOCK;
+}
+
+int QuantisReadDoubles_01(QuantisDeviceHandle *deviceHandle,
+                          double *values,
+                          size_t count)
+{
+  size_t readCount;
+  int result = QuantisReadArray(deviceHandle, (char *)values, count, sizeof(*values), &readCount);
+  if (result < 0)
+  {
+    return result;
+  }
+
+  /* Converts in place */
+  ConvertToDoubles_01(values, (const char *)values, readCount);
+
+  return result;
+}
+
+int QuantisReadFloats_01(QuantisDeviceHandle *deviceHandle,
+                         float *values,
+                         size_t count)
+{
+  size_t readCount;
+  int result = QuantisReadArray(deviceHandle, (char *)values, count, sizeof(*values), &readCount);
+  if (result < 0)
+  {
+    return result;
+  }
+
+  /* Converts in place */
+  ConvertToFloats_01(values, (const char *)values, readCount);
+
+  return result;
+}
+
+int QuantisReadInts(QuantisDeviceHandle *deviceHandle,
+                    int *values,
+                    size_t count)
+{
+  /* ConvertToInt() is a plain copy, the read data already are the values */
+  return QuantisReadArray(deviceHandle, (char *)values, count, sizeof(*values), NULL);
+}
+
+int QuantisReadShorts(QuantisDeviceHandle *deviceHandle,
+                      short *values,
+                      size_t count)
+{
+  /* ConvertToShort() is a plain copy, the read data already are the values */
+  return QuantisReadArray(deviceHandle, (char *)values, count, sizeof(*values), NULL);
+}
+
 int QuantisReadDouble_01(QuantisDeviceType deviceType,
                          unsigned int deviceNumber,
                          double *value)
@@ -776,33 +1599,29 @@ int QuantisReadScaledInt(QuantisDeviceType deviceType,
                          int min,
                          int max)
 {
-  int tmp;
   int result;
-
-  const int BITS = sizeof(tmp) * 8;
-  const unsigned long long RANGE = max - min + 1;
-  const unsigned long long MAX_RANGE = 1ull << BITS;
-  const unsigned long long LIMIT = MAX_RANGE - (MAX_RANGE % RANGE);
+  QuantisDeviceHandle *deviceHandle = NULL;
 
   if (min > max)
   {
     return QUANTIS_ERROR_INVALID_PARAMETER;
   }
 
-  // Chooses the highest number that is the largest multiple of the output range
-  // (discard values higher the output range)
-  do
+  /* Open device */
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
+  if (result < 0)
   {
-    result = QuantisReadInt(deviceType, deviceNumber, &tmp);
-    if (result != QUANTIS_SUCCESS)
-    {
-      return result;
-    }
-  } while ((tmp > 0) && ((unsigned long long)tmp >= LIMIT));
+    return result;
+  }
 
-  *value = (tmp % RANGE) + min;
+  /* Read only the bits needed for the range */
+  result = QuantisReadScaledInts(deviceHandle, value, 1u, min, max);
 
-  return QUANTIS_SUCCESS;
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
+  deviceHandle = NULL;
+
+  return result;
 }
 
 int QuantisReadScaledShort(QuantisDeviceType deviceType,
@@ -811,32 +1630,29 @@ int QuantisReadScaledShort(QuantisDeviceType deviceType,
                            short min,
                            short max)
 {
-  short tmp;
   int result;
-  const int BITS = sizeof(tmp) * 8;
-  const unsigned int RANGE = max - min + 1;
-  const unsigned int MAX_RANGE = 1u << BITS;
-  const unsigned int LIMIT = MAX_RANGE - (MAX_RANGE % RANGE);
+  QuantisDeviceHandle *deviceHandle = NULL;
 
   if (min > max)
   {
     return QUANTIS_ERROR_INVALID_PARAMETER;
   }
 
-  // Chooses the highest number that is the largest multiple of the output range
-  // (discard values higher the output range)
-  do
+  /* Open device */
+  result = QuantisAcquireHandle(deviceType, deviceNumber, &deviceHandle);
+  if (result < 0)
   {
-    result = QuantisReadShort(deviceType, deviceNumber, &tmp);
-    if (result != QUANTIS_SUCCESS)
-    {
-      return result;
-    }
-  } while ((tmp > 0) && ((unsigned int)tmp >= LIMIT));
+    return result;
+  }
 
-  *value = (tmp % RANGE) + min;
+  /* Read only the bits needed for the range */
+  result = QuantisReadScaledShorts(deviceHandle, value, 1u, min, max);
 
-  return QUANTIS_SUCCESS;
+  /* Release device */
+  QuantisReleaseHandle(deviceHandle, result);
+  deviceHandle = NULL;
+
+  return result;
 }
 
 char *QuantisStrError(QuantisError errorNumber)
@@ -887,6 +1703,10 @@ char *QuantisStrError(QuantisError errorNumber)
     msg = "the module returns an invalid status";
     break;
 
+  case QUANTIS_ERROR_WOULD_BLOCK:
+    msg = "No data available (operation would block)";
+    break;
+
   case QUANTIS_SUCCESS:
     msg = "Success";
     break;
@@ -921,6 +1741,10 @@ char *QuantisFullStrError(QuantisDeviceType deviceType, QuantisError errorNumber
       break;
 #endif /* DISABLE_QUANTIS_USB */
 
+    case QUANTIS_DEVICE_AGGREGATE:
+      msg = QuantisOperationsAggregate.QuantisTypeStrError(errorNumber);
+      break;
+
     default:
       break;
     }
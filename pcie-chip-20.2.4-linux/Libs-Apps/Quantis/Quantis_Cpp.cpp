@@ -324,56 +324,118 @@ int idQ::Quantis::ReadInt() const
 int idQ::Quantis::ReadInt(int min, int max) const
     throw(std::runtime_error)
 {
-  int tmp;
-  const int BITS = sizeof(tmp) * 8;
-  const unsigned long long RANGE = max - min + 1;
-  const unsigned long long MAX_RANGE = 1ull << BITS;
-  const unsigned long long LIMIT = MAX_RANGE - (MAX_RANGE % RANGE);
+  int value;
+  ReadInts(&value, 1u, min, max);
+  return value;
+}
 
-  if (min > max)
+short idQ::Quantis::ReadShort() const
+    throw(std::runtime_error)
+{
+  string buffer = Read(sizeof(short));
+  return ConvertToShort(buffer.c_str());
+}
+
+short idQ::Quantis::ReadShort(short min, short max) const
+    throw(std::runtime_error)
+{
+  short value;
+  ReadShorts(&value, 1u, min, max);
+  return value;
+}
+
+void idQ::Quantis::ReadDoubles(double *values, size_t count) const
+    throw(std::runtime_error)
+{
+  CheckFullError(_deviceType, QuantisReadDoubles_01(deviceHandle, values, count));
+}
+
+void idQ::Quantis::ReadDoubles(std::vector<double> &values) const
+    throw(std::runtime_error)
+{
+  if (values.empty())
   {
-    // Throw error
-    CheckError(QUANTIS_ERROR_INVALID_PARAMETER);
+    return;
   }
+  ReadDoubles(&values[0], values.size());
+}
 
-  // Chooses the highest number that is the largest multiple of the output range
-  // (discard values higher the output range)
-  do
+void idQ::Quantis::ReadFloats(float *values, size_t count) const
+    throw(std::runtime_error)
+{
+  CheckFullError(_deviceType, QuantisReadFloats_01(deviceHandle, values, count));
+}
+
+void idQ::Quantis::ReadFloats(std::vector<float> &values) const
+    throw(std::runtime_error)
+{
+  if (values.empty())
   {
-    tmp = ReadInt();
-  } while ((tmp > 0) && (static_cast<unsigned long long>(tmp) >= LIMIT));
+    return;
+  }
+  ReadFloats(&values[0], values.size());
+}
 
-  return static_cast<int>(tmp % RANGE + min);
+void idQ::Quantis::ReadInts(int *values, size_t count) const
+    throw(std::runtime_error)
+{
+  CheckFullError(_deviceType, QuantisReadInts(deviceHandle, values, count));
 }
 
-short idQ::Quantis::ReadShort() const
+void idQ::Quantis::ReadInts(std::vector<int> &values) const
     throw(std::runtime_error)
 {
-  string buffer = Read(sizeof(short));
-  return ConvertToShort(buffer.c_str());
+  if (values.empty())
+  {
+    return;
+  }
+  ReadInts(&values[0], values.size());
 }
 
-short idQ::Quantis::ReadShort(short min, short max) const
+void idQ::Quantis::ReadShorts(short *values, size_t count) const
     throw(std::runtime_error)
 {
-  short tmp;
-  const int BITS = sizeof(tmp) * 8;
-  const unsigned int RANGE = max - min + 1;
-  const unsigned int MAX_RANGE = 1u << BITS;
-  const unsigned int LIMIT = MAX_RANGE - (MAX_RANGE % RANGE);
+  CheckFullError(_deviceType, QuantisReadShorts(deviceHandle, values, count));
+}
 
-  if (min > max)
+void idQ::Quantis::ReadShorts(std::vector<short> &values) const
+    throw(std::runtime_error)
+{
+  if (values.empty())
   {
-    // Throw error
-    CheckError(QUANTIS_ERROR_INVALID_PARAMETER);
+    return;
   }
+  ReadShorts(&values[0], values.size());
+}
+
+void idQ::Quantis::ReadInts(int *values, size_t count, int min, int max) const
+    throw(std::runtime_error)
+{
+  CheckFullError(_deviceType, QuantisReadScaledInts(deviceHandle, values, count, min, max));
+}
 
-  // Chooses the highest number that is the largest multiple of the output range
-  // (discard values higher the output range)
-  do
+void idQ::Quantis::ReadInts(std::vector<int> &values, int min, int max) const
+    throw(std::runtime_error)
+{
+  if (values.empty())
   {
-    tmp = ReadShort();
-  } while ((tmp > 0) && (static_cast<unsigned int>(tmp) >= LIMIT));
+    return;
+  }
+  ReadInts(&values[0], values.size(), min, max);
+}
 
-  return static_cast<short>(tmp % RANGE + min);
+void idQ::Quantis::ReadShorts(short *values, size_t count, short min, short max) const
+    throw(std::runtime_error)
+{
+  CheckFullError(_deviceType, QuantisReadScaledShorts(deviceHandle, values, count, min, max));
+}
+
+void idQ::Quantis::ReadShorts(std::vector<short> &values, short min, short max) const
+    throw(std::runtime_error)
+{
+  if (values.empty())
+  {
+    return;
+  }
+  ReadShorts(&values[0], values.size(), min, max);
 }
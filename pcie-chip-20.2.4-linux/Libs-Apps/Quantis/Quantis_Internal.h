@@ -90,6 +90,31 @@ extern "C"
   /** Data rate (in Bytes per second) of a single Quantis module */
 #define QUANTIS_MODULE_DATA_RATE 500000
 
+  /**
+   * Interval (in milliseconds) between two modules status checks on the read
+   * path, 0 to only check on the first read and after an I/O error.
+   * Definition is in Quantis_C.c.
+   */
+  extern unsigned int quantisModulesStatusCheckInterval;
+
+  /**
+   * Library state of a device handle. QuantisOpenInternal allocates it
+   * around the public QuantisDeviceHandle, whose layout (and thus the ABI)
+   * is left unchanged. Use QUANTIS_HANDLE_STATE() to get it from a handle.
+   */
+  typedef struct
+  {
+    /** Public part, must be first */
+    QuantisDeviceHandle handle;
+    /** Prefetch pool, NULL unless enabled with QuantisPoolEnable() */
+    void *pool;
+    /** Non-zero once set with QuantisSetNonBlocking() */
+    int nonBlocking;
+  } QuantisHandleState;
+
+  /** Library state of a handle opened by QuantisOpenInternal */
+#define QUANTIS_HANDLE_STATE(deviceHandle) ((QuantisHandleState *)(deviceHandle))
+
   /*************************** Internal functions ***************************
    *
    * NOTE: Definition of all internal function is in Quantis_C.c!
@@ -119,6 +144,66 @@ extern "C"
    */
   int QuantisCountSetBits(int value);
 
+  /**
+   * Reads random data from the prefetch pool of the device.
+   * Definition is in Quantis_Pool.c.
+   * @param deviceHandle a pointer to a handle the device, with a pool enabled
+   * @param buffer a pointer to a destination buffer.
+   * @param size the number of bytes to read.
+   * @return The number of read bytes on success or a QUANTIS_ERROR code on failure.
+   */
+  int QuantisPoolRead(QuantisDeviceHandle *deviceHandle,
+                      void *buffer,
+                      size_t size);
+
+  /***************** Quantis aggregate functions declarations *****************
+   *
+   * Definition of Quantis aggregate function is in Quantis_Aggregate.c
+   *
+   */
+
+  int QuantisAggregateBoardReset(QuantisDeviceHandle *deviceHandle);
+
+  void QuantisAggregateClose(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisAggregateCount();
+
+  int QuantisAggregateGetBoardVersion(QuantisDeviceHandle *deviceHandle);
+
+  float QuantisAggregateGetDriverVersion();
+
+  char *QuantisAggregateGetManufacturer(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisAggregateGetModulesMask(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisAggregateGetModulesDataRate(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisAggregateGetModulesPower(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisAggregateGetModulesStatus(QuantisDeviceHandle *deviceHandle);
+
+  char *QuantisAggregateGetSerialNumber(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisAggregateModulesDisable(QuantisDeviceHandle *deviceHandle,
+                                     int moduleMask);
+
+  int QuantisAggregateModulesEnable(QuantisDeviceHandle *deviceHandle,
+                                    int moduleMask);
+
+  int QuantisAggregateOpen(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisAggregateRead(QuantisDeviceHandle *deviceHandle,
+                           void *buffer,
+                           size_t size);
+
+  int QuantisAggregateGetBusDeviceId(QuantisDeviceHandle *deviceHandle);
+
+  char *QuantisAggregateTypeStrError(int errorNumber);
+
+  int QuantisAggregateGetAis31StartupTestsRequestFlag(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisAggregateClearAis31StartupTestsRequestFlag(QuantisDeviceHandle *deviceHandle);
+
   /******************** Quantis PCI functions declarations ********************
    *
    * Definition of Quantis PCI function is in QuantisPci_MyOs.c
@@ -133,16 +218,25 @@ extern "C"
   
 #ifndef DISABLE_QUANTIS_PCI
 
+  int QuantisPciAsyncError(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisPciAsyncPrepare(QuantisDeviceHandle *deviceHandle);
+
   int QuantisPciBoardReset(QuantisDeviceHandle *deviceHandle);
 
   void QuantisPciClose(QuantisDeviceHandle *deviceHandle);
 
+  void QuantisPciCloseInChild(QuantisDeviceHandle *deviceHandle);
+
   int QuantisPciCount();
 
   int QuantisPciGetBoardVersion(QuantisDeviceHandle *deviceHandle);
 
   float QuantisPciGetDriverVersion();
 
+  int QuantisPciGetLinkStats(QuantisDeviceHandle *deviceHandle,
+                             QuantisLinkStats *stats);
+
   char *QuantisPciGetManufacturer(QuantisDeviceHandle *deviceHandle);
 
   int QuantisPciGetModulesMask(QuantisDeviceHandle *deviceHandle);
@@ -153,6 +247,9 @@ extern "C"
 
   int QuantisPciGetModulesStatus(QuantisDeviceHandle *deviceHandle);
 
+  int QuantisPciGetModulesStatusAge(QuantisDeviceHandle *deviceHandle,
+                                    unsigned int *ageMs);
+
   char *QuantisPciGetSerialNumber(QuantisDeviceHandle *deviceHandle);
 
   int QuantisPciModulesDisable(QuantisDeviceHandle *deviceHandle,
@@ -161,6 +258,8 @@ extern "C"
   int QuantisPciModulesEnable(QuantisDeviceHandle *deviceHandle,
                               int moduleMask);
 
+  int QuantisPciMapRing(QuantisDeviceHandle *deviceHandle);
+
   int QuantisPciOpen(QuantisDeviceHandle *deviceHandle);
 
   int QuantisPciRead(QuantisDeviceHandle *deviceHandle,
@@ -169,8 +268,29 @@ extern "C"
 
   int QuantisPciGetBusDeviceId(QuantisDeviceHandle *deviceHandle);
 
+  int QuantisPciGetFd(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisPciRingAcquire(QuantisDeviceHandle *deviceHandle,
+                            const void **data);
+
+  int QuantisPciRingMapped(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisPciRingRelease(QuantisDeviceHandle *deviceHandle,
+                            size_t size);
+
+  int QuantisPciSetNonBlocking(QuantisDeviceHandle *deviceHandle,
+                               int nonBlocking);
+
+  int QuantisPciSoftSource(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisPciStartLinkStats(QuantisDeviceHandle *deviceHandle);
+
+  int QuantisPciStopLinkStats(QuantisDeviceHandle *deviceHandle);
+
   char *QuantisPciTypeStrError(int errorNumber);
 
+  void QuantisPciUnmapRing(QuantisDeviceHandle *deviceHandle);
+
   int QuantisPciGetAis31StartupTestsRequestFlag(QuantisDeviceHandle *deviceHandle);
 
   int QuantisPciClearAis31StartupTestsRequestFlag(QuantisDeviceHandle *deviceHandle);
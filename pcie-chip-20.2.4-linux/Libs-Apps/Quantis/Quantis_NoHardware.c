@@ -98,6 +98,11 @@ void QuantisUsbClose(QuantisDeviceHandle *deviceHandle)
   deviceHandle = deviceHandle; /* Avoids unused parameter warning */
 }
 
+void QuantisPciCloseInChild(QuantisDeviceHandle *deviceHandle)
+{
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+}
+
 /* Count */
 int QuantisPciCount()
 {
@@ -354,6 +359,104 @@ int QuantisUsbRead(QuantisDeviceHandle *deviceHandle, void *buffer, size_t size)
   return QuantisPciRead(deviceHandle, buffer, size);
 }
 
+int QuantisPciAsyncPrepare(QuantisDeviceHandle *deviceHandle)
+{
+  /* No file descriptor, asynchronous reads use threads */
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+int QuantisPciAsyncError(QuantisDeviceHandle *deviceHandle)
+{
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_IO;
+}
+
+int QuantisPciSetNonBlocking(QuantisDeviceHandle *deviceHandle, int nonBlocking)
+{
+  /* Reads never wait */
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  nonBlocking = nonBlocking;   /* Avoids unused parameter warning */
+  return QUANTIS_SUCCESS;
+}
+
+int QuantisPciSoftSource(QuantisDeviceHandle *deviceHandle)
+{
+  /* Emulates a card */
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return 0;
+}
+
+int QuantisPciGetFd(QuantisDeviceHandle *deviceHandle)
+{
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+int QuantisPciGetModulesStatusAge(QuantisDeviceHandle *deviceHandle,
+                                  unsigned int *ageMs)
+{
+  /* Read on each call, see QuantisPciGetModulesStatus */
+  *ageMs = 0u;
+  return QuantisPciGetModulesStatus(deviceHandle);
+}
+
+int QuantisPciGetLinkStats(QuantisDeviceHandle *deviceHandle,
+                           QuantisLinkStats *stats)
+{
+  /* No link to count on */
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  stats = stats;               /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+int QuantisPciMapRing(QuantisDeviceHandle *deviceHandle)
+{
+  /* No driver ring to map */
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+void QuantisPciUnmapRing(QuantisDeviceHandle *deviceHandle)
+{
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+}
+
+int QuantisPciRingAcquire(QuantisDeviceHandle *deviceHandle, const void **data)
+{
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  data = data;                 /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_INVALID_PARAMETER;
+}
+
+int QuantisPciRingMapped(QuantisDeviceHandle *deviceHandle)
+{
+  /* Never mapped */
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return 0;
+}
+
+int QuantisPciRingRelease(QuantisDeviceHandle *deviceHandle, size_t size)
+{
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  size = size;                 /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_INVALID_PARAMETER;
+}
+
+int QuantisPciStartLinkStats(QuantisDeviceHandle *deviceHandle)
+{
+  /* No link to count on */
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
+int QuantisPciStopLinkStats(QuantisDeviceHandle *deviceHandle)
+{
+  /* No link to count on */
+  deviceHandle = deviceHandle; /* Avoids unused parameter warning */
+  return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+}
+
 char *QuantisPciTypeStrError(int errorNumber)
 {
   return (char *)NULL;
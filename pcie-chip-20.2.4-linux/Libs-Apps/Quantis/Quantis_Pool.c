@@ -0,0 +1,490 @@
+/*
+ * Quantis prefetch pool
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "Quantis.h"
+#include "Quantis_Internal.h"
+
+/* Maximal size of a read performed by the producer thread */
+#define QUANTIS_POOL_CHUNK_SIZE (1024 * 1024)
+
+/* Size of a huge page */
+#define QUANTIS_POOL_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* Delay (in milliseconds) before the producer retries after a read error */
+#define QUANTIS_POOL_RETRY_DELAY 100
+
+/* Size of a cache line, used to keep cursors written by different threads apart */
+#define QUANTIS_POOL_CACHE_LINE 64
+
+/*
+ * The pool is a ring filled by a single producer thread and emptied by any
+ * number of consumers. Both cursors only ever increase: the producer publishes
+ * data by moving head, a consumer claims data by moving tail with a
+ * compare-and-swap. A consumer copies the bytes *before* claiming them: while
+ * tail has not moved the producer cannot overwrite them, and if another
+ * consumer moved tail in the meantime the compare-and-swap fails and the copy
+ * is discarded. Every byte is therefore handed out exactly once and the fast
+ * path takes no lock.
+ *
+ * Device reads are not thread-safe: requests too large for the pool read the
+ * device themselves, taking readMutex like the producer does.
+ */
+typedef struct
+{
+  /* Written by the producer only */
+  unsigned long long head __attribute__((aligned(QUANTIS_POOL_CACHE_LINE)));
+
+  /* Written by the consumers */
+  unsigned long long tail __attribute__((aligned(QUANTIS_POOL_CACHE_LINE)));
+
+  /* Statistics */
+  unsigned long long hits __attribute__((aligned(QUANTIS_POOL_CACHE_LINE)));
+  unsigned long long misses;
+
+  /* Read-mostly configuration */
+  unsigned char *ring __attribute__((aligned(QUANTIS_POOL_CACHE_LINE)));
+  size_t size;
+  size_t mappedSize;
+  size_t lowWatermark;
+  size_t highWatermark;
+  int flags;
+
+  /* Synchronisation with sleeping threads */
+  int lastError;
+  int stop;
+  int producerSleeping;
+  int waiters;
+  pthread_t producer;
+  pthread_mutex_t readMutex;
+  pthread_mutex_t mutex;
+  pthread_cond_t producerCond;
+  pthread_cond_t consumerCond;
+} QuantisPool;
+
+static void QuantisPoolWakeConsumers(QuantisPool *pool)
+{
+  if (__atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) > 0)
+  {
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_broadcast(&pool->consumerCond);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+static void QuantisPoolWakeProducer(QuantisPool *pool)
+{
+  if (__atomic_load_n(&pool->producerSleeping, __ATOMIC_SEQ_CST))
+  {
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_signal(&pool->producerCond);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+static void *QuantisPoolProducer(void *arg)
+{
+  QuantisDeviceHandle *deviceHandle = (QuantisDeviceHandle *)arg;
+  QuantisPool *pool = (QuantisPool *)QUANTIS_HANDLE_STATE(deviceHandle)->pool;
+  unsigned long long head;
+  size_t level;
+  size_t offset;
+  size_t length;
+  struct timespec deadline;
+  int result;
+
+  while (!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE))
+  {
+    head = pool->head;
+    level = (size_t)(head - __atomic_load_n(&pool->tail, __ATOMIC_ACQUIRE));
+
+    /* Pool is full: sleep until consumers take it below the low watermark
+     * or someone is waiting for data */
+    if (level >= pool->highWatermark)
+    {
+      pthread_mutex_lock(&pool->mutex);
+      __atomic_store_n(&pool->producerSleeping, 1, __ATOMIC_SEQ_CST);
+      while (!pool->stop &&
+             (__atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) == 0) &&
+             ((head - __atomic_load_n(&pool->tail, __ATOMIC_SEQ_CST)) > pool->lowWatermark))
+      {
+        pthread_cond_wait(&pool->producerCond, &pool->mutex);
+      }
+      __atomic_store_n(&pool->producerSleeping, 0, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&pool->mutex);
+      continue;
+    }
+
+    /* Fill up to the high watermark, one contiguous chunk at a time */
+    offset = (size_t)(head & (pool->size - 1u));
+    length = pool->highWatermark - level;
+    if (length > pool->size - offset)
+    {
+      length = pool->size - offset;
+    }
+    if (length > QUANTIS_POOL_CHUNK_SIZE)
+    {
+      length = QUANTIS_POOL_CHUNK_SIZE;
+    }
+
+    pthread_mutex_lock(&pool->readMutex);
+    result = deviceHandle->ops->Read(deviceHandle, pool->ring + offset, length);
+    pthread_mutex_unlock(&pool->readMutex);
+    if (result <= 0)
+    {
+      /* Report error to consumers and retry later */
+      __atomic_store_n(&pool->lastError,
+                       (result < 0) ? result : QUANTIS_ERROR_IO,
+                       __ATOMIC_SEQ_CST);
+      QuantisPoolWakeConsumers(pool);
+
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += QUANTIS_POOL_RETRY_DELAY * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L)
+      {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      pthread_mutex_lock(&pool->mutex);
+      if (!pool->stop)
+      {
+        pthread_cond_timedwait(&pool->producerCond, &pool->mutex, &deadline);
+      }
+      pthread_mutex_unlock(&pool->mutex);
+      continue;
+    }
+
+    /* Publish data */
+    __atomic_store_n(&pool->lastError, QUANTIS_SUCCESS, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->head, head + (unsigned int)result, __ATOMIC_SEQ_CST);
+    QuantisPoolWakeConsumers(pool);
+  }
+
+  return NULL;
+}
+
+/* Unmaps ring after wiping the random data it contains */
+static void QuantisPoolFreeRing(QuantisPool *pool)
+{
+  memset(pool->ring, 0, pool->mappedSize);
+  munmap(pool->ring, pool->mappedSize);
+  pool->ring = NULL;
+}
+
+int QuantisPoolEnable(QuantisDeviceHandle *deviceHandle,
+                      size_t size,
+                      size_t lowWatermark,
+                      size_t highWatermark,
+                      int flags)
+{
+  QuantisPool *pool = NULL;
+  size_t ringSize;
+  void *ring = MAP_FAILED;
+
+  if (deviceHandle == NULL)
+  {
+    return QUANTIS_ERROR_IO;
+  }
+
+  /* The pool producer must block, see QUANTIS_POOL_BLOCK instead */
+  if ((QUANTIS_HANDLE_STATE(deviceHandle)->pool != NULL) ||
+      QUANTIS_HANDLE_STATE(deviceHandle)->nonBlocking)
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+#ifndef DISABLE_QUANTIS_PCI
+  /* Bytes of a mapped ring are read in place, there is nothing to prefetch */
+  if ((deviceHandle->deviceType == QUANTIS_DEVICE_PCI) && QuantisPciRingMapped(deviceHandle))
+  {
+    return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+  }
+#endif /* DISABLE_QUANTIS_PCI */
+
+  /* Ring size is rounded up to a power of two */
+  if ((size == 0u) || (size > QUANTIS_MAX_READ_SIZE * 16u))
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+  for (ringSize = 4096u; ringSize < size; ringSize <<= 1)
+  {
+  }
+
+  /* Default watermarks: refill the whole ring once half of it is consumed */
+  if (highWatermark == 0u)
+  {
+    highWatermark = ringSize;
+  }
+  if (lowWatermark == 0u)
+  {
+    lowWatermark = highWatermark / 2u;
+  }
+  if ((highWatermark > ringSize) || (lowWatermark >= highWatermark))
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+  if (posix_memalign((void **)&pool, QUANTIS_POOL_CACHE_LINE, sizeof(QuantisPool)) != 0)
+  {
+    return QUANTIS_ERROR_NO_MEMORY;
+  }
+  memset(pool, 0, sizeof(QuantisPool));
+
+  /* Allocate ring, on huge pages if requested and available */
+  pool->mappedSize = ringSize;
+#ifdef MAP_HUGETLB
+  if (flags & QUANTIS_POOL_HUGEPAGES)
+  {
+    pool->mappedSize = (ringSize + QUANTIS_POOL_HUGEPAGE_SIZE - 1u) &
+                       ~(size_t)(QUANTIS_POOL_HUGEPAGE_SIZE - 1u);
+    ring = mmap(NULL, pool->mappedSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if (ring == MAP_FAILED)
+  {
+    pool->mappedSize = ringSize;
+    ring = mmap(NULL, pool->mappedSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+      free(pool);
+      return QUANTIS_ERROR_NO_MEMORY;
+    }
+#ifdef MADV_HUGEPAGE
+    /* No reserved huge pages: fall back to transparent huge pages */
+    if (flags & QUANTIS_POOL_HUGEPAGES)
+    {
+      madvise(ring, pool->mappedSize, MADV_HUGEPAGE);
+    }
+#endif
+  }
+
+  pool->ring = (unsigned char *)ring;
+  pool->size = ringSize;
+  pool->lowWatermark = lowWatermark;
+  pool->highWatermark = highWatermark;
+  pool->flags = flags;
+  pool->lastError = QUANTIS_SUCCESS;
+  pthread_mutex_init(&pool->readMutex, NULL);
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->producerCond, NULL);
+  pthread_cond_init(&pool->consumerCond, NULL);
+
+  /* Start producer */
+  QUANTIS_HANDLE_STATE(deviceHandle)->pool = pool;
+  if (pthread_create(&pool->producer, NULL, QuantisPoolProducer, deviceHandle) != 0)
+  {
+    QUANTIS_HANDLE_STATE(deviceHandle)->pool = NULL;
+    pthread_cond_destroy(&pool->consumerCond);
+    pthread_cond_destroy(&pool->producerCond);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->readMutex);
+    QuantisPoolFreeRing(pool);
+    free(pool);
+    return QUANTIS_ERROR_NO_MEMORY;
+  }
+
+  return QUANTIS_SUCCESS;
+}
+
+void QuantisPoolDisable(QuantisDeviceHandle *deviceHandle)
+{
+  QuantisPool *pool;
+
+  if ((deviceHandle == NULL) || (QUANTIS_HANDLE_STATE(deviceHandle)->pool == NULL))
+  {
+    return;
+  }
+  pool = (QuantisPool *)QUANTIS_HANDLE_STATE(deviceHandle)->pool;
+
+  /* Stop producer and wake up blocked consumers */
+  pthread_mutex_lock(&pool->mutex);
+  __atomic_store_n(&pool->stop, 1, __ATOMIC_SEQ_CST);
+  pthread_cond_broadcast(&pool->producerCond);
+  pthread_cond_broadcast(&pool->consumerCond);
+  pthread_mutex_unlock(&pool->mutex);
+  pthread_join(pool->producer, NULL);
+
+  QUANTIS_HANDLE_STATE(deviceHandle)->pool = NULL;
+
+  pthread_cond_destroy(&pool->consumerCond);
+  pthread_cond_destroy(&pool->producerCond);
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_mutex_destroy(&pool->readMutex);
+  QuantisPoolFreeRing(pool);
+  free(pool);
+}
+
+int QuantisPoolGetStats(QuantisDeviceHandle *deviceHandle,
+                        QuantisPoolStats *stats)
+{
+  QuantisPool *pool;
+  unsigned long long tail;
+
+  if ((deviceHandle == NULL) || (stats == NULL))
+  {
+    return QUANTIS_ERROR_INVALID_PARAMETER;
+  }
+
+  pool = (QuantisPool *)QUANTIS_HANDLE_STATE(deviceHandle)->pool;
+  if (pool == NULL)
+  {
+    return QUANTIS_ERROR_OPERATION_NOT_SUPPORTED;
+  }
+
+  tail = __atomic_load_n(&pool->tail, __ATOMIC_SEQ_CST);
+  stats->produced = __atomic_load_n(&pool->head, __ATOMIC_SEQ_CST);
+  stats->level = stats->produced - tail;
+  stats->hits = __atomic_load_n(&pool->hits, __ATOMIC_RELAXED);
+  stats->misses = __atomic_load_n(&pool->misses, __ATOMIC_RELAXED);
+
+  return QUANTIS_SUCCESS;
+}
+
+int QuantisPoolRead(QuantisDeviceHandle *deviceHandle,
+                    void *buffer,
+                    size_t size)
+{
+  QuantisPool *pool = (QuantisPool *)QUANTIS_HANDLE_STATE(deviceHandle)->pool;
+  unsigned long long head;
+  unsigned long long tail;
+  size_t offset;
+  size_t firstSpan;
+  int missed = 0;
+  int result;
+
+  /* Requests larger than the high watermark could never be served at once */
+  if (size > pool->highWatermark)
+  {
+    __atomic_fetch_add(&pool->misses, 1u, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&pool->readMutex);
+    result = deviceHandle->ops->Read(deviceHandle, buffer, size);
+    pthread_mutex_unlock(&pool->readMutex);
+    return result;
+  }
+
+  tail = __atomic_load_n(&pool->tail, __ATOMIC_SEQ_CST);
+  for (;;)
+  {
+    head = __atomic_load_n(&pool->head, __ATOMIC_SEQ_CST);
+
+    if (head - tail >= size)
+    {
+      /* Copy data (in two spans when wrapping around), then claim it */
+      offset = (size_t)(tail & (pool->size - 1u));
+      firstSpan = pool->size - offset;
+      if (firstSpan >= size)
+      {
+        memcpy(buffer, pool->ring + offset, size);
+      }
+      else
+      {
+        memcpy(buffer, pool->ring + offset, firstSpan);
+        memcpy((unsigned char *)buffer + firstSpan, pool->ring, size - firstSpan);
+      }
+
+      if (__atomic_compare_exchange_n(&pool->tail, &tail, tail + size, 0,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+      {
+        __atomic_fetch_add(missed ? &pool->misses : &pool->hits, 1u, __ATOMIC_RELAXED);
+        if ((head - (tail + size)) <= pool->lowWatermark)
+        {
+          QuantisPoolWakeProducer(pool);
+        }
+        return (int)size;
+      }
+
+      /* Another consumer took these bytes, tail has been reloaded */
+      continue;
+    }
+
+    /* Not enough data */
+    missed = 1;
+    result = __atomic_load_n(&pool->lastError, __ATOMIC_SEQ_CST);
+    if (result == QUANTIS_SUCCESS && !(pool->flags & QUANTIS_POOL_BLOCK))
+    {
+      result = QUANTIS_ERROR_WOULD_BLOCK;
+    }
+    if (result != QUANTIS_SUCCESS)
+    {
+      __atomic_fetch_add(&pool->misses, 1u, __ATOMIC_RELAXED);
+      return result;
+    }
+
+    /* Wait for the producer */
+    pthread_mutex_lock(&pool->mutex);
+    __atomic_fetch_add(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&pool->producerCond);
+    while (!pool->stop &&
+           (__atomic_load_n(&pool->lastError, __ATOMIC_SEQ_CST) == QUANTIS_SUCCESS) &&
+           ((__atomic_load_n(&pool->head, __ATOMIC_SEQ_CST) -
+             __atomic_load_n(&pool->tail, __ATOMIC_SEQ_CST)) < size))
+    {
+      pthread_cond_wait(&pool->consumerCond, &pool->mutex);
+    }
+    __atomic_fetch_sub(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (__atomic_load_n(&pool->stop, __ATOMIC_SEQ_CST))
+    {
+      __atomic_fetch_add(&pool->misses, 1u, __ATOMIC_RELAXED);
+      return QUANTIS_ERROR_IO;
+    }
+
+    tail = __atomic_load_n(&pool->tail, __ATOMIC_SEQ_CST);
+  }
+}
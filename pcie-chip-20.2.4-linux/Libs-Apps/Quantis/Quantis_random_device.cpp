@@ -74,6 +74,10 @@ idQ::random_device::random_device(const string &token) throw(runtime_error)
     {
       deviceType = QUANTIS_DEVICE_PCI;
     }
+    else if (token.compare(0, 1, "a") == 0)
+    {
+      deviceType = QUANTIS_DEVICE_AGGREGATE;
+    }
     else
     {
       stringstream msg;
@@ -71,6 +71,7 @@ public:
     * Constructor of the random_device class. Takes as input a string telling it
     * which device type and device number is desired. E.g. to access the Quantis USB device
     * with number 0, give it as input the string "u0".
+    * The string "a0" reads from all Quantis devices in parallel.
    * @param token Contains the encoded device type and number
    * @throw runtime_error
     */
@@ -134,6 +134,78 @@ extern "C"
 #define QUANTIS_IOCTL_GET_SERIAL_MAX_LENGTH 256
 #define QUANTIS_IOCTL_GET_SERIAL _IOR(QUANTIS_IOC_MAGIC, 12, char[QUANTIS_IOCTL_GET_SERIAL_MAX_LENGTH])
 
+/* serial number of the software data sources of the driver */
+#define QUANTIS_SOFT_SOURCE_SERIAL "SOFTWARE"
+
+/* mapping of the RX ring, see quantis_ioctl.h of the driver */
+#define QUANTIS_RING_CTRL_OFFSET 0x0
+#define QUANTIS_RING_CTRL_SIZE 0x4000
+#define QUANTIS_RING_DATA_OFFSET 0x10000
+#define QUANTIS_RING_VERSION 1
+
+struct quantis_ring_ctrl
+{
+  unsigned int version;     /* QUANTIS_RING_VERSION */
+  unsigned int block_size;  /* bytes between two blocks of the ring */
+  unsigned int block_count; /* number of blocks in the ring */
+  unsigned int errors;      /* faulty blocks, published with a zero length */
+  unsigned int producer;    /* blocks published by the driver, free running */
+  unsigned int consumer;    /* blocks released by the reader, free running */
+  unsigned int credited;    /* blocks given back to the card, free running */
+  unsigned int reserved[9];
+  unsigned int length[];    /* valid bytes of each block */
+};
+
+/* give back the released blocks and wait for a block to be published */
+#define QUANTIS_IOCTL_RING_WAIT _IO(QUANTIS_IOC_MAGIC, 16)
+
+/* give back the released blocks without waiting */
+#define QUANTIS_IOCTL_RING_RELEASE _IO(QUANTIS_IOC_MAGIC, 17)
+
+/* status of modules, with the time since the driver read it */
+struct quantis_modules_status
+{
+  unsigned int status; /* as QUANTIS_IOCTL_GET_MODULES_STATUS */
+  unsigned int age_ms; /* milliseconds since the status was read */
+};
+
+/* get status of modules as last read by the driver, without waiting */
+#define QUANTIS_IOCTL_GET_MODULES_STATUS_AGE _IOR(QUANTIS_IOC_MAGIC, 18, struct quantis_modules_status)
+
+/* link statistics, see quantis_ioctl.h of the driver */
+#define QUANTIS_PERF_VERSION 1
+#define QUANTIS_PERF_APM_METRICS 10
+
+#define QUANTIS_PERF_RUNNING 0x1 /* started and not stopped yet */
+#define QUANTIS_PERF_ENGINE 0x2  /* the engine cycle counters are valid */
+#define QUANTIS_PERF_APM 0x4     /* the performance monitor counters are valid */
+
+struct quantis_perf_counters
+{
+  unsigned int version;             /* QUANTIS_PERF_VERSION */
+  unsigned int flags;               /* QUANTIS_PERF_* */
+  unsigned long long elapsed_ns;    /* time from start to stop, or to now */
+  unsigned long long clock_cycles;  /* engine clock cycles */
+  unsigned long long data_cycles;   /* cycles the engine moved data */
+  unsigned long long pending_cycles; /* cycles the engine waited for the host */
+  unsigned long long ring_bytes;    /* bytes read from the RX ring */
+  unsigned long long ring_blocks;   /* blocks received in the RX ring */
+  unsigned long long ring_overruns; /* times the RX ring was full */
+  unsigned long long ring_waits;    /* times a reader found the RX ring empty */
+  unsigned long long apm_clock_cycles; /* global clock counter of the monitor */
+  unsigned int apm_metrics[QUANTIS_PERF_APM_METRICS]; /* metric counters */
+  unsigned int reserved[6];
+};
+
+/* clear and start the link statistics */
+#define QUANTIS_IOCTL_PERF_START _IO(QUANTIS_IOC_MAGIC, 19)
+
+/* stop the link statistics, they keep their values */
+#define QUANTIS_IOCTL_PERF_STOP _IO(QUANTIS_IOC_MAGIC, 20)
+
+/* get the link statistics */
+#define QUANTIS_IOCTL_PERF_GET _IOR(QUANTIS_IOC_MAGIC, 21, struct quantis_perf_counters)
+
 /* max number of IOCTL */
 /* #define QUANTIS_IOCTL_MAXNR 8 */
 #endif /* __linux__ || __FreeBSD__ */
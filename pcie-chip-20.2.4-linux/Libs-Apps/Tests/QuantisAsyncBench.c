@@ -0,0 +1,250 @@
+/*
+ * Throughput of the Quantis asynchronous reads by queue depth
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Quantis/Quantis.h"
+
+/*
+ * Keeps QD reads in flight on one handle for a few seconds, for each queue
+ * depth from 1 to 64, and prints the throughput. The first line is the
+ * synchronous QuantisReadHandled() for reference.
+ *
+ * Usage: QuantisAsyncBench [-u] [-n device] [-s size] [-t seconds]
+ *   -u  reads a USB device instead of a PCI one
+ */
+
+#define MAX_QUEUE_DEPTH 64
+
+typedef struct Bench
+{
+  QuantisDeviceHandle *deviceHandle;
+  unsigned char *buffers;
+  size_t size;
+  int stop;
+  unsigned int inFlight;
+  unsigned long long reads;
+  unsigned long long bytes;
+  int error;
+} Bench;
+
+static double Now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void Print(const char *mode, unsigned int queueDepth, const Bench *bench, double elapsed)
+{
+  printf("%-5s %3u %12.0f %10.2f\n", mode, queueDepth,
+         (double)bench->reads / elapsed,
+         (double)bench->bytes / elapsed / (1024.0 * 1024.0));
+}
+
+/* Submits the read again as soon as it completes, until the time is up */
+static void ReadDone(QuantisDeviceHandle *deviceHandle, void *buffer, int result, void *user)
+{
+  Bench *bench = (Bench *)user;
+
+  bench->inFlight--;
+  if (result < 0)
+  {
+    bench->error = result;
+    return;
+  }
+  bench->reads++;
+  bench->bytes += (unsigned long long)result;
+  if (!bench->stop &&
+      (QuantisReadAsync(deviceHandle, buffer, bench->size, ReadDone, bench) == QUANTIS_SUCCESS))
+  {
+    bench->inFlight++;
+  }
+}
+
+static int RunAsync(Bench *bench, unsigned int queueDepth, double seconds)
+{
+  unsigned int i;
+  double start;
+  double elapsed;
+
+  bench->stop = 0;
+  bench->reads = bench->bytes = 0u;
+  for (i = 0u; i < queueDepth; i++)
+  {
+    int result = QuantisReadAsync(bench->deviceHandle, bench->buffers + i * bench->size,
+                                  bench->size, ReadDone, bench);
+    if (result < 0)
+    {
+      return result;
+    }
+    bench->inFlight++;
+  }
+
+  start = Now();
+  while ((elapsed = Now() - start) < seconds)
+  {
+    QuantisAsyncWait(100);
+    if (bench->error < 0)
+    {
+      break;
+    }
+  }
+  elapsed = Now() - start;
+  bench->stop = 1;
+  while (bench->inFlight > 0u)
+  {
+    QuantisAsyncWait(-1);
+  }
+  if (bench->error < 0)
+  {
+    return bench->error;
+  }
+
+  Print("async", queueDepth, bench, elapsed);
+  return QUANTIS_SUCCESS;
+}
+
+static int RunSync(Bench *bench, double seconds)
+{
+  double start = Now();
+  double elapsed;
+
+  bench->reads = bench->bytes = 0u;
+  while ((elapsed = Now() - start) < seconds)
+  {
+    int result = QuantisReadHandled(bench->deviceHandle, bench->buffers, bench->size);
+    if (result < 0)
+    {
+      return result;
+    }
+    bench->reads++;
+    bench->bytes += (unsigned long long)result;
+  }
+
+  Print("sync", 1u, bench, elapsed);
+  return QUANTIS_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+  QuantisDeviceType deviceType = QUANTIS_DEVICE_PCI;
+  unsigned int deviceNumber = 0u;
+  double seconds = 2.0;
+  unsigned int queueDepth;
+  Bench bench;
+  int result;
+  int option;
+
+  memset(&bench, 0, sizeof(bench));
+  bench.size = 4096u;
+  while ((option = getopt(argc, argv, "un:s:t:")) != -1)
+  {
+    switch (option)
+    {
+    case 'u':
+      deviceType = QUANTIS_DEVICE_USB;
+      break;
+    case 'n':
+      deviceNumber = (unsigned int)atoi(optarg);
+      break;
+    case 's':
+      bench.size = (size_t)atol(optarg);
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-u] [-n device] [-s size] [-t seconds]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if ((bench.size == 0u) || (bench.size > QUANTIS_MAX_READ_SIZE))
+  {
+    fprintf(stderr, "Invalid read size\n");
+    return EXIT_FAILURE;
+  }
+
+  bench.buffers = (unsigned char *)malloc(MAX_QUEUE_DEPTH * bench.size);
+  if (bench.buffers == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  result = QuantisOpen(deviceType, deviceNumber, &bench.deviceHandle);
+  if (result < 0)
+  {
+    fprintf(stderr, "Cannot open the device: %s\n", QuantisStrError((QuantisError)result));
+    free(bench.buffers);
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu bytes per read, %.1f s per queue depth\n", bench.size, seconds);
+  printf("mode   QD      reads/s      MiB/s\n");
+  result = RunSync(&bench, seconds);
+  for (queueDepth = 1u; (result == QUANTIS_SUCCESS) && (queueDepth <= MAX_QUEUE_DEPTH); queueDepth *= 2u)
+  {
+    result = RunAsync(&bench, queueDepth, seconds);
+  }
+  if (result < 0)
+  {
+    fprintf(stderr, "Read failed: %s\n", QuantisStrError((QuantisError)result));
+  }
+
+  QuantisClose(bench.deviceHandle);
+  free(bench.buffers);
+  return (result < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+/*
+ * Test of the Quantis asynchronous reads
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Quantis/Quantis.h"
+
+/* Number of reads submitted by the test, more than the worker threads */
+#define READ_COUNT 256
+
+/* Written past the requested size, must be left untouched */
+#define CANARY 0xA5
+
+typedef struct Read
+{
+  QuantisDeviceHandle *deviceHandle;
+  unsigned char buffer[512];
+  size_t size;
+  int calls;
+  int result;
+} Read;
+
+static Read reads[READ_COUNT];
+static int failures = 0;
+
+#define CHECK(condition)                                              \
+  do                                                                  \
+  {                                                                   \
+    if (!(condition))                                                 \
+    {                                                                 \
+      fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__,      \
+              #condition);                                            \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+static void ReadDone(QuantisDeviceHandle *deviceHandle, void *buffer, int result, void *user)
+{
+  Read *read = (Read *)user;
+
+  CHECK(deviceHandle == read->deviceHandle);
+  CHECK(buffer == read->buffer);
+  read->calls++;
+  read->result = result;
+}
+
+static void ReadUnexpected(QuantisDeviceHandle *deviceHandle, void *buffer, int result, void *user)
+{
+  (void)deviceHandle;
+  (void)buffer;
+  (void)result;
+  (void)user;
+  CHECK(0);
+}
+
+/* Runs the callbacks until every read of the test completed */
+static void WaitAll(void)
+{
+  int done = 0;
+
+  while (done < READ_COUNT)
+  {
+    int count = QuantisAsyncWait(5000);
+    CHECK(count > 0);
+    if (count <= 0)
+    {
+      return;
+    }
+    done += count;
+  }
+  CHECK(done == READ_COUNT);
+}
+
+/* Reads of various sizes, from two handles, all in flight at once */
+static void TestReads(QuantisDeviceHandle *handles[2])
+{
+  size_t i;
+  size_t j;
+
+  memset(reads, 0, sizeof(reads));
+  for (i = 0u; i < READ_COUNT; i++)
+  {
+    reads[i].deviceHandle = handles[i % 2u];
+    reads[i].size = (i * 37u) % (sizeof(reads[i].buffer) - 1u);
+    memset(reads[i].buffer, CANARY, sizeof(reads[i].buffer));
+    CHECK(QuantisReadAsync(reads[i].deviceHandle, reads[i].buffer, reads[i].size,
+                           ReadDone, &reads[i]) == QUANTIS_SUCCESS);
+  }
+  WaitAll();
+
+  for (i = 0u; i < READ_COUNT; i++)
+  {
+    CHECK(reads[i].calls == 1);
+    CHECK(reads[i].result == (int)reads[i].size);
+    for (j = reads[i].size; j < sizeof(reads[i].buffer); j++)
+    {
+      CHECK(reads[i].buffer[j] == CANARY);
+    }
+  }
+}
+
+/* Completions are signalled on the descriptor given to event loops */
+static void TestFd(QuantisDeviceHandle *deviceHandle)
+{
+  struct pollfd pollFd;
+
+  pollFd.fd = QuantisAsyncGetFd();
+  CHECK(pollFd.fd >= 0);
+  pollFd.events = POLLIN;
+  pollFd.revents = 0;
+
+  memset(reads, 0, sizeof(reads));
+  reads[0].deviceHandle = deviceHandle;
+  reads[0].size = 64u;
+  CHECK(QuantisReadAsync(deviceHandle, reads[0].buffer, reads[0].size,
+                         ReadDone, &reads[0]) == QUANTIS_SUCCESS);
+  CHECK(poll(&pollFd, 1, 5000) == 1);
+  CHECK(QuantisAsyncPoll() == 1);
+  CHECK(reads[0].calls == 1);
+  CHECK(reads[0].result == 64);
+}
+
+/* Refused reads don't call back */
+static void TestInvalid(QuantisDeviceHandle *deviceHandle)
+{
+  unsigned char buffer[16];
+
+  CHECK(QuantisReadAsync(NULL, buffer, sizeof(buffer), ReadUnexpected, NULL) < 0);
+  CHECK(QuantisReadAsync(deviceHandle, buffer, sizeof(buffer), NULL, NULL) ==
+        QUANTIS_ERROR_INVALID_PARAMETER);
+  CHECK(QuantisReadAsync(deviceHandle, NULL, sizeof(buffer), ReadUnexpected, NULL) ==
+        QUANTIS_ERROR_INVALID_PARAMETER);
+  CHECK(QuantisReadAsync(deviceHandle, buffer, QUANTIS_MAX_READ_SIZE + 1u,
+                         ReadUnexpected, NULL) == QUANTIS_ERROR_INVALID_READ_SIZE);
+
+  /* Nothing is pending, waiting returns at once */
+  CHECK(QuantisAsyncPoll() == 0);
+  CHECK(QuantisAsyncWait(-1) == 0);
+}
+
+int main(void)
+{
+  QuantisDeviceHandle *handles[2];
+
+  if ((QuantisOpen(QUANTIS_DEVICE_PCI, 0u, &handles[0]) != QUANTIS_SUCCESS) ||
+      (QuantisOpen(QUANTIS_DEVICE_PCI, 0u, &handles[1]) != QUANTIS_SUCCESS))
+  {
+    fprintf(stderr, "Cannot open the device\n");
+    return EXIT_FAILURE;
+  }
+
+  TestReads(handles);
+  TestFd(handles[0]);
+  TestInvalid(handles[0]);
+
+  QuantisClose(handles[0]);
+  QuantisClose(handles[1]);
+
+  if (failures != 0)
+  {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("QuantisAsyncTest: all checks passed\n");
+  return EXIT_SUCCESS;
+}
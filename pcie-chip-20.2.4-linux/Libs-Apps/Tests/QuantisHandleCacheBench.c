@@ -0,0 +1,201 @@
+/*
+ * Calls per second of the stateless Quantis functions with and without the handle cache
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Quantis/Quantis.h"
+
+/*
+ * Calls QuantisReadInt() from several threads, first with the handle cache
+ * disabled (every call opens and closes the device, as before the cache),
+ * then with the cache, and prints the calls per second of both. The last
+ * line reads the same values through a handle opened once, the upper bound.
+ *
+ * Usage: QuantisHandleCacheBench [-u] [-n device] [-c calls] [-t threads]
+ *   -u  reads a USB device instead of a PCI one
+ */
+
+#define MAX_THREADS 64
+
+static QuantisDeviceType deviceType = QUANTIS_DEVICE_PCI;
+static unsigned int deviceNumber = 0u;
+static QuantisDeviceHandle *deviceHandle = NULL;
+static long calls = 1000000;
+
+static void *Stateless(void *arg)
+{
+  long i;
+  int value;
+
+  for (i = 0; i < calls; i++)
+  {
+    if (QuantisReadInt(deviceType, deviceNumber, &value) < 0)
+    {
+      return arg;
+    }
+  }
+  return NULL;
+}
+
+static void *Handled(void *arg)
+{
+  long i;
+  int value;
+
+  for (i = 0; i < calls; i++)
+  {
+    if (QuantisReadHandled(deviceHandle, &value, sizeof(value)) != (int)sizeof(value))
+    {
+      return arg;
+    }
+  }
+  return NULL;
+}
+
+/* Runs the calls in threadCount threads, returns the calls per second or a
+ * negative value if a call failed */
+static double Run(void *(*function)(void *), int threadCount)
+{
+  pthread_t threads[MAX_THREADS];
+  struct timespec start;
+  struct timespec end;
+  void *failed;
+  int errors = 0;
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < threadCount; i++)
+  {
+    pthread_create(&threads[i], NULL, function, &errors);
+  }
+  for (i = 0; i < threadCount; i++)
+  {
+    pthread_join(threads[i], &failed);
+    errors += (failed != NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (errors != 0)
+  {
+    return -1.0;
+  }
+  return (double)calls * threadCount /
+         ((double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+static int Print(const char *mode, double rate)
+{
+  if (rate < 0.0)
+  {
+    fprintf(stderr, "%s: read failed\n", mode);
+    return 0;
+  }
+  printf("%-10s %12.0f calls/s\n", mode, rate);
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  int threadCount = 1;
+  int value;
+  int option;
+  int ok;
+
+  while ((option = getopt(argc, argv, "un:c:t:")) != -1)
+  {
+    switch (option)
+    {
+    case 'u':
+      deviceType = QUANTIS_DEVICE_USB;
+      break;
+    case 'n':
+      deviceNumber = (unsigned int)atoi(optarg);
+      break;
+    case 'c':
+      calls = atol(optarg);
+      break;
+    case 't':
+      threadCount = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-u] [-n device] [-c calls] [-t threads]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if ((threadCount < 1) || (threadCount > MAX_THREADS) || (calls < 1))
+  {
+    fprintf(stderr, "Invalid number of threads or calls\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%ld calls of QuantisReadInt in each of %d thread(s)\n", calls, threadCount);
+
+  QuantisSetHandleCacheTimeout(0u);
+  ok = Print("no cache", Run(Stateless, threadCount));
+
+  QuantisSetHandleCacheTimeout(2000u);
+  /* Fills the cache before measuring */
+  QuantisReadInt(deviceType, deviceNumber, &value);
+  ok = ok && Print("cache", Run(Stateless, threadCount));
+
+  if (QuantisOpen(deviceType, deviceNumber, &deviceHandle) < 0)
+  {
+    fprintf(stderr, "Cannot open the device\n");
+    return EXIT_FAILURE;
+  }
+  ok = ok && Print("handle", Run(Handled, threadCount));
+  QuantisClose(deviceHandle);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
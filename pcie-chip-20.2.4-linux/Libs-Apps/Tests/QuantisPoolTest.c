@@ -0,0 +1,176 @@
+/*
+ * Test of the Quantis prefetch pool
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Quantis/Quantis.h"
+
+#define THREAD_COUNT 8
+#define READS_PER_THREAD 2000
+
+/* Pool geometry: reads larger than HIGH_WATERMARK bypass the pool */
+#define POOL_SIZE (64 * 1024)
+#define HIGH_WATERMARK (32 * 1024)
+#define LARGE_READ_SIZE (HIGH_WATERMARK + 1)
+
+/* Written past the requested size, must be left untouched */
+#define CANARY 0xA5
+
+static QuantisDeviceHandle *deviceHandle;
+static unsigned long long poolBytes[THREAD_COUNT];
+static int failures = 0;
+
+#define CHECK(condition)                                              \
+  do                                                                  \
+  {                                                                   \
+    if (!(condition))                                                 \
+    {                                                                 \
+      fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__,      \
+              #condition);                                            \
+      __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);             \
+    }                                                                 \
+  } while (0)
+
+/* Small reads served by the pool, mixed with large ones bypassing it while
+ * the producer reads the device */
+static void *Reader(void *arg)
+{
+  static unsigned char buffers[THREAD_COUNT][LARGE_READ_SIZE + 1];
+  size_t index = (size_t)arg;
+  unsigned char *buffer = buffers[index];
+  size_t size;
+  int i;
+
+  for (i = 0; i < READS_PER_THREAD; i++)
+  {
+    size = (i % 50 == 49) ? LARGE_READ_SIZE : 1u + (size_t)(i * 7 + index) % 256u;
+    buffer[size] = CANARY;
+    CHECK(QuantisReadHandled(deviceHandle, buffer, size) == (int)size);
+    CHECK(buffer[size] == CANARY);
+    if (size <= HIGH_WATERMARK)
+    {
+      poolBytes[index] += size;
+    }
+  }
+
+  return NULL;
+}
+
+static void TestConcurrentReads(void)
+{
+  pthread_t threads[THREAD_COUNT];
+  QuantisPoolStats stats;
+  unsigned long long consumed = 0u;
+  size_t i;
+
+  CHECK(QuantisPoolEnable(deviceHandle, POOL_SIZE, 0u, HIGH_WATERMARK, QUANTIS_POOL_BLOCK) ==
+        QUANTIS_SUCCESS);
+  /* One pool per handle */
+  CHECK(QuantisPoolEnable(deviceHandle, POOL_SIZE, 0u, 0u, QUANTIS_POOL_BLOCK) ==
+        QUANTIS_ERROR_INVALID_PARAMETER);
+
+  for (i = 0u; i < THREAD_COUNT; i++)
+  {
+    CHECK(pthread_create(&threads[i], NULL, Reader, (void *)i) == 0);
+  }
+  for (i = 0u; i < THREAD_COUNT; i++)
+  {
+    pthread_join(threads[i], NULL);
+    consumed += poolBytes[i];
+  }
+
+  /* Every read is counted once, and pool bytes are handed out once */
+  CHECK(QuantisPoolGetStats(deviceHandle, &stats) == QUANTIS_SUCCESS);
+  CHECK(stats.hits + stats.misses == THREAD_COUNT * READS_PER_THREAD);
+  CHECK(stats.produced - stats.level == consumed);
+  CHECK(stats.level <= HIGH_WATERMARK);
+
+  QuantisPoolDisable(deviceHandle);
+  CHECK(QuantisPoolGetStats(deviceHandle, &stats) == QUANTIS_ERROR_OPERATION_NOT_SUPPORTED);
+}
+
+static void TestInvalid(void)
+{
+  /* Watermarks must fit in the ring */
+  CHECK(QuantisPoolEnable(deviceHandle, POOL_SIZE, 0u, 2u * POOL_SIZE, 0) ==
+        QUANTIS_ERROR_INVALID_PARAMETER);
+  CHECK(QuantisPoolEnable(deviceHandle, POOL_SIZE, HIGH_WATERMARK, HIGH_WATERMARK, 0) ==
+        QUANTIS_ERROR_INVALID_PARAMETER);
+
+  /* The producer must block */
+  CHECK(QuantisSetNonBlocking(deviceHandle, 1) == QUANTIS_SUCCESS);
+  CHECK(QuantisPoolEnable(deviceHandle, POOL_SIZE, 0u, 0u, 0) == QUANTIS_ERROR_INVALID_PARAMETER);
+  CHECK(QuantisSetNonBlocking(deviceHandle, 0) == QUANTIS_SUCCESS);
+}
+
+int main(void)
+{
+  if (QuantisOpen(QUANTIS_DEVICE_PCI, 0u, &deviceHandle) != QUANTIS_SUCCESS)
+  {
+    fprintf(stderr, "Cannot open the device\n");
+    return EXIT_FAILURE;
+  }
+
+  TestConcurrentReads();
+  TestInvalid();
+
+  QuantisClose(deviceHandle);
+
+  if (failures != 0)
+  {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("QuantisPoolTest: all checks passed\n");
+  return EXIT_SUCCESS;
+}
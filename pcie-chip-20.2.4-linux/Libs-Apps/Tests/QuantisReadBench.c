@@ -0,0 +1,148 @@
+/*
+ * Syscalls and latency of small Quantis reads
+ *
+ * Copyright (C) 2004-2020 ID Quantique SA, Carouge/Geneva, Switzerland
+ * All rights reserved.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions, and the following disclaimer,
+ *    without modification.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY.
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * Alternatively, this software may be distributed under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * For history of changes, see ChangeLog.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Quantis/Quantis.h"
+
+/*
+ * Reads small blocks (64 bytes by default) through one handle and prints
+ * the number of reads and the time per read. Run it under strace to count
+ * the syscalls issued per read:
+ *
+ *   strace -c -e trace=read,ioctl QuantisReadBench -c 100000
+ *
+ * On a PCI device, the read() count should match the number of reads and
+ * only one QUANTIS_IOCTL_GET_MODULES_STATUS ioctl should be issued, on the
+ * first read (or one per interval given with -i).
+ *
+ * Usage: QuantisReadBench [-u] [-n device] [-c reads] [-s size] [-i interval]
+ *   -u  reads a USB device instead of a PCI one
+ *   -i  modules status check interval in milliseconds (default 0, never)
+ */
+
+#define MAX_SIZE 4096
+
+int main(int argc, char *argv[])
+{
+  QuantisDeviceType deviceType = QUANTIS_DEVICE_PCI;
+  unsigned int deviceNumber = 0u;
+  QuantisDeviceHandle *deviceHandle = NULL;
+  unsigned char buffer[MAX_SIZE];
+  struct timespec start;
+  struct timespec end;
+  double seconds;
+  long reads = 100000;
+  long i;
+  int size = 64;
+  int option;
+  int result;
+
+  while ((option = getopt(argc, argv, "un:c:s:i:")) != -1)
+  {
+    switch (option)
+    {
+    case 'u':
+      deviceType = QUANTIS_DEVICE_USB;
+      break;
+    case 'n':
+      deviceNumber = (unsigned int)atoi(optarg);
+      break;
+    case 'c':
+      reads = atol(optarg);
+      break;
+    case 's':
+      size = atoi(optarg);
+      break;
+    case 'i':
+      QuantisSetModulesStatusCheckInterval((unsigned int)atoi(optarg));
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-u] [-n device] [-c reads] [-s size] [-i interval]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if ((reads < 1) || (size < 1) || (size > MAX_SIZE))
+  {
+    fprintf(stderr, "Invalid number of reads or size (1 to %d bytes)\n", MAX_SIZE);
+    return EXIT_FAILURE;
+  }
+
+  result = QuantisOpen(deviceType, deviceNumber, &deviceHandle);
+  if (result < 0)
+  {
+    fprintf(stderr, "Cannot open the device: %s\n", QuantisStrError(result));
+    return EXIT_FAILURE;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < reads; i++)
+  {
+    result = QuantisReadHandled(deviceHandle, buffer, (size_t)size);
+    if (result != size)
+    {
+      fprintf(stderr, "Read %ld failed: %s\n", i,
+              result < 0 ? QuantisStrError(result) : "short read");
+      QuantisClose(deviceHandle);
+      return EXIT_FAILURE;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  QuantisClose(deviceHandle);
+
+  seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%ld reads of %d bytes in %.3f s, %.2f us per read\n",
+         reads, size, seconds, seconds * 1e6 / (double)reads);
+
+  return EXIT_SUCCESS;
+}